@@ -348,10 +348,11 @@ nir_load_libclc_shader(unsigned ptr_bit_size,
       size_t buffer_size;
       uint8_t *buffer = disk_cache_get(disk_cache, cache_key, &buffer_size);
       if (buffer) {
-         struct blob_reader blob;
-         blob_reader_init(&blob, buffer, buffer_size);
-         nir_shader *nir = nir_deserialize(NULL, nir_options, &blob);
-         free(buffer);
+         /* Only the functions kernels call get deserialized. */
+         nir_shader *nir = nir_deserialize_library(NULL, nir_options,
+                                                   buffer, buffer_size, true);
+         if (!nir)
+            free(buffer);
          close_clc_data(&clc);
          return nir;
       }
@@ -430,7 +431,7 @@ nir_load_libclc_shader(unsigned ptr_bit_size,
    if (disk_cache) {
       struct blob blob;
       blob_init(&blob);
-      nir_serialize(&blob, nir, false);
+      nir_serialize_library(&blob, nir, false);
       disk_cache_put(disk_cache, cache_key, blob.data, blob.size, NULL);
       blob_finish(&blob);
    }
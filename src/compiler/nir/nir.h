@@ -4004,6 +4004,13 @@ typedef struct nir_shader {
    u_printf_info *printf_info;
 
    bool has_debug_info;
+
+   /**
+    * Function implementations which are only deserialized when first used,
+    * for shaders loaded with nir_deserialize_library().  Use
+    * nir_function_get_library_impl() to get at them.
+    */
+   struct nir_lazy_impls *lazy_impls;
 } nir_shader;
 
 #define nir_foreach_function(func, shader) \
@@ -4944,6 +4951,36 @@ should_print_nir(UNUSED nir_shader *shader)
 }
 #endif /* NDEBUG */
 
+typedef struct nir_pass_stats_sample {
+   int64_t start_ns;
+   unsigned instr_count;
+} nir_pass_stats_sample;
+
+/* Set by NIR_PASS_STATS, see nir_pass_stats.c */
+extern bool nir_pass_stats_enabled;
+
+void nir_pass_stats_init(void);
+void _nir_pass_stats_begin(nir_shader *shader, nir_pass_stats_sample *sample);
+void _nir_pass_stats_end(nir_shader *shader, const nir_pass_stats_sample *sample,
+                         const char *pass, const char *site, bool progress);
+
+static inline nir_pass_stats_sample
+nir_pass_stats_begin(nir_shader *shader)
+{
+   nir_pass_stats_sample sample = { 0, 0 };
+   if (unlikely(nir_pass_stats_enabled))
+      _nir_pass_stats_begin(shader, &sample);
+   return sample;
+}
+
+static inline void
+nir_pass_stats_end(nir_shader *shader, const nir_pass_stats_sample *sample,
+                   const char *pass, const char *site, bool progress)
+{
+   if (unlikely(nir_pass_stats_enabled) && sample->start_ns)
+      _nir_pass_stats_end(shader, sample, pass, site, progress);
+}
+
 #define _PASS(pass, nir, do_pass)                                       \
    do {                                                                 \
       if (should_skip_nir(#pass)) {                                     \
@@ -4973,7 +5010,11 @@ should_print_nir(UNUSED nir_shader *shader)
       printf("%s\n", #pass);                                                             \
    static const char *when = "after " #pass " in " __FILE__ ":" NIR_STRINGIZE(__LINE__); \
    struct blob blob_before = nir_validate_progress_setup(nir);                           \
-   if (pass(nir, ##__VA_ARGS__)) {                                                       \
+   nir_pass_stats_sample _stats = nir_pass_stats_begin(nir);                             \
+   bool _pass_progress = pass(nir, ##__VA_ARGS__);                                       \
+   nir_pass_stats_end(nir, &_stats, #pass, __FILE__ ":" NIR_STRINGIZE(__LINE__),         \
+                      _pass_progress);                                                   \
+   if (_pass_progress) {                                                                 \
       nir_validate_shader(nir, when);                                                    \
       UNUSED bool _;                                                                     \
       progress = true;                                                                   \
@@ -24,6 +24,7 @@
 #include "util/u_printf.h"
 #include "nir.h"
 #include "nir_control_flow.h"
+#include "nir_serialize.h"
 #include "nir_xfb_info.h"
 
 /* Secret Decoder Ring:
@@ -824,6 +825,11 @@ nir_shader_clone(void *mem_ctx, const nir_shader *s)
    clone_state state;
    init_clone_state(&state, NULL, true, false);
 
+   /* Function bodies which were not deserialized yet would be lost.  Loading
+    * them doesn't change the shader, only where its bodies are kept.
+    */
+   nir_shader_load_library_impls((nir_shader *)s);
+
    nir_shader *ns = nir_shader_create(mem_ctx, s->info.stage, s->options);
    state.ns = ns;
 
@@ -26,6 +26,7 @@
 #include "nir.h"
 #include "nir_builder.h"
 #include "nir_control_flow.h"
+#include "nir_serialize.h"
 
 /*
  * TODO: write a proper inliner for GPUs.
@@ -456,11 +457,12 @@ function_link_pass(struct nir_builder *b,
       return false;
 
    func = nir_shader_get_function_for_name(state->link_shader, call->callee->name);
-   if (!func || !func->impl) {
+   const nir_function_impl *impl = func ? nir_function_get_library_impl(func) : NULL;
+   if (!impl) {
       return false;
    }
    return lower_call_function_impl(b, call->callee,
-                                   func->impl,
+                                   impl,
                                    state);
 }
 
@@ -0,0 +1,254 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "nir.h"
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/simple_mtx.h"
+#include "util/u_call_once.h"
+#include "util/u_debug.h"
+
+/** @file
+ * Pass statistics.
+ *
+ * With NIR_PASS_STATS=<file>, every pass run through NIR_PASS records its
+ * wall time, whether it made progress and how it changed the number of
+ * instructions, per call site and per pass.  The totals for the process
+ * are written to the file at exit, as JSON if its name ends in ".json" and
+ * as CSV otherwise; "-" writes CSV to stderr.
+ *
+ * Passes which run other passes through NIR_PASS are counted with the
+ * time of those.  Unlike NIR_DEBUG, this is available in release builds.
+ */
+
+bool nir_pass_stats_enabled = false;
+
+struct nir_pass_stats_entry {
+   const char *pass;
+   const char *site; /* NULL for the totals of a pass */
+   uint64_t calls;
+   uint64_t progress;
+   int64_t time_ns;
+   int64_t instr_delta;
+};
+
+static struct {
+   simple_mtx_t mtx;
+   const char *path;
+   void *mem_ctx;
+   struct hash_table *sites;
+} stats = {
+   .mtx = SIMPLE_MTX_INITIALIZER,
+};
+
+DEBUG_GET_ONCE_OPTION(nir_pass_stats, "NIR_PASS_STATS", NULL);
+
+static uint32_t
+entry_hash(const void *key)
+{
+   const struct nir_pass_stats_entry *entry = key;
+   return _mesa_hash_string(entry->pass) ^ _mesa_hash_string(entry->site);
+}
+
+static bool
+entry_equal(const void *a, const void *b)
+{
+   const struct nir_pass_stats_entry *ea = a, *eb = b;
+   return !strcmp(ea->pass, eb->pass) && !strcmp(ea->site, eb->site);
+}
+
+static unsigned
+count_instrs(nir_shader *shader)
+{
+   unsigned count = 0;
+
+   nir_foreach_function_impl(impl, shader) {
+      nir_foreach_block(block, impl)
+         count += exec_list_length(&block->instr_list);
+   }
+
+   return count;
+}
+
+void
+_nir_pass_stats_begin(nir_shader *shader, nir_pass_stats_sample *sample)
+{
+   sample->instr_count = count_instrs(shader);
+   sample->start_ns = os_time_get_nano();
+}
+
+void
+_nir_pass_stats_end(nir_shader *shader, const nir_pass_stats_sample *sample,
+                    const char *pass, const char *site, bool progress)
+{
+   const int64_t time_ns = os_time_get_nano() - sample->start_ns;
+   const int64_t instr_delta =
+      (int64_t)count_instrs(shader) - (int64_t)sample->instr_count;
+
+   simple_mtx_lock(&stats.mtx);
+
+   /* Already dumped at exit */
+   if (!stats.sites) {
+      simple_mtx_unlock(&stats.mtx);
+      return;
+   }
+
+   const struct nir_pass_stats_entry key = { .pass = pass, .site = site };
+   struct hash_entry *he = _mesa_hash_table_search(stats.sites, &key);
+   struct nir_pass_stats_entry *entry = he ? he->data : NULL;
+   if (!entry) {
+      entry = rzalloc(stats.mem_ctx, struct nir_pass_stats_entry);
+      entry->pass = pass;
+      entry->site = site;
+      _mesa_hash_table_insert(stats.sites, entry, entry);
+   }
+
+   entry->calls++;
+   entry->progress += progress;
+   entry->time_ns += time_ns;
+   entry->instr_delta += instr_delta;
+
+   simple_mtx_unlock(&stats.mtx);
+}
+
+static int
+compare_entries(const void *a, const void *b)
+{
+   const struct nir_pass_stats_entry *ea = *(const struct nir_pass_stats_entry **)a;
+   const struct nir_pass_stats_entry *eb = *(const struct nir_pass_stats_entry **)b;
+
+   /* Most expensive first */
+   if (ea->time_ns != eb->time_ns)
+      return ea->time_ns < eb->time_ns ? 1 : -1;
+   return strcmp(ea->site ? ea->site : ea->pass, eb->site ? eb->site : eb->pass);
+}
+
+/* Returns the entries sorted by time, the totals of each pass first. */
+static struct nir_pass_stats_entry **
+collect_entries(void *mem_ctx, unsigned *num_passes, unsigned *num_sites)
+{
+   struct hash_table *passes = _mesa_string_hash_table_create(mem_ctx);
+   unsigned count = stats.sites->entries;
+
+   hash_table_foreach(stats.sites, he) {
+      const struct nir_pass_stats_entry *site = he->data;
+      struct hash_entry *pe = _mesa_hash_table_search(passes, site->pass);
+      struct nir_pass_stats_entry *total = pe ? pe->data : NULL;
+
+      if (!total) {
+         total = rzalloc(mem_ctx, struct nir_pass_stats_entry);
+         total->pass = site->pass;
+         _mesa_hash_table_insert(passes, site->pass, total);
+      }
+
+      total->calls += site->calls;
+      total->progress += site->progress;
+      total->time_ns += site->time_ns;
+      total->instr_delta += site->instr_delta;
+   }
+
+   *num_passes = passes->entries;
+   *num_sites = count;
+
+   struct nir_pass_stats_entry **entries =
+      ralloc_array(mem_ctx, struct nir_pass_stats_entry *,
+                   passes->entries + count);
+   unsigned i = 0;
+
+   hash_table_foreach(passes, he)
+      entries[i++] = he->data;
+   hash_table_foreach(stats.sites, he)
+      entries[i++] = he->data;
+
+   qsort(entries, *num_passes, sizeof(*entries), compare_entries);
+   qsort(entries + *num_passes, count, sizeof(*entries), compare_entries);
+
+   return entries;
+}
+
+static void
+print_json_entry(FILE *fp, const struct nir_pass_stats_entry *entry, bool last)
+{
+   fprintf(fp, "    {\"pass\": \"%s\", ", entry->pass);
+   if (entry->site)
+      fprintf(fp, "\"site\": \"%s\", ", entry->site);
+   fprintf(fp, "\"calls\": %" PRIu64 ", \"progress\": %" PRIu64 ", "
+           "\"time_us\": %.1f, \"instr_delta\": %" PRId64 "}%s\n",
+           entry->calls, entry->progress, entry->time_ns / 1000.0,
+           entry->instr_delta, last ? "" : ",");
+}
+
+static void
+nir_pass_stats_dump(void)
+{
+   simple_mtx_lock(&stats.mtx);
+
+   const bool to_stderr = !strcmp(stats.path, "-");
+   const size_t len = strlen(stats.path);
+   const bool json = !to_stderr && len >= 5 &&
+                     !strcmp(stats.path + len - 5, ".json");
+   FILE *fp = to_stderr ? stderr : fopen(stats.path, "w");
+
+   if (!fp) {
+      fprintf(stderr, "NIR_PASS_STATS: failed to open %s\n", stats.path);
+      goto out;
+   }
+
+   unsigned num_passes, num_sites;
+   struct nir_pass_stats_entry **entries =
+      collect_entries(stats.mem_ctx, &num_passes, &num_sites);
+
+   if (json) {
+      fprintf(fp, "{\n  \"passes\": [\n");
+      for (unsigned i = 0; i < num_passes; i++)
+         print_json_entry(fp, entries[i], i + 1 == num_passes);
+      fprintf(fp, "  ],\n  \"sites\": [\n");
+      for (unsigned i = 0; i < num_sites; i++)
+         print_json_entry(fp, entries[num_passes + i], i + 1 == num_sites);
+      fprintf(fp, "  ]\n}\n");
+   } else {
+      /* The totals of each pass have an empty site. */
+      fprintf(fp, "pass,site,calls,progress,time_us,instr_delta\n");
+      for (unsigned i = 0; i < num_passes + num_sites; i++) {
+         fprintf(fp, "%s,%s,%" PRIu64 ",%" PRIu64 ",%.1f,%" PRId64 "\n",
+                 entries[i]->pass, entries[i]->site ? entries[i]->site : "",
+                 entries[i]->calls, entries[i]->progress,
+                 entries[i]->time_ns / 1000.0, entries[i]->instr_delta);
+      }
+   }
+
+   if (!to_stderr)
+      fclose(fp);
+   else
+      fflush(fp);
+
+out:
+   ralloc_free(stats.mem_ctx);
+   stats.mem_ctx = NULL;
+   stats.sites = NULL;
+   nir_pass_stats_enabled = false;
+   simple_mtx_unlock(&stats.mtx);
+}
+
+static void
+nir_pass_stats_init_once(void)
+{
+   stats.path = debug_get_option_nir_pass_stats();
+   if (!stats.path || !stats.path[0])
+      return;
+
+   stats.mem_ctx = ralloc_context(NULL);
+   stats.sites = _mesa_hash_table_create(stats.mem_ctx, entry_hash, entry_equal);
+   atexit(nir_pass_stats_dump);
+   nir_pass_stats_enabled = true;
+}
+
+void
+nir_pass_stats_init(void)
+{
+   static once_flag once = ONCE_FLAG_INIT;
+   call_once(&once, nir_pass_stats_init_once);
+}
@@ -22,6 +22,8 @@
  */
 
 #include "nir_serialize.h"
+#include "util/simple_mtx.h"
+#include "util/u_atomic.h"
 #include "util/u_dynarray.h"
 #include "util/u_math.h"
 #include "util/u_printf.h"
@@ -2185,39 +2187,30 @@ nir_serialize_function(struct blob *blob, const nir_function *fxn)
 }
 
 static void
-serialize_internal(struct blob *blob, const nir_shader *nir, bool strip, bool serialize_info)
+write_shader_head(write_ctx *ctx, const nir_shader *nir, bool serialize_info)
 {
-   write_ctx ctx = { 0 };
-   _mesa_pointer_hash_table_init(&ctx.remap_table, NULL);
-   ctx.blob = blob;
-   ctx.nir = nir;
-   ctx.strip = strip;
-   ctx.debug_info = nir->has_debug_info && !strip;
-   ctx.phi_fixups = UTIL_DYNARRAY_INIT;
-
-   size_t idx_size_offset = blob_reserve_uint32(blob);
-
+   struct blob *blob = ctx->blob;
    struct shader_info info = nir->info;
    if (!serialize_info)
       memset(&info, 0, sizeof(info));
 
    enum nir_serialize_shader_flags flags = 0;
-   if (!strip && info.name)
+   if (!ctx->strip && info.name)
       flags |= NIR_SERIALIZE_SHADER_NAME;
-   if (!strip && info.label)
+   if (!ctx->strip && info.label)
       flags |= NIR_SERIALIZE_SHADER_LABEL;
-   if (ctx.debug_info)
+   if (ctx->debug_info)
       flags |= NIR_SERIALIZE_DEBUG_INFO;
    blob_write_uint32(blob, flags);
 
-   if (!strip && info.name)
+   if (!ctx->strip && info.name)
       blob_write_string(blob, info.name);
-   if (!strip && info.label)
+   if (!ctx->strip && info.label)
       blob_write_string(blob, info.label);
    info.name = info.label = NULL;
    blob_write_bytes(blob, (uint8_t *)&info, sizeof(info));
 
-   write_var_list(&ctx, &nir->variables);
+   write_var_list(ctx, &nir->variables);
 
    blob_write_uint32(blob, nir->num_inputs);
    blob_write_uint32(blob, nir->num_uniforms);
@@ -2226,21 +2219,48 @@ serialize_internal(struct blob *blob, const nir_shader *nir, bool strip, bool se
 
    blob_write_uint32(blob, exec_list_length(&nir->functions));
    nir_foreach_function(fxn, nir) {
-      write_function(&ctx, fxn);
+      write_function(ctx, fxn);
    }
+}
 
-   nir_foreach_function_impl(impl, nir) {
-      write_function_impl(&ctx, impl);
-   }
+static void
+write_shader_tail(write_ctx *ctx, const nir_shader *nir)
+{
+   struct blob *blob = ctx->blob;
 
    blob_write_uint32(blob, nir->constant_data_size);
    if (nir->constant_data_size > 0)
       blob_write_bytes(blob, nir->constant_data, nir->constant_data_size);
 
-   write_xfb_info(&ctx, nir->xfb_info);
+   write_xfb_info(ctx, nir->xfb_info);
 
    if (nir->info.uses_printf)
       u_printf_serialize_info(blob, nir->printf_info, nir->printf_info_count);
+}
+
+static void
+serialize_internal(struct blob *blob, const nir_shader *nir, bool strip, bool serialize_info)
+{
+   /* Function bodies which were not deserialized yet would be lost. */
+   nir_shader_load_library_impls((nir_shader *)nir);
+
+   write_ctx ctx = { 0 };
+   _mesa_pointer_hash_table_init(&ctx.remap_table, NULL);
+   ctx.blob = blob;
+   ctx.nir = nir;
+   ctx.strip = strip;
+   ctx.debug_info = nir->has_debug_info && !strip;
+   ctx.phi_fixups = UTIL_DYNARRAY_INIT;
+
+   size_t idx_size_offset = blob_reserve_uint32(blob);
+
+   write_shader_head(&ctx, nir, serialize_info);
+
+   nir_foreach_function_impl(impl, nir) {
+      write_function_impl(&ctx, impl);
+   }
+
+   write_shader_tail(&ctx, nir);
 
    blob_overwrite_uint32(blob, idx_size_offset, ctx.next_idx);
 
@@ -2261,16 +2281,11 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
    serialize_internal(blob, nir, strip, true);
 }
 
-nir_shader *
-nir_deserialize(void *mem_ctx,
-                const struct nir_shader_compiler_options *options,
-                struct blob_reader *blob)
+static nir_shader *
+read_shader_head(read_ctx *ctx, void *mem_ctx,
+                 const struct nir_shader_compiler_options *options)
 {
-   read_ctx ctx = { 0 };
-   ctx.blob = blob;
-   list_inithead(&ctx.phi_srcs);
-   ctx.idx_table_len = blob_read_uint32(blob);
-   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+   struct blob_reader *blob = ctx->blob;
 
    enum nir_serialize_shader_flags flags = blob_read_uint32(blob);
    char *name = (flags & NIR_SERIALIZE_SHADER_NAME) ? blob_read_string(blob) : NULL;
@@ -2279,49 +2294,73 @@ nir_deserialize(void *mem_ctx,
    struct shader_info info;
    blob_copy_bytes(blob, (uint8_t *)&info, sizeof(info));
 
-   ctx.nir = nir_shader_create(mem_ctx, info.stage, options);
+   ctx->nir = nir_shader_create(mem_ctx, info.stage, options);
 
-   ctx.nir->has_debug_info = !!(flags & NIR_SERIALIZE_DEBUG_INFO);
-   if (ctx.nir->has_debug_info)
-      _mesa_hash_table_init(&ctx.strings, NULL, _mesa_hash_string, _mesa_key_string_equal);
+   ctx->nir->has_debug_info = !!(flags & NIR_SERIALIZE_DEBUG_INFO);
+   if (ctx->nir->has_debug_info)
+      _mesa_hash_table_init(&ctx->strings, NULL, _mesa_hash_string, _mesa_key_string_equal);
 
-   info.name = name ? ralloc_strdup(ctx.nir, name) : NULL;
-   info.label = label ? ralloc_strdup(ctx.nir, label) : NULL;
+   info.name = name ? ralloc_strdup(ctx->nir, name) : NULL;
+   info.label = label ? ralloc_strdup(ctx->nir, label) : NULL;
 
-   ctx.nir->info = info;
+   ctx->nir->info = info;
 
-   read_var_list(&ctx, &ctx.nir->variables);
+   read_var_list(ctx, &ctx->nir->variables);
 
-   ctx.nir->num_inputs = blob_read_uint32(blob);
-   ctx.nir->num_uniforms = blob_read_uint32(blob);
-   ctx.nir->num_outputs = blob_read_uint32(blob);
-   ctx.nir->scratch_size = blob_read_uint32(blob);
+   ctx->nir->num_inputs = blob_read_uint32(blob);
+   ctx->nir->num_uniforms = blob_read_uint32(blob);
+   ctx->nir->num_outputs = blob_read_uint32(blob);
+   ctx->nir->scratch_size = blob_read_uint32(blob);
 
    unsigned num_functions = blob_read_uint32(blob);
    for (unsigned i = 0; i < num_functions; i++)
-      read_function(&ctx);
+      read_function(ctx);
 
-   nir_foreach_function(fxn, ctx.nir) {
-      if (fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL)
-         nir_function_set_impl(fxn, read_function_impl(&ctx));
+   return ctx->nir;
+}
+
+static void
+read_shader_tail(read_ctx *ctx)
+{
+   struct blob_reader *blob = ctx->blob;
+
+   ctx->nir->constant_data_size = blob_read_uint32(blob);
+   if (ctx->nir->constant_data_size > 0) {
+      ctx->nir->constant_data =
+         ralloc_size(ctx->nir, ctx->nir->constant_data_size);
+      blob_copy_bytes(blob, ctx->nir->constant_data,
+                      ctx->nir->constant_data_size);
    }
 
-   ctx.nir->constant_data_size = blob_read_uint32(blob);
-   if (ctx.nir->constant_data_size > 0) {
-      ctx.nir->constant_data =
-         ralloc_size(ctx.nir, ctx.nir->constant_data_size);
-      blob_copy_bytes(blob, ctx.nir->constant_data,
-                      ctx.nir->constant_data_size);
+   ctx->nir->xfb_info = read_xfb_info(ctx);
+
+   if (ctx->nir->info.uses_printf) {
+      ctx->nir->printf_info =
+         u_printf_deserialize_info(ctx->nir, blob,
+                                   &ctx->nir->printf_info_count);
    }
+}
+
+nir_shader *
+nir_deserialize(void *mem_ctx,
+                const struct nir_shader_compiler_options *options,
+                struct blob_reader *blob)
+{
+   read_ctx ctx = { 0 };
+   ctx.blob = blob;
+   list_inithead(&ctx.phi_srcs);
+   ctx.idx_table_len = blob_read_uint32(blob);
+   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
 
-   ctx.nir->xfb_info = read_xfb_info(&ctx);
+   read_shader_head(&ctx, mem_ctx, options);
 
-   if (ctx.nir->info.uses_printf) {
-      ctx.nir->printf_info =
-         u_printf_deserialize_info(ctx.nir, blob,
-                                   &ctx.nir->printf_info_count);
+   nir_foreach_function(fxn, ctx.nir) {
+      if (fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL)
+         nir_function_set_impl(fxn, read_function_impl(&ctx));
    }
 
+   read_shader_tail(&ctx);
+
    free(ctx.idx_table);
    _mesa_hash_table_fini(&ctx.strings, NULL);
 
@@ -2351,6 +2390,262 @@ nir_deserialize_function(void *mem_ctx,
    return fxn;
 }
 
+/*
+ * Libraries with lazily deserialized function bodies.
+ *
+ * The shader is written like nir_serialize() does, except that the body of
+ * each function is a separate, self-contained section listed in a table
+ * after the function declarations.  nir_deserialize_library() only reads
+ * the declarations and variables; bodies are read the first time
+ * nir_function_get_library_impl() asks for them, typically when
+ * nir_link_shader_functions() links a kernel against the library.
+ *
+ * Bodies only reference the objects of the head of the library (variables
+ * and functions) and their own, so every body is written with the object
+ * indices continuing from the end of the head.  The data is never written
+ * to and only holds offsets, so it can come straight from a read-only
+ * mapping of a cache file shared between processes.
+ */
+
+struct nir_lazy_impls {
+   simple_mtx_t mtx;
+
+   const uint8_t *data;
+   size_t size;
+   bool owns_data;
+
+   /* Objects of the head, which the bodies start their numbering after */
+   void **head_objects;
+   uint32_t num_head_objects;
+   uint32_t idx_table_len;
+
+   /* nir_function -> struct nir_lazy_impl */
+   struct hash_table *impls;
+};
+
+struct nir_lazy_impl {
+   uint32_t offset;
+   uint32_t size;
+};
+
+void
+nir_serialize_library(struct blob *blob, const nir_shader *nir, bool strip)
+{
+   nir_shader_load_library_impls((nir_shader *)nir);
+
+   write_ctx ctx = { 0 };
+   _mesa_pointer_hash_table_init(&ctx.remap_table, NULL);
+   ctx.blob = blob;
+   ctx.nir = nir;
+   ctx.strip = strip;
+   ctx.debug_info = nir->has_debug_info && !strip;
+   ctx.phi_fixups = UTIL_DYNARRAY_INIT;
+
+   size_t idx_size_offset = blob_reserve_uint32(blob);
+   size_t head_size_offset = blob_reserve_uint32(blob);
+
+   write_shader_head(&ctx, nir, true);
+   write_shader_tail(&ctx, nir);
+
+   const uint32_t num_head_objects = ctx.next_idx;
+   uint32_t idx_table_len = num_head_objects;
+
+   const unsigned num_functions = exec_list_length(&nir->functions);
+   blob_align(blob, sizeof(uint32_t));
+   size_t table_offset = blob_reserve_bytes(blob, num_functions * 2 * sizeof(uint32_t));
+
+   unsigned i = 0;
+   nir_foreach_function(fxn, nir) {
+      uint32_t offset = 0, size = 0;
+
+      if (fxn->impl) {
+         /* Every body must decode on its own. */
+         ctx.next_idx = num_head_objects;
+         ctx.last_type = NULL;
+         ctx.last_interface_type = NULL;
+         memset(&ctx.last_var_data, 0, sizeof(ctx.last_var_data));
+
+         blob_align(blob, sizeof(uint64_t));
+         offset = blob->size;
+         write_function_impl(&ctx, fxn->impl);
+         size = blob->size - offset;
+
+         idx_table_len = MAX2(idx_table_len, ctx.next_idx);
+      }
+
+      blob_overwrite_bytes(blob, table_offset + (i * 2 + 0) * sizeof(uint32_t),
+                           &offset, sizeof(offset));
+      blob_overwrite_bytes(blob, table_offset + (i * 2 + 1) * sizeof(uint32_t),
+                           &size, sizeof(size));
+      i++;
+   }
+
+   blob_overwrite_uint32(blob, idx_size_offset, idx_table_len);
+   blob_overwrite_uint32(blob, head_size_offset, num_head_objects);
+
+   _mesa_hash_table_fini(&ctx.remap_table, NULL);
+   util_dynarray_fini(&ctx.phi_fixups);
+}
+
+static void
+nir_lazy_impls_destroy(void *ptr)
+{
+   struct nir_lazy_impls *lazy = ptr;
+
+   simple_mtx_destroy(&lazy->mtx);
+   if (lazy->owns_data)
+      free((void *)lazy->data);
+}
+
+/**
+ * Deserialize a library written by nir_serialize_library(), leaving the
+ * function bodies in data until they are used.
+ *
+ * data must stay valid as long as the shader, with take_ownership it is
+ * free()d along with the shader.
+ */
+nir_shader *
+nir_deserialize_library(void *mem_ctx,
+                        const struct nir_shader_compiler_options *options,
+                        const void *data, size_t size,
+                        bool take_ownership)
+{
+   struct blob_reader blob;
+   blob_reader_init(&blob, data, size);
+
+   read_ctx ctx = { 0 };
+   ctx.blob = &blob;
+   list_inithead(&ctx.phi_srcs);
+   ctx.idx_table_len = blob_read_uint32(&blob);
+   const uint32_t num_head_objects = blob_read_uint32(&blob);
+   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+
+   nir_shader *nir = read_shader_head(&ctx, mem_ctx, options);
+   read_shader_tail(&ctx);
+
+   struct nir_lazy_impls *lazy = rzalloc(nir, struct nir_lazy_impls);
+   simple_mtx_init(&lazy->mtx, mtx_plain);
+   lazy->data = data;
+   lazy->size = size;
+   lazy->owns_data = take_ownership;
+   lazy->num_head_objects = num_head_objects;
+   lazy->idx_table_len = ctx.idx_table_len;
+   lazy->head_objects = ralloc_array(lazy, void *, num_head_objects);
+   memcpy(lazy->head_objects, ctx.idx_table, num_head_objects * sizeof(void *));
+   lazy->impls = _mesa_pointer_hash_table_create(lazy);
+   ralloc_set_destructor(lazy, nir_lazy_impls_destroy);
+
+   blob_reader_align(&blob, sizeof(uint32_t));
+   nir_foreach_function(fxn, nir) {
+      struct nir_lazy_impl *impl = ralloc(lazy, struct nir_lazy_impl);
+      blob_copy_bytes(&blob, &impl->offset, sizeof(impl->offset));
+      blob_copy_bytes(&blob, &impl->size, sizeof(impl->size));
+
+      assert((fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL) == (impl->size != 0));
+      fxn->impl = NULL;
+
+      if (impl->size)
+         _mesa_hash_table_insert(lazy->impls, fxn, impl);
+      else
+         ralloc_free(impl);
+   }
+
+   free(ctx.idx_table);
+   _mesa_hash_table_fini(&ctx.strings, NULL);
+
+   if (blob.overrun) {
+      ralloc_free(nir);
+      return NULL;
+   }
+
+   nir->lazy_impls = lazy;
+
+   return nir;
+}
+
+static nir_function_impl *
+load_library_impl(nir_function *fxn)
+{
+   nir_shader *nir = fxn->shader;
+   struct nir_lazy_impls *lazy = nir->lazy_impls;
+
+   simple_mtx_lock(&lazy->mtx);
+
+   /* Another thread may have loaded it in the meantime. */
+   nir_function_impl *fi = fxn->impl;
+   struct hash_entry *entry = fi ? NULL : _mesa_hash_table_search(lazy->impls, fxn);
+   if (entry) {
+      const struct nir_lazy_impl *impl = entry->data;
+      struct blob_reader blob;
+      blob_reader_init(&blob, lazy->data + impl->offset, impl->size);
+
+      read_ctx ctx = { 0 };
+      ctx.nir = nir;
+      ctx.blob = &blob;
+      list_inithead(&ctx.phi_srcs);
+      ctx.idx_table_len = lazy->idx_table_len;
+      ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+      memcpy(ctx.idx_table, lazy->head_objects,
+             lazy->num_head_objects * sizeof(void *));
+      ctx.next_idx = lazy->num_head_objects;
+      if (nir->has_debug_info)
+         _mesa_hash_table_init(&ctx.strings, NULL, _mesa_hash_string, _mesa_key_string_equal);
+
+      fi = read_function_impl(&ctx);
+      assert(!blob.overrun);
+
+      free(ctx.idx_table);
+      _mesa_hash_table_fini(&ctx.strings, NULL);
+
+      fi->function = fxn;
+      p_atomic_set(&fxn->impl, fi);
+      _mesa_hash_table_remove(lazy->impls, entry);
+
+      /* Every body is loaded, later lookups only find declarations. */
+      if (!_mesa_hash_table_num_entries(lazy->impls) && lazy->owns_data) {
+         free((void *)lazy->data);
+         lazy->data = NULL;
+         lazy->owns_data = false;
+      }
+   }
+
+   simple_mtx_unlock(&lazy->mtx);
+
+   return fi;
+}
+
+/**
+ * Returns the implementation of a function, deserializing it first if the
+ * shader is a library from nir_deserialize_library().  This may be called
+ * from several threads for the same library.
+ */
+nir_function_impl *
+nir_function_get_library_impl(const nir_function *fxn)
+{
+   nir_function_impl *fi = p_atomic_read(&fxn->impl);
+
+   if (fi || !fxn->shader->lazy_impls)
+      return fi;
+
+   return load_library_impl((nir_function *)fxn);
+}
+
+/**
+ * Deserialize all remaining function bodies of a library, after which it
+ * can be used like any other shader.  Cloning and serializing it do this
+ * first.  This may run concurrently with nir_function_get_library_impl(),
+ * so the lazy state is kept until the shader is destroyed.
+ */
+void
+nir_shader_load_library_impls(nir_shader *nir)
+{
+   if (!nir->lazy_impls)
+      return;
+
+   nir_foreach_function(fxn, nir)
+      nir_function_get_library_impl(fxn);
+}
+
 void
 nir_shader_serialize_deserialize(nir_shader *shader)
 {
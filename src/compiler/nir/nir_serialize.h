@@ -45,6 +45,14 @@ nir_deserialize_function(void *mem_ctx,
                          const struct nir_shader_compiler_options *options,
                          struct blob_reader *blob);
 
+void nir_serialize_library(struct blob *blob, const nir_shader *nir, bool strip);
+nir_shader *nir_deserialize_library(void *mem_ctx,
+                                    const struct nir_shader_compiler_options *options,
+                                    const void *data, size_t size,
+                                    bool take_ownership);
+nir_function_impl *nir_function_get_library_impl(const nir_function *fxn);
+void nir_shader_load_library_impls(nir_shader *nir);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
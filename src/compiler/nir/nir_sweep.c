@@ -213,6 +213,7 @@ nir_sweep(nir_shader *nir)
    }
 
    ralloc_steal(nir, nir->constant_data);
+   ralloc_steal(nir, nir->lazy_impls);
    ralloc_steal(nir, nir->xfb_info);
    ralloc_steal(nir, nir->printf_info);
    for (int i = 0; i < nir->printf_info_count; i++) {
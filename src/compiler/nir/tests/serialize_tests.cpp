@@ -23,6 +23,8 @@
 
 #include <gtest/gtest.h>
 
+#include "c11/threads.h"
+
 #include "nir.h"
 #include "nir_builder.h"
 #include "nir_serialize.h"
@@ -101,6 +103,132 @@ nir_serialize_test::ASSERT_SWIZZLE_EQ(nir_alu_instr *a, nir_alu_instr *b, unsign
 class nir_serialize_all_test : public nir_serialize_test {};
 class nir_serialize_all_but_one_test : public nir_serialize_test {};
 
+class nir_serialize_library_test : public ::testing::Test {
+protected:
+   nir_serialize_library_test();
+   ~nir_serialize_library_test();
+
+   nir_function *add_function(const char *name, unsigned num_params);
+   nir_shader *deserialize_library();
+   void ASSERT_SAME_SHADER(nir_shader *expected, nir_shader *res);
+
+   nir_shader *shader;
+   nir_function *leaf, *middle, *unused;
+   struct blob library;
+   const nir_shader_compiler_options options;
+};
+
+/*
+ * main() calls middle(x), which calls leaf() twice.  unused() isn't called
+ * and has control flow.  The bodies reference a shared variable and other
+ * functions, which are in the head of the serialized library.
+ */
+nir_serialize_library_test::nir_serialize_library_test()
+:  options()
+{
+   glsl_type_singleton_init_or_ref();
+
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE, &options,
+                                                  "library test");
+   shader = b.shader;
+
+   nir_variable *var = nir_variable_create(shader, nir_var_mem_shared,
+                                           glsl_uint_type(), "var");
+
+   leaf = add_function("leaf", 1);
+   middle = add_function("middle", 1);
+   unused = add_function("unused", 0);
+
+   nir_builder lb = nir_builder_at(nir_before_impl(leaf->impl));
+   nir_def *x = nir_load_param(&lb, 0);
+   nir_store_var(&lb, var, nir_iadd_imm(&lb, nir_imul_imm(&lb, x, 3), 1), 0x1);
+
+   nir_builder mb = nir_builder_at(nir_before_impl(middle->impl));
+   x = nir_load_param(&mb, 0);
+   nir_call(&mb, leaf, nir_iadd_imm(&mb, x, 7));
+   nir_call(&mb, leaf, x);
+
+   nir_builder ub = nir_builder_at(nir_before_impl(unused->impl));
+   nir_push_if(&ub, nir_ieq_imm(&ub, nir_load_var(&ub, var), 0));
+   nir_store_var(&ub, var, nir_imm_int(&ub, 42), 0x1);
+   nir_pop_if(&ub, NULL);
+
+   nir_call(&b, middle, nir_imm_int(&b, 5));
+
+   nir_validate_shader(shader, "library");
+
+   blob_init(&library);
+   nir_serialize_library(&library, shader, false);
+}
+
+nir_serialize_library_test::~nir_serialize_library_test()
+{
+   if (HasFailure()) {
+      printf("\nShader from the failed test\n\n");
+      nir_print_shader(shader, stdout);
+   }
+
+   blob_finish(&library);
+   ralloc_free(shader);
+
+   glsl_type_singleton_decref();
+}
+
+nir_function *
+nir_serialize_library_test::add_function(const char *name, unsigned num_params)
+{
+   nir_function *fxn = nir_function_create(shader, name);
+
+   fxn->num_params = num_params;
+   fxn->params = rzalloc_array(shader, nir_parameter, num_params);
+   for (unsigned i = 0; i < num_params; i++) {
+      fxn->params[i].num_components = 1;
+      fxn->params[i].bit_size = 32;
+   }
+
+   nir_function_impl_create(fxn);
+
+   return fxn;
+}
+
+nir_shader *
+nir_serialize_library_test::deserialize_library()
+{
+   nir_shader *lib = nir_deserialize_library(shader, &options, library.data,
+                                             library.size, false);
+   EXPECT_NE(lib, nullptr);
+   return lib;
+}
+
+/* Serializing both shaders writes the same bytes if they are the same. */
+void
+nir_serialize_library_test::ASSERT_SAME_SHADER(nir_shader *expected,
+                                               nir_shader *res)
+{
+   struct blob a, b;
+
+   blob_init(&a);
+   blob_init(&b);
+   nir_serialize(&a, expected, false);
+   nir_serialize(&b, res, false);
+
+   EXPECT_EQ(a.size, b.size);
+   EXPECT_TRUE(a.size == b.size && !memcmp(a.data, b.data, a.size));
+
+   blob_finish(&a);
+   blob_finish(&b);
+}
+
+static nir_function *
+find_function(nir_shader *nir, const char *name)
+{
+   nir_foreach_function(fxn, nir) {
+      if (!strcmp(fxn->name, name))
+         return fxn;
+   }
+   return NULL;
+}
+
 } // namespace
 
 #if NIR_MAX_VEC_COMPONENTS == 16
@@ -195,3 +323,145 @@ TEST_P(nir_serialize_all_but_one_test, single_channel)
 
    ASSERT_SWIZZLE_EQ(vec_alu, vec_alu_dup, 1, 0);
 }
+
+TEST_F(nir_serialize_library_test, lazy_load_one)
+{
+   nir_shader *lib = deserialize_library();
+
+   nir_foreach_function(fxn, lib)
+      EXPECT_EQ(fxn->impl, nullptr);
+
+   nir_function *lib_middle = find_function(lib, "middle");
+   nir_function *lib_leaf = find_function(lib, "leaf");
+   ASSERT_NE(lib_middle, nullptr);
+   ASSERT_NE(lib_leaf, nullptr);
+
+   nir_function_impl *impl = nir_function_get_library_impl(lib_middle);
+   ASSERT_NE(impl, nullptr);
+   EXPECT_EQ(impl, lib_middle->impl);
+   EXPECT_EQ(impl->function, lib_middle);
+   EXPECT_EQ(nir_function_get_library_impl(lib_middle), impl);
+
+   /* Only the one asked for is loaded */
+   nir_foreach_function(fxn, lib) {
+      if (fxn != lib_middle) {
+         EXPECT_EQ(fxn->impl, nullptr);
+      }
+   }
+
+   /* Its calls refer to the library's functions */
+   unsigned num_calls = 0;
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_call) {
+            EXPECT_EQ(nir_instr_as_call(instr)->callee, lib_leaf);
+            num_calls++;
+         }
+      }
+   }
+   EXPECT_EQ(num_calls, 2u);
+
+   /* The leaf body refers to the library's variable */
+   impl = nir_function_get_library_impl(lib_leaf);
+   ASSERT_NE(impl, nullptr);
+   nir_variable *lib_var = NULL;
+   nir_foreach_variable_with_modes(var, lib, nir_var_mem_shared)
+      lib_var = var;
+   ASSERT_NE(lib_var, nullptr);
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_deref &&
+             nir_instr_as_deref(instr)->deref_type == nir_deref_type_var) {
+            EXPECT_EQ(nir_instr_as_deref(instr)->var, lib_var);
+         }
+      }
+   }
+
+   nir_shader_load_library_impls(lib);
+   nir_validate_shader(lib, "library");
+   ASSERT_SAME_SHADER(shader, lib);
+}
+
+TEST_F(nir_serialize_library_test, load_all)
+{
+   nir_shader *lib = deserialize_library();
+
+   nir_shader_load_library_impls(lib);
+
+   nir_foreach_function(fxn, lib)
+      EXPECT_NE(fxn->impl, nullptr);
+
+   nir_validate_shader(lib, "library");
+   ASSERT_SAME_SHADER(shader, lib);
+}
+
+TEST_F(nir_serialize_library_test, clone_and_serialize_lazy)
+{
+   nir_shader *lib = deserialize_library();
+   nir_function_get_library_impl(find_function(lib, "leaf"));
+
+   /* Both load the bodies which weren't used yet */
+   nir_shader *clone = nir_shader_clone(shader, lib);
+   nir_foreach_function(fxn, lib)
+      EXPECT_NE(fxn->impl, nullptr);
+   ASSERT_SAME_SHADER(shader, clone);
+
+   lib = deserialize_library();
+   ASSERT_SAME_SHADER(shader, lib);
+
+   /* Libraries can be written again */
+   lib = deserialize_library();
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize_library(&blob, lib, false);
+   EXPECT_EQ(blob.size, library.size);
+   EXPECT_TRUE(blob.size == library.size &&
+               !memcmp(blob.data, library.data, blob.size));
+   blob_finish(&blob);
+}
+
+static int
+load_library_impls_thread(void *data)
+{
+   nir_shader *lib = (nir_shader *)data;
+
+   nir_foreach_function(fxn, lib)
+      nir_function_get_library_impl(fxn);
+
+   return 0;
+}
+
+TEST_F(nir_serialize_library_test, clone_while_loading)
+{
+   /* The library frees its own copy once every body is loaded. */
+   void *data = malloc(library.size);
+   memcpy(data, library.data, library.size);
+   nir_shader *lib = nir_deserialize_library(shader, &options, data,
+                                             library.size, true);
+   ASSERT_NE(lib, nullptr);
+
+   thrd_t threads[4];
+   for (unsigned i = 0; i < ARRAY_SIZE(threads); i++)
+      ASSERT_EQ(thrd_create(&threads[i], load_library_impls_thread, lib),
+                thrd_success);
+
+   nir_shader *clone = nir_shader_clone(shader, lib);
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, lib, false);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(threads); i++)
+      ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success);
+
+   nir_validate_shader(lib, "library");
+   ASSERT_SAME_SHADER(shader, clone);
+   ASSERT_SAME_SHADER(shader, lib);
+
+   struct blob expected;
+   blob_init(&expected);
+   nir_serialize(&expected, shader, false);
+   EXPECT_TRUE(blob.size == expected.size &&
+               !memcmp(blob.data, expected.data, blob.size));
+   blob_finish(&expected);
+   blob_finish(&blob);
+}
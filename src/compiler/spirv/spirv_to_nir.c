@@ -825,6 +825,26 @@ vtn_foreach_instruction(struct vtn_builder *b, const uint32_t *start,
    return w;
 }
 
+/* Like vtn_foreach_instruction() but skips the bodies of the functions found
+ * unreachable by vtn_find_reachable_functions().  The handler must not stop
+ * the walk.
+ */
+void
+vtn_foreach_reachable_instruction(struct vtn_builder *b, const uint32_t *start,
+                                  const uint32_t *end,
+                                  vtn_instruction_handler handler)
+{
+   util_dynarray_foreach(&b->unreachable_functions, struct vtn_word_range, r) {
+      if (r->end <= start)
+         continue;
+
+      vtn_foreach_instruction(b, start, r->start, handler);
+      start = r->end;
+   }
+
+   vtn_foreach_instruction(b, start, end, handler);
+}
+
 static bool
 vtn_handle_debug_printf(struct vtn_builder *b, SpvOp ext_opcode,
                         const uint32_t *w, unsigned count)
@@ -7542,8 +7562,15 @@ spirv_to_nir(const uint32_t *words, size_t word_count,
       }
    }
 
+   /* Only translate the functions the entry point can call, large modules
+    * often carry many more.
+    */
+   if (!options->create_library)
+      vtn_find_reachable_functions(b, words, word_end);
+
    /* Set types on all vtn_values */
-   vtn_foreach_instruction(b, words, word_end, vtn_set_instruction_result_type);
+   vtn_foreach_reachable_instruction(b, words, word_end,
+                                     vtn_set_instruction_result_type);
 
    vtn_build_cfg(b, words, word_end);
 
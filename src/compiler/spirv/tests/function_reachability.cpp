@@ -0,0 +1,82 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include "helpers.h"
+
+class FunctionReachability : public spirv_test {
+protected:
+   nir_function *find_function(const char *name)
+   {
+      nir_foreach_function(func, shader) {
+         if (func->name && strcmp(func->name, name) == 0)
+            return func;
+      }
+      return NULL;
+   }
+};
+
+TEST_F(FunctionReachability, unreachable_functions_skipped)
+{
+   /*
+               OpCapability Shader
+               OpMemoryModel Logical GLSL450
+               OpEntryPoint GLCompute %main "main"
+               OpExecutionMode %main LocalSize 1 1 1
+               OpName %main "main"
+               OpName %used "used"
+               OpName %leaf "leaf"
+               OpName %dead "dead"
+       %void = OpTypeVoid
+          %6 = OpTypeFunction %void
+       %main = OpFunction %void None %6
+          %7 = OpLabel
+          %8 = OpFunctionCall %void %used
+               OpReturn
+               OpFunctionEnd
+       %dead = OpFunction %void None %6
+          %9 = OpLabel
+         %10 = OpFunctionCall %void %leaf
+               OpReturn
+               OpFunctionEnd
+       %used = OpFunction %void None %6
+         %11 = OpLabel
+         %12 = OpFunctionCall %void %leaf
+               OpReturn
+               OpFunctionEnd
+       %leaf = OpFunction %void None %6
+         %13 = OpLabel
+               OpReturn
+               OpFunctionEnd
+   */
+   static const uint32_t words[] = {
+      0x07230203, 0x00010000, 0x0008000b, 0x0000000e, 0x00000000, 0x00020011,
+      0x00000001, 0x0003000e, 0x00000000, 0x00000001, 0x0005000f, 0x00000005,
+      0x00000001, 0x6e69616d, 0x00000000, 0x00060010, 0x00000001, 0x00000011,
+      0x00000001, 0x00000001, 0x00000001, 0x00040005, 0x00000001, 0x6e69616d,
+      0x00000000, 0x00040005, 0x00000002, 0x64657375, 0x00000000, 0x00040005,
+      0x00000003, 0x6661656c, 0x00000000, 0x00040005, 0x00000004, 0x64616564,
+      0x00000000, 0x00020013, 0x00000005, 0x00030021, 0x00000006, 0x00000005,
+      0x00050036, 0x00000005, 0x00000001, 0x00000000, 0x00000006, 0x000200f8,
+      0x00000007, 0x00040039, 0x00000005, 0x00000008, 0x00000002, 0x000100fd,
+      0x00010038, 0x00050036, 0x00000005, 0x00000004, 0x00000000, 0x00000006,
+      0x000200f8, 0x00000009, 0x00040039, 0x00000005, 0x0000000a, 0x00000003,
+      0x000100fd, 0x00010038, 0x00050036, 0x00000005, 0x00000002, 0x00000000,
+      0x00000006, 0x000200f8, 0x0000000b, 0x00040039, 0x00000005, 0x0000000c,
+      0x00000003, 0x000100fd, 0x00010038, 0x00050036, 0x00000005, 0x00000003,
+      0x00000000, 0x00000006, 0x000200f8, 0x0000000d, 0x000100fd, 0x00010038,
+   };
+
+   get_nir(sizeof(words) / sizeof(words[0]), words, MESA_SHADER_COMPUTE);
+   ASSERT_NE(shader, nullptr);
+
+   /* Calls are followed forward and through several levels */
+   nir_function *used = find_function("used");
+   nir_function *leaf = find_function("leaf");
+   ASSERT_NE(used, nullptr);
+   ASSERT_NE(leaf, nullptr);
+   EXPECT_NE(used->impl, nullptr);
+   EXPECT_NE(leaf->impl, nullptr);
+
+   /* A function only called by other unreachable ones is never translated */
+   EXPECT_EQ(find_function("dead"), nullptr);
+}
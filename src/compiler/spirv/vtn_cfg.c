@@ -24,6 +24,7 @@
 #include "vtn_private.h"
 #include "spirv_info.h"
 #include "nir/nir_vla.h"
+#include "util/bitset.h"
 #include "util/u_debug.h"
 
 static unsigned
@@ -530,11 +531,145 @@ vtn_parse_switch(struct vtn_builder *b,
    _mesa_hash_table_destroy(block_to_case, NULL);
 }
 
+struct vtn_function_scan {
+   uint32_t id;
+   struct vtn_word_range words;
+   unsigned first_callee;
+   unsigned num_callees;
+};
+
+/*
+ * Find the functions which can be reached from the entry point, before
+ * anything is done with the function bodies.  This is a single walk over
+ * the words recording the functions each one calls, followed by a walk of
+ * the call graph from the entry point.  The bodies of all other functions
+ * are recorded in b->unreachable_functions so that the later passes can skip
+ * them.
+ *
+ * Every instruction taking a function operand must be handled here, anything
+ * it refers to will otherwise fail as not being a function.
+ */
+void
+vtn_find_reachable_functions(struct vtn_builder *b, const uint32_t *words,
+                             const uint32_t *end)
+{
+   void *mem_ctx = ralloc_context(b);
+
+   struct util_dynarray funcs, callees;
+   util_dynarray_init(&funcs, mem_ctx);
+   util_dynarray_init(&callees, mem_ctx);
+
+   /* Index + 1 in funcs of the function with a given id */
+   uint32_t *func_index = rzalloc_array(mem_ctx, uint32_t, b->value_id_bound);
+
+   struct vtn_function_scan *func = NULL;
+   for (const uint32_t *w = words; w < end;) {
+      SpvOp opcode = w[0] & SpvOpCodeMask;
+      unsigned count = w[0] >> SpvWordCountShift;
+      vtn_fail_if(count < 1 || w + count > end, "Malformed instruction");
+
+      uint32_t callee = 0;
+      switch (opcode) {
+      case SpvOpFunction:
+         vtn_fail_if(func != NULL, "OpFunction inside a function");
+         vtn_fail_if(count < 5 || w[2] >= b->value_id_bound ||
+                     func_index[w[2]], "Malformed OpFunction");
+         func = util_dynarray_grow(&funcs, struct vtn_function_scan, 1);
+         *func = (struct vtn_function_scan) {
+            .id = w[2],
+            .words.start = w,
+            .first_callee = util_dynarray_num_elements(&callees, uint32_t),
+         };
+         func_index[w[2]] =
+            util_dynarray_num_elements(&funcs, struct vtn_function_scan);
+         break;
+
+      case SpvOpFunctionEnd:
+         vtn_fail_if(func == NULL, "OpFunctionEnd outside of a function");
+         func->words.end = w + count;
+         func->num_callees = util_dynarray_num_elements(&callees, uint32_t) -
+                             func->first_callee;
+         func = NULL;
+         break;
+
+      case SpvOpFunctionCall:
+         if (count >= 4)
+            callee = w[3];
+         break;
+
+      case SpvOpCooperativeMatrixReduceNV:
+         if (count >= 6)
+            callee = w[5];
+         break;
+
+      case SpvOpCooperativeMatrixPerElementOpNV:
+         if (count >= 5)
+            callee = w[4];
+         break;
+
+      default:
+         break;
+      }
+
+      if (callee && func)
+         util_dynarray_append(&callees, callee);
+
+      w += count;
+   }
+   vtn_fail_if(func != NULL, "Missing OpFunctionEnd");
+
+   const unsigned num_funcs =
+      util_dynarray_num_elements(&funcs, struct vtn_function_scan);
+   const uint32_t entry_id = b->entry_point - b->values;
+   vtn_fail_if(!func_index[entry_id], "Entry point is not a function");
+
+   BITSET_WORD *reachable =
+      rzalloc_array(mem_ctx, BITSET_WORD, BITSET_WORDS(num_funcs));
+   uint32_t *stack = ralloc_array(mem_ctx, uint32_t, num_funcs);
+   unsigned stack_size = 0;
+
+   BITSET_SET(reachable, func_index[entry_id] - 1);
+   stack[stack_size++] = func_index[entry_id] - 1;
+
+   const uint32_t *callee_ids = callees.data;
+   while (stack_size) {
+      const struct vtn_function_scan *caller =
+         util_dynarray_element(&funcs, struct vtn_function_scan,
+                               stack[--stack_size]);
+
+      for (unsigned i = 0; i < caller->num_callees; i++) {
+         const uint32_t id = callee_ids[caller->first_callee + i];
+
+         /* Bad ids are reported when the call is translated */
+         if (id >= b->value_id_bound || !func_index[id])
+            continue;
+
+         const unsigned idx = func_index[id] - 1;
+         if (!BITSET_TEST(reachable, idx)) {
+            BITSET_SET(reachable, idx);
+            stack[stack_size++] = idx;
+         }
+      }
+   }
+
+   util_dynarray_init(&b->unreachable_functions, b);
+   for (unsigned i = 0; i < num_funcs; i++) {
+      if (BITSET_TEST(reachable, i))
+         continue;
+
+      const struct vtn_function_scan *scan =
+         util_dynarray_element(&funcs, struct vtn_function_scan, i);
+      util_dynarray_append(&b->unreachable_functions, scan->words);
+   }
+
+   ralloc_free(mem_ctx);
+}
+
 void
 vtn_build_cfg(struct vtn_builder *b, const uint32_t *words, const uint32_t *end)
 {
-   vtn_foreach_instruction(b, words, end,
-                           vtn_cfg_handle_prepass_instruction);
+   vtn_foreach_reachable_instruction(b, words, end,
+                                     vtn_cfg_handle_prepass_instruction);
 
    if (b->shader->info.stage == MESA_SHADER_KERNEL)
       return;
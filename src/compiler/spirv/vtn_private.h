@@ -230,6 +230,12 @@ struct vtn_function {
    struct list_head constructs;
 };
 
+/* The words [start, end) of the module */
+struct vtn_word_range {
+   const uint32_t *start;
+   const uint32_t *end;
+};
+
 #define vtn_foreach_function(func, func_list) \
    list_for_each_entry(struct vtn_function, func, func_list, link)
 
@@ -242,6 +248,8 @@ struct vtn_function {
 typedef bool (*vtn_instruction_handler)(struct vtn_builder *, SpvOp,
                                         const uint32_t *, unsigned);
 
+void vtn_find_reachable_functions(struct vtn_builder *b, const uint32_t *words,
+                                  const uint32_t *end);
 void vtn_build_cfg(struct vtn_builder *b, const uint32_t *words,
                    const uint32_t *end);
 void vtn_function_emit(struct vtn_builder *b, struct vtn_function *func,
@@ -262,6 +270,10 @@ void vtn_build_structured_cfg(struct vtn_builder *b, const uint32_t *words,
 const uint32_t *
 vtn_foreach_instruction(struct vtn_builder *b, const uint32_t *start,
                         const uint32_t *end, vtn_instruction_handler handler);
+void
+vtn_foreach_reachable_instruction(struct vtn_builder *b, const uint32_t *start,
+                                  const uint32_t *end,
+                                  vtn_instruction_handler handler);
 
 struct vtn_ssa_value {
    bool is_variable;
@@ -703,6 +715,12 @@ struct vtn_builder {
    struct vtn_function *func;
    struct list_head functions;
 
+   /* Functions which can't be reached from the entry point, as word ranges
+    * in module order.  Their bodies are skipped entirely, so they don't get
+    * a vtn_function or a nir_function.  Always empty with create_library.
+    */
+   struct util_dynarray unreachable_functions;
+
    struct hash_table *strings;
 
    /* Current function parameter index */
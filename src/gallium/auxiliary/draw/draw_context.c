@@ -1125,7 +1125,8 @@ draw_set_mapped_texture(struct draw_context *draw,
                         const void *base_ptr,
                         uint32_t row_stride[PIPE_MAX_TEXTURE_LEVELS],
                         uint32_t img_stride[PIPE_MAX_TEXTURE_LEVELS],
-                        uint32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS])
+                        uint32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS],
+                        bool tiled_4x4)
 {
 #if DRAW_LLVM_AVAILABLE
    if (draw->llvm)
@@ -1134,7 +1135,8 @@ draw_set_mapped_texture(struct draw_context *draw,
                                    sview_idx,
                                    width, height, depth, first_level,
                                    last_level, num_samples, sample_stride, base_ptr,
-                                   row_stride, img_stride, mip_offsets);
+                                   row_stride, img_stride, mip_offsets,
+                                   tiled_4x4);
 #endif
 }
 
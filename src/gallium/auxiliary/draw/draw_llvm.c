@@ -56,6 +56,7 @@
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
 
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_pointer.h"
 #include "util/u_string.h"
@@ -65,7 +66,8 @@
 
 
 static void
-draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *var);
+draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *var,
+                   struct nir_shader *nir);
 
 
 struct draw_gs_llvm_iface {
@@ -431,6 +433,9 @@ fail:
 void
 draw_llvm_destroy(struct draw_llvm *llvm)
 {
+   if (util_queue_is_initialized(&llvm->compile_queue))
+      util_queue_destroy(&llvm->compile_queue);
+
    lp_context_destroy(&llvm->context);
 
    /* XXX free other draw_llvm data? */
@@ -464,39 +469,52 @@ draw_get_ir_cache_key(struct nir_shader *nir,
 }
 
 
-/**
- * Create LLVM-generated code for a vertex shader.
- */
-struct draw_llvm_variant *
-draw_llvm_create_variant(struct draw_llvm *llvm,
-                         unsigned num_inputs,
-                         const struct draw_llvm_variant_key *key)
+static struct draw_llvm_variant *
+create_variant(struct draw_llvm *llvm,
+               struct llvm_vertex_shader *shader,
+               unsigned num_inputs,
+               const struct draw_llvm_variant_key *key)
 {
-   struct draw_llvm_variant *variant;
-   struct llvm_vertex_shader *shader =
-      llvm_vertex_shader(llvm->draw->vs.vertex_shader);
-   char module_name[64];
-   unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH];
-   struct lp_cached_code cached = { 0 };
-   bool needs_caching = false;
-   variant = MALLOC(sizeof *variant +
-                    shader->variant_key_size -
-                    sizeof variant->key);
+   struct draw_llvm_variant *variant =
+      CALLOC(1, sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
       return NULL;
 
    variant->llvm = llvm;
    variant->shader = shader;
+   variant->num_inputs = num_inputs;
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   snprintf(module_name, sizeof(module_name), "draw_llvm_vs_variant%u",
-            variant->shader->variants_cached);
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
 
-   if (shader->base.state.ir.nir && llvm->draw->disk_cache_cookie) {
-      draw_get_ir_cache_key(shader->base.state.ir.nir,
-                            key,
+   return variant;
+}
+
+
+/**
+ * Generate and compile the code of a vertex shader variant in the given
+ * LLVM context.  This only reads state owned by the variant, its shader
+ * and the NIR passed in, so it is safe to run on the compile thread.
+ */
+static bool
+compile_variant(struct draw_llvm_variant *variant,
+                lp_context_ref *context,
+                struct nir_shader *nir,
+                const char *module_name,
+                bool optimize)
+{
+   struct draw_llvm *llvm = variant->llvm;
+   struct llvm_vertex_shader *shader = variant->shader;
+   unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
+
+   if (nir && llvm->draw->disk_cache_cookie) {
+      draw_get_ir_cache_key(nir,
+                            &variant->key,
                             shader->variant_key_size,
-                            num_inputs,
+                            variant->num_inputs,
                             ir_sha1_cache_key);
 
       llvm->draw->disk_cache_find_shader(llvm->draw->disk_cache_cookie,
@@ -505,22 +523,32 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
       if (!cached.data_size)
          needs_caching = true;
    }
-   variant->gallivm = gallivm_create(module_name, &llvm->context, &cached);
+
+   /* Loading optimized code from the disk cache is cheaper still. */
+   if (cached.data_size)
+      optimize = true;
+   needs_caching &= optimize;
+
+   variant->gallivm = gallivm_create(module_name, context,
+                                     optimize ? &cached : NULL);
+   if (!variant->gallivm)
+      return false;
+   variant->gallivm->no_opt = !optimize;
 
    create_vs_jit_types(variant);
 
    if (gallivm_debug & (GALLIVM_DEBUG_TGSI | GALLIVM_DEBUG_IR)) {
-      if (llvm->draw->vs.vertex_shader->state.type == PIPE_SHADER_IR_TGSI)
-         tgsi_dump(llvm->draw->vs.vertex_shader->state.tokens, 0);
+      if (shader->base.state.type == PIPE_SHADER_IR_TGSI)
+         tgsi_dump(shader->base.state.tokens, 0);
       else
-         nir_print_shader(llvm->draw->vs.vertex_shader->state.ir.nir, stderr);
+         nir_print_shader(nir, stderr);
       draw_llvm_dump_variant_key(&variant->key);
    }
 
-   variant->vertex_header_type = lp_build_create_jit_vertex_header_type(variant->gallivm, num_inputs);
+   variant->vertex_header_type = lp_build_create_jit_vertex_header_type(variant->gallivm, variant->num_inputs);
    variant->vertex_header_ptr_type = LLVMPointerType(variant->vertex_header_type, 0);
 
-   draw_llvm_generate(llvm, variant);
+   draw_llvm_generate(llvm, variant, nir);
 
    gallivm_compile_module(variant->gallivm);
 
@@ -533,10 +561,75 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
                                            ir_sha1_cache_key);
    gallivm_free_ir(variant->gallivm);
 
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
+   return variant->jit_func != NULL;
+}
+
+
+static void
+free_variant(struct draw_llvm_variant *variant)
+{
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   lp_context_destroy(&variant->context);
+   FREE(variant->function_name);
+   FREE(variant);
+}
+
+
+/**
+ * Background compilation of the optimized variant replacing an unoptimized
+ * one with GALLIVM_PERF=tiered, queued once the unoptimized variant has been
+ * run gallivm_tier_up_threshold times.  The job compiles a private copy of
+ * the NIR in its own LLVM context, then points the unoptimized variant at
+ * the optimized code, so draws keep running meanwhile.
+ */
+struct draw_llvm_variant_job {
+   struct draw_llvm_variant *fallback;
+   struct draw_llvm_variant *variant;
+   struct nir_shader *nir;
+   char module_name[64];
+   unsigned invocations;
+   bool queued;
+   bool compiled;
+   struct util_queue_fence fence;
+};
+
+
+/**
+ * Create LLVM-generated code for a vertex shader.
+ */
+struct draw_llvm_variant *
+draw_llvm_create_variant(struct draw_llvm *llvm,
+                         unsigned num_inputs,
+                         const struct draw_llvm_variant_key *key,
+                         bool optimize)
+{
+   struct llvm_vertex_shader *shader =
+      llvm_vertex_shader(llvm->draw->vs.vertex_shader);
+   char module_name[64];
+
+   struct draw_llvm_variant *variant =
+      create_variant(llvm, shader, num_inputs, key);
+   if (!variant)
+      return NULL;
+
+   snprintf(module_name, sizeof(module_name), "draw_llvm_vs_variant%u",
+            shader->variants_cached);
+
+   if (!compile_variant(variant, &llvm->context, shader->base.state.ir.nir,
+                        module_name, optimize)) {
+      free_variant(variant);
+      return NULL;
+   }
+
+   /* Unoptimized variants get recompiled in the background once hot. */
+   if (variant->gallivm->no_opt) {
+      variant->job = CALLOC_STRUCT(draw_llvm_variant_job);
+      if (variant->job)
+         util_queue_fence_init(&variant->job->fence);
+   }
+
    /*variant->no = */shader->variants_created++;
-   variant->list_item_global.base = variant;
 
    return variant;
 }
@@ -583,10 +676,11 @@ generate_vs(struct draw_llvm_variant *variant,
             const struct lp_build_sampler_soa *draw_sampler,
             const struct lp_build_image_soa *draw_image,
             bool clamp_vertex_color,
-            struct lp_build_mask_context *bld_mask)
+            struct lp_build_mask_context *bld_mask,
+            struct nir_shader *nir)
 {
-   struct draw_llvm *llvm = variant->llvm;
-   const struct tgsi_token *tokens = llvm->draw->vs.vertex_shader->state.tokens;
+   const struct draw_vertex_shader *vs = &variant->shader->base;
+   const struct tgsi_token *tokens = vs->state.tokens;
    LLVMValueRef consts_ptr =
       lp_jit_resources_constants(variant->gallivm, variant->resources_type, resources_ptr);
    LLVMValueRef ssbos_ptr =
@@ -607,14 +701,13 @@ generate_vs(struct draw_llvm_variant *variant,
    params.resources_type = variant->resources_type;
    params.resources_ptr = resources_ptr;
    params.sampler = draw_sampler;
-   params.info = &llvm->draw->vs.vertex_shader->info;
+   params.info = &vs->info;
    params.ssbo_ptr = ssbos_ptr;
    params.image = draw_image;
 
-   if (llvm->draw->vs.vertex_shader->state.ir.nir &&
-       llvm->draw->vs.vertex_shader->state.type == PIPE_SHADER_IR_NIR) {
+   if (nir && vs->state.type == PIPE_SHADER_IR_NIR) {
       lp_build_nir_soa(variant->gallivm,
-                       llvm->draw->vs.vertex_shader->state.ir.nir,
+                       nir,
                        &params,
                        outputs);
    } else {
@@ -625,7 +718,7 @@ generate_vs(struct draw_llvm_variant *variant,
    }
 
    if (clamp_vertex_color) {
-      const struct tgsi_shader_info *info = &llvm->draw->vs.vertex_shader->info;
+      const struct tgsi_shader_info *info = &vs->info;
       do_clamp_vertex_color(variant->gallivm,
                             vs_type, info,
                             outputs);
@@ -1073,7 +1166,7 @@ generate_viewport(struct draw_llvm_variant *variant,
 {
    struct gallivm_state *gallivm = variant->gallivm;
    struct lp_type f32_type = vs_type;
-   const unsigned pos = variant->llvm->draw->vs.position_output;
+   const unsigned pos = variant->shader->base.position_output;
    LLVMTypeRef vs_type_llvm = lp_build_vec_type(gallivm, vs_type);
    LLVMValueRef out3 = LLVMBuildLoad2(builder, vs_type_llvm, outputs[pos][3], ""); /*w0 w1 .. wn*/
    LLVMValueRef const1 = lp_build_const_vec(gallivm, f32_type, 1.0);       /*1.0 1.0 1.0 1.0*/
@@ -1125,7 +1218,7 @@ generate_viewport(struct draw_llvm_variant *variant,
  * Returns clipmask as nxi32 bitmask for the n vertices
  */
 static LLVMValueRef
-generate_clipmask(struct draw_llvm *llvm,
+generate_clipmask(const struct draw_vertex_shader *vs,
                   struct gallivm_state *gallivm,
                   struct lp_type vs_type,
                   LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
@@ -1143,16 +1236,16 @@ generate_clipmask(struct draw_llvm *llvm,
    LLVMValueRef plane1, planes, plane_ptr;
    struct lp_type f32_type = vs_type;
    struct lp_type i32_type = lp_int_type(vs_type);
-   const unsigned pos = llvm->draw->vs.position_output;
-   const unsigned cv = llvm->draw->vs.clipvertex_output;
-   int num_written_clipdistance = llvm->draw->vs.vertex_shader->info.num_written_clipdistance;
+   const unsigned pos = vs->position_output;
+   const unsigned cv = vs->clipvertex_output;
+   int num_written_clipdistance = vs->info.num_written_clipdistance;
    bool have_cd = false;
    bool clip_user = key->clip_user;
    unsigned ucp_enable = key->ucp_enable;
    unsigned cd[2];
 
-   cd[0] = llvm->draw->vs.ccdistance_output[0];
-   cd[1] = llvm->draw->vs.ccdistance_output[1];
+   cd[0] = vs->ccdistance_output[0];
+   cd[1] = vs->ccdistance_output[1];
 
    if (cd[0] != pos || cd[1] != pos)
       have_cd = true;
@@ -1311,7 +1404,7 @@ generate_clipmask(struct draw_llvm *llvm,
        * This isn't really part of clipmask but stored the same in vertex
        * header later, so do it here.
        */
-      unsigned edge_attr = llvm->draw->vs.edgeflag_output;
+      unsigned edge_attr = vs->edgeflag_output;
       LLVMValueRef one = lp_build_const_vec(gallivm, f32_type, 1.0);
       LLVMValueRef edgeflag = LLVMBuildLoad2(builder, vec_type, outputs[edge_attr][0], "");
       test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_EQUAL, one, edgeflag);
@@ -1543,7 +1636,8 @@ draw_gs_llvm_epilogue(const struct lp_build_gs_iface *gs_base,
 
 
 static void
-draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
+draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
+                   struct nir_shader *nir)
 {
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMContextRef context = gallivm->context;
@@ -1568,8 +1662,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    LLVMValueRef instance_index[PIPE_MAX_ATTRIBS];
    LLVMValueRef fake_buf_ptr, fake_buf;
 
-   struct draw_context *draw = llvm->draw;
-   const struct tgsi_shader_info *vs_info = &draw->vs.vertex_shader->info;
+   const struct draw_vertex_shader *vs = &variant->shader->base;
+   const struct tgsi_shader_info *vs_info = &vs->info;
    unsigned i, j;
    struct lp_build_context bld, blduivec;
    struct lp_build_loop_state lp_loop;
@@ -1594,8 +1688,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
                                                     key->clip_user ||
                                                     key->need_edgeflags);
    LLVMValueRef variant_func;
-   const unsigned pos = draw->vs.position_output;
-   const unsigned cv = draw->vs.clipvertex_output;
+   const unsigned pos = vs->position_output;
+   const unsigned cv = vs->clipvertex_output;
    bool have_clipdist = false;
    struct lp_bld_tgsi_system_values system_values;
 
@@ -1967,7 +2061,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
                   sampler,
                   image,
                   key->clamp_vertex_color,
-                  &mask);
+                  &mask,
+                  nir);
 
       lp_build_mask_end(&mask);
       if (pos != -1 && cv != -1) {
@@ -1978,7 +2073,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
          if (enable_cliptest) {
             LLVMValueRef temp = LLVMBuildLoad2(builder, blduivec.vec_type, clipmask_bool_ptr, "");
             /* allocate clipmask, assign it integer type */
-            clipmask = generate_clipmask(llvm,
+            clipmask = generate_clipmask(vs,
                                          gallivm,
                                          vs_type,
                                          outputs,
@@ -2023,6 +2118,23 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
 }
 
 
+/**
+ * lp_sampler_static_texture_state() plus the texture layout the driver
+ * passed to draw_set_mapped_texture().
+ */
+static void
+draw_llvm_static_texture_state(const struct draw_llvm *llvm,
+                               mesa_shader_stage stage, unsigned idx,
+                               struct lp_static_texture_state *state)
+{
+   const struct pipe_sampler_view *view = llvm->draw->sampler_views[stage][idx];
+
+   lp_sampler_static_texture_state(state, view);
+   if (view && view->texture)
+      state->tiled_4x4 = BITSET_TEST(llvm->tiled_4x4_views[stage], idx);
+}
+
+
 struct draw_llvm_variant_key *
 draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
 {
@@ -2098,8 +2210,8 @@ draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[MESA_SHADER_VERTEX][i]);
    }
    for (unsigned i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[MESA_SHADER_VERTEX][i]);
+      draw_llvm_static_texture_state(llvm, MESA_SHADER_VERTEX, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_llvm_variant_key_images(key);
@@ -2155,13 +2267,19 @@ draw_llvm_set_mapped_texture(struct draw_context *draw,
                              const void *base_ptr,
                              uint32_t row_stride[PIPE_MAX_TEXTURE_LEVELS],
                              uint32_t img_stride[PIPE_MAX_TEXTURE_LEVELS],
-                             uint32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS])
+                             uint32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS],
+                             bool tiled_4x4)
 {
    struct lp_jit_texture *jit_tex;
 
    assert(shader_stage < DRAW_MAX_SHADER_STAGE);
    assert(sview_idx < ARRAY_SIZE(draw->llvm->jit_resources[shader_stage].textures));
 
+   if (tiled_4x4)
+      BITSET_SET(draw->llvm->tiled_4x4_views[shader_stage], sview_idx);
+   else
+      BITSET_CLEAR(draw->llvm->tiled_4x4_views[shader_stage], sview_idx);
+
    jit_tex = &draw->llvm->jit_resources[shader_stage].textures[sview_idx];
    jit_tex->width = width;
    jit_tex->height = height;
@@ -2236,6 +2354,84 @@ draw_llvm_set_sampler_state(struct draw_context *draw,
 }
 
 
+static void
+variant_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct draw_llvm_variant_job *job = data;
+   struct draw_llvm_variant *variant = job->variant;
+
+   lp_context_create(&variant->context);
+   if (variant->context.ref) {
+      job->compiled = compile_variant(variant, &variant->context, job->nir,
+                                      job->module_name, true);
+   }
+
+   /* Runs of the unoptimized variant from now on use the optimized code,
+    * draw_llvm_tier_up_variant() swaps the variants themselves later.
+    */
+   if (job->compiled)
+      p_atomic_set(&job->fallback->jit_func, variant->jit_func);
+
+   ralloc_free(job->nir);
+   job->nir = NULL;
+}
+
+
+/**
+ * Wait for and release the background job attached to an unoptimized
+ * variant, dropping the optimized variant if it was never swapped in.
+ */
+static void
+variant_job_destroy(struct draw_llvm_variant_job *job)
+{
+   util_queue_fence_wait(&job->fence);
+   util_queue_fence_destroy(&job->fence);
+   ralloc_free(job->nir);
+   if (job->variant)
+      free_variant(job->variant);
+   FREE(job);
+}
+
+
+/**
+ * Queue the compilation of the optimized variant replacing an unoptimized
+ * one.  Drops the job if that is not possible.
+ */
+static void
+variant_job_queue(struct draw_llvm_variant *fallback)
+{
+   struct draw_llvm_variant_job *job = fallback->job;
+   struct draw_llvm *llvm = fallback->llvm;
+   struct llvm_vertex_shader *shader = fallback->shader;
+   struct nir_shader *nir = shader->base.state.ir.nir;
+
+   if (!util_queue_is_initialized(&llvm->compile_queue)) {
+      util_queue_init(&llvm->compile_queue, "draw_compile", 64, 1,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                      UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY, NULL);
+   }
+
+   job->variant = create_variant(llvm, shader, fallback->num_inputs,
+                                 &fallback->key);
+   if (nir)
+      job->nir = nir_shader_clone(NULL, nir);
+
+   if (!util_queue_is_initialized(&llvm->compile_queue) ||
+       !job->variant || (nir && !job->nir)) {
+      fallback->job = NULL;
+      variant_job_destroy(job);
+      return;
+   }
+
+   snprintf(job->module_name, sizeof(job->module_name),
+            "draw_llvm_vs_variant%u", shader->variants_cached);
+   job->fallback = fallback;
+   job->queued = true;
+   util_queue_add_job(&llvm->compile_queue, job, &job->fence,
+                      variant_job_execute, NULL, 0);
+}
+
+
 void
 draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
 {
@@ -2246,14 +2442,61 @@ draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
                     variant->shader->variants_cached, llvm->nr_variants);
    }
 
-   gallivm_destroy(variant->gallivm);
+   if (variant->job)
+      variant_job_destroy(variant->job);
 
    list_del(&variant->list_item_local.list);
    variant->shader->variants_cached--;
    list_del(&variant->list_item_global.list);
    llvm->nr_variants--;
-   FREE(variant->function_name);
-   FREE(variant);
+   free_variant(variant);
+}
+
+
+/**
+ * Called before each run of a vertex shader variant: count the runs of an
+ * unoptimized variant, queue its optimized compile once it has been run
+ * gallivm_tier_up_threshold times, and replace it with the optimized
+ * variant once that job has finished.  The job already pointed the
+ * unoptimized variant at the optimized code, so this never waits.
+ */
+struct draw_llvm_variant *
+draw_llvm_tier_up_variant(struct draw_llvm_variant *variant)
+{
+   struct draw_llvm_variant_job *job = variant->job;
+
+   if (!job)
+      return variant;
+
+   if (!job->queued) {
+      if (++job->invocations >= gallivm_tier_up_threshold)
+         variant_job_queue(variant);
+      return variant;
+   }
+
+   if (!util_queue_fence_is_signalled(&job->fence))
+      return variant;
+
+   struct draw_llvm *llvm = variant->llvm;
+   struct llvm_vertex_shader *shader = variant->shader;
+   struct draw_llvm_variant *optimized = job->compiled ? job->variant : NULL;
+
+   /* Keep the unoptimized variant if the optimized one failed to build. */
+   if (!optimized) {
+      variant->job = NULL;
+      variant_job_destroy(job);
+      return variant;
+   }
+
+   job->variant = NULL;
+   draw_llvm_destroy_variant(variant);
+
+   list_add(&optimized->list_item_local.list, &shader->variants.list);
+   list_add(&optimized->list_item_global.list, &llvm->vs_variants_list.list);
+   llvm->nr_variants++;
+   shader->variants_cached++;
+
+   return optimized;
 }
 
 
@@ -2624,8 +2867,8 @@ draw_gs_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[MESA_SHADER_GEOMETRY][i]);
    }
    for (unsigned i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[MESA_SHADER_GEOMETRY][i]);
+      draw_llvm_static_texture_state(llvm, MESA_SHADER_GEOMETRY, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_gs_llvm_variant_key_images(key);
@@ -3295,8 +3538,8 @@ draw_tcs_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[MESA_SHADER_TESS_CTRL][i]);
    }
    for (i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[MESA_SHADER_TESS_CTRL][i]);
+      draw_llvm_static_texture_state(llvm, MESA_SHADER_TESS_CTRL, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_tcs_llvm_variant_key_images(key);
@@ -3842,8 +4085,8 @@ draw_tes_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[MESA_SHADER_TESS_EVAL][i]);
    }
    for (unsigned i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[MESA_SHADER_TESS_EVAL][i]);
+      draw_llvm_static_texture_state(llvm, MESA_SHADER_TESS_EVAL, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_tes_llvm_variant_key_images(key);
@@ -40,10 +40,12 @@
 #include "gallivm/lp_bld_jit_sample.h"
 
 #include "pipe/p_context.h"
+#include "util/bitset.h"
 #include "util/list.h"
 
 
 struct draw_llvm;
+struct draw_llvm_variant_job;
 struct llvm_vertex_shader;
 struct llvm_geometry_shader;
 struct llvm_tess_ctrl_shader;
@@ -407,6 +409,16 @@ struct draw_llvm_variant
    struct draw_llvm_variant_list_item list_item_global;
    struct draw_llvm_variant_list_item list_item_local;
 
+   unsigned num_inputs;
+
+   /* Optimized recompile of an unoptimized variant, see
+    * draw_llvm_tier_up_variant()
+    */
+   struct draw_llvm_variant_job *job;
+
+   /* Private LLVM context of a variant compiled in the background */
+   lp_context_ref context;
+
    /* key is variable-sized, must be last */
    struct draw_llvm_variant_key key;
 };
@@ -548,6 +560,9 @@ struct draw_llvm {
    struct draw_gs_jit_context gs_jit_context;
 
    struct lp_jit_resources jit_resources[DRAW_MAX_SHADER_STAGE];
+   /** sampler views stored in 4x4 blocks, see draw_set_mapped_texture() */
+   BITSET_DECLARE(tiled_4x4_views[DRAW_MAX_SHADER_STAGE],
+                  PIPE_MAX_SHADER_SAMPLER_VIEWS);
 
    struct draw_llvm_variant_list_item vs_variants_list;
    int nr_variants;
@@ -560,6 +575,9 @@ struct draw_llvm {
 
    struct draw_tes_llvm_variant_list_item tes_variants_list;
    int nr_tes_variants;
+
+   /** Background compiles of optimized vertex shader variants */
+   struct util_queue compile_queue;
 };
 
 
@@ -596,11 +614,15 @@ draw_llvm_destroy(struct draw_llvm *llvm);
 struct draw_llvm_variant *
 draw_llvm_create_variant(struct draw_llvm *llvm,
                          unsigned num_vertex_header_attribs,
-                         const struct draw_llvm_variant_key *key);
+                         const struct draw_llvm_variant_key *key,
+                         bool optimize);
 
 void
 draw_llvm_destroy_variant(struct draw_llvm_variant *variant);
 
+struct draw_llvm_variant *
+draw_llvm_tier_up_variant(struct draw_llvm_variant *variant);
+
 struct draw_llvm_variant_key *
 draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store);
 
@@ -665,7 +687,8 @@ draw_llvm_set_mapped_texture(struct draw_context *draw,
                              const void *base_ptr,
                              uint32_t row_stride[PIPE_MAX_TEXTURE_LEVELS],
                              uint32_t img_stride[PIPE_MAX_TEXTURE_LEVELS],
-                             uint32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS]);
+                             uint32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS],
+                             bool tiled_4x4);
 
 void
 draw_llvm_set_mapped_image(struct draw_context *draw,
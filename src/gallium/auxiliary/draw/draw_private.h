@@ -45,6 +45,7 @@
 #include "pipe/p_defines.h"
 #include "pipe/p_shader_tokens.h"
 #include "util/sha1/sha1.h"
+#include "util/u_queue.h"
 
 #include "draw_vertex_header.h"
 
@@ -240,6 +241,10 @@ struct draw_context
          /* pointer to planes */
          float (*planes)[DRAW_TOTAL_CLIP_PLANES][4];
       } user;
+
+      /** Worker threads helping the drawing thread shade large draws */
+      struct util_queue shade_queue;
+      unsigned num_shade_threads;
    } pt;
 
    struct {
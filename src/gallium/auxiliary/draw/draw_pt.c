@@ -38,6 +38,7 @@
 #include "draw/draw_vbuf.h"
 #include "draw/draw_vs.h"
 #include "tgsi/tgsi_dump.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_math.h"
 #include "util/u_prim.h"
 #include "util/format/u_format.h"
@@ -243,6 +244,47 @@ draw_pt_destroy(struct draw_context *draw)
       draw->pt.front.vsplit->destroy(draw->pt.front.vsplit);
       draw->pt.front.vsplit = NULL;
    }
+
+   if (util_queue_is_initialized(&draw->pt.shade_queue))
+      util_queue_destroy(&draw->pt.shade_queue);
+}
+
+
+/**
+ * Number of threads shading large draws, the drawing thread included.
+ * The worker threads are only started once a draw asks for them, so
+ * contexts which never see a large draw don't pay for them.
+ */
+unsigned
+draw_pt_shade_threads(struct draw_context *draw)
+{
+   if (!draw->pt.num_shade_threads) {
+      /* DRAW_SHADE_THREADS=1 keeps all shading on the drawing thread */
+      unsigned num_threads = debug_get_num_option("DRAW_SHADE_THREADS",
+                                                  util_get_cpu_caps()->nr_cpus);
+      num_threads = CLAMP(num_threads, 1, DRAW_SHADE_MAX_THREADS);
+
+      if (num_threads > 1 &&
+          !util_queue_init(&draw->pt.shade_queue, "draw_shade",
+                           4 * DRAW_SHADE_MAX_THREADS, num_threads - 1,
+                           UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL))
+         num_threads = 1;
+
+      draw->pt.num_shade_threads = num_threads;
+   }
+
+   return draw->pt.num_shade_threads;
+}
+
+
+/**
+ * Called by shade jobs on the worker threads, applies the FP state
+ * draw_vbo() set up on the drawing thread.
+ */
+void
+draw_pt_shade_thread_begin(struct draw_context *draw)
+{
+   util_fpstate_set_denorms_to_zero(draw->fpstate);
 }
 
 
@@ -155,6 +155,17 @@ struct draw_pt_middle_end *draw_pt_fetch_pipeline_or_emit_llvm(struct draw_conte
 struct draw_pt_middle_end *draw_pt_mesh_pipeline_or_emit(struct draw_context *draw);
 
 
+/* Threads shading large draws, including the drawing thread:
+ */
+#define DRAW_SHADE_MAX_THREADS 16
+
+unsigned
+draw_pt_shade_threads(struct draw_context *draw);
+
+void
+draw_pt_shade_thread_begin(struct draw_context *draw);
+
+
 /*******************************************************************************
  * HW vertex emit:
  */
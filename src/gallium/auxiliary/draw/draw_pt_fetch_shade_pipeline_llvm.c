@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
@@ -41,6 +42,27 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/*
+ * Vertex shading of large fetches is split into chunks shaded by the
+ * draw_pt_shade_threads() workers and the drawing thread.  The chunks write
+ * to disjoint ranges of the same vertex buffer, so everything after the VS
+ * sees the vertices in order.  Chunk boundaries are kept multiples of
+ * DRAW_SHADE_ALIGN, which covers every SIMD width the JIT'ed shader may
+ * store past the end of a chunk with.
+ */
+#define DRAW_SHADE_ALIGN 64
+#define DRAW_SHADE_MIN_VERTICES 512
+
+struct llvm_shade_job {
+   struct llvm_middle_end *fpme;
+   const struct draw_fetch_info *fetch_info;
+   struct vertex_header *verts;
+   unsigned first;
+   unsigned count;
+   bool clipped;
+   struct util_queue_fence fence;
+};
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -380,7 +402,8 @@ llvm_middle_end_prepare(struct draw_pt_middle_end *middle,
             }
          }
 
-         variant = draw_llvm_create_variant(llvm, nr, key);
+         variant = draw_llvm_create_variant(llvm, nr, key,
+                                            !(gallivm_perf & GALLIVM_PERF_TIERED));
 
          if (variant) {
             list_add(&variant->list_item_local.list, &shader->variants.list);
@@ -489,6 +512,112 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Run the vertex fetch shader for vertices [first, first + count) of the
+ * fetch, returning whether any of them needs clipping.
+ */
+static bool
+llvm_middle_end_run_vs(struct llvm_middle_end *fpme,
+                       const struct draw_fetch_info *fetch_info,
+                       struct vertex_header *verts,
+                       unsigned first, unsigned count)
+{
+   struct draw_context *draw = fpme->draw;
+   unsigned start, vertex_id_offset;
+   const unsigned *elts;
+
+   if (fetch_info->linear) {
+      start = fetch_info->start + first;
+      vertex_id_offset = draw->start_index;
+      elts = NULL;
+   } else {
+      start = draw->pt.user.eltMax;
+      vertex_id_offset = draw->pt.user.eltBias;
+      elts = fetch_info->elts + first;
+   }
+
+   verts = (struct vertex_header *)((char *)verts + first * fpme->vertex_size);
+
+   /* Swapped to the optimized code by a background compile, see
+    * draw_llvm_tier_up_variant().
+    */
+   draw_jit_vert_func jit_func = p_atomic_read(&fpme->current_variant->jit_func);
+
+   return jit_func(&fpme->llvm->vs_jit_context,
+                   &fpme->llvm->jit_resources[MESA_SHADER_VERTEX],
+                   verts,
+                   draw->pt.user.vbuffer,
+                   count,
+                   start,
+                   fpme->vertex_size,
+                   draw->pt.vertex_buffer,
+                   draw->instance_id,
+                   vertex_id_offset,
+                   draw->start_instance,
+                   elts,
+                   draw->pt.user.drawid,
+                   draw->pt.user.viewid);
+}
+
+
+static void
+llvm_shade_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct llvm_shade_job *job = data;
+
+   draw_pt_shade_thread_begin(job->fpme->draw);
+   job->clipped = llvm_middle_end_run_vs(job->fpme, job->fetch_info, job->verts,
+                                         job->first, job->count);
+}
+
+
+static bool
+llvm_middle_end_shade(struct llvm_middle_end *fpme,
+                      const struct draw_fetch_info *fetch_info,
+                      struct vertex_header *verts)
+{
+   const unsigned count = fetch_info->count;
+   unsigned num_jobs = 1;
+
+   if (count >= 2 * DRAW_SHADE_MIN_VERTICES)
+      num_jobs = MIN2(count / DRAW_SHADE_MIN_VERTICES,
+                      draw_pt_shade_threads(fpme->draw));
+
+   if (num_jobs <= 1)
+      return llvm_middle_end_run_vs(fpme, fetch_info, verts, 0, count);
+
+   const unsigned chunk = align(DIV_ROUND_UP(count, num_jobs), DRAW_SHADE_ALIGN);
+   struct llvm_shade_job jobs[DRAW_SHADE_MAX_THREADS];
+
+   num_jobs = DIV_ROUND_UP(count, chunk);
+   for (unsigned i = 0; i < num_jobs; i++) {
+      jobs[i].fpme = fpme;
+      jobs[i].fetch_info = fetch_info;
+      jobs[i].verts = verts;
+      jobs[i].first = i * chunk;
+      jobs[i].count = MIN2(chunk, count - jobs[i].first);
+      jobs[i].clipped = false;
+   }
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&fpme->draw->pt.shade_queue, &jobs[i], &jobs[i].fence,
+                         llvm_shade_job_execute, NULL, 0);
+   }
+
+   llvm_shade_job_execute(&jobs[0], NULL, 0);
+   bool clipped = jobs[0].clipped;
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+      clipped |= jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -539,39 +668,13 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       draw->statistics.vs_invocations += fetch_info->count;
    }
 
-   {
-      unsigned start, vertex_id_offset;
-      const unsigned *elts;
+   /* Run vertex fetch shader */
+   fpme->current_variant = draw_llvm_tier_up_variant(fpme->current_variant);
+   clipped = llvm_middle_end_shade(fpme, fetch_info, llvm_vert_info.verts);
 
-      if (fetch_info->linear) {
-         start = fetch_info->start;
-         vertex_id_offset = draw->start_index;
-         elts = NULL;
-      } else {
-         start = draw->pt.user.eltMax;
-         vertex_id_offset = draw->pt.user.eltBias;
-         elts = fetch_info->elts;
-      }
-      /* Run vertex fetch shader */
-      clipped = fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
-                                                &fpme->llvm->jit_resources[MESA_SHADER_VERTEX],
-                                                llvm_vert_info.verts,
-                                                draw->pt.user.vbuffer,
-                                                fetch_info->count,
-                                                start,
-                                                fpme->vertex_size,
-                                                draw->pt.vertex_buffer,
-                                                draw->instance_id,
-                                                vertex_id_offset,
-                                                draw->start_instance,
-                                                elts,
-                                                draw->pt.user.drawid,
-                                                draw->pt.user.viewid);
-
-      /* Finished with fetch and vs */
-      fetch_info = NULL;
-      vert_info = &llvm_vert_info;
-   }
+   /* Finished with fetch and vs */
+   fetch_info = NULL;
+   vert_info = &llvm_vert_info;
 
    /* Keep track of the patch lengths if we have a geometry shader, this way we can increment
     * gl_PrimitiveID once per patch, instead of per tessellation output primitive.
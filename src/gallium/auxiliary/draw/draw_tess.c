@@ -23,12 +23,14 @@
  *
  **************************************************************************/
 #include "draw_tess.h"
+#include "draw_pt.h"
 #if DRAW_LLVM_AVAILABLE
 #include "draw_llvm.h"
 #endif
 
 #include "tessellator/p_tessellator.h"
 #include "nir/nir_to_tgsi_info.h"
+#include "util/hash_table.h"
 #include "util/u_prim.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -216,12 +218,13 @@ int draw_tess_ctrl_shader_run(struct draw_tess_ctrl_shader *shader,
 #define DEBUG_INPUTS 0
 static void
 llvm_fetch_tes_input(struct draw_tess_eval_shader *shader,
+                     struct draw_tes_inputs *tes_input,
                      const struct draw_prim_info *input_prim_info,
                      unsigned prim_id,
                      unsigned num_vertices)
 {
    const float (*input_ptr)[4];
-   float (*input_data)[32][PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS] = &shader->tes_input->data;
+   float (*input_data)[32][PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS] = &tes_input->data;
    unsigned slot, i;
    int vs_slot;
    unsigned input_vertex_stride = shader->input_vertex_stride;
@@ -299,20 +302,245 @@ llvm_fetch_tess_factors(struct draw_tess_eval_shader *shader,
    }
 }
 
+/*
+ * Patches with the same tess factors get the same domain points and
+ * topology, so the tessellator output is kept in the shader and looked up
+ * by the factors which the tessellator actually distinguishes.  Once the
+ * cache is full, which fractional spacing with varying factors quickly
+ * gets to, the rest of the draw's patterns are only kept for the draw.
+ */
+#define DRAW_TESS_MAX_PATTERNS 256
+
+struct draw_tess_pattern {
+   /* key: used outer, then inner factors, unused ones are zero */
+   float factors[6];
+
+   uint32_t num_domain_points;
+   uint32_t num_indices;
+   /* padded to the shader's vector length */
+   float *domain_points_u;
+   float *domain_points_v;
+   uint16_t *indices;
+};
+
+static uint32_t
+draw_tess_pattern_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(((struct draw_tess_pattern *)NULL)->factors));
+}
+
+static bool
+draw_tess_pattern_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(((struct draw_tess_pattern *)NULL)->factors)) == 0;
+}
+
+/**
+ * Integer spacing clamps the factors to [1, 64] (NaN to 1) and rounds
+ * them up, so all factors rounding to the same integer share a pattern.
+ * Fractional spacing uses every bit of the factor.
+ */
+static inline float
+draw_tess_quantize_factor(const struct draw_tess_eval_shader *shader,
+                          float factor)
+{
+   if (shader->spacing != PIPE_TESS_SPACING_EQUAL)
+      return factor;
+
+   if (!(factor > 1.0f))
+      return 1.0f;
+
+   return ceilf(MIN2(factor, 64.0f));
+}
+
+/**
+ * Return the tessellation of a patch, or NULL if the factors cull it.
+ * Patterns which don't fit in the cache are allocated from *uncached,
+ * created on demand, which the caller frees after the draw.
+ */
+static const struct draw_tess_pattern *
+draw_tess_get_pattern(struct draw_tess_eval_shader *shader,
+                      const struct pipe_tessellation_factors *factors,
+                      void **uncached)
+{
+   unsigned num_outer, num_inner;
+
+   switch (shader->prim_mode) {
+   case MESA_PRIM_QUADS:
+      num_outer = 4;
+      num_inner = 2;
+      break;
+   case MESA_PRIM_TRIANGLES:
+      num_outer = 3;
+      num_inner = 1;
+      break;
+   default:
+      num_outer = 2;
+      num_inner = 0;
+      break;
+   }
+
+   struct draw_tess_pattern key = { 0 };
+   for (unsigned i = 0; i < num_outer; i++) {
+      /* NaN culls as well */
+      if (!(factors->outer_tf[i] > 0.0f))
+         return NULL;
+      key.factors[i] = draw_tess_quantize_factor(shader, factors->outer_tf[i]);
+   }
+   for (unsigned i = 0; i < num_inner; i++)
+      key.factors[num_outer + i] = draw_tess_quantize_factor(shader, factors->inner_tf[i]);
+
+   uint32_t hash = draw_tess_pattern_hash(&key);
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(shader->patterns, hash, &key);
+   if (entry)
+      return entry->data;
+
+   struct pipe_tessellation_factors tess_factors = { 0 };
+   memcpy(tess_factors.outer_tf, key.factors, num_outer * sizeof(float));
+   memcpy(tess_factors.inner_tf, &key.factors[num_outer], num_inner * sizeof(float));
+
+   if (!shader->tessellator)
+      shader->tessellator = p_tess_init(shader->prim_mode,
+                                        shader->spacing,
+                                        !shader->vertex_order_cw,
+                                        shader->point_mode);
+
+   /**
+    * Make sure subnormals are not flushed to zero during tessellation.
+    * This is the behavior required by D3D11. OpenGL doesn't care.
+    */
+   struct pipe_tessellator_data data = { 0 };
+   unsigned fpstate = util_fpstate_get();
+   util_fpstate_set(shader->draw->fpstate);  /* do not flush subnormals */
+   p_tessellate(shader->tessellator, &tess_factors, &data);
+   util_fpstate_set(fpstate);                /* flush subnormals again */
+
+   if (data.num_domain_points == 0)
+      return NULL;
+
+   const bool cache = shader->patterns->entries < DRAW_TESS_MAX_PATTERNS;
+   if (!cache && !*uncached)
+      *uncached = ralloc_context(NULL);
+
+   unsigned num_points = util_align_npot(data.num_domain_points, shader->vector_length);
+   struct draw_tess_pattern *pattern =
+      rzalloc_size(cache ? shader->patterns : *uncached, sizeof(*pattern) +
+                   2 * num_points * sizeof(float) +
+                   data.num_indices * sizeof(uint16_t));
+   if (!pattern)
+      return NULL;
+
+   memcpy(pattern->factors, key.factors, sizeof(key.factors));
+   pattern->num_domain_points = data.num_domain_points;
+   pattern->num_indices = data.num_indices;
+   pattern->domain_points_u = (float *)(pattern + 1);
+   pattern->domain_points_v = pattern->domain_points_u + num_points;
+   pattern->indices = (uint16_t *)(pattern->domain_points_v + num_points);
+
+   memcpy(pattern->domain_points_u, data.domain_points_u,
+          data.num_domain_points * sizeof(float));
+   memcpy(pattern->domain_points_v, data.domain_points_v,
+          data.num_domain_points * sizeof(float));
+   for (uint32_t i = 0; i < data.num_indices; i++)
+      pattern->indices[i] = data.indices[i];
+
+   if (cache)
+      _mesa_hash_table_insert_pre_hashed(shader->patterns, hash, pattern, pattern);
+   return pattern;
+}
+
 static void
 llvm_tes_run(struct draw_tess_eval_shader *shader,
+             struct draw_tes_inputs *tes_input,
              uint32_t prim_id,
              uint32_t patch_vertices_in,
-             struct pipe_tessellator_data *tess_data,
+             const struct draw_tess_pattern *pattern,
              struct pipe_tessellation_factors *tess_factors,
              struct vertex_header *output)
 {
    shader->current_variant->jit_func(shader->jit_resources,
-                                     shader->tes_input->data, output, prim_id,
-                                     tess_data->num_domain_points, tess_data->domain_points_u, tess_data->domain_points_v,
+                                     tes_input->data, output, prim_id,
+                                     pattern->num_domain_points, pattern->domain_points_u, pattern->domain_points_v,
                                      tess_factors->outer_tf, tess_factors->inner_tf, patch_vertices_in,
                                      shader->draw->pt.user.viewid);
 }
+
+/*
+ * Draws with many domain points run the TES on contiguous ranges of
+ * patches on the draw_pt_shade_threads() workers.  The output offsets of
+ * all patches are known up front.  The TES stores whole vectors, so the
+ * last patch of a range would write past its end into the next range; it
+ * is shaded into a scratch buffer and copied in place instead.
+ */
+#define DRAW_TESS_MIN_JOB_POINTS 1024
+
+struct draw_tess_patch {
+   struct pipe_tessellation_factors factors;
+   const struct draw_tess_pattern *pattern;
+   uint32_t vert_start;
+   uint32_t elt_start;
+};
+
+struct draw_tess_job {
+   struct draw_tess_eval_shader *shader;
+   const struct draw_prim_info *input_prims;
+   unsigned num_input_vertices_per_patch;
+   unsigned first_patch;
+   struct draw_tess_patch *patches;
+   unsigned start, end;
+   /* first vertex of the next range */
+   uint32_t vert_end;
+
+   struct draw_tes_inputs *tes_input;
+   char *output;
+   unsigned vertex_size;
+   uint16_t *elts;
+
+   struct util_queue_fence fence;
+};
+
+static void
+draw_tess_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct draw_tess_job *job = data;
+   struct draw_tess_eval_shader *shader = job->shader;
+
+   draw_pt_shade_thread_begin(shader->draw);
+
+   for (unsigned i = job->start; i < job->end; i++) {
+      struct draw_tess_patch *patch = &job->patches[i];
+      const struct draw_tess_pattern *pattern = patch->pattern;
+
+      if (!pattern)
+         continue;
+
+      for (uint32_t j = 0; j < pattern->num_indices; j++)
+         job->elts[patch->elt_start + j] = patch->vert_start + pattern->indices[j];
+
+      char *output = job->output + patch->vert_start * job->vertex_size;
+      const uint32_t num_points =
+         util_align_npot(pattern->num_domain_points, shader->vector_length);
+      char *scratch = NULL;
+
+      if (patch->vert_start + num_points > job->vert_end) {
+         scratch = MALLOC(num_points * job->vertex_size);
+         if (!scratch)
+            continue;
+      }
+
+      llvm_fetch_tes_input(shader, job->tes_input, job->input_prims, i,
+                           job->num_input_vertices_per_patch);
+      llvm_tes_run(shader, job->tes_input, job->first_patch + i,
+                   job->num_input_vertices_per_patch, pattern, &patch->factors,
+                   (struct vertex_header *)(scratch ? scratch : output));
+
+      if (scratch) {
+         memcpy(output, scratch, pattern->num_domain_points * job->vertex_size);
+         FREE(scratch);
+      }
+   }
+}
 #endif
 
 /**
@@ -356,72 +584,128 @@ int draw_tess_eval_shader_run(struct draw_tess_eval_shader *shader,
    shader->input_info = input_info;
 
 #if DRAW_LLVM_AVAILABLE
-   struct pipe_tessellation_factors factors;
-   struct pipe_tessellator_data data = { 0 };
-   struct pipe_tessellator *ptess = p_tess_init(shader->prim_mode,
-                                                shader->spacing,
-                                                !shader->vertex_order_cw,
-                                                shader->point_mode);
+   unsigned num_patches = input_prims->primitive_count;
    unsigned first_patch = input_prims->start / shader->draw->pt.vertices_per_patch;
-   for (unsigned i = 0; i < input_prims->primitive_count; i++) {
-      uint32_t vert_start = output_verts->count;
-      uint32_t prim_start = output_prims->primitive_count;
-      uint32_t elt_start = output_prims->count;
-
-      llvm_fetch_tess_factors(shader, i, num_input_vertices_per_patch, &factors);
-
-      /**
-       * Tessellate with the factors for this primitive.
-       * Make sure subnormals are not flushed to zero during tessellation.
-       * This is the behavior required by D3D11. OpenGL doesn't care.
-       */
-      unsigned fpstate = util_fpstate_get();
-      util_fpstate_set(shader->draw->fpstate);  /* do not flush subnormals */
-      p_tessellate(ptess, &factors, &data);
-      util_fpstate_set(fpstate);                /* flush subnormals again */
-
-      if (data.num_domain_points == 0)
-         continue;
+   uint32_t prim_len = u_prim_vertex_count(output_prims->prim)->min;
+   uint32_t num_points = 0;
+
+   /* Patterns may only go away between draws, patches point to them */
+   if (shader->patterns->entries >= DRAW_TESS_MAX_PATTERNS) {
+      _mesa_hash_table_destroy(shader->patterns, NULL);
+      shader->patterns = _mesa_hash_table_create(NULL, draw_tess_pattern_hash,
+                                                 draw_tess_pattern_equal);
+   }
 
-      uint32_t old_verts = vert_start;
-      uint32_t new_verts = vert_start + util_align_npot(data.num_domain_points, 4);
-      uint32_t old_size = output_verts->vertex_size * old_verts;
-      uint32_t new_size = output_verts->vertex_size * new_verts;
-      output_verts->verts = REALLOC(output_verts->verts, old_size, new_size);
+   struct draw_tess_patch *patches = MALLOC(num_patches * sizeof(*patches));
+   void *uncached_patterns = NULL;
+   for (unsigned i = 0; i < num_patches; i++) {
+      llvm_fetch_tess_factors(shader, i, num_input_vertices_per_patch, &patches[i].factors);
+      patches[i].pattern = draw_tess_get_pattern(shader, &patches[i].factors,
+                                                 &uncached_patterns);
+
+      uint32_t prims_per_patch = 0;
+      if (patches[i].pattern) {
+         num_points += patches[i].pattern->num_domain_points;
+         prims_per_patch = patches[i].pattern->num_indices / prim_len;
+      }
+      output_prims->primitive_count += prims_per_patch;
+      if (patch_lengths) {
+         (*patch_lengths)[i] = prims_per_patch;
+      }
+   }
+
+   unsigned num_jobs = 1;
+   if (num_points >= 2 * DRAW_TESS_MIN_JOB_POINTS && num_patches > 1)
+      num_jobs = MIN3(num_points / DRAW_TESS_MIN_JOB_POINTS, num_patches,
+                      draw_pt_shade_threads(shader->draw));
 
-      output_verts->count += data.num_domain_points;
+   /* Lay out the patches' outputs, splitting them into jobs of about the
+    * same number of domain points.
+    */
+   struct draw_tess_job jobs[DRAW_SHADE_MAX_THREADS];
+   uint64_t job_points = 0;
+   uint32_t vert_end = 0;
+   unsigned job = 0;
 
-      output_prims->count += data.num_indices;
-      elts = REALLOC(elts, elt_start * sizeof(uint16_t),
-                     output_prims->count * sizeof(uint16_t));
+   jobs[0].start = 0;
+   for (unsigned i = 0; i < num_patches; i++) {
+      const struct draw_tess_pattern *pattern = patches[i].pattern;
 
-      for (uint32_t i = 0; i < data.num_indices; i++)
-         elts[elt_start + i] = vert_start + data.indices[i];
+      if (job + 1 < num_jobs &&
+          job_points * num_jobs >= (uint64_t)(job + 1) * num_points) {
+         jobs[job].end = i;
+         jobs[job++].vert_end = output_verts->count;
+         jobs[job].start = i;
+      }
 
-      llvm_fetch_tes_input(shader, input_prims, i, num_input_vertices_per_patch);
-      /* run once per primitive? */
-      char *output = (char *)output_verts->verts;
-      output += vert_start * vertex_size;
-      llvm_tes_run(shader, first_patch + i, num_input_vertices_per_patch, &data, &factors, (struct vertex_header *)output);
+      patches[i].vert_start = output_verts->count;
+      patches[i].elt_start = output_prims->count;
+      if (!pattern)
+         continue;
 
-      if (shader->draw->collect_statistics) {
-         shader->draw->statistics.ds_invocations += data.num_domain_points;
+      output_verts->count += pattern->num_domain_points;
+      output_prims->count += pattern->num_indices;
+      vert_end = patches[i].vert_start +
+                 util_align_npot(pattern->num_domain_points, shader->vector_length);
+      job_points += pattern->num_domain_points;
+   }
+   jobs[job].end = num_patches;
+   jobs[job].vert_end = vert_end;
+   num_jobs = job + 1;
+
+   if (output_verts->count) {
+      output_verts->verts = MALLOC(vertex_size * vert_end);
+      elts = MALLOC(output_prims->count * sizeof(uint16_t));
+      output_prims->primitive_lengths = MALLOC(output_prims->primitive_count * sizeof(uint32_t));
+      for (uint32_t i = 0; i < output_prims->primitive_count; i++) {
+         output_prims->primitive_lengths[i] = prim_len;
       }
 
-      uint32_t prim_len = u_prim_vertex_count(output_prims->prim)->min;
-      uint32_t prims_per_patch = data.num_indices / prim_len;
-      output_prims->primitive_count += prims_per_patch;
-      if (patch_lengths) {
-         (*patch_lengths)[i] = prims_per_patch;
+      for (unsigned j = 0; j < num_jobs; j++) {
+         jobs[j].shader = shader;
+         jobs[j].input_prims = input_prims;
+         jobs[j].num_input_vertices_per_patch = num_input_vertices_per_patch;
+         jobs[j].first_patch = first_patch;
+         jobs[j].patches = patches;
+         jobs[j].tes_input = shader->tes_input;
+         jobs[j].output = (char *)output_verts->verts;
+         jobs[j].vertex_size = vertex_size;
+         jobs[j].elts = elts;
       }
 
-      output_prims->primitive_lengths = REALLOC(output_prims->primitive_lengths, prim_start * sizeof(uint32_t),
-                                                output_prims->primitive_count * sizeof(uint32_t));
-      for (uint32_t i = prim_start; i < output_prims->primitive_count; i++) {
-         output_prims->primitive_lengths[i] = prim_len;
+      /* Jobs without their own input scratch run serially on this thread. */
+      unsigned num_queued = 1;
+      for (; num_queued < num_jobs; num_queued++) {
+         struct draw_tess_job *queued = &jobs[num_queued];
+         struct draw_tes_inputs *tes_input =
+            align_malloc(sizeof(struct draw_tes_inputs), 16);
+         if (!tes_input)
+            break;
+
+         memset(tes_input, 0, sizeof(struct draw_tes_inputs));
+         queued->tes_input = tes_input;
+         util_queue_fence_init(&queued->fence);
+         util_queue_add_job(&shader->draw->pt.shade_queue, queued, &queued->fence,
+                            draw_tess_job_execute, NULL, 0);
       }
+
+      draw_tess_job_execute(&jobs[0], NULL, 0);
+      for (unsigned j = num_queued; j < num_jobs; j++)
+         draw_tess_job_execute(&jobs[j], NULL, 0);
+
+      for (unsigned j = 1; j < num_queued; j++) {
+         util_queue_fence_wait(&jobs[j].fence);
+         util_queue_fence_destroy(&jobs[j].fence);
+         align_free(jobs[j].tes_input);
+      }
+   }
+
+   if (shader->draw->collect_statistics) {
+      shader->draw->statistics.ds_invocations += num_points;
    }
-   p_tess_destroy(ptess);
+
+   FREE(patches);
+   ralloc_free(uncached_patterns);
 #endif
 
    *elts_out = elts;
@@ -599,6 +883,9 @@ draw_create_tess_eval_shader(struct draw_context *draw,
       tes->tes_input = align_malloc(sizeof(struct draw_tes_inputs), 16);
       memset(tes->tes_input, 0, sizeof(struct draw_tes_inputs));
 
+      tes->patterns = _mesa_hash_table_create(NULL, draw_tess_pattern_hash,
+                                              draw_tess_pattern_equal);
+
       tes->jit_resources = &draw->llvm->jit_resources[MESA_SHADER_TESS_EVAL];
       llvm_tes->variant_key_size =
          draw_tes_llvm_variant_key_size(
@@ -641,6 +928,10 @@ void draw_delete_tess_eval_shader(struct draw_context *draw,
 
       assert(shader->variants_cached == 0);
       align_free(dtes->tes_input);
+
+      _mesa_hash_table_destroy(dtes->patterns, NULL);
+      if (dtes->tessellator)
+         p_tess_destroy(dtes->tessellator);
    }
 #endif
    if (dtes->state.type == PIPE_SHADER_IR_NIR && dtes->state.ir.nir)
@@ -52,6 +52,9 @@ struct draw_tes_inputs {
   float data[32][PIPE_MAX_SHADER_INPUTS][4];
 };
 
+struct hash_table;
+struct pipe_tessellator;
+
 #endif
 
 struct draw_tess_ctrl_shader {
@@ -98,6 +101,10 @@ struct draw_tess_eval_shader {
    struct draw_tes_inputs *tes_input;
    struct lp_jit_resources *jit_resources;
    struct draw_tes_llvm_variant *current_variant;
+
+   /* Tessellator output by tess factors, see draw_tess_get_pattern() */
+   struct pipe_tessellator *tessellator;
+   struct hash_table *patterns;
 #endif
 };
 
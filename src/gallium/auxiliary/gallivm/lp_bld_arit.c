@@ -82,6 +82,33 @@
 #define LOG_POLY_DEGREE 4
 
 
+/**
+ * Generate min(a, b) or max(a, b) of a 512bit float vector with AVX-512.
+ * Like the SSE/AVX intrinsics, returns b if either value is NaN.
+ */
+static LLVMValueRef
+lp_build_minmax_avx512(struct lp_build_context *bld,
+                       const char *intrinsic,
+                       LLVMValueRef a,
+                       LLVMValueRef b,
+                       enum gallivm_nan_behavior nan_behavior)
+{
+   LLVMValueRef args[3], res;
+
+   /* The AVX-512 variants take a rounding mode, _MM_FROUND_CUR_DIRECTION */
+   args[0] = a;
+   args[1] = b;
+   args[2] = lp_build_const_int32(bld->gallivm, 4);
+   res = lp_build_intrinsic(bld->gallivm->builder, intrinsic,
+                            bld->vec_type, args, ARRAY_SIZE(args), 0);
+
+   if (nan_behavior == GALLIVM_NAN_RETURN_OTHER)
+      res = lp_build_select(bld, lp_build_isnan(bld, b), a, res);
+
+   return res;
+}
+
+
 /**
  * Generate min(a, b)
  * No checks for special case values of a or b = 1 or 0 are done.
@@ -104,6 +131,15 @@ lp_build_min_simple(struct lp_build_context *bld,
 
    /* TODO: optimize the constant case */
 
+   if (type.floating && util_get_cpu_caps()->has_avx512f &&
+       type.width * type.length == 512 &&
+       (type.width == 32 || type.width == 64)) {
+      return lp_build_minmax_avx512(bld, type.width == 32 ?
+                                    "llvm.x86.avx512.min.ps.512" :
+                                    "llvm.x86.avx512.min.pd.512",
+                                    a, b, nan_behavior);
+   }
+
    if (type.floating && util_get_cpu_caps()->has_sse) {
       if (type.width == 32) {
          if (type.length == 1) {
@@ -258,6 +294,15 @@ lp_build_max_simple(struct lp_build_context *bld,
 
    /* TODO: optimize the constant case */
 
+   if (type.floating && util_get_cpu_caps()->has_avx512f &&
+       type.width * type.length == 512 &&
+       (type.width == 32 || type.width == 64)) {
+      return lp_build_minmax_avx512(bld, type.width == 32 ?
+                                    "llvm.x86.avx512.max.ps.512" :
+                                    "llvm.x86.avx512.max.pd.512",
+                                    a, b, nan_behavior);
+   }
+
    if (type.floating && util_get_cpu_caps()->has_sse) {
       if (type.width == 32) {
          if (type.length == 1) {
@@ -1767,6 +1812,20 @@ lp_build_iround_nearest_sse2(struct lp_build_context *bld,
       res = lp_build_intrinsic_unary(builder, intrinsic,
                                      ret_type, arg);
    }
+   else if (type.width * type.length == 512) {
+      LLVMValueRef args[4];
+
+      assert(util_get_cpu_caps()->has_avx512f);
+
+      /* Unmasked, with the current rounding mode */
+      args[0] = a;
+      args[1] = LLVMGetUndef(ret_type);
+      args[2] = LLVMConstInt(LLVMInt16TypeInContext(bld->gallivm->context),
+                             0xffff, 0);
+      args[3] = LLVMConstInt(i32t, 4, 0);
+      res = lp_build_intrinsic(builder, "llvm.x86.avx512.mask.cvtps2dq.512",
+                               ret_type, args, ARRAY_SIZE(args), 0);
+   }
    else {
       if (type.width* type.length == 128) {
          intrinsic = "llvm.x86.sse2.cvtps2dq";
@@ -2225,7 +2284,8 @@ lp_build_iround(struct lp_build_context *bld,
 
    if ((util_get_cpu_caps()->has_sse2 &&
        ((type.width == 32) && (type.length == 1 || type.length == 4))) ||
-       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8)) {
+       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8) ||
+       (util_get_cpu_caps()->has_avx512f && type.width == 32 && type.length == 16)) {
       return lp_build_iround_nearest_sse2(bld, a);
    }
    if (arch_rounding_available(type)) {
@@ -2632,7 +2692,8 @@ lp_build_fast_rsqrt_available(struct lp_type type)
    assert(type.floating);
 
    if ((util_get_cpu_caps()->has_sse && type.width == 32 && type.length == 4) ||
-       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8)) {
+       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8) ||
+       (util_get_cpu_caps()->has_avx512f && type.width == 32 && type.length == 16)) {
       return true;
    }
    return false;
@@ -2657,7 +2718,17 @@ lp_build_fast_rsqrt(struct lp_build_context *bld,
    if (lp_build_fast_rsqrt_available(type)) {
       const char *intrinsic = NULL;
 
-      if (type.length == 4) {
+      if (type.length == 16) {
+         /* RSQRT14PS, unmasked */
+         LLVMValueRef args[3];
+         args[0] = a;
+         args[1] = LLVMGetUndef(bld->vec_type);
+         args[2] = LLVMConstInt(LLVMInt16TypeInContext(bld->gallivm->context),
+                                0xffff, 0);
+         return lp_build_intrinsic(builder, "llvm.x86.avx512.rsqrt14.ps.512",
+                                   bld->vec_type, args, ARRAY_SIZE(args), 0);
+      }
+      else if (type.length == 4) {
          intrinsic = "llvm.x86.sse.rsqrt.ps";
       }
       else {
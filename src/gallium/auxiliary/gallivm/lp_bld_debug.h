@@ -55,6 +55,8 @@ struct gallivm_state;
 #define GALLIVM_PERF_NO_OPT          (1 << 3)
 #define GALLIVM_PERF_NO_AOS_SAMPLING (1 << 4)
 #define GALLIVM_PERF_NO_LOD_ELLIPSE  (1 << 5)
+#define GALLIVM_PERF_TIERED          (1 << 6)
+#define GALLIVM_PERF_TIER_STATS      (1 << 7)
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,6 +65,8 @@ extern "C" {
 
 extern unsigned gallivm_perf;
 
+extern unsigned gallivm_tier_up_threshold;
+
 extern unsigned gallivm_debug;
 
 
@@ -86,6 +86,8 @@ create_pass_manager(struct gallivm_state *gallivm)
 void
 gallivm_free_ir(struct gallivm_state *gallivm)
 {
+   gallivm_report_compile_time(gallivm);
+
    if (gallivm->passmgr)
       lp_passmgr_dispose(gallivm->passmgr);
 
@@ -153,7 +155,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if ((gallivm_perf & GALLIVM_PERF_NO_OPT) || gallivm->no_opt) {
          optlevel = None;
       }
       else {
@@ -380,6 +382,8 @@ gallivm_add_global_mapping(struct gallivm_state *gallivm, LLVMValueRef sym, void
 void
 gallivm_compile_module(struct gallivm_state *gallivm)
 {
+   int64_t time_begin = os_time_get();
+
    assert(!gallivm->compiled);
 
    if (gallivm->builder) {
@@ -393,6 +397,9 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->di_builder = NULL;
    }
 
+   if (gallivm->no_opt)
+      lp_passmgr_set_no_opt(gallivm->module);
+
    LLVMSetDataLayout(gallivm->module, "");
    assert(!gallivm->engine);
    if (!init_gallivm_engine(gallivm)) {
@@ -449,6 +456,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
  skip_cached:
 
    ++gallivm->compiled;
+   gallivm_add_compile_time(gallivm, time_begin);
 
    lp_init_printf_hook(gallivm);
    gallivm_add_global_mapping(gallivm, gallivm->debug_printf_hook, debug_printf);
@@ -498,17 +506,15 @@ gallivm_jit_function(struct gallivm_state *gallivm,
 {
    void *code;
    func_pointer jit_func;
-   int64_t time_begin = 0;
+   int64_t time_begin = os_time_get();
 
    assert(gallivm->compiled);
    assert(gallivm->engine);
 
-   if (gallivm_debug & GALLIVM_DEBUG_PERF)
-      time_begin = os_time_get();
-
    code = LLVMGetPointerToGlobal(gallivm->engine, func);
    assert(code);
    jit_func = pointer_to_func(code);
+   gallivm_add_compile_time(gallivm, time_begin);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
       int64_t time_end = os_time_get();
@@ -53,6 +53,17 @@ struct lp_cached_code;
 struct lp_jit_texture;
 struct lp_context_ref;
 
+/**
+ * JIT tiers.  With GALLIVM_PERF=tiered, drivers compile new variants at
+ * the fast tier and recompile the ones invoked gallivm_tier_up_threshold
+ * times at the optimized tier.
+ */
+enum gallivm_tier {
+   GALLIVM_TIER_FAST,
+   GALLIVM_TIER_OPTIMIZED,
+   GALLIVM_NUM_TIERS,
+};
+
 struct gallivm_state
 {
    char *module_name;
@@ -90,6 +101,15 @@ struct gallivm_state
    LLVMValueRef texture_descriptor;
    struct lp_jit_texture *texture_dynamic_state;
    LLVMValueRef sampler_descriptor;
+
+   /* Compile this module for speed of compilation rather than speed of
+    * the generated code: minimal IR passes and -O0 code generation.
+    * Such modules make up the GALLIVM_TIER_FAST tier.
+    */
+   bool no_opt;
+
+   /* Microseconds spent optimizing and generating code for this module */
+   int64_t compile_time;
 };
 
 unsigned
@@ -133,6 +153,12 @@ gallivm_stub_func(struct gallivm_state *gallivm, LLVMValueRef func);
 
 unsigned gallivm_get_perf_flags(void);
 
+void
+gallivm_add_compile_time(struct gallivm_state *gallivm, int64_t time_begin);
+
+void
+gallivm_report_compile_time(struct gallivm_state *gallivm);
+
 void lp_init_clock_hook(struct gallivm_state *gallivm);
 
 void lp_init_env_options(void);
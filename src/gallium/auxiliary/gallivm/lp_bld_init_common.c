@@ -25,6 +25,8 @@
  *
  **************************************************************************/
 
+#include "util/os_time.h"
+#include "util/u_atomic.h"
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
 #include "lp_bld_debug.h"
@@ -43,9 +45,18 @@ static const struct debug_named_value lp_bld_perf_flags[] = {
    { "no_aos_sampling", GALLIVM_PERF_NO_AOS_SAMPLING, "disable aos sampling optimization" },
    { "no_lod_ellipse", GALLIVM_PERF_NO_LOD_ELLIPSE, "disable LOD elliptical derivative transform" },
    { "nopt",   GALLIVM_PERF_NO_OPT, "disable optimization passes to speed up shader compilation" },
+   { "tiered", GALLIVM_PERF_TIERED, "compile new shader variants quickly, recompile frequently used ones optimized in the background" },
+   { "tier_stats", GALLIVM_PERF_TIER_STATS, "report the time spent compiling in each JIT tier" },
    DEBUG_NAMED_VALUE_END
 };
 
+/* Invocations of a fast tier variant before it is recompiled optimized */
+unsigned gallivm_tier_up_threshold = 16;
+
+/* Compile time of all modules so far, per JIT tier */
+static int64_t gallivm_tier_time[GALLIVM_NUM_TIERS];
+static uint32_t gallivm_tier_modules[GALLIVM_NUM_TIERS];
+
 unsigned gallivm_debug = 0;
 
 static const struct debug_named_value lp_bld_debug_flags[] = {
@@ -88,6 +99,8 @@ lp_init_env_options(void)
       gallivm_debug &= ~GALLIVM_DEBUG_SYMBOLS;
 
    gallivm_perf = debug_get_flags_option("GALLIVM_PERF", lp_bld_perf_flags, 0 );
+   gallivm_tier_up_threshold =
+      MAX2(debug_get_num_option("GALLIVM_TIER_UP_THRESHOLD", 16), 1);
 }
 
 unsigned
@@ -96,6 +109,45 @@ gallivm_get_perf_flags(void)
    return gallivm_perf;
 }
 
+/**
+ * Add the time since \p time_begin to the module's compile time.
+ */
+void
+gallivm_add_compile_time(struct gallivm_state *gallivm, int64_t time_begin)
+{
+   gallivm->compile_time += os_time_get() - time_begin;
+}
+
+/**
+ * Account the compile time of a module to its JIT tier once it has been
+ * compiled, printing the totals with GALLIVM_PERF=tier_stats.
+ */
+void
+gallivm_report_compile_time(struct gallivm_state *gallivm)
+{
+   const enum gallivm_tier tier = gallivm->no_opt ? GALLIVM_TIER_FAST
+                                                  : GALLIVM_TIER_OPTIMIZED;
+
+   /* Also called when the IR is freed a second time */
+   if (!gallivm->compiled || !gallivm->compile_time)
+      return;
+
+   int64_t total = p_atomic_add_return(&gallivm_tier_time[tier],
+                                       gallivm->compile_time);
+   uint32_t modules = p_atomic_inc_return(&gallivm_tier_modules[tier]);
+
+   if (gallivm_perf & GALLIVM_PERF_TIER_STATS) {
+      debug_printf("gallivm: %s module %s took %.3f ms, "
+                   "%u modules took %.3f ms so far\n",
+                   tier == GALLIVM_TIER_FAST ? "fast" : "optimized",
+                   gallivm->module_name ? gallivm->module_name : "",
+                   gallivm->compile_time / 1000.0,
+                   modules, total / 1000.0);
+   }
+
+   gallivm->compile_time = 0;
+}
+
 void
 lp_init_clock_hook(struct gallivm_state *gallivm)
 {
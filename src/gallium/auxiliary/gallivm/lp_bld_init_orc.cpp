@@ -99,6 +99,30 @@ public:
 
 };
 
+/*
+ * Generates code for GALLIVM_TIER_FAST modules at -O0 and for all other
+ * modules at the optimization level of the JIT's target machine.
+ */
+class LPTieredCompiler : public llvm::orc::SimpleCompiler {
+private:
+   std::unique_ptr<llvm::TargetMachine> tm;
+   std::unique_ptr<llvm::TargetMachine> fast_tm;
+public:
+   LPTieredCompiler(std::unique_ptr<llvm::TargetMachine> TM,
+                    std::unique_ptr<llvm::TargetMachine> FastTM)
+      : SimpleCompiler(*TM), tm(std::move(TM)), fast_tm(std::move(FastTM)) {
+   }
+
+   llvm::Expected<CompileResult> operator()(llvm::Module &M) override {
+      if (lp_passmgr_is_no_opt(llvm::wrap(&M))) {
+         /* Fast tier modules are never put into the shader cache */
+         llvm::orc::SimpleCompiler fast(*fast_tm);
+         return fast(M);
+      }
+      return SimpleCompiler::operator()(M);
+   }
+};
+
 class LPJit;
 
 void lpjit_exit();
@@ -337,6 +361,23 @@ LPJit::LPJit() :jit_dylib_count(0) {
    lljit = ExitOnErr(
       LLJITBuilder()
          .setJITTargetMachineBuilder(std::move(JTMB))
+         .setCompileFunctionCreator(
+            [&](JITTargetMachineBuilder JTMB)
+               -> llvm::Expected<std::unique_ptr<IRCompileLayer::IRCompiler>> {
+               auto TM = JTMB.createTargetMachine();
+               if (!TM)
+                  return TM.takeError();
+#if LLVM_VERSION_MAJOR >= 18
+               JTMB.setCodeGenOptLevel(llvm::CodeGenOptLevel::None);
+#else
+               JTMB.setCodeGenOptLevel(llvm::CodeGenOpt::None);
+#endif
+               auto FastTM = JTMB.createTargetMachine();
+               if (!FastTM)
+                  return FastTM.takeError();
+               return std::make_unique<LPTieredCompiler>(std::move(*TM),
+                                                         std::move(*FastTM));
+            })
 #ifdef USE_JITLINK
          .setObjectLinkingLayerCreator(
 #if LLVM_VERSION_MAJOR >= 21
@@ -601,6 +642,8 @@ gallivm_destroy(struct gallivm_state *gallivm)
 void
 gallivm_free_ir(struct gallivm_state *gallivm)
 {
+   gallivm_report_compile_time(gallivm);
+
    if (gallivm->module)
       LLVMDisposeModule(gallivm->module);
    FREE(gallivm->module_name);
@@ -647,6 +690,9 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
    lp_build_coro_add_malloc_hooks(gallivm);
 
+   if (gallivm->no_opt)
+      lp_passmgr_set_no_opt(gallivm->module);
+
    /* Dump bitcode to a file */
    if (gallivm_debug & GALLIVM_DEBUG_DUMP_BC &&
        !(gallivm->cache && gallivm->cache->data_size)) {
@@ -666,6 +712,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
    LPJit::add_ir_module_to_jd(gallivm->_ts_context, gallivm->module,
       gallivm->_per_module_jd);
+   ++gallivm->compiled;
    /* ownership of module is now transferred into orc jit,
     * disallow modifying it
     */
@@ -686,13 +733,16 @@ gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func, const char *func_name)
 {
    LPObjectCacheORC *objcache = NULL;
+   int64_t time_begin = os_time_get();
    if (gallivm->cache) {
       assert(gallivm->cache->jit_obj_cache);
       objcache = (LPObjectCacheORC *)gallivm->cache->jit_obj_cache;
    }
 
-   return pointer_to_func(
-      LPJit::lookup_in_jd(func_name, gallivm->_per_module_jd, objcache));
+   /* The module's passes and code generation run in the first lookup */
+   void *code = LPJit::lookup_in_jd(func_name, gallivm->_per_module_jd, objcache);
+   gallivm_add_compile_time(gallivm, time_begin);
+   return pointer_to_func(code);
 }
 
 void
@@ -349,6 +349,17 @@ lp_build_select(struct lp_build_context *bld,
 
       res = LLVMBuildSelect(builder, mask, a, b, "");
    }
+   else if (util_get_cpu_caps()->has_avx512f &&
+            type.width * type.length == 512 &&
+            (type.width >= 32 || util_get_cpu_caps()->has_avx512bw) &&
+            LLVMGetTypeKind(LLVMTypeOf(mask)) == LLVMVectorTypeKind) {
+      /* There is no BLENDV in AVX-512, but selecting on the sign bit of the
+       * mask is a single compare into a mask register plus a masked blend.
+       */
+      LLVMValueRef zero = LLVMConstNull(LLVMTypeOf(mask));
+      mask = LLVMBuildICmp(builder, LLVMIntSLT, mask, zero, "");
+      res = LLVMBuildSelect(builder, mask, a, b, "");
+   }
    else if (((util_get_cpu_caps()->has_sse4_1 &&
               type.width * type.length == 128) ||
              (util_get_cpu_caps()->has_avx &&
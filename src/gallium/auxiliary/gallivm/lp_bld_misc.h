@@ -51,6 +51,9 @@ struct lp_cached_code {
    size_t data_size;
    bool dont_cache;
    void *jit_obj_cache;
+   /* os_time_get_nano() of the failed cache lookup, used by the driver to
+    * record how long the code took to build. */
+   int64_t miss_time;
 };
 
 struct lp_generated_code;
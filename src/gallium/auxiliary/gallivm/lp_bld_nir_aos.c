@@ -212,17 +212,18 @@ emit_store_reg(struct lp_build_nir_aos_context *bld,
    LLVMValueRef cur = LLVMBuildLoad2(gallivm->builder, reg_bld->vec_type,
                                      reg_storage, "");
    LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   const unsigned length = reg_bld->type.length;
    LLVMValueRef shuffles[LP_MAX_VECTOR_LENGTH];
-   for (unsigned j = 0; j < 16; j++) {
+   for (unsigned j = 0; j < length; j++) {
       unsigned comp = j % 4;
       if (writemask & (1 << comp)) {
-         shuffles[j] = LLVMConstInt(i32t, 16 + j, 0); // new val
+         shuffles[j] = LLVMConstInt(i32t, length + j, 0); // new val
       } else {
          shuffles[j] = LLVMConstInt(i32t, j, 0);      // cur val
       }
    }
    cur = LLVMBuildShuffleVector(gallivm->builder, cur, vals[0],
-                                LLVMConstVector(shuffles, 16), "");
+                                LLVMConstVector(shuffles, length), "");
 
    LLVMBuildStore(gallivm->builder, cur, reg_storage);
 }
@@ -305,7 +306,7 @@ emit_load_const(struct lp_build_nir_aos_context *bld,
                 const nir_load_const_instr *instr,
                 LLVMValueRef outval[NIR_MAX_VEC_COMPONENTS])
 {
-   LLVMValueRef elems[16];
+   LLVMValueRef elems[LP_MAX_VECTOR_LENGTH];
    const int nc = instr->def.num_components;
    bool do_swizzle = false;
 
@@ -433,8 +434,9 @@ get_alu_src(struct lp_build_nir_aos_context *bld,
          assert(LLVMGetTypeKind(LLVMTypeOf(value)) == LLVMVectorTypeKind);
 
          // swizzle vector of ((r,g,b,a), (r,g,b,a), (r,g,b,a), (r,g,b,a))
+         const unsigned length = bld->base.type.length;
          assert(bld->base.type.width == 8);
-         assert(bld->base.type.length == 16);
+         assert(length % 4 == 0);
 
          // Do our own swizzle here since lp_build_swizzle_aos_n() does
          // not do what we want.
@@ -443,7 +445,7 @@ get_alu_src(struct lp_build_nir_aos_context *bld,
          // shuffles = {2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15}
          // result = {b0,g0,r0,a0, b1,g1,r1,a1, b2,g2,r2,a2, b3,g3,r3,a3}.
          LLVMValueRef shuffles[LP_MAX_VECTOR_WIDTH];
-         for (unsigned i = 0; i < 16; i++) {
+         for (unsigned i = 0; i < length; i++) {
             unsigned chan = i % 4;
             /* apply src register swizzle */
             if (chan < num_components) {
@@ -457,7 +459,7 @@ get_alu_src(struct lp_build_nir_aos_context *bld,
          }
          value = LLVMBuildShuffleVector(builder, value,
                                         LLVMGetUndef(LLVMTypeOf(value)),
-                                        LLVMConstVector(shuffles, 16), "");
+                                        LLVMConstVector(shuffles, length), "");
       } else if (src_components > 1 && num_components == 1) {
          value = LLVMBuildExtractValue(gallivm->builder, value,
                                        src.swizzle[0], "");
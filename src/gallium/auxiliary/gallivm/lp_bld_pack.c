@@ -151,6 +151,33 @@ lp_build_const_unpack_shuffle_16wide(struct gallivm_state *gallivm,
    return LLVMConstVector(elems, 16);
 }
 
+/**
+ * Similar to lp_build_const_unpack_shuffle_half, but for 512bit vectors,
+ * interleaving each of the four 128bit lanes separately like the AVX-512
+ * unpack instructions do.
+ */
+static LLVMValueRef
+lp_build_const_unpack_shuffle_lanes(struct gallivm_state *gallivm,
+                                    unsigned n, unsigned lo_hi)
+{
+   LLVMValueRef elems[LP_MAX_VECTOR_LENGTH];
+   const unsigned lane_length = n / 4;
+   unsigned i, j;
+
+   assert(n <= LP_MAX_VECTOR_LENGTH);
+   assert(lo_hi < 2);
+
+   for (i = 0; i < n; i += 2) {
+      j = (i / lane_length) * lane_length +
+          lo_hi * (lane_length / 2) + (i % lane_length) / 2;
+
+      elems[i + 0] = lp_build_const_int32(gallivm, 0 + j);
+      elems[i + 1] = lp_build_const_int32(gallivm, n + j);
+   }
+
+   return LLVMConstVector(elems, n);
+}
+
 /**
  * Build shuffle vectors that match PACKxx (SSE) instructions or
  * VPERM (Altivec).
@@ -488,6 +515,15 @@ lp_build_unpack2_native(struct gallivm_state *gallivm,
       /* This has to match the intrinsics in lp_build_pack2_native() */
       *dst_lo = lp_build_interleave2_half(gallivm, src_type, src, msb, 0);
       *dst_hi = lp_build_interleave2_half(gallivm, src_type, src, msb, 1);
+   } else if (src_type.length * src_type.width == 512 &&
+              (dst_type.width == 16 || dst_type.width == 32) &&
+              util_get_cpu_caps()->has_avx512bw) {
+      /* Same, with the four lanes of the AVX-512 pack instructions */
+      LLVMValueRef shuffle;
+      shuffle = lp_build_const_unpack_shuffle_lanes(gallivm, src_type.length, 0);
+      *dst_lo = LLVMBuildShuffleVector(builder, src, msb, shuffle, "");
+      shuffle = lp_build_const_unpack_shuffle_lanes(gallivm, src_type.length, 1);
+      *dst_hi = LLVMBuildShuffleVector(builder, src, msb, shuffle, "");
    } else {
       *dst_lo = lp_build_interleave2(gallivm, src_type, src, msb, 0);
       *dst_hi = lp_build_interleave2(gallivm, src_type, src, msb, 1);
@@ -739,9 +775,28 @@ lp_build_pack2_native(struct gallivm_state *gallivm,
    assert(src_type.width == dst_type.width * 2);
    assert(src_type.length * 2 == dst_type.length);
 
-   /* At this point only have special case for avx2 */
-   if (src_type.length * src_type.width == 256 &&
-       util_get_cpu_caps()->has_avx2) {
+   /* At this point only have special cases for avx2 and avx512 */
+   if (src_type.length * src_type.width == 512 &&
+       util_get_cpu_caps()->has_avx512bw) {
+      switch(src_type.width) {
+      case 32:
+         if (dst_type.sign) {
+            intrinsic = "llvm.x86.avx512.packssdw.512";
+         } else {
+            intrinsic = "llvm.x86.avx512.packusdw.512";
+         }
+         break;
+      case 16:
+         if (dst_type.sign) {
+            intrinsic = "llvm.x86.avx512.packsswb.512";
+         } else {
+            intrinsic = "llvm.x86.avx512.packuswb.512";
+         }
+         break;
+      }
+   }
+   else if (src_type.length * src_type.width == 256 &&
+            util_get_cpu_caps()->has_avx2) {
       switch(src_type.width) {
       case 32:
          if (dst_type.sign) {
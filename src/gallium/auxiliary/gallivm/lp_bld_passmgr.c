@@ -25,6 +25,8 @@
  *
  **************************************************************************/
 
+#include <string.h>
+
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
@@ -53,6 +55,26 @@ struct lp_passmgr {
 struct lp_passmgr;
 #endif
 
+#define LP_NO_OPT_FLAG "lp.no_opt"
+
+void
+lp_passmgr_set_no_opt(LLVMModuleRef module)
+{
+   LLVMContextRef context = LLVMGetModuleContext(module);
+   LLVMValueRef one = LLVMConstInt(LLVMInt32TypeInContext(context), 1, 0);
+
+   LLVMAddModuleFlag(module, LLVMModuleFlagBehaviorOverride,
+                     LP_NO_OPT_FLAG, strlen(LP_NO_OPT_FLAG),
+                     LLVMValueAsMetadata(one));
+}
+
+bool
+lp_passmgr_is_no_opt(LLVMModuleRef module)
+{
+   return LLVMGetModuleFlag(module, LP_NO_OPT_FLAG,
+                            strlen(LP_NO_OPT_FLAG)) != NULL;
+}
+
 bool
 lp_passmgr_create(LLVMModuleRef module, struct lp_passmgr **mgr_p)
 {
@@ -150,7 +172,7 @@ lp_passmgr_run(struct lp_passmgr *mgr,
    LLVMPassBuilderOptionsRef opts = LLVMCreatePassBuilderOptions();
    LLVMRunPasses(module, passes, tm, opts);
 
-   if (!(gallivm_perf & GALLIVM_PERF_NO_OPT))
+   if (!(gallivm_perf & GALLIVM_PERF_NO_OPT) && !lp_passmgr_is_no_opt(module))
 #if LLVM_VERSION_MAJOR >= 18
       strcpy(passes, "sroa,early-cse,simplifycfg,reassociate,mem2reg,instsimplify,instcombine<no-verify-fixpoint>");
 #else
@@ -49,6 +49,14 @@ void lp_passmgr_run(struct lp_passmgr *mgr,
                     const char *module_name);
 void lp_passmgr_dispose(struct lp_passmgr *mgr);
 
+/*
+ * Flag a module so lp_passmgr_run() only runs the minimal passes on it,
+ * as if GALLIVM_PERF=nopt was set.  Only honoured by the new pass manager.
+ */
+void lp_passmgr_set_no_opt(LLVMModuleRef module);
+
+bool lp_passmgr_is_no_opt(LLVMModuleRef module);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2508,6 +2508,62 @@ lp_build_sample_offset(struct lp_build_context *bld,
 }
 
 
+/**
+ * Compute the offset of a pixel in a texture stored in row-major 4x4 blocks.
+ *
+ * Same interface as lp_build_sample_offset().  Only formats with 1x1
+ * pixel blocks can be tiled, so the sub-block coordinates are always zero.
+ */
+void
+lp_build_tiled_4x4_sample_offset(struct lp_build_context *bld,
+                                 const struct util_format_description *format_desc,
+                                 LLVMValueRef x,
+                                 LLVMValueRef y,
+                                 LLVMValueRef z,
+                                 LLVMValueRef y_stride,
+                                 LLVMValueRef z_stride,
+                                 LLVMValueRef *out_offset,
+                                 LLVMValueRef *out_i,
+                                 LLVMValueRef *out_j)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef mask3 = lp_build_const_int_vec(gallivm, bld->type, 3);
+   LLVMValueRef two = lp_build_const_int_vec(gallivm, bld->type, 2);
+   LLVMValueRef bpp = lp_build_const_int_vec(gallivm, bld->type,
+                                             format_desc->block.bits / 8);
+
+   assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+
+   /* Pixel index within the row of blocks:
+    * (x & ~3) * 4 + (y & 3) * 4 + (x & 3)
+    */
+   LLVMValueRef x_lo = LLVMBuildAnd(builder, x, mask3, "");
+   LLVMValueRef x_hi = LLVMBuildSub(builder, x, x_lo, "");
+   LLVMValueRef pixel = LLVMBuildShl(builder, x_hi, two, "");
+   pixel = LLVMBuildOr(builder, pixel, x_lo, "");
+
+   LLVMValueRef offset;
+   if (y && y_stride) {
+      LLVMValueRef y_lo = LLVMBuildAnd(builder, y, mask3, "");
+      LLVMValueRef y_hi = LLVMBuildSub(builder, y, y_lo, "");
+      pixel = LLVMBuildOr(builder, pixel,
+                          LLVMBuildShl(builder, y_lo, two, ""), "");
+      offset = lp_build_mul(bld, pixel, bpp);
+      offset = lp_build_add(bld, offset, lp_build_mul(bld, y_hi, y_stride));
+   } else {
+      offset = lp_build_mul(bld, pixel, bpp);
+   }
+
+   if (z && z_stride) {
+      offset = lp_build_add(bld, offset, lp_build_mul(bld, z, z_stride));
+   }
+
+   *out_offset = offset;
+   *out_i = bld->zero;
+   *out_j = bld->zero;
+}
+
 
 void
 lp_build_tiled_sample_offset(struct lp_build_context *bld,
@@ -221,6 +221,7 @@ struct lp_static_texture_state
    unsigned level_zero_only:1;
    unsigned tiled:1;
    unsigned tiled_samples:5;
+   unsigned tiled_4x4:1;     /**< texels stored in row-major 4x4 blocks */
 };
 
 
@@ -784,6 +785,19 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef *out_j);
 
 
+void
+lp_build_tiled_4x4_sample_offset(struct lp_build_context *bld,
+                                 const struct util_format_description *format_desc,
+                                 LLVMValueRef x,
+                                 LLVMValueRef y,
+                                 LLVMValueRef z,
+                                 LLVMValueRef y_stride,
+                                 LLVMValueRef z_stride,
+                                 LLVMValueRef *out_offset,
+                                 LLVMValueRef *out_i,
+                                 LLVMValueRef *out_j);
+
+
 void
 lp_build_tiled_sample_offset(struct lp_build_context *bld,
                              enum pipe_format format,
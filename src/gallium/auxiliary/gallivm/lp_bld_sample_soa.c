@@ -188,6 +188,11 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
                                    bld->static_texture_state,
                                    x, y, z, width, height, z_stride,
                                    &offset, &i, &j);
+   } else if (bld->static_texture_state->tiled_4x4) {
+      lp_build_tiled_4x4_sample_offset(&bld->int_coord_bld,
+                                       bld->format_desc,
+                                       x, y, z, y_stride, z_stride,
+                                       &offset, &i, &j);
    } else {
       lp_build_sample_offset(&bld->int_coord_bld,
                              bld->format_desc,
@@ -3029,6 +3034,11 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
                                    bld->static_texture_state,
                                    x, y, z, width, height, img_stride_vec,
                                    &offset, &i, &j);
+   } else if (bld->static_texture_state->tiled_4x4) {
+      lp_build_tiled_4x4_sample_offset(int_coord_bld,
+                                       bld->format_desc,
+                                       x, y, z, row_stride_vec, img_stride_vec,
+                                       &offset, &i, &j);
    } else {
       lp_build_sample_offset(int_coord_bld,
                              bld->format_desc,
@@ -3575,6 +3585,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
                     derived_sampler_state.mag_img_filter;
 
       use_aos &= !static_texture_state->tiled;
+      use_aos &= !static_texture_state->tiled_4x4;
 
       if (gallivm_perf & GALLIVM_PERF_NO_AOS_SAMPLING) {
          use_aos = 0;
@@ -4761,6 +4772,11 @@ lp_build_img_op_soa(const struct lp_static_texture_state *static_texture_state,
                                    static_texture_state,
                                    x, y, z, width, height, img_stride_vec,
                                    &offset, &i, &j);
+   } else if (static_texture_state->tiled_4x4) {
+      lp_build_tiled_4x4_sample_offset(&int_coord_bld,
+                                       format_desc,
+                                       x, y, z, row_stride_vec, img_stride_vec,
+                                       &offset, &i, &j);
    } else {
       lp_build_sample_offset(&int_coord_bld,
                              format_desc,
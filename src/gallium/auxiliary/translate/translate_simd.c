@@ -0,0 +1,536 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Portable vertex translation for the common vertex formats.
+ *
+ * Instead of converting vertex by vertex and attribute by attribute
+ * through util_format function pointers like translate_generic, each
+ * attribute is converted for a batch of vertices at a time by a loop
+ * specialized for its input and output format.  The loops are plain C
+ * which the compiler vectorizes for the target (SSE, AVX2, NEON, ...),
+ * so this is also fast on architectures translate_sse doesn't support.
+ *
+ * translate_simd_create() returns NULL for keys with formats it doesn't
+ * have a loop for, and the caller falls back to translate_generic.
+ */
+
+#include "util/u_memory.h"
+#include "util/format/u_format.h"
+#include "util/half_float.h"
+#include "util/u_math.h"
+#include "pipe/p_state.h"
+#include "translate.h"
+
+
+/* Vertices converted per attribute before moving to the next attribute */
+#define TRANSLATE_SIMD_BATCH 64
+
+
+typedef void (*simd_convert_func)(uint8_t *restrict dst, unsigned dst_stride,
+                                  const uint8_t *const *restrict src,
+                                  unsigned count);
+
+struct translate_simd {
+   struct translate translate;
+
+   struct {
+      enum translate_element_type type;
+      simd_convert_func convert;
+
+      unsigned buffer;
+      unsigned input_offset;
+      unsigned instance_divisor;
+      unsigned output_offset;
+      enum pipe_format output_format;
+
+      const uint8_t *input_ptr;
+      unsigned input_stride;
+      unsigned max_index;
+   } attrib[TRANSLATE_MAX_ATTRIBS];
+
+   unsigned nr_attrib;
+};
+
+
+static struct translate_simd *
+translate_simd(struct translate *translate)
+{
+   return (struct translate_simd *)translate;
+}
+
+
+/*
+ * Copies of attributes whose input and output formats match.
+ */
+#define COPY_KERNEL(SIZE)                                                    \
+static void                                                                  \
+copy_##SIZE(uint8_t *restrict dst, unsigned dst_stride,                      \
+            const uint8_t *const *restrict src, unsigned count)              \
+{                                                                            \
+   for (unsigned i = 0; i < count; i++) {                                    \
+      memcpy(dst, src[i], SIZE);                                             \
+      dst += dst_stride;                                                     \
+   }                                                                         \
+}
+
+COPY_KERNEL(1)
+COPY_KERNEL(2)
+COPY_KERNEL(3)
+COPY_KERNEL(4)
+COPY_KERNEL(6)
+COPY_KERNEL(8)
+COPY_KERNEL(12)
+COPY_KERNEL(16)
+
+
+static simd_convert_func
+get_copy_func(unsigned size)
+{
+   switch (size) {
+   case 1: return copy_1;
+   case 2: return copy_2;
+   case 3: return copy_3;
+   case 4: return copy_4;
+   case 6: return copy_6;
+   case 8: return copy_8;
+   case 12: return copy_12;
+   case 16: return copy_16;
+   default: return NULL;
+   }
+}
+
+
+/*
+ * Conversions of NR channels of an array format to OUT_NR 32-bit floats,
+ * OUT_NR being either NR or 4, with missing channels filled from
+ * (0, 0, 0, 1).
+ */
+#define CONVERT_KERNEL(NAME, SRC_TYPE, CONV, NR, OUT_NR)                     \
+static void                                                                  \
+convert_##NAME##_##NR##_##OUT_NR(uint8_t *restrict dst, unsigned dst_stride, \
+                                 const uint8_t *const *restrict src,         \
+                                 unsigned count)                             \
+{                                                                            \
+   for (unsigned i = 0; i < count; i++) {                                    \
+      SRC_TYPE in[NR];                                                       \
+      float out[4] = { 0.0f, 0.0f, 0.0f, 1.0f };                             \
+      memcpy(in, src[i], sizeof(in));                                        \
+      for (unsigned c = 0; c < NR; c++)                                      \
+         out[c] = CONV(in[c]);                                               \
+      memcpy(dst, out, OUT_NR * sizeof(float));                              \
+      dst += dst_stride;                                                     \
+   }                                                                         \
+}
+
+#define CONVERT_KERNELS(NAME, SRC_TYPE, CONV)                                \
+   CONVERT_KERNEL(NAME, SRC_TYPE, CONV, 1, 1)                                \
+   CONVERT_KERNEL(NAME, SRC_TYPE, CONV, 1, 4)                                \
+   CONVERT_KERNEL(NAME, SRC_TYPE, CONV, 2, 2)                                \
+   CONVERT_KERNEL(NAME, SRC_TYPE, CONV, 2, 4)                                \
+   CONVERT_KERNEL(NAME, SRC_TYPE, CONV, 3, 3)                                \
+   CONVERT_KERNEL(NAME, SRC_TYPE, CONV, 3, 4)                                \
+   CONVERT_KERNEL(NAME, SRC_TYPE, CONV, 4, 4)
+
+#define CONV_FLOAT(x)     (x)
+#define CONV_HALF(x)      _mesa_half_to_float(x)
+#define CONV_SCALED(x)    ((float)(x))
+#define CONV_UNORM8(x)    ((float)(x) * (1.0f / 255.0f))
+#define CONV_SNORM8(x)    MAX2((float)(x) * (1.0f / 127.0f), -1.0f)
+#define CONV_UNORM16(x)   ((float)(x) * (1.0f / 65535.0f))
+#define CONV_SNORM16(x)   MAX2((float)(x) * (1.0f / 32767.0f), -1.0f)
+
+CONVERT_KERNELS(float32, float, CONV_FLOAT)
+CONVERT_KERNELS(float16, uint16_t, CONV_HALF)
+CONVERT_KERNELS(unorm8, uint8_t, CONV_UNORM8)
+CONVERT_KERNELS(snorm8, int8_t, CONV_SNORM8)
+CONVERT_KERNELS(uscaled8, uint8_t, CONV_SCALED)
+CONVERT_KERNELS(sscaled8, int8_t, CONV_SCALED)
+CONVERT_KERNELS(unorm16, uint16_t, CONV_UNORM16)
+CONVERT_KERNELS(snorm16, int16_t, CONV_SNORM16)
+CONVERT_KERNELS(uscaled16, uint16_t, CONV_SCALED)
+CONVERT_KERNELS(sscaled16, int16_t, CONV_SCALED)
+
+
+enum simd_channel_type {
+   SIMD_FLOAT32,
+   SIMD_FLOAT16,
+   SIMD_UNORM8,
+   SIMD_SNORM8,
+   SIMD_USCALED8,
+   SIMD_SSCALED8,
+   SIMD_UNORM16,
+   SIMD_SNORM16,
+   SIMD_USCALED16,
+   SIMD_SSCALED16,
+   SIMD_NUM_CHANNEL_TYPES
+};
+
+#define CONVERT_FUNCS(NAME) {                                                \
+   { convert_##NAME##_1_1, convert_##NAME##_1_4 },                           \
+   { convert_##NAME##_2_2, convert_##NAME##_2_4 },                           \
+   { convert_##NAME##_3_3, convert_##NAME##_3_4 },                           \
+   { convert_##NAME##_4_4, convert_##NAME##_4_4 },                           \
+}
+
+/* Indexed by channel type, number of channels - 1 and whether the output
+ * has 4 channels rather than the same number as the input.
+ */
+static const simd_convert_func
+convert_funcs[SIMD_NUM_CHANNEL_TYPES][4][2] = {
+   [SIMD_FLOAT32] = CONVERT_FUNCS(float32),
+   [SIMD_FLOAT16] = CONVERT_FUNCS(float16),
+   [SIMD_UNORM8] = CONVERT_FUNCS(unorm8),
+   [SIMD_SNORM8] = CONVERT_FUNCS(snorm8),
+   [SIMD_USCALED8] = CONVERT_FUNCS(uscaled8),
+   [SIMD_SSCALED8] = CONVERT_FUNCS(sscaled8),
+   [SIMD_UNORM16] = CONVERT_FUNCS(unorm16),
+   [SIMD_SNORM16] = CONVERT_FUNCS(snorm16),
+   [SIMD_USCALED16] = CONVERT_FUNCS(uscaled16),
+   [SIMD_SSCALED16] = CONVERT_FUNCS(sscaled16),
+};
+
+
+/* D3DCOLOR style colors */
+static void
+convert_bgra8_unorm_4_4(uint8_t *restrict dst, unsigned dst_stride,
+                        const uint8_t *const *restrict src, unsigned count)
+{
+   for (unsigned i = 0; i < count; i++) {
+      const uint8_t *in = src[i];
+      float out[4];
+      out[0] = CONV_UNORM8(in[2]);
+      out[1] = CONV_UNORM8(in[1]);
+      out[2] = CONV_UNORM8(in[0]);
+      out[3] = CONV_UNORM8(in[3]);
+      memcpy(dst, out, sizeof(out));
+      dst += dst_stride;
+   }
+}
+
+
+static int
+get_channel_type(const struct util_format_description *desc)
+{
+   const struct util_format_channel_description *chan = &desc->channel[0];
+
+   if (chan->pure_integer)
+      return -1;
+
+   switch (chan->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (chan->size == 32)
+         return SIMD_FLOAT32;
+      if (chan->size == 16)
+         return SIMD_FLOAT16;
+      return -1;
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+      if (chan->size == 8)
+         return chan->normalized ? SIMD_UNORM8 : SIMD_USCALED8;
+      if (chan->size == 16)
+         return chan->normalized ? SIMD_UNORM16 : SIMD_USCALED16;
+      return -1;
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (chan->size == 8)
+         return chan->normalized ? SIMD_SNORM8 : SIMD_SSCALED8;
+      if (chan->size == 16)
+         return chan->normalized ? SIMD_SNORM16 : SIMD_SSCALED16;
+      return -1;
+   default:
+      return -1;
+   }
+}
+
+
+/**
+ * Number of channels of R32[G32[B32[A32]]]_FLOAT formats, 0 otherwise.
+ */
+static unsigned
+get_float_output_channels(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT: return 1;
+   case PIPE_FORMAT_R32G32_FLOAT: return 2;
+   case PIPE_FORMAT_R32G32B32_FLOAT: return 3;
+   case PIPE_FORMAT_R32G32B32A32_FLOAT: return 4;
+   default: return 0;
+   }
+}
+
+
+static simd_convert_func
+get_convert_func(enum pipe_format input_format, enum pipe_format output_format)
+{
+   const struct util_format_description *desc =
+      util_format_description(input_format);
+
+   if (input_format == output_format &&
+       desc->block.width == 1 && desc->block.height == 1 &&
+       !(desc->block.bits & 7))
+      return get_copy_func(desc->block.bits >> 3);
+
+   const unsigned out_nr = get_float_output_channels(output_format);
+   if (!out_nr)
+      return NULL;
+
+   if (input_format == PIPE_FORMAT_B8G8R8A8_UNORM && out_nr == 4)
+      return convert_bgra8_unorm_4_4;
+
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN || !desc->is_array ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB)
+      return NULL;
+
+   const unsigned nr = desc->nr_channels;
+   if (out_nr != nr && out_nr != 4)
+      return NULL;
+
+   for (unsigned c = 0; c < nr; c++) {
+      if (desc->swizzle[c] != PIPE_SWIZZLE_X + c)
+         return NULL;
+   }
+
+   const int type = get_channel_type(desc);
+   if (type < 0)
+      return NULL;
+
+   return convert_funcs[type][nr - 1][out_nr == 4 && nr != 4];
+}
+
+
+static ALWAYS_INLINE void
+simd_emit_instance_id(uint8_t *dst, unsigned dst_stride,
+                      enum pipe_format output_format,
+                      unsigned instance_id, unsigned count)
+{
+   uint32_t value = instance_id;
+
+   if (output_format == PIPE_FORMAT_R32_FLOAT) {
+      float f = (float)instance_id;
+      memcpy(&value, &f, sizeof(value));
+   }
+
+   for (unsigned i = 0; i < count; i++) {
+      memcpy(dst, &value, sizeof(value));
+      dst += dst_stride;
+   }
+}
+
+
+static ALWAYS_INLINE void
+simd_run_batch(struct translate_simd *ts,
+               const void *elts,
+               unsigned index_size,
+               unsigned start,
+               unsigned count,
+               unsigned start_instance,
+               unsigned instance_id,
+               uint8_t *vert)
+{
+   const unsigned output_stride = ts->translate.key.output_stride;
+   const uint8_t *src[TRANSLATE_SIMD_BATCH];
+
+   for (unsigned attr = 0; attr < ts->nr_attrib; attr++) {
+      uint8_t *dst = vert + ts->attrib[attr].output_offset;
+      const uint8_t *input_ptr = ts->attrib[attr].input_ptr;
+      const unsigned input_stride = ts->attrib[attr].input_stride;
+      const unsigned max_index = ts->attrib[attr].max_index;
+      unsigned i;
+
+      if (ts->attrib[attr].type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         simd_emit_instance_id(dst, output_stride,
+                               ts->attrib[attr].output_format,
+                               instance_id, count);
+         continue;
+      }
+
+      if (ts->attrib[attr].instance_divisor) {
+         unsigned index = start_instance +
+                          instance_id / ts->attrib[attr].instance_divisor;
+         const uint8_t *ptr = input_ptr + (ptrdiff_t)input_stride * index;
+
+         for (i = 0; i < count; i++)
+            src[i] = ptr;
+      } else {
+         switch (index_size) {
+         case 0:
+            /* clamp to avoid going out of bounds, like translate_sse */
+            for (i = 0; i < count; i++) {
+               unsigned index = MIN2(start + i, max_index);
+               src[i] = input_ptr + (ptrdiff_t)input_stride * index;
+            }
+            break;
+         case 1:
+            for (i = 0; i < count; i++) {
+               unsigned index = MIN2(((const uint8_t *)elts)[i], max_index);
+               src[i] = input_ptr + (ptrdiff_t)input_stride * index;
+            }
+            break;
+         case 2:
+            for (i = 0; i < count; i++) {
+               unsigned index = MIN2(((const uint16_t *)elts)[i], max_index);
+               src[i] = input_ptr + (ptrdiff_t)input_stride * index;
+            }
+            break;
+         default:
+            for (i = 0; i < count; i++) {
+               unsigned index = MIN2(((const uint32_t *)elts)[i], max_index);
+               src[i] = input_ptr + (ptrdiff_t)input_stride * index;
+            }
+            break;
+         }
+      }
+
+      ts->attrib[attr].convert(dst, output_stride, src, count);
+   }
+}
+
+
+static ALWAYS_INLINE void
+simd_run(struct translate_simd *ts,
+         const void *elts,
+         unsigned index_size,
+         unsigned start,
+         unsigned count,
+         unsigned start_instance,
+         unsigned instance_id,
+         void *output_buffer)
+{
+   const unsigned output_stride = ts->translate.key.output_stride;
+   uint8_t *vert = output_buffer;
+
+   for (unsigned first = 0; first < count; first += TRANSLATE_SIMD_BATCH) {
+      simd_run_batch(ts, (const uint8_t *)elts + first * index_size,
+                     index_size, start + first,
+                     MIN2(count - first, TRANSLATE_SIMD_BATCH),
+                     start_instance, instance_id,
+                     vert + (size_t)first * output_stride);
+   }
+}
+
+
+static void UTIL_CDECL
+simd_run_elts(struct translate *translate,
+              const unsigned *elts,
+              unsigned count,
+              unsigned start_instance,
+              unsigned instance_id,
+              void *output_buffer)
+{
+   simd_run(translate_simd(translate), elts, 4, 0, count,
+            start_instance, instance_id, output_buffer);
+}
+
+static void UTIL_CDECL
+simd_run_elts16(struct translate *translate,
+                const uint16_t *elts,
+                unsigned count,
+                unsigned start_instance,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   simd_run(translate_simd(translate), elts, 2, 0, count,
+            start_instance, instance_id, output_buffer);
+}
+
+static void UTIL_CDECL
+simd_run_elts8(struct translate *translate,
+               const uint8_t *elts,
+               unsigned count,
+               unsigned start_instance,
+               unsigned instance_id,
+               void *output_buffer)
+{
+   simd_run(translate_simd(translate), elts, 1, 0, count,
+            start_instance, instance_id, output_buffer);
+}
+
+static void UTIL_CDECL
+simd_run_linear(struct translate *translate,
+                unsigned start,
+                unsigned count,
+                unsigned start_instance,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   simd_run(translate_simd(translate), NULL, 0, start, count,
+            start_instance, instance_id, output_buffer);
+}
+
+
+static void
+simd_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_simd *ts = translate_simd(translate);
+
+   for (unsigned i = 0; i < ts->nr_attrib; i++) {
+      if (ts->attrib[i].buffer == buf) {
+         ts->attrib[i].input_ptr = ((const uint8_t *)ptr +
+                                    ts->attrib[i].input_offset);
+         ts->attrib[i].input_stride = stride;
+         ts->attrib[i].max_index = max_index;
+      }
+   }
+}
+
+
+static void
+simd_release(struct translate *translate)
+{
+   FREE(translate);
+}
+
+
+struct translate *
+translate_simd_create(const struct translate_key *key)
+{
+   struct translate_simd *ts = CALLOC_STRUCT(translate_simd);
+   if (!ts)
+      return NULL;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   ts->translate.key = *key;
+   ts->translate.release = simd_release;
+   ts->translate.set_buffer = simd_set_buffer;
+   ts->translate.run_elts = simd_run_elts;
+   ts->translate.run_elts16 = simd_run_elts16;
+   ts->translate.run_elts8 = simd_run_elts8;
+   ts->translate.run = simd_run_linear;
+
+   for (unsigned i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *element = &key->element[i];
+
+      ts->attrib[i].type = element->type;
+      ts->attrib[i].buffer = element->input_buffer;
+      ts->attrib[i].input_offset = element->input_offset;
+      ts->attrib[i].instance_divisor = element->instance_divisor;
+      ts->attrib[i].output_offset = element->output_offset;
+      ts->attrib[i].output_format = element->output_format;
+
+      if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         if (element->output_format != PIPE_FORMAT_R32_USCALED &&
+             element->output_format != PIPE_FORMAT_R32_SSCALED &&
+             element->output_format != PIPE_FORMAT_R32_FLOAT)
+            goto fail;
+         continue;
+      }
+
+      ts->attrib[i].convert = get_convert_func(element->input_format,
+                                               element->output_format);
+      if (!ts->attrib[i].convert)
+         goto fail;
+   }
+
+   ts->nr_attrib = key->nr_elements;
+
+   return &ts->translate;
+
+fail:
+   FREE(ts);
+   return NULL;
+}
@@ -0,0 +1,339 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Vertex translation by the translate_simd and translate_sse backends,
+ * compared with translate_generic.
+ *
+ * A few vertex layouts which translate_simd has loops for are translated
+ * from random data, for linear runs, including ones reaching past the
+ * buffer's max index, and for 8, 16 and 32-bit indices, some of which are
+ * out of bounds.  All backends must write the same vertices as
+ * translate_generic.  With -v, the time per vertex of each backend is
+ * printed too.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "translate/translate.h"
+#include "util/format/u_format.h"
+#include "util/os_time.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+
+#define NUM_VERTICES 4096
+#define NUM_INSTANCES 8
+#define NUM_RUNS 8
+#define VERTEX_STRIDE 64
+#define INSTANCE_STRIDE 16
+#define MAX_OUTPUT_STRIDE (TRANSLATE_MAX_ATTRIBS * 16)
+
+
+struct translate_layout {
+   const char *name;
+   unsigned nr_elements;
+   struct {
+      enum translate_element_type type;
+      enum pipe_format input_format;
+      enum pipe_format output_format;
+      unsigned input_buffer;
+      unsigned input_offset;
+      unsigned instance_divisor;
+   } element[8];
+};
+
+
+static const struct translate_layout layouts[] = {
+   {
+      "float", 3, {
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R32G32B32_FLOAT,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 0, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R32G32B32_FLOAT,
+           PIPE_FORMAT_R32G32B32_FLOAT, 0, 12, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R32G32_FLOAT,
+           PIPE_FORMAT_R32G32_FLOAT, 0, 24, 0 },
+      },
+   },
+   {
+      "packed", 8, {
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R16G16B16A16_FLOAT,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 0, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R8G8B8A8_UNORM,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 8, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_B8G8R8A8_UNORM,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 12, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R8G8B8A8_SNORM,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 16, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R16G16_SNORM,
+           PIPE_FORMAT_R32G32_FLOAT, 0, 20, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R16G16B16A16_UNORM,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 24, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R8G8B8_USCALED,
+           PIPE_FORMAT_R32G32B32_FLOAT, 0, 32, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R16_SSCALED,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 36, 0 },
+      },
+   },
+   {
+      "instanced", 4, {
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R32G32B32A32_FLOAT,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 0, 0, 0 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R8G8B8A8_UNORM,
+           PIPE_FORMAT_R32G32B32A32_FLOAT, 1, 0, 1 },
+         { TRANSLATE_ELEMENT_NORMAL, PIPE_FORMAT_R16G16_FLOAT,
+           PIPE_FORMAT_R32G32_FLOAT, 1, 4, 2 },
+         { TRANSLATE_ELEMENT_INSTANCE_ID, PIPE_FORMAT_R32_FLOAT,
+           PIPE_FORMAT_R32_FLOAT, 0, 0, 0 },
+      },
+   },
+};
+
+
+enum translate_run {
+   RUN_LINEAR,
+   RUN_ELTS8,
+   RUN_ELTS16,
+   RUN_ELTS32,
+   RUN_CLAMPED_LINEAR,   /* linear, as 32-bit indices */
+};
+
+static const char *run_names[] = {
+   "linear", "elts8", "elts16", "elts32",
+};
+
+
+struct translate_test_data {
+   uint8_t *vertices;
+   uint8_t *instances;
+   uint8_t *elts8;
+   uint16_t *elts16;
+   uint32_t *elts32;
+   uint32_t *clamped_linear;
+};
+
+
+static void
+init_key(struct translate_key *key, const struct translate_layout *layout)
+{
+   unsigned offset = 0;
+
+   memset(key, 0, sizeof(*key));
+
+   for (unsigned i = 0; i < layout->nr_elements; i++) {
+      struct translate_element *element = &key->element[i];
+
+      element->type = layout->element[i].type;
+      element->input_format = layout->element[i].input_format;
+      element->output_format = layout->element[i].output_format;
+      element->input_buffer = layout->element[i].input_buffer;
+      element->input_offset = layout->element[i].input_offset;
+      element->instance_divisor = layout->element[i].instance_divisor;
+      element->output_offset = offset;
+
+      offset += util_format_get_blocksize(element->output_format);
+   }
+
+   key->nr_elements = layout->nr_elements;
+   key->output_stride = offset;
+}
+
+
+static void
+run_translate(struct translate *translate, const struct translate_test_data *data,
+              enum translate_run run, unsigned start, unsigned count,
+              void *out)
+{
+   translate->set_buffer(translate, 0, data->vertices, VERTEX_STRIDE,
+                         NUM_VERTICES - 1);
+   translate->set_buffer(translate, 1, data->instances, INSTANCE_STRIDE,
+                         NUM_INSTANCES - 1);
+
+   /* start_instance 1, instance_id 3 */
+   switch (run) {
+   case RUN_LINEAR:
+      translate->run(translate, start, count, 1, 3, out);
+      break;
+   case RUN_ELTS8:
+      translate->run_elts8(translate, data->elts8 + start, count, 1, 3, out);
+      break;
+   case RUN_ELTS16:
+      translate->run_elts16(translate, data->elts16 + start, count, 1, 3, out);
+      break;
+   case RUN_ELTS32:
+      translate->run_elts(translate, data->elts32 + start, count, 1, 3, out);
+      break;
+   case RUN_CLAMPED_LINEAR:
+      translate->run_elts(translate, data->clamped_linear + start, count, 1, 3,
+                          out);
+      break;
+   }
+}
+
+
+/**
+ * Compare dwords, any NaN matching any other, since the random input
+ * data has NaNs which the backends may canonicalize differently.
+ */
+static bool
+compare_vertices(const uint32_t *res, const uint32_t *ref, unsigned size)
+{
+   for (unsigned i = 0; i < size / 4; i++) {
+      if (res[i] != ref[i] &&
+          !(isnan(uif(res[i])) && isnan(uif(ref[i]))))
+         return false;
+   }
+
+   return true;
+}
+
+
+static bool
+test_translate(bool verbose,
+               const struct translate_layout *layout,
+               const struct translate_test_data *data,
+               uint8_t *out, uint8_t *expected)
+{
+   struct translate_key key;
+   bool success = true;
+
+   init_key(&key, layout);
+
+   struct translate *backends[3] = {
+      translate_generic_create(&key),
+      translate_simd_create(&key),
+      translate_sse2_create(&key),
+   };
+   static const char *backend_names[3] = { "generic", "simd", "sse2" };
+
+   if (!backends[0] || !backends[1]) {
+      printf("%s: no %s backend\n", layout->name,
+             backends[0] ? "simd" : "generic");
+      success = false;
+      goto out;
+   }
+
+   for (unsigned run = RUN_LINEAR; run <= RUN_ELTS32; run++) {
+      /* In bounds, and past the last vertex for linear runs or with out of
+       * bounds indices for the others.
+       */
+      static const unsigned ranges[][2] = {
+         { 100, 1000 },
+         { NUM_VERTICES - 100, 300 },
+      };
+
+      for (unsigned b = 1; b < ARRAY_SIZE(backends); b++) {
+         bool match = true;
+
+         if (!backends[b])
+            continue;
+
+         for (unsigned r = 0; r < ARRAY_SIZE(ranges); r++) {
+            const unsigned size = ranges[r][1] * key.output_stride;
+
+            memset(expected, 0xcd, size);
+            memset(out, 0xcd, size);
+            /* translate_generic doesn't clamp linear runs, so give it the
+             * clamped indices instead.
+             */
+            run_translate(backends[0], data,
+                          run == RUN_LINEAR ? RUN_CLAMPED_LINEAR : run,
+                          ranges[r][0], ranges[r][1], expected);
+            run_translate(backends[b], data, run, ranges[r][0], ranges[r][1],
+                          out);
+            match = match && compare_vertices((const uint32_t *)out,
+                                              (const uint32_t *)expected,
+                                              size);
+         }
+
+         if (!match) {
+            printf("%s %s %s: FAIL\n", backend_names[b], layout->name,
+                   run_names[run]);
+         }
+
+         success = success && match;
+      }
+
+      for (unsigned b = 0; verbose && b < ARRAY_SIZE(backends); b++) {
+         int64_t best = INT64_MAX;
+
+         if (!backends[b])
+            continue;
+
+         for (unsigned i = 0; i < NUM_RUNS; i++) {
+            int64_t start = os_time_get_nano();
+            run_translate(backends[b], data, run, 0, NUM_VERTICES, out);
+            best = MIN2(best, os_time_get_nano() - start);
+         }
+
+         printf("%s %s %s: %.2f ns/vertex\n", backend_names[b],
+                layout->name, run_names[run], (double)best / NUM_VERTICES);
+      }
+   }
+
+out:
+   for (unsigned b = 0; b < ARRAY_SIZE(backends); b++) {
+      if (backends[b])
+         backends[b]->release(backends[b]);
+   }
+
+   return success;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+   const unsigned num_elts = NUM_VERTICES + 300;
+   struct translate_test_data data = {
+      .vertices = MALLOC(NUM_VERTICES * VERTEX_STRIDE),
+      .instances = MALLOC(NUM_INSTANCES * INSTANCE_STRIDE),
+      .elts8 = MALLOC(num_elts * sizeof(uint8_t)),
+      .elts16 = MALLOC(num_elts * sizeof(uint16_t)),
+      .elts32 = MALLOC(num_elts * sizeof(uint32_t)),
+      .clamped_linear = MALLOC(num_elts * sizeof(uint32_t)),
+   };
+   uint8_t *out = MALLOC(NUM_VERTICES * MAX_OUTPUT_STRIDE);
+   uint8_t *expected = MALLOC(NUM_VERTICES * MAX_OUTPUT_STRIDE);
+   bool success = true;
+
+   srand(0x7a5e);
+
+   for (unsigned i = 0; i < NUM_VERTICES * VERTEX_STRIDE; i++)
+      data.vertices[i] = rand();
+   for (unsigned i = 0; i < NUM_INSTANCES * INSTANCE_STRIDE; i++)
+      data.instances[i] = rand();
+
+   /* Random indices, every 37th out of bounds, except for 8-bit ones */
+   for (unsigned i = 0; i < num_elts; i++) {
+      uint32_t index = rand() % NUM_VERTICES;
+
+      data.elts8[i] = index;
+      data.elts16[i] = i % 37 == 0 ? 0xffff : index;
+      data.elts32[i] = i % 37 == 0 ? NUM_VERTICES + i : index;
+      data.clamped_linear[i] = MIN2(i, NUM_VERTICES - 1);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(layouts); i++) {
+      success = test_translate(verbose, &layouts[i], &data,
+                               out, expected) && success;
+   }
+
+   FREE(data.vertices);
+   FREE(data.instances);
+   FREE(data.elts8);
+   FREE(data.elts16);
+   FREE(data.elts32);
+   FREE(data.clamped_linear);
+   FREE(out);
+   FREE(expected);
+
+   return success ? 0 : 1;
+}
@@ -230,10 +230,15 @@ util_sse2_premul_blend_epi16( __m128i a, __m128i d, __m128i s)
 /* Apply premultiplied-alpha blending on four pixels in packed BGRA
  * format (one/inv_src_alpha blend mode).
  *
+ * d * a / 255 is approximated as (d * a) >> 8, so results can be up to
+ * 2 above the exactly rounded blend (UTIL_SSE2_BLEND_PREMUL_ERROR).
+ *
  * src    -- four pixels (bgra8 format)
  * dst    -- four destination pixels (bgra8)
  * return -- blended pixels (bgra8)
  */
+#define UTIL_SSE2_BLEND_PREMUL_ERROR 2
+
 static ALWAYS_INLINE __m128i
 util_sse2_blend_premul_4(const __m128i src,
                          const __m128i dst)
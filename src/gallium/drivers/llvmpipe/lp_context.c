@@ -32,6 +32,8 @@
 
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_init.h"
 #include "pipe/p_defines.h"
 #include "util/u_inlines.h"
 #include "util/u_math.h"
@@ -40,6 +42,7 @@
 #include "util/u_upload_mgr.h"
 #include "lp_clear.h"
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
 #include "lp_perf.h"
 #include "lp_state.h"
@@ -61,6 +64,14 @@ llvmpipe_destroy(struct pipe_context *pipe)
    mtx_unlock(&lp_screen->ctx_mutex);
    lp_print_counters();
 
+   if (util_queue_is_initialized(&llvmpipe->compile_queue)) {
+      util_queue_finish(&llvmpipe->compile_queue);
+      if (LP_DEBUG & DEBUG_COUNTERS)
+         debug_printf("llvmpipe: nr_fs_fallback_draws:         %9"PRIu64"\n",
+                      llvmpipe->nr_fs_fallback_draws);
+   }
+   lp_fs_variant_reference(llvmpipe, &llvmpipe->fs_fallback, NULL);
+
    if (llvmpipe->csctx) {
       lp_csctx_destroy(llvmpipe->csctx);
    }
@@ -107,6 +118,9 @@ llvmpipe_destroy(struct pipe_context *pipe)
 
    llvmpipe_sampler_matrix_destroy(llvmpipe);
 
+   if (util_queue_is_initialized(&llvmpipe->compile_queue))
+      util_queue_destroy(&llvmpipe->compile_queue);
+
    lp_context_destroy(&llvmpipe->context);
 
    align_free(llvmpipe);
@@ -274,6 +288,21 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context.ref)
       goto fail;
 
+   /* Compile shader variants in the background, running unoptimized
+    * variants meanwhile, to avoid stalls on first use.  With tiering only
+    * variants which are used often get the optimized compile.
+    */
+   if (gallivm_get_perf_flags() & GALLIVM_PERF_TIERED)
+      llvmpipe->tier_up_threshold = gallivm_tier_up_threshold;
+   else if (debug_get_bool_option("LP_ASYNC_FS_COMPILE", false))
+      llvmpipe->tier_up_threshold = 1;
+
+   if (llvmpipe->tier_up_threshold &&
+       !util_queue_init(&llvmpipe->compile_queue, "lpcompile", 64, 1,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY, NULL))
+      goto fail;
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -35,9 +35,11 @@
 
 #include "draw/draw_vertex.h"
 #include "util/u_blitter.h"
+#include "util/u_queue.h"
 
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
+#include "lp_perf.h"
 #include "lp_texture_handle.h"
 #include "lp_setup.h"
 #include "lp_state_fs.h"
@@ -80,6 +82,14 @@ struct llvmpipe_context {
 
    struct lp_sampler_matrix sampler_matrix;
 
+   /**
+    * Set while shaders launched by this context may still be running.
+    * Texture handles can be used by any context, so such shaders may be
+    * looking up functions in the sampler matrix of another one.  See
+    * llvmpipe_clear_sample_functions_cache().
+    */
+   uint32_t shaders_busy;
+
    /** Other rendering state */
    unsigned sample_mask;
    unsigned min_samples;
@@ -113,6 +123,9 @@ struct llvmpipe_context {
    struct pipe_query_data_pipeline_statistics pipeline_statistics;
    unsigned active_statistics_queries;
 
+   /** Totals of enum lp_stat, for the driver-specific queries */
+   uint64_t stats[LP_STAT_COUNT];
+
    unsigned active_occlusion_queries;
 
    unsigned active_primgen_queries;
@@ -167,6 +180,17 @@ struct llvmpipe_context {
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Background compilation of optimized shader variants, only
+    * initialized with LP_ASYNC_FS_COMPILE or GALLIVM_PERF=tiered.
+    */
+   struct util_queue compile_queue;
+   /** Invocations of an unoptimized variant before it is recompiled */
+   unsigned tier_up_threshold;
+   /** Bound fragment shader variant, if it is an unoptimized fallback */
+   struct lp_fragment_shader_variant *fs_fallback;
+   /** Number of draws which ran on fallback fragment shader variants */
+   uint64_t nr_fs_fallback_draws;
+
    bool permit_linear_rasterizer;
    bool single_vp;
 
@@ -218,5 +242,18 @@ llvmpipe_context(struct pipe_context *pipe)
    return (struct llvmpipe_context *)pipe;
 }
 
+
+/**
+ * Called before launching shaders.  The exchange orders the store before
+ * the shaders' function cache lookups, so a context freeing old caches
+ * either sees the flag or the shaders only see the new caches.
+ */
+static inline void
+llvmpipe_mark_shaders_busy(struct llvmpipe_context *llvmpipe)
+{
+   if (!llvmpipe->shaders_busy)
+      p_atomic_xchg(&llvmpipe->shaders_busy, 1);
+}
+
 #endif /* LP_CONTEXT_H */
 
@@ -0,0 +1,205 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/bitscan.h"
+#include "util/os_file.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "lp_cpu_topology.h"
+
+#if DETECT_OS_LINUX
+#include <limits.h>
+#endif
+
+
+static unsigned
+mask_count(const util_affinity_mask mask)
+{
+   unsigned count = 0;
+   for (unsigned i = 0; i < UTIL_MAX_CPUS / 32; i++)
+      count += util_bitcount(mask[i]);
+   return count;
+}
+
+
+#if DETECT_OS_LINUX
+/**
+ * Parse a sysfs CPU list such as "0-15,32-47" into an affinity mask.
+ */
+static bool
+read_cpu_list(const char *path, util_affinity_mask mask)
+{
+   char *list = os_read_file(path, NULL);
+   if (!list)
+      return false;
+
+   memset(mask, 0, sizeof(util_affinity_mask));
+
+   const char *p = list;
+   bool ok = true;
+   while (*p && *p != '\n') {
+      char *end;
+      unsigned long first = strtoul(p, &end, 10);
+      unsigned long last = first;
+      if (end == p) {
+         ok = false;
+         break;
+      }
+      p = end;
+      if (*p == '-') {
+         last = strtoul(p + 1, &end, 10);
+         if (end == p + 1) {
+            ok = false;
+            break;
+         }
+         p = end;
+      }
+      for (unsigned long cpu = first; cpu <= last && cpu < UTIL_MAX_CPUS; cpu++)
+         mask[cpu / 32] |= 1u << (cpu % 32);
+      if (*p == ',')
+         p++;
+   }
+
+   free(list);
+   return ok && mask_count(mask) > 0;
+}
+
+
+/**
+ * Get the CPUs sharing a NUMA node or package with the calling thread.
+ */
+static bool
+get_policy_mask(enum lp_thread_policy policy, util_affinity_mask mask)
+{
+   char path[PATH_MAX];
+   int cpu = util_get_current_cpu();
+
+   if (cpu < 0 || cpu >= UTIL_MAX_CPUS)
+      return false;
+
+   if (policy == LP_THREAD_POLICY_SOCKET) {
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu%d/topology/package_cpus_list",
+               cpu);
+      if (read_cpu_list(path, mask))
+         return true;
+
+      /* Older kernels only have the deprecated name. */
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu%d/topology/core_siblings_list",
+               cpu);
+      return read_cpu_list(path, mask);
+   }
+
+   util_affinity_mask nodes;
+   if (!read_cpu_list("/sys/devices/system/node/possible", nodes))
+      return false;
+
+   for (unsigned node = 0; node < UTIL_MAX_CPUS; node++) {
+      if (!(nodes[node / 32] & (1u << (node % 32))))
+         continue;
+
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/node/node%u/cpulist", node);
+      if (read_cpu_list(path, mask) &&
+          (mask[cpu / 32] & (1u << (cpu % 32))))
+         return true;
+   }
+
+   return false;
+}
+#endif
+
+
+void
+lp_cpu_topology_init(struct lp_cpu_topology *topo)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+   const char *policy = debug_get_option("LP_THREAD_POLICY", "all");
+   util_affinity_mask allowed;
+
+   memset(topo, 0, sizeof *topo);
+   memset(allowed, 0xff, sizeof allowed);
+
+   topo->num_cpus = MAX2(caps->nr_cpus, 1);
+
+   if (!strcmp(policy, "node")) {
+      topo->policy = LP_THREAD_POLICY_NODE;
+   } else if (!strcmp(policy, "socket")) {
+      topo->policy = LP_THREAD_POLICY_SOCKET;
+   } else if (strcmp(policy, "all")) {
+      debug_printf("llvmpipe: unknown LP_THREAD_POLICY \"%s\"\n", policy);
+   }
+
+   if (topo->policy != LP_THREAD_POLICY_ALL) {
+      bool found = false;
+#if DETECT_OS_LINUX
+      found = get_policy_mask(topo->policy, allowed);
+#endif
+      if (found) {
+         topo->num_cpus = MIN2(mask_count(allowed), topo->num_cpus);
+      } else {
+         debug_printf("llvmpipe: LP_THREAD_POLICY=%s unavailable, "
+                      "using all CPUs\n", policy);
+         topo->policy = LP_THREAD_POLICY_ALL;
+         memset(allowed, 0xff, sizeof allowed);
+      }
+   }
+
+   /* One domain per L3 cache that has at least one allowed CPU. */
+   unsigned num_L3 = caps->L3_affinity_mask ? caps->num_L3_caches : 1;
+   topo->domain_mask = CALLOC(MAX2(num_L3, 1), sizeof(util_affinity_mask));
+   if (!topo->domain_mask)
+      return;
+
+   for (unsigned i = 0; i < num_L3; i++) {
+      uint32_t *dst = topo->domain_mask[topo->num_domains];
+
+      for (unsigned j = 0; j < UTIL_MAX_CPUS / 32; j++) {
+         dst[j] = allowed[j];
+         if (caps->L3_affinity_mask)
+            dst[j] &= caps->L3_affinity_mask[i][j];
+      }
+      if (mask_count(dst))
+         topo->num_domains++;
+   }
+
+   /* Only pin when asked to, pinning by default hasn't been shown to help
+    * and would take the placement away from the OS on every multi-L3 host.
+    */
+   topo->pin = topo->num_domains && topo->policy != LP_THREAD_POLICY_ALL;
+}
+
+
+void
+lp_cpu_topology_fini(struct lp_cpu_topology *topo)
+{
+   FREE(topo->domain_mask);
+   topo->domain_mask = NULL;
+   topo->num_domains = 0;
+}
+
+
+/**
+ * Pin worker \p index of \p count to a cache domain.  Workers are assigned
+ * in contiguous blocks so that consecutive workers share a cache.
+ */
+void
+lp_cpu_topology_pin_thread(const struct lp_cpu_topology *topo,
+                           thrd_t thread, unsigned index, unsigned count)
+{
+   if (!topo || !topo->pin || !count)
+      return;
+
+   unsigned domain = index * topo->num_domains / count;
+
+   util_set_thread_affinity(thread, topo->domain_mask[domain], NULL,
+                            util_get_cpu_caps()->num_cpu_mask_bits);
+}
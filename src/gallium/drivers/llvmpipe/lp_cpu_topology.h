@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/* CPU placement of the rasterizer and compute worker threads.
+ *
+ * The LP_THREAD_POLICY environment variable selects which CPUs llvmpipe
+ * may use:
+ *
+ *   all     every CPU in the system (default)
+ *   node    only the NUMA node of the thread creating the screen
+ *   socket  only the CPU package of the thread creating the screen
+ *
+ * With node or socket, worker threads are pinned to the L3 cache domains
+ * of the chosen set reported by util_cpu_caps, in contiguous blocks, so that
+ * neighbouring workers share a cache and the load is spread evenly across
+ * domains.  With all, scheduling is left to the OS as it always was.  Since
+ * scene data is allocated and first touched by the binning thread,
+ * confining the workers to that thread's node keeps scene memory
+ * node-local without an explicit NUMA allocator.
+ */
+#ifndef LP_CPU_TOPOLOGY_H
+#define LP_CPU_TOPOLOGY_H
+
+#include "util/u_cpu_detect.h"
+#include "util/u_thread.h"
+
+
+enum lp_thread_policy {
+   LP_THREAD_POLICY_ALL,
+   LP_THREAD_POLICY_NODE,
+   LP_THREAD_POLICY_SOCKET,
+};
+
+
+struct lp_cpu_topology {
+   enum lp_thread_policy policy;
+
+   /** Number of CPUs usable under the policy */
+   unsigned num_cpus;
+
+   /** Cache domains worker threads are spread across */
+   unsigned num_domains;
+   util_affinity_mask *domain_mask;
+
+   /** Whether worker threads should be pinned at all */
+   bool pin;
+};
+
+
+void
+lp_cpu_topology_init(struct lp_cpu_topology *topo);
+
+void
+lp_cpu_topology_fini(struct lp_cpu_topology *topo);
+
+void
+lp_cpu_topology_pin_thread(const struct lp_cpu_topology *topo,
+                           thrd_t thread, unsigned index, unsigned count);
+
+
+#endif /* LP_CPU_TOPOLOGY_H */
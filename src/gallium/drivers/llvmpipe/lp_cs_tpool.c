@@ -29,8 +29,40 @@
  */
 
 #include "util/u_thread.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
+#include "lp_cpu_topology.h"
+
+/**
+ * Claim the next chunk of iterations of a task, returns false once all
+ * of them were claimed.
+ *
+ * Chunks are a share of the iterations which are left, so the threads
+ * make few trips to the counter while there is a lot of work and get
+ * single iterations at the end, finishing together.
+ */
+static bool
+lp_cs_tpool_claim(struct lp_cs_tpool_task *task, unsigned num_threads,
+                  unsigned *iter_start, unsigned *iter_count)
+{
+   unsigned next = p_atomic_read(&task->iter_next);
+
+   if (next >= task->iter_total)
+      return false;
+
+   unsigned chunk = CLAMP((task->iter_total - next) / (2 * num_threads),
+                          1, LP_CS_TPOOL_MAX_CHUNK);
+
+   next = p_atomic_fetch_add(&task->iter_next, chunk);
+   if (next >= task->iter_total)
+      return false;
+
+   *iter_start = next;
+   *iter_count = MIN2(chunk, task->iter_total - next);
+   return true;
+}
 
 static int
 lp_cs_tpool_worker(void *data)
@@ -43,7 +75,7 @@ lp_cs_tpool_worker(void *data)
 
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
+      unsigned iter_start, iter_count, iter_done = 0;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -53,29 +85,23 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
+      task->num_workers++;
+      mtx_unlock(&pool->m);
 
-      unsigned this_iter = task->iter_start;
-
-      iter_per_thread = task->iter_per_thread;
-
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
+      while (lp_cs_tpool_claim(task, pool->num_threads,
+                               &iter_start, &iter_count)) {
+         task->work(task->data, iter_start, iter_count, &lmem);
+         iter_done += iter_count;
       }
 
-      task->iter_start += iter_per_thread;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
-
-      mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
-
       mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
+      /* Everything is claimed, let the other workers skip the task. */
+      if (!list_is_empty(&task->list))
+         list_delinit(&task->list);
+
+      task->iter_finished += iter_done;
+      task->num_workers--;
+      if (task->iter_finished == task->iter_total && !task->num_workers)
          cnd_broadcast(&task->finish);
    }
    mtx_unlock(&pool->m);
@@ -84,7 +110,8 @@ lp_cs_tpool_worker(void *data)
 }
 
 struct lp_cs_tpool *
-lp_cs_tpool_create(unsigned num_threads)
+lp_cs_tpool_create(unsigned num_threads,
+                   const struct lp_cpu_topology *topology)
 {
    struct lp_cs_tpool *pool = CALLOC_STRUCT(lp_cs_tpool);
 
@@ -103,6 +130,10 @@ lp_cs_tpool_create(unsigned num_threads)
       }
    }
    pool->num_threads = num_threads;
+
+   for (unsigned i = 0; i < num_threads; i++)
+      lp_cpu_topology_pin_thread(topology, pool->threads[i], i, num_threads);
+
    return pool;
 }
 
@@ -136,9 +167,8 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       struct lp_cs_local_mem lmem;
 
       memset(&lmem, 0, sizeof(lmem));
-      for (unsigned t = 0; t < num_iters; t++) {
-         work(data, t, &lmem);
-      }
+      if (num_iters)
+         work(data, 0, num_iters, &lmem);
       FREE(lmem.local_mem_ptr);
       return NULL;
    }
@@ -151,16 +181,19 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->data = data;
    task->iter_total = num_iters;
 
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
-
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
 
    list_addtail(&task->list, &pool->workqueue);
 
-   cnd_broadcast(&pool->new_work);
+   /* Don't wake up threads which would find nothing left to claim. */
+   if ((unsigned)num_iters < pool->num_threads) {
+      for (int i = 0; i < num_iters; i++)
+         cnd_signal(&pool->new_work);
+   } else {
+      cnd_broadcast(&pool->new_work);
+   }
    mtx_unlock(&pool->m);
    return task;
 }
@@ -175,7 +208,7 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
       return;
 
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (task->iter_finished < task->iter_total || task->num_workers)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
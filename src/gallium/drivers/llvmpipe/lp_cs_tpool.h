@@ -28,6 +28,9 @@
  * The item is added to the work queue once, but it must execute
  * number of iterations times. This saves storing a bunch of queue
  * structs with just unique indexes in them.
+ * Workers claim chunks of iterations with an atomic counter, sized
+ * by how many iterations are left, and the task function is called
+ * once per chunk.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
  */
@@ -41,6 +44,8 @@
 
 #include "lp_limits.h"
 
+struct lp_cpu_topology;
+
 struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
@@ -56,7 +61,12 @@ struct lp_cs_local_mem {
    void *local_mem_ptr;
 };
 
-typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
+/* Largest number of iterations claimed at once */
+#define LP_CS_TPOOL_MAX_CHUNK 256
+
+/* Runs iterations iter_start to iter_start + iter_count - 1 */
+typedef void (*lp_cs_tpool_task_func)(void *data, int iter_start, int iter_count,
+                                      struct lp_cs_local_mem *lmem);
 
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
@@ -64,13 +74,13 @@ struct lp_cs_tpool_task {
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
+   unsigned iter_next;     /* atomic, may overshoot iter_total */
    unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
+   unsigned num_workers;   /* workers which may still claim iterations */
 };
 
-struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
+struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads,
+                                       const struct lp_cpu_topology *topology);
 void lp_cs_tpool_destroy(struct lp_cs_tpool *);
 
 struct lp_cs_tpool_task *lp_cs_tpool_queue_task(struct lp_cs_tpool *,
@@ -68,14 +68,22 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
    if (!llvmpipe_check_render_cond(lp))
       return;
 
+   llvmpipe_mark_shaders_busy(lp);
+
    if (indirect && indirect->buffer) {
       util_draw_indirect(pipe, info, drawid_offset, indirect);
       return;
    }
 
+   if (lp->fs_fallback)
+      llvmpipe_check_fs_fallback(lp);
+
    if (lp->dirty)
       llvmpipe_update_derived(lp);
 
+   if (lp->fs_fallback)
+      lp->nr_fs_fallback_draws++;
+
    /*
     * Map vertex buffers
     */
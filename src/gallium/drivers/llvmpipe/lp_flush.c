@@ -66,6 +66,10 @@ llvmpipe_flush(struct pipe_context *pipe,
    if (fence && (!*fence))
       *fence = (struct pipe_fence_handle *)lp_fence_create(0);
 
+   /* The fence covers all the shaders launched so far. */
+   if (fence && lp_fence_signalled((struct lp_fence *)*fence))
+      p_atomic_set(&llvmpipe->shaders_busy, 0);
+
    llvmpipe_clear_sample_functions_cache(llvmpipe, fence);
 
    /* Enable to dump BMPs of the color/depth buffers each frame */
@@ -35,6 +35,11 @@
 
 /**
  * Tile size (width and height). This needs to be a power of two.
+ *
+ * It can't be chosen per framebuffer: the triangle rasterizer splits a tile
+ * into exactly 16 blocks of 16x16 (a 16 bit mask), the SSE triangle paths,
+ * the per-tile hiz and the linear path's scanline buffers assume 64, and
+ * texture sizes are aligned to it.
  */
 #define TILE_ORDER 6
 #define TILE_SIZE (1 << TILE_ORDER)
@@ -66,7 +71,14 @@
 
 #define LP_MAX_SAMPLES 8
 
-#define LP_MAX_THREADS 32
+/**
+ * Enough for every hardware thread of a two-socket, 64 cores per socket
+ * machine.  The arrays which would scale badly with it (rasterizer tasks,
+ * scene bin queues, query counts) are allocated for the number of threads
+ * actually used.  What remains sized by it is a few KiB: the setup shard
+ * pointers, the compute pool thread handles and the per-thread statistics.
+ */
+#define LP_MAX_THREADS 256
 
 
 /**
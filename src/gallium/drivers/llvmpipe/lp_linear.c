@@ -153,7 +153,8 @@ lp_fs_linear_run(const struct lp_rast_state *state,
                                  oow,
                                  a0[i+1],
                                  dadx[i+1],
-                                 dady[i+1])) {
+                                 dady[i+1],
+                                 rgba_order)) {
          if (LP_DEBUG & DEBUG_LINEAR2)
             debug_printf("  -- init_interp(%d) failed\n", i);
          goto fail;
@@ -314,10 +315,12 @@ lp_linear_check_variant(struct lp_fragment_shader_variant *variant)
    for (unsigned i = 0; i < info->num_texs; i++) {
       const struct lp_tgsi_texture_info *tex_info = &info->tex[i];
       const unsigned unit = tex_info->sampler_unit;
+      const unsigned coord_input = tex_info->coord[0].u.index;
 
       /* XXX: Relax this once setup premultiplies by oow:
        */
-      if (info->base.input_interpolate[unit] != TGSI_INTERPOLATE_PERSPECTIVE) {
+      if (info->base.input_interpolate[coord_input] !=
+          TGSI_INTERPOLATE_PERSPECTIVE) {
          if (LP_DEBUG & DEBUG_LINEAR)
             debug_printf(" -- samp[%d]: texcoord not perspective\n", i);
          goto fail;
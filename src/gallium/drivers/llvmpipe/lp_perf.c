@@ -25,15 +25,135 @@
  *
  **************************************************************************/
 
+#include "util/u_atomic.h"
+#include "util/u_call_once.h"
 #include "util/u_debug.h"
+#include "util/perf/cpu_trace.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
+#include "lp_state_fs.h"
 
 
 
 struct lp_counters lp_count;
 
 
+static const char *lp_stat_names[LP_STAT_RAST_THREAD_TIME] = {
+   [LP_STAT_JIT_COMPILES] = "lp-jit-compiles",
+   [LP_STAT_JIT_TIME] = "lp-jit-time",
+   [LP_STAT_SCENES] = "lp-scenes",
+   [LP_STAT_BIN_TIME] = "lp-bin-time",
+   [LP_STAT_TRIS] = "lp-triangles",
+   [LP_STAT_CULLED_TRIS] = "lp-culled-triangles",
+   [LP_STAT_EMPTY_64] = "lp-empty-tiles",
+   [LP_STAT_PARTIALLY_COVERED_64] = "lp-partially-covered-tiles",
+   [LP_STAT_FULLY_COVERED_64] = "lp-fully-covered-tiles",
+   [LP_STAT_SCENE_BLOCK_MALLOCS] = "lp-scene-block-mallocs",
+   [LP_STAT_SCENE_BLOCK_REUSES] = "lp-scene-block-reuses",
+   [LP_STAT_RAST_TIME] = "lp-rast-time",
+   [LP_STAT_FS_GENERAL] = "lp-fs-invocations-general",
+   [LP_STAT_FS_BLIT_RGBA] = "lp-fs-invocations-blit-rgba",
+   [LP_STAT_FS_BLIT_RGB1] = "lp-fs-invocations-blit-rgb1",
+   [LP_STAT_FS_AERO_MINIFICATION] = "lp-fs-invocations-aero-minification",
+   [LP_STAT_FS_LLVM_LINEAR] = "lp-fs-invocations-linear",
+};
+
+static char lp_stat_thread_names[LP_MAX_THREADS][32];
+
+static_assert(LP_STAT_FS_GENERAL + LP_FS_KIND_GENERAL == LP_STAT_FS_GENERAL &&
+              LP_STAT_FS_GENERAL + LP_FS_KIND_BLIT_RGBA == LP_STAT_FS_BLIT_RGBA &&
+              LP_STAT_FS_GENERAL + LP_FS_KIND_BLIT_RGB1 == LP_STAT_FS_BLIT_RGB1 &&
+              LP_STAT_FS_GENERAL + LP_FS_KIND_AERO_MINIFICATION == LP_STAT_FS_AERO_MINIFICATION &&
+              LP_STAT_FS_GENERAL + LP_FS_KIND_LLVM_LINEAR == LP_STAT_FS_LLVM_LINEAR,
+              "LP_STAT_FS_x must be indexed by enum lp_fs_kind");
+
+static_assert(LP_STAT_BIN_LAST + 1 == LP_STAT_RAST_FIRST &&
+              LP_STAT_RAST_LAST + 1 == LP_STAT_RAST_THREAD_TIME,
+              "the _LAST markers must be the last statistic of their group");
+
+
+static void
+init_thread_names(void)
+{
+   for (unsigned i = 0; i < LP_MAX_THREADS; i++) {
+      snprintf(lp_stat_thread_names[i], sizeof lp_stat_thread_names[i],
+               "lp-rast-time-thread-%u", i);
+   }
+}
+
+
+void
+lp_stats_init(void)
+{
+   static util_once_flag once = UTIL_ONCE_FLAG_INIT;
+   util_call_once(&once, init_thread_names);
+}
+
+
+const char *
+lp_stat_name(enum lp_stat stat)
+{
+   if (stat >= LP_STAT_RAST_THREAD_TIME)
+      return lp_stat_thread_names[stat - LP_STAT_RAST_THREAD_TIME];
+   return lp_stat_names[stat];
+}
+
+
+bool
+lp_stat_is_time(enum lp_stat stat)
+{
+   return stat == LP_STAT_JIT_TIME ||
+          stat == LP_STAT_BIN_TIME ||
+          stat == LP_STAT_RAST_TIME ||
+          stat >= LP_STAT_RAST_THREAD_TIME;
+}
+
+
+/**
+ * Add stats[first..last] to a context's totals.
+ */
+void
+lp_stats_add(uint64_t *totals, const uint64_t *stats,
+             enum lp_stat first, enum lp_stat last)
+{
+   for (unsigned i = first; i <= last; i++) {
+      if (stats[i])
+         p_atomic_add(&totals[i], stats[i]);
+   }
+}
+
+
+/**
+ * Report stats[first..last] as perfetto counters.  Times are reported in
+ * microseconds, like the queries do.
+ */
+void
+lp_stats_trace(const uint64_t *stats, enum lp_stat first, enum lp_stat last)
+{
+   if (!util_perfetto_is_tracing_enabled())
+      return;
+
+   for (unsigned i = first; i <= last; i++) {
+      MESA_TRACE_SET_COUNTER(lp_stat_name(i),
+                             lp_stat_is_time(i) ? stats[i] / 1000.0 :
+                                                  (double)stats[i]);
+   }
+}
+
+
+/**
+ * Account for a shader compile which took \p time_us microseconds.
+ */
+void
+lp_stats_count_compile(uint64_t *totals, int64_t time_us)
+{
+   p_atomic_inc(&totals[LP_STAT_JIT_COMPILES]);
+   p_atomic_add(&totals[LP_STAT_JIT_TIME], time_us * 1000);
+
+   MESA_TRACE_SET_COUNTER(lp_stat_names[LP_STAT_JIT_TIME], (double)time_us);
+}
+
+
 void
 lp_reset_counters(void)
 {
@@ -52,6 +172,7 @@ lp_print_counters(void)
       debug_printf("llvmpipe: nr_culled_triangles:          %9u\n", lp_count.nr_culled_tris);
       debug_printf("llvmpipe: nr_rectangles:                %9u\n", lp_count.nr_rects);
       debug_printf("llvmpipe: nr_culled_rectangles:         %9u\n", lp_count.nr_culled_rects);
+      debug_printf("llvmpipe: nr_parallel_binned_tris:      %9u\n", lp_count.nr_parallel_binned_tris);
 
       total_64 = (lp_count.nr_empty_64 +
                   lp_count.nr_fully_covered_64 +
@@ -75,6 +196,11 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_partially_covered_64x64: %9u (%3.0f%% of %u)\n", lp_count.nr_partially_covered_64, p3, total_64);
       debug_printf("llvmpipe:   nr_empty_64x64:             %9u (%3.0f%% of %u)\n", lp_count.nr_empty_64, p1, total_64);
 
+      p1 = 100.0 * (float) lp_count.nr_hiz_culled_64 / (float) lp_count.nr_hiz_tested_64;
+
+      debug_printf("llvmpipe: nr_hiz_tested_64x64:          %9u\n", lp_count.nr_hiz_tested_64);
+      debug_printf("llvmpipe:   nr_hiz_culled_64x64:        %9u (%3.0f%% of %u)\n", lp_count.nr_hiz_culled_64, p1, lp_count.nr_hiz_tested_64);
+
       total_16 = (lp_count.nr_empty_16 +
                   lp_count.nr_fully_covered_16 +
                   lp_count.nr_partially_covered_16);
@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "util/compiler.h"
+#include "lp_limits.h"
 
 /**
  * Various counters
@@ -44,6 +45,7 @@ struct lp_counters
    unsigned nr_culled_tris;
    unsigned nr_rects;
    unsigned nr_culled_rects;
+   unsigned nr_parallel_binned_tris;
    unsigned nr_empty_64;
    unsigned nr_fully_covered_64;
    unsigned nr_partially_covered_64;
@@ -53,6 +55,8 @@ struct lp_counters
    unsigned nr_pure_shade_64;
    unsigned nr_shade_64;
    unsigned nr_shade_opaque_64;
+   unsigned nr_hiz_tested_64;
+   unsigned nr_hiz_culled_64;
    unsigned nr_empty_16;
    unsigned nr_fully_covered_16;
    unsigned nr_partially_covered_16;
@@ -86,6 +90,82 @@ extern struct lp_counters lp_count;
 #endif
 
 
+/**
+ * Statistics which, unlike the counters above, are collected in all
+ * builds.  They are exposed as driver-specific queries (see
+ * llvmpipe_get_driver_query_info()) and as perfetto counter tracks.
+ *
+ * Each context keeps its own totals in llvmpipe_context::stats.  The
+ * binner accumulates its statistics in the scene and the rasterizer
+ * threads in their task.  Both are added to the totals of the context
+ * which owns the scene once it has been binned / rasterized, before its
+ * fence is signalled, and reported to perfetto per scene.  Times are in
+ * nanoseconds.
+ */
+enum lp_stat
+{
+   LP_STAT_JIT_COMPILES,
+   LP_STAT_JIT_TIME,
+
+   /* Binner statistics */
+   LP_STAT_SCENES,
+   LP_STAT_BIN_TIME,
+   LP_STAT_TRIS,
+   LP_STAT_CULLED_TRIS,
+   LP_STAT_EMPTY_64,
+   LP_STAT_PARTIALLY_COVERED_64,
+   LP_STAT_FULLY_COVERED_64,
+   LP_STAT_SCENE_BLOCK_MALLOCS,  /**< scene data blocks malloc'd */
+   LP_STAT_SCENE_BLOCK_REUSES,   /**< and taken from the block pool */
+   LP_STAT_BIN_FIRST = LP_STAT_SCENES,
+   LP_STAT_BIN_LAST = LP_STAT_SCENE_BLOCK_REUSES,
+
+   /* Rasterizer statistics */
+   LP_STAT_RAST_TIME,            /**< summed over all threads */
+   LP_STAT_FS_GENERAL,           /**< fragment shader invocations, */
+   LP_STAT_FS_BLIT_RGBA,         /**< per enum lp_fs_kind */
+   LP_STAT_FS_BLIT_RGB1,
+   LP_STAT_FS_AERO_MINIFICATION,
+   LP_STAT_FS_LLVM_LINEAR,
+   LP_STAT_RAST_FIRST = LP_STAT_RAST_TIME,
+   LP_STAT_RAST_LAST = LP_STAT_FS_LLVM_LINEAR,
+
+   LP_STAT_RAST_THREAD_TIME,     /**< one per rasterizer thread */
+
+   LP_STAT_COUNT = LP_STAT_RAST_THREAD_TIME + LP_MAX_THREADS
+};
+
+
+extern void
+lp_stats_init(void);
+
+
+extern const char *
+lp_stat_name(enum lp_stat stat);
+
+
+extern bool
+lp_stat_is_time(enum lp_stat stat);
+
+
+/* The ranges passed to these are a group's _FIRST and _LAST markers, or
+ * the per-thread statistics, so they follow the groups as counters are
+ * added.
+ */
+extern void
+lp_stats_add(uint64_t *totals, const uint64_t *stats,
+             enum lp_stat first, enum lp_stat last);
+
+
+
+extern void
+lp_stats_trace(const uint64_t *stats, enum lp_stat first, enum lp_stat last);
+
+
+extern void
+lp_stats_count_compile(uint64_t *totals, int64_t time_us);
+
+
 extern void
 lp_reset_counters(void);
 
@@ -32,11 +32,13 @@
 
 #include "draw/draw_context.h"
 #include "pipe/p_defines.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_fence.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_screen.h"
 #include "lp_state.h"
@@ -55,10 +57,20 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          (type >= PIPE_QUERY_DRIVER_SPECIFIC &&
+           type < PIPE_QUERY_DRIVER_SPECIFIC + LP_STAT_COUNT));
 
-   struct llvmpipe_query *pq = CALLOC_STRUCT(llvmpipe_query);
+   const unsigned num_threads =
+      MAX2(1, llvmpipe_screen(pipe->screen)->num_threads);
+
+   /* The per-thread counts follow the query. */
+   struct llvmpipe_query *pq =
+      CALLOC(1, sizeof(*pq) + 2 * num_threads * sizeof(uint64_t));
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
+      pq->num_threads = num_threads;
       pq->type = type;
       pq->index = index;
    }
@@ -89,6 +101,28 @@ llvmpipe_destroy_query(struct pipe_context *pipe, struct pipe_query *q)
 }
 
 
+/**
+ * Driver-specific queries (see llvmpipe_get_driver_query_info()) sample
+ * the context's statistics when they begin, and again once the last scene
+ * binned while they were active has been rasterized, i.e. when \p ready.
+ * Only work done on behalf of this context is counted.
+ */
+static uint64_t
+driver_query_result(struct llvmpipe_context *llvmpipe,
+                    struct llvmpipe_query *pq, bool ready)
+{
+   const enum lp_stat stat = pq->type - PIPE_QUERY_DRIVER_SPECIFIC;
+
+   if (!pq->sampled) {
+      pq->end[0] = p_atomic_read(&llvmpipe->stats[stat]);
+      pq->sampled = ready;
+   }
+
+   const uint64_t value = pq->end[0] - pq->start[0];
+   return lp_stat_is_time(stat) ? value / 1000 : value;
+}
+
+
 static bool
 llvmpipe_get_query_result(struct pipe_context *pipe,
                           struct pipe_query *q,
@@ -118,6 +152,11 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
     */
    result->u64 = 0;
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      result->u64 = driver_query_result(llvmpipe_context(pipe), pq, true);
+      return true;
+   }
+
    /* Combine the per-thread results */
    switch (pq->type) {
    case PIPE_QUERY_OCCLUSION_COUNTER:
@@ -224,7 +263,7 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
 {
    const struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    const unsigned num_threads = MAX2(1, screen->num_threads);
-   const struct llvmpipe_query *pq = llvmpipe_query(q);
+   struct llvmpipe_query *pq = llvmpipe_query(q);
    const struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
    uint64_t ready;
 
@@ -353,7 +392,10 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
          }
          break;
       default:
-         fprintf(stderr, "Unknown query type %d\n", pq->type);
+         if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC)
+            value = driver_query_result(llvmpipe_context(pipe), pq, ready);
+         else
+            fprintf(stderr, "Unknown query type %d\n", pq->type);
          break;
       }
    }
@@ -408,10 +450,16 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
       llvmpipe_finish(pipe, __func__);
    }
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, pq->num_threads * sizeof(*pq->end));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      pq->start[0] = p_atomic_read(&llvmpipe->stats[pq->type - PIPE_QUERY_DRIVER_SPECIFIC]);
+      pq->sampled = false;
+      return true;
+   }
+
    switch (pq->type) {
    case PIPE_QUERY_PRIMITIVES_EMITTED:
       pq->num_primitives_written[0] = llvmpipe->so_stats[pq->index].num_primitives_written;
@@ -34,7 +34,9 @@
 #include "util/u_string.h"
 #include "util/u_thread.h"
 #include "util/u_memset.h"
+#include "util/u_atomic.h"
 #include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
 
 #include "lp_scene_queue.h"
 #include "lp_context.h"
@@ -87,13 +89,35 @@ lp_rast_begin(struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, MAX2(1, rast->num_threads));
 }
 
 
 static void
 lp_rast_end(struct lp_rasterizer *rast)
 {
+   const unsigned num_threads = MAX2(1, rast->num_threads);
+   uint64_t stats[LP_STAT_COUNT];
+
+   /* All threads are done with the scene, so their statistics for it can
+    * be gathered here.  They're already in the context's totals, see
+    * rasterize_scene().
+    */
+   memset(stats, 0, sizeof stats);
+   for (unsigned i = 0; i < num_threads; i++) {
+      uint64_t *task_stats = rast->tasks[i].perf_stats;
+
+      stats[LP_STAT_RAST_THREAD_TIME + i] = task_stats[LP_STAT_RAST_TIME];
+      for (unsigned j = LP_STAT_RAST_FIRST; j <= LP_STAT_RAST_LAST; j++) {
+         stats[j] += task_stats[j];
+         task_stats[j] = 0;
+      }
+   }
+
+   lp_stats_trace(stats, LP_STAT_RAST_FIRST, LP_STAT_RAST_LAST);
+   lp_stats_trace(stats, LP_STAT_RAST_THREAD_TIME,
+                  LP_STAT_RAST_THREAD_TIME + num_threads - 1);
+
    rast->curr_scene = NULL;
 }
 
@@ -125,9 +149,10 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
 
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i].texture) {
+         const unsigned x_scale = scene->cbufs[i].tiled ? 4 : 1;
          task->color_tiles[i] = scene->cbufs[i].map +
                                 scene->cbufs[i].stride * task->y +
-                                scene->cbufs[i].format_bytes * task->x;
+                                scene->cbufs[i].format_bytes * task->x * x_scale;
       }
    }
    if (scene->fb.zsbuf.texture) {
@@ -135,6 +160,10 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
    }
+
+   /* Nothing is known about depth values loaded from memory. */
+   task->hiz_zmin = -INFINITY;
+   task->hiz_zmax = INFINITY;
 }
 
 
@@ -165,6 +194,26 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
           "%s clear value (target format %d) raw 0x%x,0x%x,0x%x,0x%x\n",
           __func__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
+   if (scene->cbufs[cbuf].tiled) {
+      /* A clear doesn't care about pixel order, so fill each row of 4x4
+       * blocks as one long row.  Tiled buffers are padded to whole blocks.
+       */
+      assert(scene->cbufs[cbuf].nr_samples == 1);
+      util_fill_box(scene->cbufs[cbuf].map,
+                    format,
+                    scene->cbufs[cbuf].stride * 4,
+                    scene->cbufs[cbuf].layer_stride,
+                    task->x * 4,
+                    task->y / 4,
+                    0,
+                    align(task->width, 4) * 4,
+                    align(task->height, 4) / 4,
+                    scene->cbufs[cbuf].layer_count,
+                    &uc);
+      LP_COUNT(nr_color_tile_clear);
+      return;
+   }
+
    for (unsigned s = 0; s < scene->cbufs[cbuf].nr_samples; s++) {
       void *map = (char *) scene->cbufs[cbuf].map
          + scene->cbufs[cbuf].sample_stride * s;
@@ -295,6 +344,27 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
          }
       }
    }
+
+   if (scene->hiz) {
+      const uint64_t zmask = scene->hiz_zmask;
+
+      if ((clear_mask64 & zmask) == zmask) {
+         const unsigned block_size =
+            util_format_get_blocksize(scene->fb.zsbuf.format);
+         const uint16_t value16 = (uint16_t) clear_value64;
+         const uint32_t value32 = (uint32_t) clear_value64;
+         const void *src = block_size == 2 ? (const void *) &value16 :
+                           block_size == 4 ? (const void *) &value32 :
+                                             (const void *) &clear_value64;
+         float z;
+
+         util_format_unpack_z_float(scene->fb.zsbuf.format, &z, src, 1);
+         task->hiz_zmin = task->hiz_zmax = z;
+      } else if (clear_mask64 & zmask) {
+         task->hiz_zmin = -INFINITY;
+         task->hiz_zmax = INFINITY;
+      }
+   }
 }
 
 
@@ -326,6 +396,8 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
 
    const struct lp_fragment_shader_variant *variant = state->variant;
 
+   lp_rast_count_fs(task, variant, task->width * task->height);
+
    unsigned view_index = inputs->view_index;
    /* render the whole 64x64 tile in 4x4 chunks */
    for (unsigned y = 0; y < task->height; y += 4){
@@ -336,7 +408,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
          for (unsigned i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i].texture) {
-               stride[i] = scene->cbufs[i].stride;
+               stride[i] = lp_rast_get_color_block_stride(scene, i);
                sample_stride[i] = scene->cbufs[i].sample_stride;
                color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
                                           tile_y + y,
@@ -446,7 +518,7 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
    unsigned view_index = inputs->view_index;
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i].texture) {
-         stride[i] = scene->cbufs[i].stride;
+         stride[i] = lp_rast_get_color_block_stride(scene, i);
          sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer, view_index);
@@ -478,6 +550,12 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
 
+      /* count pixels with any sample covered */
+      uint64_t covered = mask[0] | mask[1];
+      covered |= covered >> 32;
+      covered |= covered >> 16;
+      lp_rast_count_fs(task, variant, util_bitcount(covered & 0xffff));
+
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
@@ -539,6 +617,12 @@ lp_rast_blit_tile_to_dest(struct lp_rasterizer_task *task,
       return;
    }
 
+   /* The copies below assume a linear destination. */
+   if (scene->cbufs[0].tiled) {
+      lp_rast_shade_tile_opaque(task, arg);
+      return;
+   }
+
    uint8_t *dst = llvmpipe_get_texture_image_address(lpt, face_slice, level);
    if (!dst)
       return;
@@ -583,6 +667,7 @@ lp_rast_blit_tile_to_dest(struct lp_rasterizer_task *task,
                         task->width, task->height,
                         src, src_stride,
                         src_x, src_y);
+         lp_rast_count_fs(task, variant, task->width * task->height);
          return;
       }
 
@@ -604,6 +689,7 @@ lp_rast_blit_tile_to_dest(struct lp_rasterizer_task *task,
                src += src_stride;
             }
 
+            lp_rast_count_fs(task, variant, task->width * task->height);
             return;
          }
       }
@@ -720,8 +806,170 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
 }
 
 
-/* Currently have two rendering paths only - the general case triangle
- * path and the super-specialized blit/clear path.
+/**
+ * Compute the range of depth values a primitive can produce anywhere in
+ * the current tile, the way the fragment shader computes them.
+ * \return false if the range is unknown.
+ */
+static bool
+lp_rast_hiz_prim_range(const struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs,
+                       float *zmin, float *zmax)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+
+   if (variant->shader_z)
+      return false;
+
+   /* z = a0.z + x * dzdx + y * dzdy, plus the polygon offset stored in
+    * a0.x.  Pixels and samples are evaluated somewhere within their
+    * pixel, so bound the plane over the tile grown by one pixel.
+    */
+   const float a0 = GET_A0(inputs)[0][2] + GET_A0(inputs)[0][0];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float hx = task->width * 0.5f + 1.0f;
+   const float hy = task->height * 0.5f + 1.0f;
+   const float cx = task->x + task->width * 0.5f;
+   const float cy = task->y + task->height * 0.5f;
+
+   const float zc = a0 + dzdx * cx + dzdy * cy;
+   const float range = fabsf(dzdx) * hx + fabsf(dzdy) * hy;
+
+   /* Allow for the shader evaluating the plane in a different order. */
+   const float eps = 8.0f * FLT_EPSILON *
+      (fabsf(a0) + fabsf(dzdx) * (cx + hx) + fabsf(dzdy) * (cy + hy));
+
+   float lo = zc - range - eps;
+   float hi = zc + range + eps;
+   if (!(lo <= hi))
+      return false;
+
+   if (variant->key.restrict_depth_values) {
+      lo = CLAMP(lo, 0.0f, 1.0f);
+      hi = CLAMP(hi, 0.0f, 1.0f);
+   }
+
+   if (variant->key.depth_clamp) {
+      const struct lp_jit_viewport *vp =
+         &task->state->jit_context.viewports[inputs->viewport_index];
+      lo = CLAMP(lo, vp->min_depth, vp->max_depth);
+      hi = CLAMP(hi, vp->min_depth, vp->max_depth);
+   }
+
+   *zmin = lo;
+   *zmax = hi;
+   return true;
+}
+
+
+/**
+ * Hierarchical depth test of a shading command against the current tile.
+ *
+ * Each task keeps conservative bounds of the depth values in its tile:
+ * they are exact after a depth clear and are widened by every primitive
+ * that may write depth.  A primitive whose depth range fails the test
+ * against those bounds cannot produce a visible fragment in the tile, so
+ * the command is skipped before any block is rasterized or shaded.
+ *
+ * \return true if the command should be skipped.
+ */
+static bool
+lp_rast_hiz_cull(struct lp_rasterizer_task *task,
+                 unsigned cmd, const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_shader_inputs *inputs;
+
+   if (!task->scene->hiz)
+      return false;
+
+   if ((cmd >= LP_RAST_OP_TRIANGLE_1 && cmd <= LP_RAST_OP_TRIANGLE_4_16) ||
+       (cmd >= LP_RAST_OP_TRIANGLE_32_1 && cmd <= LP_RAST_OP_MS_TRIANGLE_4_16))
+      inputs = &arg.triangle.tri->inputs;
+   else if (cmd == LP_RAST_OP_SHADE_TILE || cmd == LP_RAST_OP_SHADE_TILE_OPAQUE)
+      inputs = arg.shade_tile;
+   else if (cmd == LP_RAST_OP_RECTANGLE)
+      inputs = &arg.rectangle->inputs;
+   else
+      return false;
+
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   const struct lp_depth_state *depth = &variant->key.depth;
+
+   if (inputs->disable || !depth->enabled)
+      return false;
+
+   const float q = task->scene->hiz_quantum;
+   float zmin, zmax;
+   const bool known = lp_rast_hiz_prim_range(task, inputs, &zmin, &zmax);
+
+   if (known && variant->hiz_cull) {
+      bool cull;
+
+      /* The quantum covers the rounding of unorm depth values. */
+      switch (depth->func) {
+      case PIPE_FUNC_LESS:
+      case PIPE_FUNC_LEQUAL:
+         cull = zmin > task->hiz_zmax + q;
+         break;
+      case PIPE_FUNC_GREATER:
+      case PIPE_FUNC_GEQUAL:
+         cull = zmax < task->hiz_zmin - q;
+         break;
+      case PIPE_FUNC_EQUAL:
+         cull = zmin > task->hiz_zmax + q || zmax < task->hiz_zmin - q;
+         break;
+      default:
+         cull = false;
+         break;
+      }
+
+      LP_COUNT(nr_hiz_tested_64);
+      if (cull) {
+         LP_COUNT(nr_hiz_culled_64);
+         return true;
+      }
+   }
+
+   if (depth->writemask) {
+      if (known) {
+         zmin -= q;
+         zmax += q;
+      } else {
+         zmin = -INFINITY;
+         zmax = INFINITY;
+      }
+
+      /* Depth written by a passing fragment is bounded by the old value on
+       * one side for the ordered functions.
+       */
+      switch (depth->func) {
+      case PIPE_FUNC_NEVER:
+      case PIPE_FUNC_EQUAL:
+         break;
+      case PIPE_FUNC_LESS:
+      case PIPE_FUNC_LEQUAL:
+         task->hiz_zmin = MIN2(task->hiz_zmin, zmin);
+         break;
+      case PIPE_FUNC_GREATER:
+      case PIPE_FUNC_GEQUAL:
+         task->hiz_zmax = MAX2(task->hiz_zmax, zmax);
+         break;
+      default:
+         task->hiz_zmin = MIN2(task->hiz_zmin, zmin);
+         task->hiz_zmax = MAX2(task->hiz_zmax, zmax);
+         break;
+      }
+   }
+
+   return false;
+}
+
+
+/* Currently have three rendering paths - the general case triangle
+ * path, the linear path (which also takes single-sampled triangles,
+ * shading them a span at a time) and the super-specialized blit/clear
+ * path.
  */
 #define TRI   ((LP_RAST_FLAGS_TRI <<1)-1)     /* general case */
 #define RECT  ((LP_RAST_FLAGS_RECT<<1)-1)     /* direct rectangle rasterizer */
@@ -731,33 +979,33 @@ static const unsigned
 rast_flags[] = {
    BLIT,                        /* clear color */
    TRI,                         /* clear zstencil */
-   TRI,                         /* triangle_1 */
-   TRI,                         /* triangle_2 */
-   TRI,                         /* triangle_3 */
-   TRI,                         /* triangle_4 */
-   TRI,                         /* triangle_5 */
-   TRI,                         /* triangle_6 */
-   TRI,                         /* triangle_7 */
-   TRI,                         /* triangle_8 */
-   TRI,                         /* triangle_3_4 */
-   TRI,                         /* triangle_3_16 */
-   TRI,                         /* triangle_4_16 */
+   RECT,                        /* triangle_1 */
+   RECT,                        /* triangle_2 */
+   RECT,                        /* triangle_3 */
+   RECT,                        /* triangle_4 */
+   RECT,                        /* triangle_5 */
+   RECT,                        /* triangle_6 */
+   RECT,                        /* triangle_7 */
+   RECT,                        /* triangle_8 */
+   RECT,                        /* triangle_3_4 */
+   RECT,                        /* triangle_3_16 */
+   RECT,                        /* triangle_4_16 */
    RECT,                        /* shade_tile */
    RECT,                        /* shade_tile_opaque */
    TRI,                         /* begin_query */
    TRI,                         /* end_query */
    BLIT,                        /* set_state, */
-   TRI,                         /* lp_rast_triangle_32_1 */
-   TRI,                         /* lp_rast_triangle_32_2 */
-   TRI,                         /* lp_rast_triangle_32_3 */
-   TRI,                         /* lp_rast_triangle_32_4 */
-   TRI,                         /* lp_rast_triangle_32_5 */
-   TRI,                         /* lp_rast_triangle_32_6 */
-   TRI,                         /* lp_rast_triangle_32_7 */
-   TRI,                         /* lp_rast_triangle_32_8 */
-   TRI,                         /* lp_rast_triangle_32_3_4 */
-   TRI,                         /* lp_rast_triangle_32_3_16 */
-   TRI,                         /* lp_rast_triangle_32_4_16 */
+   RECT,                        /* lp_rast_triangle_32_1 */
+   RECT,                        /* lp_rast_triangle_32_2 */
+   RECT,                        /* lp_rast_triangle_32_3 */
+   RECT,                        /* lp_rast_triangle_32_4 */
+   RECT,                        /* lp_rast_triangle_32_5 */
+   RECT,                        /* lp_rast_triangle_32_6 */
+   RECT,                        /* lp_rast_triangle_32_7 */
+   RECT,                        /* lp_rast_triangle_32_8 */
+   RECT,                        /* lp_rast_triangle_32_3_4 */
+   RECT,                        /* lp_rast_triangle_32_3_16 */
+   RECT,                        /* lp_rast_triangle_32_4_16 */
    TRI,                         /* lp_rast_triangle_ms_1 */
    TRI,                         /* lp_rast_triangle_ms_2 */
    TRI,                         /* lp_rast_triangle_ms_3 */
@@ -970,6 +1218,8 @@ tri_rasterize_bin(struct lp_rasterizer_task *task,
 
    for (const struct cmd_block *block = bin->head; block; block = block->next) {
       for (unsigned k = 0; k < block->count; k++) {
+         if (lp_rast_hiz_cull(task, block->cmd[k], block->arg[k]))
+            continue;
          dispatch_tri[block->cmd[k]](task, block->arg[k]);
       }
    }
@@ -1055,6 +1305,8 @@ static void
 rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
+   MESA_TRACE_FUNC();
+
    task->scene = scene;
 
    /* Clear the cache tags. This should not always be necessary but
@@ -1071,14 +1323,23 @@ rasterize_scene(struct lp_rasterizer_task *task,
 
    if (!task->rast->no_rast) {
       /* loop over scene bins, rasterize each */
+      const int64_t start = os_time_get_nano();
       struct cmd_bin *bin;
+      bool stolen;
       int i, j;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+      while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                           &i, &j, &stolen))) {
          if (!is_empty_bin(bin))
             rasterize_bin(task, bin, i, j);
+         task->stats.bins++;
+         task->stats.bins_stolen += stolen;
       }
+
+      const int64_t busy_ns = os_time_get_nano() - start;
+      task->perf_stats[LP_STAT_RAST_TIME] += busy_ns;
+      task->stats.busy_ns += busy_ns;
    }
 
 #if LP_BUILD_FORMAT_CACHE_DEBUG
@@ -1095,6 +1356,13 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
+   /* Publish the statistics before the fence lets queries read them. */
+   uint64_t *totals = llvmpipe_context(scene->pipe)->stats;
+   lp_stats_add(totals, task->perf_stats,
+                LP_STAT_RAST_FIRST, LP_STAT_RAST_LAST);
+   p_atomic_add(&totals[LP_STAT_RAST_THREAD_TIME + task->thread_index],
+                task->perf_stats[LP_STAT_RAST_TIME]);
+
    if (scene->fence) {
       lp_fence_signal(scene->fence);
    }
@@ -1162,6 +1430,35 @@ lp_rast_finish(struct lp_rasterizer *rast)
 }
 
 
+/**
+ * Copy out the per-thread statistics.
+ * \return  the number of entries written
+ */
+unsigned
+lp_rast_get_thread_stats(const struct lp_rasterizer *rast,
+                         struct lp_rast_thread_stats *stats,
+                         unsigned max_stats)
+{
+   unsigned n = MIN2(MAX2(1, rast->num_threads), max_stats);
+   for (unsigned i = 0; i < n; i++)
+      stats[i] = rast->tasks[i].stats;
+   return n;
+}
+
+
+static void
+print_thread_stats(const struct lp_rasterizer *rast)
+{
+   for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+      const struct lp_rast_thread_stats *stats = &rast->tasks[i].stats;
+      debug_printf("llvmpipe: thread %2u: busy %8.2f ms idle %8.2f ms "
+                   "bins %9u stolen %9u\n", i,
+                   stats->busy_ns / 1000000.0, stats->idle_ns / 1000000.0,
+                   stats->bins, stats->bins_stolen);
+   }
+}
+
+
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
@@ -1215,7 +1512,13 @@ thread_function(void *init_data)
       rasterize_scene(task, rast->curr_scene);
 
       /* wait for all threads to finish with this scene */
-      util_barrier_wait(&rast->barrier);
+      if (LP_DEBUG & DEBUG_COUNTERS) {
+         int64_t start = os_time_get_nano();
+         util_barrier_wait(&rast->barrier);
+         task->stats.idle_ns += os_time_get_nano() - start;
+      } else {
+         util_barrier_wait(&rast->barrier);
+      }
 
       /* XXX: shouldn't be necessary:
        */
@@ -1242,7 +1545,8 @@ thread_function(void *init_data)
  * Initialize semaphores and spawn the threads.
  */
 static void
-create_rast_threads(struct lp_rasterizer *rast)
+create_rast_threads(struct lp_rasterizer *rast,
+                    const struct lp_cpu_topology *topology)
 {
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (unsigned i = 0; i < rast->num_threads; i++) {
@@ -1257,6 +1561,11 @@ create_rast_threads(struct lp_rasterizer *rast)
          break;
       }
    }
+
+   for (unsigned i = 0; i < rast->num_threads; i++) {
+      lp_cpu_topology_pin_thread(topology, rast->threads[i], i,
+                                 rast->num_threads);
+   }
 }
 
 
@@ -1264,15 +1573,23 @@ create_rast_threads(struct lp_rasterizer *rast)
  * Create new lp_rasterizer.  If num_threads is zero, don't create any
  * new threads, do rendering synchronously.
  * \param num_threads  number of rasterizer threads to create
+ * \param topology  CPU placement of the threads, may be NULL
  */
 struct lp_rasterizer *
-lp_rast_create(unsigned num_threads)
+lp_rast_create(unsigned num_threads,
+               const struct lp_cpu_topology *topology)
 {
    struct lp_rasterizer *rast = CALLOC_STRUCT(lp_rasterizer);
    if (!rast) {
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof(*rast->tasks));
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof(*rast->threads));
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
@@ -1293,7 +1610,7 @@ lp_rast_create(unsigned num_threads)
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", false);
 
-   create_rast_threads(rast);
+   create_rast_threads(rast, topology);
 
    /* for synchronizing rasterization threads */
    if (rast->num_threads > 0) {
@@ -1313,6 +1630,9 @@ no_thread_data_cache:
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+no_tasks:
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 no_rast:
    return NULL;
@@ -1328,6 +1648,9 @@ lp_rast_destroy(struct lp_rasterizer *rast)
     * Each thread will be woken up, notice that the exit_flag is set and
     * break out of its main loop.  The thread will then exit.
     */
+   if (LP_DEBUG & DEBUG_COUNTERS)
+      print_thread_stats(rast);
+
    rast->exit_flag = true;
    for (unsigned i = 0; i < rast->num_threads; i++) {
       util_semaphore_signal(&rast->tasks[i].work_ready);
@@ -1372,6 +1695,8 @@ lp_rast_destroy(struct lp_rasterizer *rast)
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
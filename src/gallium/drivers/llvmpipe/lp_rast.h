@@ -47,6 +47,7 @@ struct lp_rasterizer;
 struct lp_scene;
 struct lp_fence;
 struct cmd_bin;
+struct lp_cpu_topology;
 
 #define FIXED_TYPE_WIDTH 64
 /** For sub-pixel positioning */
@@ -232,7 +233,8 @@ GET_PLANES(const struct lp_rast_triangle *tri)
 
 
 struct lp_rasterizer *
-lp_rast_create(unsigned num_threads);
+lp_rast_create(unsigned num_threads,
+               const struct lp_cpu_topology *topology);
 
 void
 lp_rast_destroy(struct lp_rasterizer *);
@@ -245,6 +247,23 @@ void
 lp_rast_finish(struct lp_rasterizer *rast);
 
 
+/**
+ * Per-thread load balancing statistics.  idle_ns is only collected when
+ * LP_DEBUG=counters is set.
+ */
+struct lp_rast_thread_stats {
+   uint64_t busy_ns;       /**< time spent rasterizing bins */
+   uint64_t idle_ns;       /**< time spent waiting on other threads */
+   unsigned bins;          /**< bins rasterized */
+   unsigned bins_stolen;   /**< bins taken from another thread's queue */
+};
+
+unsigned
+lp_rast_get_thread_stats(const struct lp_rasterizer *rast,
+                         struct lp_rast_thread_stats *stats,
+                         unsigned max_stats);
+
+
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
    struct {
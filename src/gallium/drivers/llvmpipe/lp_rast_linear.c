@@ -91,8 +91,10 @@ lp_rast_linear_tile(struct lp_rasterizer_task *task,
                                    GET_DADX(inputs),
                                    GET_DADY(inputs),
                                    scene->cbufs[0].map,
-                                   scene->cbufs[0].stride))
+                                   scene->cbufs[0].stride)) {
+         lp_rast_count_fs(task, variant, task->width * task->height);
          return;
+      }
    }
 
    if (variant->jit_linear) {
@@ -105,8 +107,10 @@ lp_rast_linear_tile(struct lp_rasterizer_task *task,
                               GET_DADX(inputs),
                               GET_DADY(inputs),
                               scene->cbufs[0].map,
-                              scene->cbufs[0].stride))
+                              scene->cbufs[0].stride)) {
+         lp_rast_count_fs(task, variant, task->width * task->height);
          return;
+      }
    }
 
    {
@@ -120,30 +124,18 @@ lp_rast_linear_tile(struct lp_rasterizer_task *task,
 }
 
 
-/* Run the scanline version of the shader on a rectangle within the
- * tile.
+/* Run the scanline version of the shader on a box within the tile,
+ * falling back to the SoA shader when there is no linear variant or it
+ * can't handle the box.
  */
 static void
-lp_rast_linear_rect(struct lp_rasterizer_task *task,
-                    const union lp_rast_cmd_arg arg)
+lp_rast_linear_box(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   const struct u_rect *box)
 {
    const struct lp_scene *scene = task->scene;
-   const struct lp_rast_rectangle *rect = arg.rectangle;
-   const struct lp_rast_shader_inputs *inputs = &rect->inputs;
-
-   if (inputs->disable)
-      return;
-
-   struct u_rect box;
-   box.x0 = task->x;
-   box.y0 = task->y;
-   box.x1 = task->x + task->width - 1;
-   box.y1 = task->y + task->height - 1;
-
-   u_rect_find_intersection(&rect->box, &box);
-
-   const int width  = box.x1 - box.x0 + 1;
-   const int height = box.y1 - box.y0 + 1;
+   const int width  = box->x1 - box->x0 + 1;
+   const int height = box->y1 - box->y0 + 1;
 
    /* Note that blit primitives can end up in the non-full-tile path,
     * the binner currently doesn't try to classify sub-tile
@@ -153,65 +145,245 @@ lp_rast_linear_rect(struct lp_rasterizer_task *task,
    struct lp_fragment_shader_variant *variant = state->variant;
    if (variant->jit_linear_blit && inputs->is_blit) {
       if (variant->jit_linear_blit(state,
-                                   box.x0, box.y0,
+                                   box->x0, box->y0,
                                    width, height,
                                    GET_A0(inputs),
                                    GET_DADX(inputs),
                                    GET_DADY(inputs),
                                    scene->cbufs[0].map,
                                    scene->cbufs[0].stride)) {
+         lp_rast_count_fs(task, variant, width * height);
          return;
       }
    }
 
    if (variant->jit_linear) {
       if (variant->jit_linear(state,
-                              box.x0, box.y0,
+                              box->x0, box->y0,
                               width, height,
                               GET_A0(inputs),
                               GET_DADX(inputs),
                               GET_DADY(inputs),
                               scene->cbufs[0].map,
                               scene->cbufs[0].stride)) {
+         lp_rast_count_fs(task, variant, width * height);
          return;
       }
    }
 
-   lp_rast_linear_rect_fallback(task, inputs, &box);
+   lp_rast_linear_rect_fallback(task, inputs, box);
+}
+
+
+/* Run the scanline version of the shader on a rectangle within the
+ * tile.
+ */
+static void
+lp_rast_linear_rect(struct lp_rasterizer_task *task,
+                    const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_rectangle *rect = arg.rectangle;
+   const struct lp_rast_shader_inputs *inputs = &rect->inputs;
+
+   if (inputs->disable)
+      return;
+
+   struct u_rect box;
+   box.x0 = task->x;
+   box.y0 = task->y;
+   box.x1 = task->x + task->width - 1;
+   box.y1 = task->y + task->height - 1;
+
+   u_rect_find_intersection(&rect->box, &box);
+
+   lp_rast_linear_box(task, inputs, &box);
+}
+
+
+/* Floor of a / b for b > 0.
+ */
+static inline int64_t
+floor_div64(int64_t a, int64_t b)
+{
+   return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+
+/* Run the scanline version of the shader on the spans of a triangle
+ * (or any convex polygon, such as a rotated quad) within the given
+ * bounds.
+ *
+ * Pixel (x, y) is inside a plane when c - dcdx * x + dcdy * y > 0, the
+ * same test the triangle rasterizer does, so that each row of the
+ * triangle is one contiguous span.  Consecutive rows with the same span
+ * are shaded as a single box.
+ *
+ * \return false if the shader has no linear variant, in which case the
+ *         caller should use the regular triangle rasterizer.
+ */
+static bool
+lp_rast_linear_triangle(struct lp_rasterizer_task *task,
+                        const struct lp_rast_triangle *tri,
+                        unsigned plane_mask,
+                        const struct u_rect *bounds)
+{
+   const struct lp_rast_state *state = task->state;
+
+   if (!state || !state->variant->jit_linear)
+      return false;
+
+   const struct lp_rast_plane *tri_plane = GET_PLANES(tri);
+   struct lp_rast_plane plane[8];
+   unsigned nr_planes = 0;
+
+   while (plane_mask) {
+      int i = u_bit_scan(&plane_mask);
+      plane[nr_planes++] = tri_plane[i];
+   }
+
+   struct u_rect box = { 0, -1, 0, -1 };
+
+   for (int y = bounds->y0; y <= bounds->y1; y++) {
+      int64_t x0 = bounds->x0;
+      int64_t x1 = bounds->x1;
+
+      for (unsigned j = 0; j < nr_planes && x0 <= x1; j++) {
+         const int64_t c = plane[j].c + IMUL64(plane[j].dcdy, y);
+         const int64_t dcdx = plane[j].dcdx;
+
+         if (dcdx > 0)
+            x1 = MIN2(x1, floor_div64(c - 1, dcdx));
+         else if (dcdx < 0)
+            x0 = MAX2(x0, floor_div64(-c, -dcdx) + 1);
+         else if (c <= 0)
+            x1 = x0 - 1;
+      }
+
+      if (x0 <= x1 && box.y1 == y - 1 && box.x0 == x0 && box.x1 == x1) {
+         box.y1 = y;
+         continue;
+      }
+
+      if (box.y0 <= box.y1)
+         lp_rast_linear_box(task, &tri->inputs, &box);
+
+      box.x0 = x0;
+      box.x1 = x1;
+      box.y0 = y;
+      box.y1 = x0 <= x1 ? y : y - 1;
+   }
+
+   if (box.y0 <= box.y1)
+      lp_rast_linear_box(task, &tri->inputs, &box);
+
+   return true;
+}
+
+
+/* Triangles with an arbitrary set of planes, covering any part of the
+ * tile.
+ */
+#define LINEAR_TRI(name)                                                \
+static void                                                             \
+lp_rast_linear_##name(struct lp_rasterizer_task *task,                  \
+                      const union lp_rast_cmd_arg arg)                  \
+{                                                                       \
+   const struct lp_rast_triangle *tri = arg.triangle.tri;               \
+   struct u_rect bounds;                                                \
+                                                                        \
+   if (tri->inputs.disable)                                             \
+      return;                                                           \
+                                                                        \
+   bounds.x0 = task->x;                                                 \
+   bounds.y0 = task->y;                                                 \
+   bounds.x1 = task->x + task->width - 1;                               \
+   bounds.y1 = task->y + task->height - 1;                              \
+                                                                        \
+   if (!lp_rast_linear_triangle(task, tri, arg.triangle.plane_mask,     \
+                                &bounds))                               \
+      lp_rast_##name(task, arg);                                        \
 }
 
+/* Triangles known to lie within a size x size block of the tile, whose
+ * position is encoded in the plane mask.
+ */
+#define LINEAR_TRI_BLOCK(name, nr_planes, size)                         \
+static void                                                             \
+lp_rast_linear_##name(struct lp_rasterizer_task *task,                  \
+                      const union lp_rast_cmd_arg arg)                  \
+{                                                                       \
+   const struct lp_rast_triangle *tri = arg.triangle.tri;               \
+   const unsigned mask = arg.triangle.plane_mask;                       \
+   struct u_rect bounds;                                                \
+                                                                        \
+   if (tri->inputs.disable)                                             \
+      return;                                                           \
+                                                                        \
+   bounds.x0 = task->x + (mask & 0xff);                                 \
+   bounds.y0 = task->y + (mask >> 8);                                   \
+   bounds.x1 = MIN2(bounds.x0 + size, task->x + task->width) - 1;       \
+   bounds.y1 = MIN2(bounds.y0 + size, task->y + task->height) - 1;      \
+                                                                        \
+   if (!lp_rast_linear_triangle(task, tri, (1 << nr_planes) - 1,        \
+                                &bounds))                               \
+      lp_rast_##name(task, arg);                                        \
+}
+
+LINEAR_TRI(triangle_1)
+LINEAR_TRI(triangle_2)
+LINEAR_TRI(triangle_3)
+LINEAR_TRI(triangle_4)
+LINEAR_TRI(triangle_5)
+LINEAR_TRI(triangle_6)
+LINEAR_TRI(triangle_7)
+LINEAR_TRI(triangle_8)
+LINEAR_TRI_BLOCK(triangle_3_4, 3, 4)
+LINEAR_TRI_BLOCK(triangle_3_16, 3, 16)
+LINEAR_TRI_BLOCK(triangle_4_16, 4, 16)
+LINEAR_TRI(triangle_32_1)
+LINEAR_TRI(triangle_32_2)
+LINEAR_TRI(triangle_32_3)
+LINEAR_TRI(triangle_32_4)
+LINEAR_TRI(triangle_32_5)
+LINEAR_TRI(triangle_32_6)
+LINEAR_TRI(triangle_32_7)
+LINEAR_TRI(triangle_32_8)
+LINEAR_TRI_BLOCK(triangle_32_3_4, 3, 4)
+LINEAR_TRI_BLOCK(triangle_32_3_16, 3, 16)
+LINEAR_TRI_BLOCK(triangle_32_4_16, 4, 16)
+
 
 static const lp_rast_cmd_func
 dispatch_linear[] = {
    lp_rast_linear_clear,        /* clear_color */
    NULL,                        /* clear_zstencil */
-   NULL,                        /* triangle_1 */
-   NULL,                        /* triangle_2 */
-   NULL,                        /* triangle_3 */
-   NULL,                        /* triangle_4 */
-   NULL,                        /* triangle_5 */
-   NULL,                        /* triangle_6 */
-   NULL,                        /* triangle_7 */
-   NULL,                        /* triangle_8 */
-   NULL,                        /* triangle_3_4 */
-   NULL,                        /* triangle_3_16 */
-   NULL,                        /* triangle_4_16 */
+   lp_rast_linear_triangle_1,   /* triangle_1 */
+   lp_rast_linear_triangle_2,   /* triangle_2 */
+   lp_rast_linear_triangle_3,   /* triangle_3 */
+   lp_rast_linear_triangle_4,   /* triangle_4 */
+   lp_rast_linear_triangle_5,   /* triangle_5 */
+   lp_rast_linear_triangle_6,   /* triangle_6 */
+   lp_rast_linear_triangle_7,   /* triangle_7 */
+   lp_rast_linear_triangle_8,   /* triangle_8 */
+   lp_rast_linear_triangle_3_4, /* triangle_3_4 */
+   lp_rast_linear_triangle_3_16, /* triangle_3_16 */
+   lp_rast_linear_triangle_4_16, /* triangle_4_16 */
    lp_rast_linear_tile,         /* shade_tile */
    lp_rast_linear_tile,         /* shade_tile_opaque */
    NULL,                        /* begin_query */
    NULL,                        /* end_query */
    lp_rast_set_state,           /* set_state */
-   NULL,                        /* lp_rast_triangle_32_1 */
-   NULL,                        /* lp_rast_triangle_32_2 */
-   NULL,                        /* lp_rast_triangle_32_3 */
-   NULL,                        /* lp_rast_triangle_32_4 */
-   NULL,                        /* lp_rast_triangle_32_5 */
-   NULL,                        /* lp_rast_triangle_32_6 */
-   NULL,                        /* lp_rast_triangle_32_7 */
-   NULL,                        /* lp_rast_triangle_32_8 */
-   NULL,                        /* lp_rast_triangle_32_3_4 */
-   NULL,                        /* lp_rast_triangle_32_3_16 */
-   NULL,                        /* lp_rast_triangle_32_4_16 */
+   lp_rast_linear_triangle_32_1, /* lp_rast_triangle_32_1 */
+   lp_rast_linear_triangle_32_2, /* lp_rast_triangle_32_2 */
+   lp_rast_linear_triangle_32_3, /* lp_rast_triangle_32_3 */
+   lp_rast_linear_triangle_32_4, /* lp_rast_triangle_32_4 */
+   lp_rast_linear_triangle_32_5, /* lp_rast_triangle_32_5 */
+   lp_rast_linear_triangle_32_6, /* lp_rast_triangle_32_6 */
+   lp_rast_linear_triangle_32_7, /* lp_rast_triangle_32_7 */
+   lp_rast_linear_triangle_32_8, /* lp_rast_triangle_32_8 */
+   lp_rast_linear_triangle_32_3_4, /* lp_rast_triangle_32_3_4 */
+   lp_rast_linear_triangle_32_3_16, /* lp_rast_triangle_32_3_16 */
+   lp_rast_linear_triangle_32_4_16, /* lp_rast_triangle_32_4_16 */
 
    NULL,                        /* lp_rast_triangle_ms_1 */
    NULL,                        /* lp_rast_triangle_ms_2 */
@@ -233,7 +405,8 @@ dispatch_linear[] = {
 /* Assumptions for this path:
  *   - Single color buffer, PIPE_FORMAT_B8G8R8A8_UNORM
  *   - No depth buffer
- *   - All primitives in bins are rect, tile, blit or clear.
+ *   - All primitives in bins are rect, tile, blit, clear or
+ *     single-sampled triangles.
  *   - All shaders have a linear variant.
  */
 void
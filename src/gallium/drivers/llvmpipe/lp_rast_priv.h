@@ -91,6 +91,9 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /** Conservative range of the depth values in the current tile */
+   float hiz_zmin, hiz_zmax;
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
@@ -100,6 +103,11 @@ struct lp_rasterizer_task
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   struct lp_rast_thread_stats stats;
+
+   /** Rasterizer statistics for the current scene, see lp_rast_end() */
+   uint64_t perf_stats[LP_STAT_RAST_LAST + 1];
+
    util_semaphore work_ready;
    util_semaphore work_done;
 #ifdef _WIN32
@@ -124,11 +132,11 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread, MAX2(1, num_threads) */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -174,6 +182,12 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
    unsigned px = x % TILE_SIZE;
    unsigned py = y % TILE_SIZE;
 
+   /* In tiled buffers the 4x4 block at (px, py) is stored contiguously
+    * at px * 4 pixels into the py'th row of blocks.
+    */
+   if (task->scene->cbufs[buf].tiled)
+      px *= 4;
+
    unsigned pixel_offset = px * task->scene->cbufs[buf].format_bytes +
                            py * task->scene->cbufs[buf].stride;
    uint8_t *color = task->color_tiles[buf] + pixel_offset;
@@ -188,6 +202,19 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Get the row stride of a 4x4 color block returned by
+ * lp_rast_get_color_block_pointer().
+ */
+static inline unsigned
+lp_rast_get_color_block_stride(const struct lp_scene *scene, unsigned buf)
+{
+   if (scene->cbufs[buf].tiled)
+      return scene->cbufs[buf].format_bytes * 4;
+   return scene->cbufs[buf].stride;
+}
+
+
 /**
  * Get the pointer to a 4x4 depth block (within a 64x64 tile).
  * \param x, y location of 4x4 block in window coords
@@ -218,6 +245,18 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Count fragment shader invocations, for the LP_STAT_FS_x statistics.
+ */
+static inline void
+lp_rast_count_fs(struct lp_rasterizer_task *task,
+                 const struct lp_fragment_shader_variant *variant,
+                 unsigned count)
+{
+   task->perf_stats[LP_STAT_FS_GENERAL + variant->shader->kind] += count;
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -242,7 +281,7 @@ lp_rast_shade_quads_all(struct lp_rasterizer_task *task,
    /* color buffer */
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i].texture) {
-         stride[i] = scene->cbufs[i].stride;
+         stride[i] = lp_rast_get_color_block_stride(scene, i);
          sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer, view_index);
@@ -273,6 +312,8 @@ lp_rast_shade_quads_all(struct lp_rasterizer_task *task,
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
 
+      lp_rast_count_fs(task, variant, 16);
+
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_WHOLE](&state->jit_context,
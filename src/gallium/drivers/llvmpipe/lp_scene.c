@@ -30,6 +30,9 @@
 #include "util/u_memory.h"
 #include "util/reallocarray.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
+#include "util/u_qsort.h"
+#include "util/u_pack_color.h"
 #include "util/format/u_format.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
@@ -69,6 +72,15 @@ lp_scene_create(struct lp_setup_context *setup)
       return NULL;
 
    memset(scene, 0, sizeof(struct lp_scene));
+
+   scene->bin_queues = align_calloc(MAX2(1, setup->num_threads) *
+                                    sizeof(*scene->bin_queues),
+                                    CACHE_LINE_SIZE);
+   if (!scene->bin_queues) {
+      slab_free_st(&setup->scene_slab, scene);
+      return NULL;
+   }
+
    scene->pipe = setup->pipe;
    scene->setup = setup;
    scene->data.head = &scene->data.first;
@@ -103,6 +115,9 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->tile_order);
+   free(scene->bin_order);
+   align_free(scene->bin_queues);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -164,6 +179,7 @@ init_scene_texture(struct lp_scene_surface *ssurf, struct pipe_surface *psurf)
       ssurf->sample_stride = 0;
       ssurf->nr_samples = 0;
       ssurf->map = NULL;
+      ssurf->tiled = false;
       return;
    }
 
@@ -182,6 +198,7 @@ init_scene_texture(struct lp_scene_surface *ssurf, struct pipe_surface *psurf)
    ssurf->nr_samples = util_res_sample_count(psurf->texture);
    ssurf->base_layer = psurf->first_layer;
    ssurf->layer_count = psurf->last_layer - psurf->first_layer + 1;
+   ssurf->tiled = llvmpipe_resource_is_tiled(psurf->texture);
 }
 
 
@@ -197,6 +214,22 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
    struct pipe_surface *zsbuf = &scene->fb.zsbuf;
    init_scene_texture(&scene->zsbuf, zsbuf->texture ? zsbuf : NULL);
+
+   const struct util_format_description *zs_desc =
+      zsbuf->texture ? util_format_description(zsbuf->format) : NULL;
+
+   scene->hiz = zs_desc && util_format_has_depth(zs_desc) &&
+                !(LP_PERF & PERF_NO_HIZ);
+   if (scene->hiz) {
+      const struct util_format_channel_description *z =
+         &zs_desc->channel[zs_desc->swizzle[0]];
+
+      scene->hiz_zmask = util_pack64_mask_z(zsbuf->format, ~0u);
+      if (z->type == UTIL_FORMAT_TYPE_FLOAT)
+         scene->hiz_quantum = 0.0f;
+      else
+         scene->hiz_quantum = 1.0f / (float) ((1ull << z->size) - 1);
+   }
 }
 
 
@@ -286,17 +319,13 @@ lp_scene_end_rasterization(struct lp_scene *scene)
       }
    }
 
-   /* Free all scene data blocks:
+   /* Return all scene data blocks to the pool:
     */
    {
       struct data_block_list *list = &scene->data;
-      struct data_block *block, *tmp;
 
-      for (block = list->head; block; block = tmp) {
-         tmp = block->next;
-         if (block != &list->first)
-            FREE(block);
-      }
+      lp_scene_block_pool_put(&scene->setup->block_pool,
+                              list->head, &list->first);
 
       list->head = &list->first;
       list->head->next = NULL;
@@ -347,9 +376,17 @@ lp_scene_new_data_block(struct lp_scene *scene)
       scene->alloc_failed = true;
       return NULL;
    } else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
-      if (!block)
-         return NULL;
+      struct data_block *block =
+         lp_scene_block_pool_get(&scene->setup->block_pool);
+
+      if (block) {
+         scene->stats[LP_STAT_SCENE_BLOCK_REUSES]++;
+      } else {
+         block = MALLOC_STRUCT(data_block);
+         if (!block)
+            return NULL;
+         scene->stats[LP_STAT_SCENE_BLOCK_MALLOCS]++;
+      }
 
       scene->scene_size += sizeof *block;
 
@@ -534,64 +571,205 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static bool
-next_bin(struct lp_scene *scene)
+/** Spread the low 16 bits of v out to the even bit positions */
+static inline unsigned
+morton_spread(unsigned v)
+{
+   v &= 0xffff;
+   v = (v | (v << 8)) & 0x00ff00ff;
+   v = (v | (v << 4)) & 0x0f0f0f0f;
+   v = (v | (v << 2)) & 0x33333333;
+   v = (v | (v << 1)) & 0x55555555;
+   return v;
+}
+
+
+static int
+compare_morton(const void *a, const void *b, void *data)
+{
+   const struct lp_scene *scene = data;
+   const unsigned ia = *(const unsigned *)a, ib = *(const unsigned *)b;
+   const unsigned ka = morton_spread(ia % scene->tiles_x) |
+                       (morton_spread(ia / scene->tiles_x) << 1);
+   const unsigned kb = morton_spread(ib % scene->tiles_x) |
+                       (morton_spread(ib / scene->tiles_x) << 1);
+   return ka < kb ? -1 : ka > kb;
+}
+
+
+/**
+ * Build the list of all bins in Morton order so that consecutive bins
+ * handed to a thread are spatially close, which keeps texture and
+ * framebuffer cache lines on the same core.  Only rebuilt when the
+ * framebuffer dimensions change.
+ */
+static void
+build_tile_order(struct lp_scene *scene)
+{
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+
+   if (scene->tile_order_x == scene->tiles_x &&
+       scene->tile_order_y == scene->tiles_y)
+      return;
+
+   for (unsigned i = 0; i < num_bins; i++)
+      scene->tile_order[i] = i;
+
+   util_qsort_r(scene->tile_order, num_bins, sizeof(unsigned),
+                compare_morton, scene);
+
+   scene->tile_order_x = scene->tiles_x;
+   scene->tile_order_y = scene->tiles_y;
+}
+
+
+/** Number of commands in a bin, used as an estimate of its cost */
+static unsigned
+bin_weight(const struct cmd_bin *bin)
+{
+   unsigned weight = 0;
+   for (const struct cmd_block *block = bin->head; block; block = block->next)
+      weight += block->count;
+   return weight;
+}
+
+
+static inline void
+bin_queue_init(struct lp_bin_queue *queue, unsigned head, unsigned tail)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   p_atomic_set(&queue->range, ((uint64_t)tail << 32) | head);
+}
+
+
+/** Take the next bin from the head of our own queue, or -1 if empty */
+static inline int
+bin_queue_pop(struct lp_bin_queue *queue)
+{
+   uint64_t range = p_atomic_read(&queue->range);
+   for (;;) {
+      const unsigned head = range & 0xffffffff, tail = range >> 32;
+      if (head >= tail)
+         return -1;
+
+      const uint64_t old = p_atomic_cmpxchg(&queue->range, range, range + 1);
+      if (old == range)
+         return head;
+      range = old;
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return false;
+}
+
+
+/** Take a bin from the tail of another thread's queue, or -1 if empty */
+static inline int
+bin_queue_steal(struct lp_bin_queue *queue)
+{
+   uint64_t range = p_atomic_read(&queue->range);
+   for (;;) {
+      const unsigned head = range & 0xffffffff, tail = range >> 32;
+      if (head >= tail)
+         return -1;
+
+      const uint64_t stolen = ((uint64_t)(tail - 1) << 32) | head;
+      const uint64_t old = p_atomic_cmpxchg(&queue->range, range, stolen);
+      if (old == range)
+         return tail - 1;
+      range = old;
    }
-   return true;
 }
 
 
+/**
+ * Prepare the per-thread bin queues for rasterization.
+ * Called once per scene by one thread, before any thread calls
+ * lp_scene_bin_iter_next().
+ *
+ * Non-empty bins are collected in Morton order and split into one
+ * contiguous run per thread, balanced by command count rather than by
+ * number of bins.
+ */
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_threads)
 {
-   scene->curr_x = scene->curr_y = -1;
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+   unsigned num_active = 0;
+   uint64_t total_weight = 0;
+
+   assert(num_threads > 0 && num_threads <= MAX2(1, scene->setup->num_threads));
+   scene->num_bin_queues = num_threads;
+
+   if (!scene->tiles || !scene->tile_order || !scene->bin_order) {
+      for (unsigned t = 0; t < num_threads; t++)
+         bin_queue_init(&scene->bin_queues[t], 0, 0);
+      return;
+   }
+
+   build_tile_order(scene);
+
+   for (unsigned i = 0; i < num_bins; i++) {
+      const unsigned idx = scene->tile_order[i];
+      const struct cmd_bin *bin = &scene->tiles[idx];
+      if (bin->head) {
+         scene->bin_order[num_active++] = idx;
+         total_weight += bin_weight(bin);
+      }
+   }
+
+   unsigned t = 0, start = 0;
+   uint64_t weight = 0;
+   for (unsigned i = 0; i < num_active && t < num_threads - 1; i++) {
+      weight += bin_weight(&scene->tiles[scene->bin_order[i]]);
+      while (t < num_threads - 1 &&
+             weight * num_threads >= total_weight * (t + 1)) {
+         bin_queue_init(&scene->bin_queues[t++], start, i + 1);
+         start = i + 1;
+      }
+   }
+
+   bin_queue_init(&scene->bin_queues[t++], start, num_active);
+   for (; t < num_threads; t++)
+      bin_queue_init(&scene->bin_queues[t], num_active, num_active);
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Return pointer to next bin to be rendered by the given thread.
+ * Bins come from the thread's own queue first; once that is exhausted
+ * bins are stolen from the other threads' queues.  Returns NULL when
+ * there is no work left anywhere.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread_index,
+                       int *x, int *y, bool *stolen)
 {
-   struct cmd_bin *bin = NULL;
+   const unsigned num_queues = scene->num_bin_queues;
+   int idx;
 
-   mtx_lock(&scene->mutex);
+   assert(thread_index < num_queues);
+
+   *stolen = false;
+   idx = bin_queue_pop(&scene->bin_queues[thread_index]);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+   for (unsigned i = 1; idx < 0 && i < num_queues; i++) {
+      unsigned victim = (thread_index + i) % num_queues;
+      idx = bin_queue_steal(&scene->bin_queues[victim]);
+      *stolen = idx >= 0;
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   if (idx < 0)
+      return NULL;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   const unsigned tile = scene->bin_order[idx];
+   *x = tile % scene->tiles_x;
+   *y = tile / scene->tiles_x;
+   return &scene->tiles[tile];
 }
 
 
-void
+/**
+ * Returns false if the bins couldn't be allocated, in which case the scene
+ * has no bins and nothing must be binned into it.
+ */
+bool
 lp_scene_begin_binning(struct lp_scene *scene,
                        struct pipe_framebuffer_state *fb)
 {
@@ -606,10 +784,27 @@ lp_scene_begin_binning(struct lp_scene *scene,
 
    unsigned num_required_tiles = scene->tiles_x * scene->tiles_y;
    if (scene->num_alloced_tiles < num_required_tiles) {
-      scene->tiles = reallocarray(scene->tiles, num_required_tiles,
-                                  sizeof(struct cmd_bin));
-      if (!scene->tiles)
-         return;
+      /* Each array is replaced as soon as it has grown, and kept otherwise,
+       * so they all stay valid for at least num_alloced_tiles.
+       */
+      struct cmd_bin *tiles = reallocarray(scene->tiles, num_required_tiles,
+                                           sizeof(struct cmd_bin));
+      if (tiles)
+         scene->tiles = tiles;
+      unsigned *tile_order = !tiles ? NULL :
+         reallocarray(scene->tile_order, num_required_tiles, sizeof(unsigned));
+      if (tile_order)
+         scene->tile_order = tile_order;
+      unsigned *bin_order = !tile_order ? NULL :
+         reallocarray(scene->bin_order, num_required_tiles, sizeof(unsigned));
+      if (bin_order)
+         scene->bin_order = bin_order;
+
+      scene->tile_order_x = scene->tile_order_y = 0;
+      if (!bin_order) {
+         scene->tiles_x = scene->tiles_y = 0;
+         return false;
+      }
       memset(scene->tiles, 0, sizeof(struct cmd_bin) * num_required_tiles);
       scene->num_alloced_tiles = num_required_tiles;
    }
@@ -639,6 +834,7 @@ lp_scene_begin_binning(struct lp_scene *scene,
    }
 
    scene->fb_max_layer = max_layer;
+   return true;
 }
 
 
@@ -656,3 +852,200 @@ lp_scene_end_binning(struct lp_scene *scene)
          lp_debug_bins(scene);
    }
 }
+
+
+/**
+ * Prepare \p shard for binning commands which will later be appended to
+ * \p scene.  The shard doesn't hold references to the framebuffer or any
+ * resources, and is limited to \p budget bytes of data blocks.
+ */
+bool
+lp_scene_begin_shard(struct lp_scene *shard,
+                     const struct lp_scene *scene,
+                     unsigned budget)
+{
+   const unsigned num_tiles = scene->tiles_x * scene->tiles_y;
+
+   if (shard->num_alloced_tiles < num_tiles) {
+      struct cmd_bin *tiles = reallocarray(shard->tiles, num_tiles,
+                                           sizeof(struct cmd_bin));
+      if (!tiles)
+         return false;
+      shard->tiles = tiles;
+      shard->num_alloced_tiles = num_tiles;
+   }
+   memset(shard->tiles, 0, sizeof(struct cmd_bin) * num_tiles);
+
+   shard->tiles_x = scene->tiles_x;
+   shard->tiles_y = scene->tiles_y;
+   memcpy(&shard->fb, &scene->fb, sizeof shard->fb);
+   shard->fb_max_layer = scene->fb_max_layer;
+   shard->fb_max_samples = scene->fb_max_samples;
+   memcpy(shard->fixed_sample_pos, scene->fixed_sample_pos,
+          sizeof shard->fixed_sample_pos);
+   shard->had_queries = scene->had_queries;
+   shard->permit_linear_rasterizer = scene->permit_linear_rasterizer;
+   shard->alloc_failed = false;
+   shard->scene_size = LP_SCENE_MAX_SIZE - MIN2(budget, LP_SCENE_MAX_SIZE);
+   memset(shard->stats, 0, sizeof shard->stats);
+
+   /* Only malloc'd blocks can be handed over to the scene, so mark the
+    * embedded one as full.
+    */
+   shard->data.head = &shard->data.first;
+   shard->data.first.next = NULL;
+   shard->data.first.used = DATA_BLOCK_SIZE;
+
+   return true;
+}
+
+
+static void
+lp_scene_end_shard(struct lp_scene *shard)
+{
+   shard->data.head = &shard->data.first;
+   shard->data.first.next = NULL;
+
+   /* Shallow copy, see lp_scene_begin_shard() */
+   memset(&shard->fb, 0, sizeof shard->fb);
+}
+
+
+/**
+ * Append the commands binned into \p shard to \p scene's bins and move
+ * the data blocks they live in over to \p scene.
+ */
+void
+lp_scene_merge_shard(struct lp_scene *scene, struct lp_scene *shard)
+{
+   const unsigned num_tiles = scene->tiles_x * scene->tiles_y;
+
+   for (unsigned i = 0; i < num_tiles; i++) {
+      const struct cmd_bin *src = &shard->tiles[i];
+      struct cmd_bin *dst = &scene->tiles[i];
+
+      if (!src->head)
+         continue;
+
+      if (dst->tail)
+         dst->tail->next = src->head;
+      else
+         dst->head = src->head;
+      dst->tail = src->tail;
+      dst->last_state = src->last_state;
+   }
+
+   /* Insert the shard's blocks after the scene's current block, which is
+    * still the one being allocated from.
+    */
+   struct data_block *head = shard->data.head;
+   if (head != &shard->data.first) {
+      struct data_block *last = head;
+      unsigned num_blocks = 1;
+
+      while (last->next != &shard->data.first) {
+         last = last->next;
+         num_blocks++;
+      }
+
+      last->next = scene->data.head->next;
+      scene->data.head->next = head;
+      scene->scene_size += num_blocks * sizeof(struct data_block);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(scene->stats); i++)
+      scene->stats[i] += shard->stats[i];
+
+   lp_scene_end_shard(shard);
+}
+
+
+/**
+ * Throw away everything binned into \p shard.
+ */
+void
+lp_scene_discard_shard(struct lp_scene *shard)
+{
+   lp_scene_block_pool_put(&shard->setup->block_pool,
+                           shard->data.head, &shard->data.first);
+
+   lp_scene_end_shard(shard);
+}
+
+
+void
+lp_scene_block_pool_init(struct lp_scene_block_pool *pool)
+{
+   (void) mtx_init(&pool->mutex, mtx_plain);
+   pool->head = NULL;
+   pool->num_blocks = 0;
+}
+
+
+void
+lp_scene_block_pool_fini(struct lp_scene_block_pool *pool)
+{
+   struct data_block *block, *tmp;
+
+   for (block = pool->head; block; block = tmp) {
+      tmp = block->next;
+      FREE(block);
+   }
+
+   pool->head = NULL;
+   pool->num_blocks = 0;
+   mtx_destroy(&pool->mutex);
+}
+
+
+/**
+ * Take a data block from \p pool.
+ * \return NULL if the pool is empty.
+ */
+struct data_block *
+lp_scene_block_pool_get(struct lp_scene_block_pool *pool)
+{
+   mtx_lock(&pool->mutex);
+
+   struct data_block *block = pool->head;
+   if (block) {
+      pool->head = block->next;
+      pool->num_blocks--;
+   }
+
+   mtx_unlock(&pool->mutex);
+
+   return block;
+}
+
+
+/**
+ * Give the malloc'd data blocks from \p head up to, but not including,
+ * \p end back to \p pool.  Blocks which don't fit in the pool are freed.
+ */
+void
+lp_scene_block_pool_put(struct lp_scene_block_pool *pool,
+                        struct data_block *head,
+                        const struct data_block *end)
+{
+   struct data_block *block, *tmp;
+
+   if (head == end)
+      return;
+
+   mtx_lock(&pool->mutex);
+
+   for (block = head; block && block != end; block = tmp) {
+      tmp = block->next;
+
+      if (pool->num_blocks < LP_SCENE_POOL_MAX_BLOCKS) {
+         block->next = pool->head;
+         pool->head = block;
+         pool->num_blocks++;
+      } else {
+         FREE(block);
+      }
+   }
+
+   mtx_unlock(&pool->mutex);
+}
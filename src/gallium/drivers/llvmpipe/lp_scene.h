@@ -38,6 +38,7 @@
 #include "util/u_thread.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 
 struct lp_scene_queue;
 struct lp_rast_state;
@@ -116,10 +117,42 @@ struct data_block_list {
    struct data_block *head;
 };
 
+
+/* Number of data blocks a block pool keeps at most, i.e. enough for one
+ * full scene.  Blocks released beyond that are freed.
+ */
+#define LP_SCENE_POOL_MAX_BLOCKS (LP_SCENE_MAX_SIZE / DATA_BLOCK_SIZE)
+
+/**
+ * Data blocks released by finished scenes, kept for the next scenes of the
+ * same setup context so that binning doesn't malloc once the application
+ * has reached a steady state.  Shards (see lp_setup_parallel.c) allocate
+ * from several threads, hence the mutex.
+ */
+struct lp_scene_block_pool {
+   mtx_t mutex;
+   struct data_block *head;
+   unsigned num_blocks;
+};
+
 struct resource_ref;
 
 struct shader_ref;
 
+
+/**
+ * Per-thread queue of bins to rasterize.
+ *
+ * Each queue owns a contiguous range [head, tail) of lp_scene::bin_order.
+ * The owning thread pops bins from the head while idle threads steal
+ * from the tail.  Both ends are packed into a single 64-bit word so that
+ * either can be advanced with one compare-and-swap.
+ */
+struct lp_bin_queue {
+   uint64_t range;  /**< tail << 32 | head */
+   uint8_t pad[56]; /**< keep queues on separate cache lines */
+};
+
 struct lp_scene_surface {
    uint8_t *map;
    unsigned stride;
@@ -129,6 +162,7 @@ struct lp_scene_surface {
    unsigned nr_samples;
    unsigned base_layer;
    unsigned layer_count;
+   bool tiled;             /**< LP_RESOURCE_FLAG_TILED_4X4 layout */
 };
 
 
@@ -156,6 +190,11 @@ struct lp_scene {
     */
    struct lp_scene_surface zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
 
+   /** Per-tile depth culling, see lp_rast_hiz_cull() */
+   bool hiz;
+   float hiz_quantum;      /**< depth buffer resolution, 0 for float */
+   uint64_t hiz_zmask;     /**< depth bits of a packed zsbuf value */
+
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
@@ -191,17 +230,28 @@ struct lp_scene {
    bool alloc_failed;
    bool permit_linear_rasterizer;
 
+   /** Binner statistics, added to the context's stats when binning is done */
+   uint64_t stats[LP_STAT_BIN_LAST + 1];
+
    /**
     * Number of active tiles in each dimension.
     * This basically the framebuffer size divided by tile size
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
    mtx_t mutex;
 
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
+
+   /** All bins in Morton (Z-curve) order, as indices into tiles[] */
+   unsigned *tile_order;
+   unsigned tile_order_x, tile_order_y;  /**< dims tile_order was built for */
+
+   /** Non-empty bins in rasterization order, split among bin_queues */
+   unsigned *bin_order;
+   unsigned num_bin_queues;
+   struct lp_bin_queue *bin_queues;  /**< one per rasterizer thread */
    struct data_block_list data;
 };
 
@@ -398,16 +448,17 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_threads);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread_index,
+                       int *x, int *y, bool *stolen);
 
 
 
 /* Begin/end binning of a scene
  */
-void
+bool
 lp_scene_begin_binning(struct lp_scene *scene,
                        struct pipe_framebuffer_state *fb);
 
@@ -415,6 +466,20 @@ void
 lp_scene_end_binning(struct lp_scene *scene);
 
 
+/* Bin part of a scene into a separate shard scene on another thread
+ */
+bool
+lp_scene_begin_shard(struct lp_scene *shard,
+                     const struct lp_scene *scene,
+                     unsigned budget);
+
+void
+lp_scene_merge_shard(struct lp_scene *scene, struct lp_scene *shard);
+
+void
+lp_scene_discard_shard(struct lp_scene *shard);
+
+
 /* Begin/end rasterization of a scene
  */
 void
@@ -424,4 +489,19 @@ void
 lp_scene_end_rasterization(struct lp_scene *scene);
 
 
+void
+lp_scene_block_pool_init(struct lp_scene_block_pool *pool);
+
+void
+lp_scene_block_pool_fini(struct lp_scene_block_pool *pool);
+
+struct data_block *
+lp_scene_block_pool_get(struct lp_scene_block_pool *pool);
+
+void
+lp_scene_block_pool_put(struct lp_scene_block_pool *pool,
+                        struct data_block *head,
+                        const struct data_block *end);
+
+
 #endif /* LP_SCENE_H */
@@ -28,6 +28,7 @@
 
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_atomic.h"
 #include "util/u_cpu_detect.h"
 #include "util/format/u_format.h"
 #include "util/u_screen.h"
@@ -53,6 +54,7 @@
 #include "lp_debug.h"
 #include "lp_public.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
 #include "lp_flush.h"
@@ -87,6 +89,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "cs", DEBUG_CS, NULL },
    { "accurate_a0", DEBUG_ACCURATE_A0 },
    { "mesh", DEBUG_MESH },
+   { "cache", DEBUG_CACHE, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -102,6 +105,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
    { "no_rast_linear", PERF_NO_RAST_LINEAR, NULL },
    { "no_shade",       PERF_NO_SHADE, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
+   { "no_bin_threads", PERF_NO_BIN_THREADS, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -764,6 +769,17 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_cpu_topology_fini(&screen->topology);
+
+   if ((LP_DEBUG & DEBUG_CACHE) && screen->disk_shader_cache) {
+      debug_printf("llvmpipe: shader cache: %u hits, %u misses, "
+                   "%.1f ms of JIT avoided, %.1f ms of JIT spent\n",
+                   screen->disk_cache_stats.hits,
+                   screen->disk_cache_stats.misses,
+                   screen->disk_cache_stats.jit_ns_saved / 1000000.0,
+                   screen->disk_cache_stats.jit_ns_spent / 1000000.0);
+   }
+
    lp_jit_screen_cleanup(screen);
 
    disk_cache_destroy(screen->disk_shader_cache);
@@ -832,6 +848,38 @@ llvmpipe_fence_finish(struct pipe_screen *screen,
 }
 
 
+/**
+ * Expose the enum lp_stat counters as driver-specific queries, e.g. for
+ * the gallium HUD.  Each context counts only its own work.
+ * Only the rasterizer threads which exist get a per-thread time.
+ */
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *_screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+   const unsigned num_queries =
+      LP_STAT_RAST_THREAD_TIME + MAX2(1, screen->num_threads);
+
+   if (!info)
+      return num_queries;
+
+   if (index >= num_queries)
+      return 0;
+
+   info->name = lp_stat_name(index);
+   info->query_type = PIPE_QUERY_DRIVER_SPECIFIC + index;
+   info->max_value.u64 = 0;
+   info->type = lp_stat_is_time(index) ? PIPE_DRIVER_QUERY_TYPE_MICROSECONDS :
+                                         PIPE_DRIVER_QUERY_TYPE_UINT64;
+   info->result_type = PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE;
+   info->group_id = ~(unsigned)0;
+   info->flags = 0;
+   return 1;
+}
+
+
 static void
 update_cache_sha1_cpu(struct mesa_sha1 *ctx)
 {
@@ -889,27 +937,77 @@ llvmpipe_screen_get_fd(struct pipe_screen *_screen)
 }
 
 
+/**
+ * Disk cache entries are prefixed with the time it originally took to
+ * build the code, so that cache hits can report the JIT time they saved.
+ */
+struct lp_disk_cache_header {
+   uint64_t jit_time_ns;
+};
+
+
+static void *
+lp_disk_cache_lookup(struct llvmpipe_screen *screen,
+                     unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH],
+                     size_t *size)
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
+                          20, sha1);
+
+   void *buffer = disk_cache_get(screen->disk_shader_cache, sha1, size);
+   if (buffer && *size <= sizeof(struct lp_disk_cache_header)) {
+      free(buffer);
+      return NULL;
+   }
+   return buffer;
+}
+
+
 void
 lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
                           struct lp_cached_code *cache,
                           unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH])
 {
-   unsigned char sha1[CACHE_KEY_SIZE];
-
    if (!screen->disk_shader_cache)
       return;
-   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
-                          20, sha1);
 
    size_t binary_size;
-   uint8_t *buffer = disk_cache_get(screen->disk_shader_cache,
-                                    sha1, &binary_size);
+   uint8_t *buffer = lp_disk_cache_lookup(screen, ir_sha1_cache_key,
+                                          &binary_size);
    if (!buffer) {
       cache->data_size = 0;
+      cache->miss_time = os_time_get_nano();
+      p_atomic_inc(&screen->disk_cache_stats.misses);
       return;
    }
+
+   struct lp_disk_cache_header header;
+   memcpy(&header, buffer, sizeof header);
+   binary_size -= sizeof header;
+   memmove(buffer, buffer + sizeof header, binary_size);
+
    cache->data_size = binary_size;
    cache->data = buffer;
+
+   p_atomic_inc(&screen->disk_cache_stats.hits);
+   p_atomic_add(&screen->disk_cache_stats.jit_ns_saved, header.jit_time_ns);
+}
+
+
+bool
+lp_disk_cache_has_shader(struct llvmpipe_screen *screen,
+                         unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH])
+{
+   if (!screen->disk_shader_cache)
+      return false;
+
+   size_t binary_size;
+   void *buffer = lp_disk_cache_lookup(screen, ir_sha1_cache_key,
+                                       &binary_size);
+   free(buffer);
+   return buffer != NULL;
 }
 
 
@@ -922,10 +1020,25 @@ lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
 
    if (!screen->disk_shader_cache || !cache->data_size || cache->dont_cache)
       return;
+
+   struct lp_disk_cache_header header = { 0 };
+   if (cache->miss_time) {
+      header.jit_time_ns = os_time_get_nano() - cache->miss_time;
+      p_atomic_add(&screen->disk_cache_stats.jit_ns_spent, header.jit_time_ns);
+   }
+
+   size_t size = sizeof header + cache->data_size;
+   uint8_t *buffer = malloc(size);
+   if (!buffer)
+      return;
+
+   memcpy(buffer, &header, sizeof header);
+   memcpy(buffer + sizeof header, cache->data, cache->data_size);
+
    disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
                           20, sha1);
-   disk_cache_put(screen->disk_shader_cache, sha1, cache->data,
-                  cache->data_size, NULL);
+   disk_cache_put(screen->disk_shader_cache, sha1, buffer, size, NULL);
+   free(buffer);
 }
 
 
@@ -938,13 +1051,14 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
    if (screen->late_init_done)
       goto out;
 
-   screen->rast = lp_rast_create(screen->num_threads);
+   screen->rast = lp_rast_create(screen->num_threads, &screen->topology);
    if (!screen->rast) {
       ret = false;
       goto out;
    }
 
-   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
+   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads,
+                                         &screen->topology);
    if (!screen->cs_tpool) {
       lp_rast_destroy(screen->rast);
       ret = false;
@@ -980,6 +1094,8 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
 
    LP_PERF = debug_get_flags_option("LP_PERF", lp_perf_flags, 0 );
 
+   lp_stats_init();
+
    screen = CALLOC_STRUCT(llvmpipe_screen);
    if (!screen)
       return NULL;
@@ -1001,6 +1117,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = u_default_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
 
    screen->base.query_memory_info = util_sw_query_memory_info;
 
@@ -1012,8 +1129,11 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_disk_shader_cache = lp_get_disk_shader_cache;
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
-   screen->num_threads = util_get_cpu_caps()->nr_cpus > 1
-      ? util_get_cpu_caps()->nr_cpus : 0;
+   lp_cpu_topology_init(&screen->topology);
+   screen->tiled_textures = debug_get_bool_option("LP_TEX_TILED", false);
+
+   screen->num_threads = screen->topology.num_cpus > 1
+      ? screen->topology.num_cpus : 0;
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS",
                                               screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
@@ -42,6 +42,7 @@
 #include "util/vma.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
+#include "lp_cpu_topology.h"
 
 struct sw_winsys;
 struct lp_cs_tpool;
@@ -53,6 +54,10 @@ struct llvmpipe_screen
    struct sw_winsys *winsys;
 
    unsigned num_threads;
+   struct lp_cpu_topology topology;
+
+   /* Store eligible textures in 4x4 blocks (LP_TEX_TILED) */
+   bool tiled_textures;
 
    /* Increments whenever textures are modified.  Contexts can track this.
     */
@@ -74,6 +79,14 @@ struct llvmpipe_screen
 
    struct disk_cache *disk_shader_cache;
 
+   /* Disk cache statistics, updated atomically */
+   struct {
+      uint32_t hits;
+      uint32_t misses;
+      uint64_t jit_ns_saved;
+      uint64_t jit_ns_spent;
+   } disk_cache_stats;
+
 #if defined(HAVE_LIBDRM) && defined(HAVE_LINUX_UDMABUF_H)
    int udmabuf_fd;
 #endif
@@ -96,6 +109,11 @@ lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
                           unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH]);
 
 
+bool
+lp_disk_cache_has_shader(struct llvmpipe_screen *screen,
+                         unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH]);
+
+
 void
 lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
                             struct lp_cached_code *cache,
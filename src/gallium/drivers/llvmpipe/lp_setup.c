@@ -43,6 +43,7 @@
 #include "util/u_viewport.h"
 #include "draw/draw_pipe.h"
 #include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
 #include "lp_context.h"
 #include "lp_memory.h"
 #include "lp_scene.h"
@@ -77,7 +78,7 @@ lp_setup_wait_empty_scene(struct lp_setup_context *setup)
 }
 
 
-static void
+static bool
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
    assert(setup->scene == NULL);
@@ -142,7 +143,7 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
       }
    }
 
-   lp_scene_begin_binning(setup->scene, &setup->fb);
+   return lp_scene_begin_binning(setup->scene, &setup->fb);
 }
 
 
@@ -232,6 +233,14 @@ lp_setup_rasterize_scene(struct lp_setup_context *setup)
    struct lp_scene *scene = setup->scene;
    struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
 
+   MESA_TRACE_FUNC();
+
+   scene->stats[LP_STAT_SCENES] = 1;
+   lp_stats_add(llvmpipe_context(scene->pipe)->stats, scene->stats,
+                LP_STAT_BIN_FIRST, LP_STAT_BIN_LAST);
+   lp_stats_trace(scene->stats, LP_STAT_BIN_FIRST, LP_STAT_BIN_LAST);
+   memset(scene->stats, 0, sizeof scene->stats);
+
    scene->num_active_queries = setup->active_binned_queries;
    memcpy(scene->active_queries, setup->active_queries,
           scene->num_active_queries * sizeof(scene->active_queries[0]));
@@ -371,8 +380,8 @@ set_scene_state(struct lp_setup_context *setup,
 
    /* wait for a free/empty scene
     */
-   if (old_state == SETUP_FLUSHED)
-      lp_setup_get_empty_scene(setup);
+   if (old_state == SETUP_FLUSHED && !lp_setup_get_empty_scene(setup))
+      goto fail;
 
    switch (new_state) {
    case SETUP_CLEARED:
@@ -508,7 +517,8 @@ lp_setup_try_clear_color_buffer(struct lp_setup_context *setup,
        * buffers which the app or gallium frontend might issue
        * separately.
        */
-      set_scene_state(setup, SETUP_CLEARED, __func__);
+      if (!set_scene_state(setup, SETUP_CLEARED, __func__))
+         return false;
 
       assert(PIPE_CLEAR_COLOR0 == (1 << 2));
       setup->clear.flags |= 1 << (cbuf + 2);
@@ -566,7 +576,8 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
        * buffers which the app or gallium frontend might issue
        * separately.
        */
-      set_scene_state(setup, SETUP_CLEARED, __func__);
+      if (!set_scene_state(setup, SETUP_CLEARED, __func__))
+         return false;
 
       setup->clear.flags |= flags;
 
@@ -1370,7 +1381,10 @@ lp_setup_destroy(struct lp_setup_context *setup)
       lp_scene_destroy(scene);
    }
 
+   lp_setup_destroy_bin_shards(setup);
+
    LP_DBG(DEBUG_SETUP, "number of scenes used: %d\n", setup->num_active_scenes);
+   lp_scene_block_pool_fini(&setup->block_pool);
    slab_destroy(&setup->scene_slab);
 
    FREE(setup);
@@ -1392,6 +1406,7 @@ lp_setup_create(struct pipe_context *pipe,
       goto no_setup;
    }
 
+   setup->num_threads = screen->num_threads;
    lp_setup_init_vbuf(setup);
 
    setup->psize_slot = -1;
@@ -1403,7 +1418,6 @@ lp_setup_create(struct pipe_context *pipe,
     */
    setup->pipe = pipe;
 
-   setup->num_threads = screen->num_threads;
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1415,6 +1429,7 @@ lp_setup_create(struct pipe_context *pipe,
    slab_create(&setup->scene_slab,
                sizeof(struct lp_scene),
                INITIAL_SCENES);
+   lp_scene_block_pool_init(&setup->block_pool);
    /* create just one scene for starting point */
    setup->scenes[0] = lp_scene_create(setup);
    if (!setup->scenes[0]) {
@@ -1440,6 +1455,8 @@ no_scenes:
          lp_scene_destroy(setup->scenes[i]);
       }
    }
+   lp_scene_block_pool_fini(&setup->block_pool);
+   slab_destroy(&setup->scene_slab);
 
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
@@ -59,6 +59,11 @@ struct lp_setup_variant;
 #define INITIAL_SCENES 4
 #define MAX_SCENES 64
 
+/** Minimum number of triangles per thread for binning a draw in parallel */
+#define LP_BIN_SHARD_MIN_TRIS 64
+
+struct lp_bin_shard;
+
 
 
 /**
@@ -92,6 +97,7 @@ struct lp_setup_context
    unsigned scene_idx;
 
    struct slab_mempool scene_slab;
+   struct lp_scene_block_pool block_pool;
    int num_active_scenes;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
@@ -99,6 +105,10 @@ struct lp_setup_context
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
 
+   /** Per-thread copies used by lp_setup_bin_triangles_parallel() */
+   struct lp_bin_shard *bin_shards[LP_MAX_THREADS];
+   bool bin_shard;       /**< this is one of the copies */
+
    unsigned flatshade_first:1;
    unsigned ccw_is_frontface:1;
    unsigned scissor_test:1;
@@ -199,6 +209,20 @@ struct lp_setup_context
 };
 
 
+/**
+ * A slice of a draw's triangles, binned on a worker thread into a private
+ * scene whose bins are then appended to the real scene's.
+ */
+struct lp_bin_shard {
+   struct lp_setup_context setup;   /**< copy of the setup, binning to scene */
+   struct lp_scene *scene;
+   const void *vertex_buffer;
+   const uint16_t *indices;         /**< NULL for non-indexed draws */
+   unsigned stride;
+   unsigned first_tri, end_tri;
+};
+
+
 static inline void
 scissor_planes_needed(bool scis_planes[4], const struct u_rect *bbox,
                       const struct u_rect *scissor)
@@ -307,6 +331,16 @@ lp_setup_bin_rectangle(struct lp_setup_context *setup,
                        struct lp_rast_rectangle *rect,
                        bool opaque);
 
+bool
+lp_setup_bin_triangles_parallel(struct lp_setup_context *setup,
+                                const void *vertex_buffer,
+                                unsigned stride,
+                                const uint16_t *indices,
+                                unsigned nr);
+
+void
+lp_setup_destroy_bin_shards(struct lp_setup_context *setup);
+
 static inline bool
 lp_setup_zero_sample_mask(struct lp_setup_context *setup)
 {
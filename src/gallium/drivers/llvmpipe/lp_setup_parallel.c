@@ -0,0 +1,182 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Bin the triangles of a draw on several threads.
+ *
+ * The triangle list is cut into contiguous slices, one per shard.  Each
+ * shard bins its slice with a private copy of the setup context into a
+ * private scene, using the compute thread pool.  The shards' bins are then
+ * appended to the current scene's bins in slice order, so every bin sees
+ * the triangles in submission order, exactly as with serial binning.
+ *
+ * A shard can't flush the scene when it runs out of memory.  If any shard
+ * does, all of them are thrown away and the caller bins the draw serially.
+ */
+
+#include "util/u_memory.h"
+#include "util/u_math.h"
+
+#include "lp_context.h"
+#include "lp_cs_tpool.h"
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_screen.h"
+#include "lp_setup_context.h"
+
+
+typedef const float (*const_float4_ptr)[4];
+
+
+static inline const_float4_ptr
+get_vert(const struct lp_bin_shard *shard, unsigned i)
+{
+   const unsigned index = shard->indices ? shard->indices[i] : i;
+   return (const_float4_ptr)
+      ((const char *)shard->vertex_buffer + index * shard->stride);
+}
+
+
+static void
+bin_shard_task(void *data, int iter_start, int iter_count,
+               struct lp_cs_local_mem *lmem)
+{
+   for (int iter_idx = iter_start; iter_idx < iter_start + iter_count; iter_idx++) {
+      struct lp_bin_shard *shard = ((struct lp_bin_shard **)data)[iter_idx];
+      struct lp_setup_context *setup = &shard->setup;
+
+      for (unsigned i = shard->first_tri; i < shard->end_tri; i++) {
+         if (shard->scene->alloc_failed)
+            break;
+
+         setup->triangle(setup,
+                         get_vert(shard, i * 3 + 0),
+                         get_vert(shard, i * 3 + 1),
+                         get_vert(shard, i * 3 + 2));
+      }
+   }
+}
+
+
+static struct lp_bin_shard *
+get_bin_shard(struct lp_setup_context *setup, unsigned i)
+{
+   if (!setup->bin_shards[i]) {
+      struct lp_bin_shard *shard = CALLOC_STRUCT(lp_bin_shard);
+      if (!shard)
+         return NULL;
+
+      shard->scene = lp_scene_create(setup);
+      if (!shard->scene) {
+         FREE(shard);
+         return NULL;
+      }
+
+      setup->bin_shards[i] = shard;
+   }
+
+   return setup->bin_shards[i];
+}
+
+
+/**
+ * Bin a MESA_PRIM_TRIANGLES draw on multiple threads.
+ *
+ * \return false if the draw wasn't binned, in which case the caller
+ *         must bin it serially.
+ */
+bool
+lp_setup_bin_triangles_parallel(struct lp_setup_context *setup,
+                                const void *vertex_buffer,
+                                unsigned stride,
+                                const uint16_t *indices,
+                                unsigned nr)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+   struct lp_scene *scene = setup->scene;
+   const unsigned num_tris = nr / 3;
+   const unsigned num_shards =
+      MIN2(setup->num_threads, num_tris / LP_BIN_SHARD_MIN_TRIS);
+
+   /* The linear rasterizer's rectangle setup and the pipeline statistics
+    * counters can't be run on several threads.
+    */
+   if (num_shards < 2 ||
+       (LP_PERF & PERF_NO_BIN_THREADS) ||
+       setup->bin_shard ||
+       setup->permit_linear_rasterizer ||
+       setup->rasterizer_discard ||
+       lp->active_statistics_queries ||
+       !scene ||
+       !screen->cs_tpool || !screen->cs_tpool->num_threads)
+      return false;
+
+   /* Leave it to the serial path to flush an almost full scene. */
+   const unsigned budget = (LP_SCENE_MAX_SIZE - scene->scene_size) / num_shards;
+   if (budget < 2 * DATA_BLOCK_SIZE)
+      return false;
+
+   /* Replace first_triangle(), the state is already up to date. */
+   lp_setup_choose_triangle(setup);
+
+   for (unsigned i = 0; i < num_shards; i++) {
+      struct lp_bin_shard *shard = get_bin_shard(setup, i);
+
+      if (!shard || !lp_scene_begin_shard(shard->scene, scene, budget)) {
+         while (i--)
+            lp_scene_discard_shard(setup->bin_shards[i]->scene);
+         return false;
+      }
+
+      memcpy(&shard->setup, setup, sizeof *setup);
+      shard->setup.scene = shard->scene;
+      shard->setup.bin_shard = true;
+      shard->vertex_buffer = vertex_buffer;
+      shard->indices = indices;
+      shard->stride = stride;
+      shard->first_tri = num_tris * i / num_shards;
+      shard->end_tri = num_tris * (i + 1) / num_shards;
+   }
+
+   struct lp_cs_tpool_task *task =
+      lp_cs_tpool_queue_task(screen->cs_tpool, bin_shard_task,
+                             setup->bin_shards, num_shards);
+   bool failed = !task;
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+
+   for (unsigned i = 0; i < num_shards; i++)
+      failed = failed || setup->bin_shards[i]->scene->alloc_failed;
+
+   for (unsigned i = 0; i < num_shards; i++) {
+      if (failed)
+         lp_scene_discard_shard(setup->bin_shards[i]->scene);
+      else
+         lp_scene_merge_shard(scene, setup->bin_shards[i]->scene);
+   }
+
+   if (failed) {
+      LP_DBG(DEBUG_SETUP, "%s: falling back to serial binning\n", __func__);
+      return false;
+   }
+
+   LP_COUNT_ADD(nr_parallel_binned_tris, num_tris);
+
+   return true;
+}
+
+
+void
+lp_setup_destroy_bin_shards(struct lp_setup_context *setup)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(setup->bin_shards); i++) {
+      struct lp_bin_shard *shard = setup->bin_shards[i];
+
+      if (shard) {
+         lp_scene_destroy(shard->scene);
+         FREE(shard);
+         setup->bin_shards[i] = NULL;
+      }
+   }
+}
@@ -88,6 +88,7 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
    struct lp_scene *scene = setup->scene;
 
    LP_COUNT(nr_fully_covered_64);
+   scene->stats[LP_STAT_FULLY_COVERED_64]++;
 
    /* if variant is opaque and scissor doesn't effect the tile */
    if (opaque) {
@@ -208,6 +209,7 @@ partial(struct lp_setup_context *setup,
       lp_setup_whole_tile(setup, &rect->inputs, ix, iy, opaque);
    } else {
       LP_COUNT(nr_partially_covered_64);
+      setup->scene->stats[LP_STAT_PARTIALLY_COVERED_64]++;
       lp_scene_bin_cmd_with_state(setup->scene,
                                   ix, iy,
                                   setup->fs.stored,
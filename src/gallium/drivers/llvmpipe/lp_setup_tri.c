@@ -326,6 +326,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    if (!u_rect_test_intersection(&setup->draw_regions[viewport_index], &bbox)) {
       if (0) debug_printf("no intersection\n");
       LP_COUNT(nr_culled_tris);
+      scene->stats[LP_STAT_CULLED_TRIS]++;
       return true;
    }
 
@@ -827,6 +828,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
              ix0 == bbox->x1 / TILE_SIZE);
 
+      scene->stats[LP_STAT_PARTIALLY_COVERED_64]++;
+
       if (nr_planes == 3) {
          if (sz < 4) {
             /* Triangle is contained in a single 4x4 stamp:
@@ -948,6 +951,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                if (in)
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
+               scene->stats[LP_STAT_EMPTY_64]++;
             } else if (partial) {
                /* Not trivially accepted by at least one plane -
                 * rasterize/shade partial tile
@@ -965,6 +969,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                   goto fail;
 
                LP_COUNT(nr_partially_covered_64);
+               scene->stats[LP_STAT_PARTIALLY_COVERED_64]++;
             } else {
                /* triangle covers the whole tile- shade whole tile */
                LP_COUNT(nr_fully_covered_64);
@@ -1013,10 +1018,19 @@ retry_triangle_ccw(struct lp_setup_context *setup,
    if (lp_setup_zero_sample_mask(setup)) {
       if (0) debug_printf("zero sample mask\n");
       LP_COUNT(nr_culled_tris);
+      setup->scene->stats[LP_STAT_CULLED_TRIS]++;
       return;
    }
 
    if (!do_triangle_ccw(setup, position, v0, v1, v2, front)) {
+      /* Can't flush from a worker thread, the whole draw gets rebinned
+       * serially instead.
+       */
+      if (setup->bin_shard) {
+         setup->scene->alloc_failed = true;
+         return;
+      }
+
       if (!lp_setup_flush_and_restart(setup))
          return;
 
@@ -1164,6 +1178,10 @@ triangle_cw(struct lp_setup_context *setup,
 
    int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
 
+   setup->scene->stats[LP_STAT_TRIS]++;
+   if (area_sign >= 0)  /* back-facing or zero area */
+      setup->scene->stats[LP_STAT_CULLED_TRIS]++;
+
    if (area_sign < 0) {
       if (setup->flatshade_first) {
          rotate_fixed_position_12(&position);
@@ -1193,6 +1211,10 @@ triangle_ccw(struct lp_setup_context *setup,
 
    int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
 
+   setup->scene->stats[LP_STAT_TRIS]++;
+   if (area_sign <= 0)  /* back-facing or zero area */
+      setup->scene->stats[LP_STAT_CULLED_TRIS]++;
+
    if (area_sign > 0)
       retry_triangle_ccw(setup, &position, v0, v1, v2, setup->ccw_is_frontface);
 }
@@ -1216,6 +1238,10 @@ triangle_both(struct lp_setup_context *setup,
 
    int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
 
+   setup->scene->stats[LP_STAT_TRIS]++;
+   if (area_sign == 0)  /* zero area */
+      setup->scene->stats[LP_STAT_CULLED_TRIS]++;
+
    if (0) {
       assert(!util_is_inf_or_nan(v0[0][0]));
       assert(!util_is_inf_or_nan(v0[0][1]));
@@ -42,6 +42,8 @@
 #include "draw/draw_vertex.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
 #include "lp_state_fs.h"
 #include "lp_perf.h"
 
@@ -53,6 +55,11 @@
 
 #define LP_MAX_VBUF_SIZE    4096
 
+/* With multiple threads, allow enough vertices per draw to make binning
+ * it in parallel worthwhile, see lp_setup_bin_triangles_parallel().
+ */
+#define LP_MAX_VBUF_SIZE_THREADED (64 * 1024)
+
 
 
 /** cast wrapper */
@@ -165,6 +172,17 @@ rect(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Charge the time spent binning a draw to the current scene.
+ */
+static inline void
+add_bin_time(struct lp_setup_context *setup, int64_t start)
+{
+   if (setup->scene)
+      setup->scene->stats[LP_STAT_BIN_TIME] += os_time_get_nano() - start;
+}
+
+
 /**
  * draw elements / indexed primitives
  */
@@ -175,8 +193,11 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
    const unsigned stride = setup->vertex_info->size * sizeof(float);
    const void *vertex_buffer = setup->vertex_buffer;
    const bool flatshade_first = setup->flatshade_first;
+   const int64_t bin_start = os_time_get_nano();
    unsigned i;
 
+   MESA_TRACE_FUNC();
+
    assert(setup->setup.variant);
 
    if (!lp_setup_update_state(setup, true))
@@ -223,7 +244,10 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
       break;
 
    case MESA_PRIM_TRIANGLES:
-      if (nr % 6 == 0 && !uses_constant_interp) {
+      if (lp_setup_bin_triangles_parallel(setup, vertex_buffer, stride,
+                                          indices, nr)) {
+         /* binned on the worker threads */
+      } else if (nr % 6 == 0 && !uses_constant_interp) {
          for (i = 5; i < nr; i += 6) {
             rect(setup,
                  get_vert(vertex_buffer, indices[i-5], stride),
@@ -370,6 +394,8 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
    default:
       assert(0);
    }
+
+   add_bin_time(setup, bin_start);
 }
 
 
@@ -385,8 +411,11 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    const void *vertex_buffer =
       (void *) get_vert(setup->vertex_buffer, start, stride);
    const bool flatshade_first = setup->flatshade_first;
+   const int64_t bin_start = os_time_get_nano();
    unsigned i;
 
+   MESA_TRACE_FUNC();
+
    if (!lp_setup_update_state(setup, true))
       return;
 
@@ -431,7 +460,10 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       break;
 
    case MESA_PRIM_TRIANGLES:
-      if (nr % 6 == 0 && !uses_constant_interp) {
+      if (lp_setup_bin_triangles_parallel(setup, vertex_buffer, stride,
+                                          NULL, nr)) {
+         /* binned on the worker threads */
+      } else if (nr % 6 == 0 && !uses_constant_interp) {
          for (i = 5; i < nr; i += 6) {
             rect(setup,
                  get_vert(vertex_buffer, i-5, stride),
@@ -632,6 +664,8 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    default:
       assert(0);
    }
+
+   add_bin_time(setup, bin_start);
 }
 
 
@@ -706,7 +740,8 @@ void
 lp_setup_init_vbuf(struct lp_setup_context *setup)
 {
    setup->base.max_indices = LP_MAX_VBUF_INDEXES;
-   setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE;
+   setup->base.max_vertex_buffer_bytes = setup->num_threads > 1 ?
+      LP_MAX_VBUF_SIZE_THREADED : LP_MAX_VBUF_SIZE;
 
    setup->base.get_vertex_info = lp_setup_get_vertex_info;
    setup->base.allocate_vertices = lp_setup_allocate_vertices;
@@ -126,6 +126,9 @@ llvmpipe_set_framebuffer_state(struct pipe_context *,
 void
 llvmpipe_update_fs(struct llvmpipe_context *lp);
 
+void
+llvmpipe_check_fs_fallback(struct llvmpipe_context *lp);
+
 void
 llvmpipe_update_setup(struct llvmpipe_context *lp);
 
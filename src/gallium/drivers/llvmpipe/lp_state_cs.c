@@ -311,12 +311,10 @@ mesh_convert_to_aos(struct gallivm_state *gallivm,
 }
 
 static void
-generate_compute(struct llvmpipe_context *lp,
-                 struct lp_compute_shader *shader,
+generate_compute(struct nir_shader *nir,
                  struct lp_compute_shader_variant *variant)
 {
    struct gallivm_state *gallivm = variant->gallivm;
-   struct nir_shader *nir = shader->base.ir.nir;
    const struct lp_compute_shader_variant_key *key = &variant->key;
    char func_name[64], func_name_coro[64];
    LLVMTypeRef arg_types[CS_ARG_MAX];
@@ -417,7 +415,7 @@ generate_compute(struct llvmpipe_context *lp,
       }
    }
 
-   if (variant->gallivm->cache->data_size) {
+   if (variant->gallivm->cache && variant->gallivm->cache->data_size) {
       gallivm_stub_func(gallivm, function);
       if (use_coro)
          gallivm_stub_func(gallivm, coro);
@@ -561,7 +559,7 @@ generate_compute(struct llvmpipe_context *lp,
                                                             variant->jit_cs_context_type,
                                                             params.context_ptr);
 
-         lp_build_nir_soa_func(gallivm, shader->base.ir.nir,
+         lp_build_nir_soa_func(gallivm, nir,
                                func->impl,
                                &params,
                                NULL);
@@ -934,7 +932,7 @@ generate_compute(struct llvmpipe_context *lp,
          io = LLVMBuildPtrToInt(gallivm->builder, io_ptr, LLVMInt64TypeInContext(gallivm->context),  "");
          io = LLVMBuildAdd(builder, io, LLVMBuildZExt(builder, LLVMBuildMul(builder, vertex_loop_state.counter, lp_build_const_int32(gallivm, vsize), ""), LLVMInt64TypeInContext(gallivm->context), ""), "");
          io = LLVMBuildIntToPtr(gallivm->builder, io, LLVMPointerType(LLVMVoidTypeInContext(gallivm->context), 0), "");
-         mesh_convert_to_aos(gallivm, shader->base.ir.nir, true, variant->jit_vertex_header_type,
+         mesh_convert_to_aos(gallivm, nir, true, variant->jit_vertex_header_type,
                              io, output_array, clipmask,
                              vertex_loop_state.counter, lp_elem_type(cs_type), -1, false);
          lp_build_loop_end_cond(&vertex_loop_state,
@@ -949,7 +947,7 @@ generate_compute(struct llvmpipe_context *lp,
          prim_offset = LLVMBuildAdd(builder, prim_offset, lp_build_const_int32(gallivm, vsize * (nir->info.mesh.max_vertices_out + 8)), "");
          io = LLVMBuildAdd(builder, io, LLVMBuildZExt(builder, prim_offset, LLVMInt64TypeInContext(gallivm->context), ""), "");
          io = LLVMBuildIntToPtr(gallivm->builder, io, LLVMPointerType(LLVMVoidTypeInContext(gallivm->context), 0), "");
-         mesh_convert_to_aos(gallivm, shader->base.ir.nir, false, variant->jit_prim_type,
+         mesh_convert_to_aos(gallivm, nir, false, variant->jit_prim_type,
                              io, output_array, clipmask,
                              prim_loop_state.counter, lp_elem_type(cs_type), -1, false);
          lp_build_loop_end_cond(&prim_loop_state,
@@ -1049,6 +1047,11 @@ llvmpipe_get_compute_state_info(struct pipe_context *pipe, void *cs,
 }
 
 
+static void
+destroy_variant(struct llvmpipe_context *lp,
+                struct lp_compute_shader_variant *variant);
+
+
 /**
  * Remove shader variant from two lists: the shader's variant list
  * and the context's variant list.
@@ -1066,8 +1069,6 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_cs_variants, variant->nr_instrs, lp->nr_cs_instrs);
    }
 
-   gallivm_destroy(variant->gallivm);
-
    /* remove from shader's list */
    list_del(&variant->list_item_local.list);
    variant->shader->variants_cached--;
@@ -1077,8 +1078,7 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
    lp->nr_cs_variants--;
    lp->nr_cs_instrs -= variant->nr_instrs;
 
-   FREE(variant->function_name);
-   FREE(variant);
+   destroy_variant(lp, variant);
 }
 
 
@@ -1145,16 +1145,16 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if (BITSET_TEST(nir->info.textures_used, i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[sh_type][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[sh_type][i]);
          }
       }
    } else {
       key->nr_sampler_views = key->nr_samplers;
       for (unsigned i = 0; i < key->nr_sampler_views; ++i) {
          if (BITSET_TEST(nir->info.samplers_used, i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[sh_type][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[sh_type][i]);
          }
       }
    }
@@ -1251,6 +1251,7 @@ lp_debug_cs_variant(const struct lp_compute_shader_variant *variant)
 
 static void
 lp_cs_get_ir_cache_key(struct lp_compute_shader_variant *variant,
+                       struct nir_shader *nir,
                        unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH])
 {
    struct blob blob = { 0 };
@@ -1258,7 +1259,7 @@ lp_cs_get_ir_cache_key(struct lp_compute_shader_variant *variant,
    void *ir_binary;
 
    blob_init(&blob);
-   nir_serialize(&blob, variant->shader->base.ir.nir, true);
+   nir_serialize(&blob, nir, true);
    ir_binary = blob.data;
    ir_size = blob.size;
 
@@ -1273,13 +1274,9 @@ lp_cs_get_ir_cache_key(struct lp_compute_shader_variant *variant,
 
 
 static struct lp_compute_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
-                 struct lp_compute_shader *shader,
-                 mesa_shader_stage sh_type,
-                 const struct lp_compute_shader_variant_key *key)
+create_variant(struct lp_compute_shader *shader,
+               const struct lp_compute_shader_variant_key *key)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
-
    struct lp_compute_shader_variant *variant =
       MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
@@ -1287,43 +1284,64 @@ generate_variant(struct llvmpipe_context *lp,
 
    memset(variant, 0, sizeof(*variant));
 
+   variant->shader = shader;
+   memcpy(&variant->key, key, shader->variant_key_size);
+
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
+
+   if ((LP_DEBUG & DEBUG_CS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
+      lp_debug_cs_variant(variant);
+   }
+
+   return variant;
+}
+
+
+/**
+ * Generate the code of a variant from the given NIR in the given LLVM
+ * context.  The NIR is modified by the prepasses, so background compiles
+ * pass their own copy.  Unoptimized variants bypass the disk cache.
+ */
+static bool
+compile_variant(struct llvmpipe_screen *screen,
+                lp_context_ref *context,
+                struct nir_shader *nir,
+                struct lp_compute_shader_variant *variant,
+                bool optimize)
+{
+   struct lp_compute_shader *shader = variant->shader;
+   mesa_shader_stage sh_type = nir->info.stage;
+
    char module_name[64];
    const char *shname = sh_type == MESA_SHADER_MESH ? "ms" :
       (sh_type == MESA_SHADER_TASK ? "ts" : "cs");
    snprintf(module_name, sizeof(module_name), "%s%u_variant%u",
-            shname, shader->no, shader->variants_created);
-
-   variant->shader = shader;
-   memcpy(&variant->key, key, shader->variant_key_size);
+            shname, shader->no, variant->no);
 
    unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH];
    struct lp_cached_code cached = { 0 };
    bool needs_caching = false;
 
-   lp_cs_get_ir_cache_key(variant, ir_sha1_cache_key);
+   if (optimize) {
+      lp_cs_get_ir_cache_key(variant, nir, ir_sha1_cache_key);
 
-   lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-   if (!cached.data_size)
-      needs_caching = true;
-
-   variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = true;
    }
 
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
+   variant->gallivm = gallivm_create(module_name, context,
+                                     optimize ? &cached : NULL);
+   if (!variant->gallivm)
+      return false;
 
-   if ((LP_DEBUG & DEBUG_CS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
-      lp_debug_cs_variant(variant);
-   }
+   variant->gallivm->no_opt = !optimize;
 
    lp_jit_init_cs_types(variant);
 
    if (sh_type == MESA_SHADER_MESH) {
-      struct nir_shader *nir = shader->base.ir.nir;
       int per_prim_count = util_bitcount64(nir->info.per_primitive_outputs);
       int out_count = util_bitcount64(nir->info.outputs_written);
       int per_vert_count = out_count - per_prim_count;
@@ -1332,7 +1350,7 @@ generate_variant(struct llvmpipe_context *lp,
       variant->jit_prim_type = LLVMArrayType(LLVMArrayType(LLVMFloatTypeInContext(variant->gallivm->context), 4), per_prim_count);
    }
 
-   generate_compute(lp, shader, variant);
+   generate_compute(nir, variant);
 
 #if GALLIVM_USE_ORCJIT
 /* module has been moved into ORCJIT after gallivm_compile_module */
@@ -1352,10 +1370,187 @@ generate_variant(struct llvmpipe_context *lp,
       lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
    }
    gallivm_free_ir(variant->gallivm);
+   return true;
+}
+
+
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 const struct lp_compute_shader_variant_key *key,
+                 bool optimize)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   struct lp_compute_shader_variant *variant = create_variant(shader, key);
+   if (!variant)
+      return NULL;
+
+   if (!compile_variant(screen, &lp->context, shader->base.ir.nir,
+                        variant, optimize)) {
+      destroy_variant(lp, variant);
+      return NULL;
+   }
+
+   return variant;
+}
+
+
+/**
+ * Background compilation of an optimized compute shader variant with
+ * GALLIVM_PERF=tiered, see the fragment shader equivalent in
+ * lp_state_fs.c.  Dispatches are synchronous, so the unoptimized variant
+ * is replaced as soon as the job has finished.
+ */
+struct lp_cs_variant_job {
+   struct llvmpipe_screen *screen;
+   uint64_t *stats;              /**< llvmpipe_context::stats */
+   struct nir_shader *nir;
+   struct lp_compute_shader_variant *variant;
+   unsigned invocations;
+   bool queued;
+   bool cache_only;
+   bool compiled;
+   struct util_queue_fence fence;
+};
+
+
+static void
+cs_variant_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_cs_variant_job *job = data;
+   struct lp_compute_shader_variant *variant = job->variant;
+
+   int64_t t0 = os_time_get();
+   if (job->cache_only) {
+      unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH];
+
+      lp_cs_get_ir_cache_key(variant, job->nir, ir_sha1_cache_key);
+      if (!lp_disk_cache_has_shader(job->screen, ir_sha1_cache_key)) {
+         /* keep the NIR for the compile once the variant is hot */
+         lp_stats_count_compile(job->stats, os_time_get() - t0);
+         return;
+      }
+   }
+
+   lp_context_create(&variant->context);
+   if (variant->context.ref) {
+      job->compiled = compile_variant(job->screen, &variant->context,
+                                      job->nir, variant, true);
+   }
+   lp_stats_count_compile(job->stats, os_time_get() - t0);
+
+   ralloc_free(job->nir);
+   job->nir = NULL;
+}
+
+
+/**
+ * Wait for and release the background job attached to an unoptimized
+ * variant, dropping the optimized variant if it was never swapped in.
+ */
+static void
+cs_variant_job_destroy(struct llvmpipe_context *lp,
+                       struct lp_cs_variant_job *job)
+{
+   util_queue_fence_wait(&job->fence);
+   util_queue_fence_destroy(&job->fence);
+   ralloc_free(job->nir);
+   if (job->variant)
+      destroy_variant(lp, job->variant);
+   FREE(job);
+}
+
+
+static void
+destroy_variant(struct llvmpipe_context *lp,
+                struct lp_compute_shader_variant *variant)
+{
+   if (variant->job)
+      cs_variant_job_destroy(lp, variant->job);
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   lp_context_destroy(&variant->context);
+   FREE(variant->function_name);
+   FREE(variant);
+}
+
+
+static void
+cs_variant_job_queue(struct llvmpipe_context *lp,
+                     struct lp_compute_shader_variant *fallback);
+
+
+/**
+ * Generate an unoptimized compute variant, along with the job which
+ * compiles the optimized one once the variant is used often enough.
+ * Returns NULL if the caller should just compile the optimized variant.
+ */
+static struct lp_compute_shader_variant *
+generate_fallback_variant(struct llvmpipe_context *lp,
+                          struct lp_compute_shader *shader,
+                          const struct lp_compute_shader_variant_key *key)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   struct lp_compute_shader_variant *variant = create_variant(shader, key);
+   if (!variant)
+      return NULL;
+
+   struct lp_cs_variant_job *job = CALLOC_STRUCT(lp_cs_variant_job);
+   if (!job ||
+       !compile_variant(screen, &lp->context, shader->base.ir.nir,
+                        variant, false)) {
+      FREE(job);
+      destroy_variant(lp, variant);
+      return NULL;
+   }
+
+   job->screen = screen;
+   job->stats = lp->stats;
+   util_queue_fence_init(&job->fence);
+   variant->job = job;
+
+   /* Loading optimized code from the disk cache is cheaper still, look it
+    * up in the background and swap it in as soon as it is loaded.
+    */
+   if (screen->disk_shader_cache) {
+      job->cache_only = true;
+      cs_variant_job_queue(lp, variant);
+   }
+
    return variant;
 }
 
 
+/**
+ * Queue the compilation of the optimized variant replacing an unoptimized
+ * one.  Drops the job if that is not possible.
+ */
+static void
+cs_variant_job_queue(struct llvmpipe_context *lp,
+                     struct lp_compute_shader_variant *fallback)
+{
+   struct lp_cs_variant_job *job = fallback->job;
+
+   /* A cache-only job which missed leaves both for the compile. */
+   if (!job->variant)
+      job->variant = create_variant(fallback->shader, &fallback->key);
+   if (!job->nir)
+      job->nir = nir_shader_clone(NULL, fallback->shader->base.ir.nir);
+
+   if (!job->variant || !job->nir) {
+      fallback->job = NULL;
+      cs_variant_job_destroy(lp, job);
+      return;
+   }
+
+   job->queued = true;
+   util_queue_add_job(&lp->compile_queue, job, &job->fence,
+                      cs_variant_job_execute, NULL, 0);
+}
+
+
 static void
 lp_cs_ctx_set_cs_variant(struct lp_cs_context *csctx,
                          struct lp_compute_shader_variant *variant)
@@ -1364,6 +1559,22 @@ lp_cs_ctx_set_cs_variant(struct lp_cs_context *csctx,
 }
 
 
+/**
+ * Put a new variant at the head of the shader's and the context's
+ * variant lists.
+ */
+static void
+llvmpipe_add_cs_shader_variant(struct llvmpipe_context *lp,
+                               struct lp_compute_shader_variant *variant)
+{
+   list_add(&variant->list_item_local.list, &variant->shader->variants.list);
+   list_add(&variant->list_item_global.list, &lp->cs_variants_list.list);
+   lp->nr_cs_variants++;
+   lp->nr_cs_instrs += variant->nr_instrs;
+   variant->shader->variants_cached++;
+}
+
+
 static struct lp_compute_shader_variant *
 llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
                            mesa_shader_stage sh_type,
@@ -1442,24 +1653,71 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
        */
       int64_t t0, t1, dt;
       t0 = os_time_get();
-      variant = generate_variant(lp, shader, sh_type, key);
+      if (sh_type == MESA_SHADER_COMPUTE &&
+          (gallivm_get_perf_flags() & GALLIVM_PERF_TIERED) &&
+          util_queue_is_initialized(&lp->compile_queue))
+         variant = generate_fallback_variant(lp, shader, key);
+      if (!variant)
+         variant = generate_variant(lp, shader, key, true);
       t1 = os_time_get();
       dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+      lp_stats_count_compile(lp->stats, dt);
 
       /* Put the new variant into the list */
-      if (variant) {
-         list_add(&variant->list_item_local.list, &shader->variants.list);
-         list_add(&variant->list_item_global.list, &lp->cs_variants_list.list);
-         lp->nr_cs_variants++;
-         lp->nr_cs_instrs += variant->nr_instrs;
-         shader->variants_cached++;
-      }
+      if (variant)
+         llvmpipe_add_cs_shader_variant(lp, variant);
    }
    return variant;
 }
 
+
+/**
+ * Called before each dispatch: count the invocations of an unoptimized
+ * compute variant, queue its optimized compile once it is hot, and swap
+ * the optimized variant in once that has finished.
+ */
+static void
+llvmpipe_cs_tier_up(struct llvmpipe_context *lp)
+{
+   struct lp_compute_shader_variant *fallback = lp->csctx->cs.current.variant;
+   struct lp_cs_variant_job *job = fallback ? fallback->job : NULL;
+
+   if (!job)
+      return;
+
+   if (!job->queued) {
+      if (++job->invocations >= lp->tier_up_threshold)
+         cs_variant_job_queue(lp, fallback);
+      return;
+   }
+
+   if (!util_queue_fence_is_signalled(&job->fence))
+      return;
+
+   /* Not in the disk cache, compile it once it is hot. */
+   if (job->cache_only && !job->compiled) {
+      job->cache_only = false;
+      job->queued = false;
+      return;
+   }
+
+   struct lp_compute_shader_variant *variant = job->compiled ? job->variant : NULL;
+
+   /* Keep using the fallback if the optimized variant failed to build. */
+   if (!variant) {
+      fallback->job = NULL;
+      cs_variant_job_destroy(lp, job);
+      return;
+   }
+
+   job->variant = NULL;
+   llvmpipe_remove_cs_shader_variant(lp, fallback);
+   llvmpipe_add_cs_shader_variant(lp, variant);
+   lp_cs_ctx_set_cs_variant(lp->csctx, variant);
+}
+
 static void
 llvmpipe_update_cs(struct llvmpipe_context *lp)
 {
@@ -1689,7 +1947,8 @@ llvmpipe_cs_update_derived(struct llvmpipe_context *llvmpipe)
 
 
 static void
-cs_exec_fn(void *init_data, int iter_idx, struct lp_cs_local_mem *lmem)
+cs_exec_fn(void *init_data, int iter_start, int iter_count,
+           struct lp_cs_local_mem *lmem)
 {
    struct lp_cs_job_info *job_info = init_data;
    struct lp_jit_cs_thread_data thread_data;
@@ -1701,46 +1960,53 @@ cs_exec_fn(void *init_data, int iter_idx, struct lp_cs_local_mem *lmem)
                                     job_info->req_local_mem);
       lmem->local_size = job_info->req_local_mem;
    }
-   if (job_info->zero_initialize_shared_memory)
-      memset(lmem->local_mem_ptr, 0, job_info->req_local_mem);
    thread_data.shared = lmem->local_mem_ptr;
 
-   thread_data.payload = job_info->payload;
-
+   const unsigned *iter_size = job_info->use_iters ? job_info->iter_size : job_info->grid_size;
    unsigned grid_z, grid_y, grid_x;
 
-   if (job_info->use_iters) {
-      grid_z = iter_idx / (job_info->iter_size[0] * job_info->iter_size[1]);
-      grid_y = (iter_idx - (grid_z * (job_info->iter_size[0] * job_info->iter_size[1]))) / job_info->iter_size[0];
-      grid_x = (iter_idx - (grid_z * (job_info->iter_size[0] * job_info->iter_size[1])) - (grid_y * job_info->iter_size[0]));
-   } else {
-      grid_z = iter_idx / (job_info->grid_size[0] * job_info->grid_size[1]);
-      grid_y = (iter_idx - (grid_z * (job_info->grid_size[0] * job_info->grid_size[1]))) / job_info->grid_size[0];
-      grid_x = (iter_idx - (grid_z * (job_info->grid_size[0] * job_info->grid_size[1])) - (grid_y * job_info->grid_size[0]));
-   }
+   grid_z = iter_start / (iter_size[0] * iter_size[1]);
+   grid_y = (iter_start - (grid_z * (iter_size[0] * iter_size[1]))) / iter_size[0];
+   grid_x = (iter_start - (grid_z * (iter_size[0] * iter_size[1])) - (grid_y * iter_size[0]));
 
-   grid_z += job_info->grid_base[2];
-   grid_y += job_info->grid_base[1];
-   grid_x += job_info->grid_base[0];
    struct lp_compute_shader_variant *variant = job_info->current->variant;
 
-   void *io_ptr = NULL;
-   if (job_info->io) {
-      size_t io_offset = job_info->io_stride * iter_idx;
-      io_ptr = (char *)job_info->io + io_offset;
-   }
-   if (thread_data.payload) {
-      size_t payload_offset = job_info->payload_stride * iter_idx;
-      thread_data.payload = (char *)thread_data.payload + payload_offset;
-   }
-   variant->jit_function(&job_info->current->jit_context,
-                         &job_info->current->jit_resources,
-                         job_info->block_size[0], job_info->block_size[1], job_info->block_size[2],
-                         grid_x, grid_y, grid_z,
-                         job_info->grid_size[0], job_info->grid_size[1], job_info->grid_size[2],
-                         job_info->work_dim, job_info->draw_id,
-                         io_ptr,
-                         &thread_data);
+   /* Run the chunk's workgroups back to back, stepping through the grid
+    * rather than recomputing the position of each of them.
+    */
+   for (int iter_idx = iter_start; iter_idx < iter_start + iter_count; iter_idx++) {
+      if (job_info->zero_initialize_shared_memory)
+         memset(lmem->local_mem_ptr, 0, job_info->req_local_mem);
+
+      void *io_ptr = NULL;
+      if (job_info->io) {
+         size_t io_offset = job_info->io_stride * iter_idx;
+         io_ptr = (char *)job_info->io + io_offset;
+      }
+      thread_data.payload = job_info->payload;
+      if (thread_data.payload) {
+         size_t payload_offset = job_info->payload_stride * iter_idx;
+         thread_data.payload = (char *)thread_data.payload + payload_offset;
+      }
+      variant->jit_function(&job_info->current->jit_context,
+                            &job_info->current->jit_resources,
+                            job_info->block_size[0], job_info->block_size[1], job_info->block_size[2],
+                            grid_x + job_info->grid_base[0],
+                            grid_y + job_info->grid_base[1],
+                            grid_z + job_info->grid_base[2],
+                            job_info->grid_size[0], job_info->grid_size[1], job_info->grid_size[2],
+                            job_info->work_dim, job_info->draw_id,
+                            io_ptr,
+                            &thread_data);
+
+      if (++grid_x == iter_size[0]) {
+         grid_x = 0;
+         if (++grid_y == iter_size[1]) {
+            grid_y = 0;
+            grid_z++;
+         }
+      }
+   }
 }
 
 
@@ -1785,9 +2051,12 @@ llvmpipe_launch_grid(struct pipe_context *pipe,
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   llvmpipe_mark_shaders_busy(llvmpipe);
+
    memset(&job_info, 0, sizeof(job_info));
 
    llvmpipe_cs_update_derived(llvmpipe);
+   llvmpipe_cs_tier_up(llvmpipe);
 
    fill_grid_size(pipe, 0, info, job_info.grid_size);
 
@@ -2129,6 +2398,8 @@ llvmpipe_draw_mesh_tasks(struct pipe_context *pipe,
    if (!llvmpipe_check_render_cond(lp))
       return;
 
+   llvmpipe_mark_shaders_busy(lp);
+
    memset(&job_info, 0, sizeof(job_info));
    if (lp->dirty)
       llvmpipe_update_derived(lp);
@@ -75,6 +75,8 @@ struct lp_cs_variant_list_item
    struct lp_compute_shader_variant *base;
 };
 
+struct lp_cs_variant_job;
+
 struct lp_compute_shader_variant
 {
    struct gallivm_state *gallivm;
@@ -104,6 +106,14 @@ struct lp_compute_shader_variant
    /* For debugging/profiling purposes */
    unsigned no;
 
+   /* Set on unoptimized variants while the optimized variant is pending,
+    * only with GALLIVM_PERF=tiered.
+    */
+   struct lp_cs_variant_job *job;
+
+   /* LLVM context of variants compiled in the background */
+   lp_context_ref context;
+
    /* key is variable-sized, must be last */
    struct lp_compute_shader_variant_key key;
 };
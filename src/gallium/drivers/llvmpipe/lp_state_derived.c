@@ -35,6 +35,7 @@
 #include "lp_screen.h"
 #include "lp_setup.h"
 #include "lp_state.h"
+#include "lp_texture.h"
 
 #include "tgsi/tgsi_from_mesa.h"
 
@@ -202,6 +203,7 @@ check_linear_rasterizer(struct llvmpipe_context *lp)
       (lp->framebuffer.nr_cbufs == 1 && lp->framebuffer.cbufs[0].texture &&
        util_res_sample_count(lp->framebuffer.cbufs[0].texture) == 1 &&
        lp->framebuffer.cbufs[0].texture->target == PIPE_TEXTURE_2D &&
+       !llvmpipe_resource_is_tiled(lp->framebuffer.cbufs[0].texture) &&
        (lp->framebuffer.cbufs[0].format == PIPE_FORMAT_B8G8R8A8_UNORM ||
         lp->framebuffer.cbufs[0].format == PIPE_FORMAT_B8G8R8X8_UNORM ||
         lp->framebuffer.cbufs[0].format == PIPE_FORMAT_R8G8B8A8_UNORM ||
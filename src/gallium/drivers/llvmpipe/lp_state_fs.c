@@ -677,6 +677,7 @@ fs_fb_fetch(const struct lp_build_fs_iface *iface,
 static void
 generate_fs_loop(struct gallivm_state *gallivm,
                  struct lp_fragment_shader *shader,
+                 struct nir_shader *nir,
                  const struct lp_fragment_shader_variant_key *key,
                  LLVMBuilderRef builder,
                  struct lp_type type,
@@ -713,7 +714,6 @@ generate_fs_loop(struct gallivm_state *gallivm,
    LLVMValueRef min_depth_bounds = NULL, max_depth_bounds = NULL;
    struct lp_build_for_loop_state loop_state, sample_loop_state = {0};
    struct lp_build_mask_context mask;
-   struct nir_shader *nir = shader->base.ir.nir;
    const bool dual_source_blend = key->blend.rt[0].blend_enable &&
                                   util_blend_state_is_dual(&key->blend, 0);
    const bool post_depth_coverage = nir->info.fs.post_depth_coverage;
@@ -3161,7 +3161,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
+generate_fragment(struct nir_shader *nir,
                   struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
@@ -3169,7 +3169,6 @@ generate_fragment(struct llvmpipe_context *lp,
    assert(partial_mask == RAST_WHOLE ||
           partial_mask == RAST_EDGE_TEST);
 
-   struct nir_shader *nir = shader->base.ir.nir;
    struct gallivm_state *gallivm = variant->gallivm;
    struct lp_fragment_shader_variant_key *key = &variant->key;
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
@@ -3290,7 +3289,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
    lp_function_add_debug_info(gallivm, function, func_type);
 
-   if (variant->gallivm->cache->data_size) {
+   if (variant->gallivm->cache && variant->gallivm->cache->data_size) {
       gallivm_stub_func(gallivm, function);
       return;
    }
@@ -3510,7 +3509,7 @@ generate_fragment(struct llvmpipe_context *lp,
                                x, y);
 
       generate_fs_loop(gallivm,
-                       shader, key,
+                       shader, nir, key,
                        builder,
                        fs_type,
                        variant->jit_context_type,
@@ -3810,7 +3809,9 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
 
 
 static void
-lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
+lp_fs_get_ir_cache_key(const struct lp_fragment_shader *shader,
+                       struct nir_shader *nir,
+                       const struct lp_fragment_shader_variant_key *key,
                        unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH])
 {
    struct blob blob = { 0 };
@@ -3818,13 +3819,13 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
    void *ir_binary;
 
    blob_init(&blob);
-   nir_serialize(&blob, variant->shader->base.ir.nir, true);
+   nir_serialize(&blob, nir, true);
    ir_binary = blob.data;
    ir_size = blob.size;
 
    struct mesa_sha1 ctx;
    _mesa_sha1_init(&ctx);
-   _mesa_sha1_update(&ctx, &variant->key, variant->shader->variant_key_size);
+   _mesa_sha1_update(&ctx, key, shader->variant_key_size);
    _mesa_sha1_update(&ctx, ir_binary, ir_size);
    _mesa_sha1_final(&ctx, ir_sha1_cache_key);
 
@@ -3833,15 +3834,14 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 
 
 /**
- * Generate a new fragment shader variant from the shader code and
- * other state indicated by the key.
+ * Allocate a fragment shader variant for the given key.  The variant
+ * holds a reference to the shader but has no code yet.
  */
 static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
-                 struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+create_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader *shader,
+               const struct lp_fragment_shader_variant_key *key)
 {
-   struct nir_shader *nir = shader->base.ir.nir;
    struct lp_fragment_shader_variant *variant =
       MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
@@ -3854,12 +3854,37 @@ generate_variant(struct llvmpipe_context *lp,
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
+
+   return variant;
+}
+
+
+/**
+ * Generate the code for a fragment shader variant from the given NIR and
+ * the state indicated by the variant's key.
+ *
+ * This doesn't touch the llvmpipe context, so it may run on a background
+ * thread as long as \p context and \p nir are private to the caller.
+ * Unoptimized variants bypass the disk cache.
+ */
+static bool
+compile_variant(struct llvmpipe_screen *screen,
+                lp_context_ref *context,
+                struct nir_shader *nir,
+                struct lp_fragment_shader_variant *variant,
+                bool optimize)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+
    struct lp_cached_code cached = { 0 };
    unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH];
    bool needs_caching = false;
-   if (shader->base.ir.nir) {
-      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+   if (optimize) {
+      lp_fs_get_ir_cache_key(shader, nir, key, ir_sha1_cache_key);
 
       lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
       if (!cached.data_size)
@@ -3868,16 +3893,13 @@ generate_variant(struct llvmpipe_context *lp,
 
    char module_name[64];
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
+            shader->no, variant->no);
+   variant->gallivm = gallivm_create(module_name, context,
+                                     optimize ? &cached : NULL);
+   if (!variant->gallivm)
+      return false;
 
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
+   variant->gallivm->no_opt = !optimize;
 
    /*
     * Determine whether we are touching all channels in the color buffer.
@@ -3950,6 +3972,7 @@ generate_variant(struct llvmpipe_context *lp,
       }
 
       if (target == PIPE_TEXTURE_2D &&
+          !samp0->texture_state.tiled_4x4 &&
           min_img_filter == PIPE_TEX_FILTER_NEAREST &&
           mag_img_filter == PIPE_TEX_FILTER_NEAREST &&
           min_mip_filter == PIPE_TEX_MIPFILTER_NONE &&
@@ -3965,10 +3988,31 @@ generate_variant(struct llvmpipe_context *lp,
       }
    }
 
+   /* Skipping a primitive in a tile where it fails the depth test is
+    * only invisible if failing fragments have no other effect.
+    */
+   variant->shader_z =
+      !!(nir->info.outputs_written & BITFIELD64_BIT(FRAG_RESULT_DEPTH));
+   variant->hiz_cull =
+         key->depth.enabled &&
+         !key->stencil[0].enabled &&
+         !variant->shader_z &&
+         (!nir->info.writes_memory || nir->info.fs.early_fragment_tests);
+
+   /* The linear samplers only address linear textures. */
+   bool linear_textures = true;
+   for (unsigned i = 0; i < key->nr_samplers; i++) {
+      const struct lp_sampler_static_state *samp =
+         lp_fs_variant_key_sampler_idx(key, i);
+      if (samp->texture_state.tiled || samp->texture_state.tiled_4x4)
+         linear_textures = false;
+   }
+
    /* Determine whether this shader + pipeline state is a candidate for
     * the linear path.
     */
    const bool linear_pipeline =
+         linear_textures &&
          !key->stencil[0].enabled &&
          !key->depth.enabled &&
          !key->depth.depth_bounds_test &&
@@ -3979,8 +4023,6 @@ generate_variant(struct llvmpipe_context *lp,
           key->cbuf_format[0] == PIPE_FORMAT_R8G8B8A8_UNORM ||
           key->cbuf_format[0] == PIPE_FORMAT_R8G8B8X8_UNORM);
 
-   memcpy(&variant->key, key, sizeof *key);
-
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
@@ -3990,12 +4032,12 @@ generate_variant(struct llvmpipe_context *lp,
    lp_jit_init_types(variant);
 
    if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+      generate_fragment(nir, shader, variant, RAST_EDGE_TEST);
 
    if (variant->jit_function[RAST_WHOLE] == NULL) {
       if (variant->opaque) {
          /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+         generate_fragment(nir, shader, variant, RAST_WHOLE);
       }
    }
 
@@ -4019,7 +4061,7 @@ generate_variant(struct llvmpipe_context *lp,
          if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
              shader->kind == LP_FS_KIND_BLIT_RGB1 ||
              shader->kind == LP_FS_KIND_LLVM_LINEAR) {
-            llvmpipe_fs_variant_linear_llvm(lp, shader, variant);
+            llvmpipe_fs_variant_linear_llvm(nir, shader, variant);
          }
       }
    } else {
@@ -4081,6 +4123,250 @@ generate_variant(struct llvmpipe_context *lp,
 
    gallivm_free_ir(variant->gallivm);
 
+   return true;
+}
+
+
+/**
+ * Generate a new fragment shader variant from the shader code and
+ * other state indicated by the key.
+ */
+static struct lp_fragment_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_fragment_shader *shader,
+                 const struct lp_fragment_shader_variant_key *key,
+                 bool optimize)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant =
+      create_variant(lp, shader, key);
+   if (!variant)
+      return NULL;
+
+   if (!compile_variant(screen, &lp->context, shader->base.ir.nir,
+                        variant, optimize)) {
+      lp_fs_variant_reference(lp, &variant, NULL);
+      return NULL;
+   }
+
+   return variant;
+}
+
+
+/**
+ * Background compilation of an optimized fragment shader variant
+ * (LP_ASYNC_FS_COMPILE or GALLIVM_PERF=tiered).  The job is queued once the
+ * unoptimized variant has been drawn with lp->tier_up_threshold times, and
+ * compiles a private copy of the shader's NIR in its own LLVM context, so
+ * it never touches state owned by the context thread.
+ *
+ * With the disk cache enabled, the job is first queued right away to only
+ * load the optimized variant from the cache, so the context thread never
+ * waits for the cache lookup.
+ */
+struct lp_fs_variant_job {
+   struct llvmpipe_screen *screen;
+   uint64_t *stats;              /**< llvmpipe_context::stats */
+   struct nir_shader *nir;
+   struct lp_fragment_shader_variant *variant;
+   unsigned invocations;
+   bool queued;
+   bool cache_only;
+   bool compiled;
+   struct util_queue_fence fence;
+};
+
+
+static void
+fs_variant_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_variant_job *job = data;
+   struct lp_fragment_shader_variant *variant = job->variant;
+
+   int64_t t0 = os_time_get();
+   if (job->cache_only) {
+      unsigned char ir_sha1_cache_key[SHA1_DIGEST_LENGTH];
+
+      lp_fs_get_ir_cache_key(variant->shader, job->nir, &variant->key,
+                             ir_sha1_cache_key);
+      if (!lp_disk_cache_has_shader(job->screen, ir_sha1_cache_key)) {
+         /* keep the NIR for the compile once the fallback is hot */
+         lp_stats_count_compile(job->stats, os_time_get() - t0);
+         return;
+      }
+   }
+
+   lp_context_create(&variant->context);
+   if (variant->context.ref) {
+      job->compiled = compile_variant(job->screen, &variant->context,
+                                      job->nir, variant, true);
+   }
+   lp_stats_count_compile(job->stats, os_time_get() - t0);
+
+   ralloc_free(job->nir);
+   job->nir = NULL;
+}
+
+
+/**
+ * Wait for and release the background job attached to a fallback variant,
+ * dropping the optimized variant if it was never swapped in.
+ */
+static void
+fs_variant_job_destroy(struct llvmpipe_context *lp,
+                       struct lp_fs_variant_job *job)
+{
+   util_queue_fence_wait(&job->fence);
+   util_queue_fence_destroy(&job->fence);
+   ralloc_free(job->nir);
+   lp_fs_variant_reference(lp, &job->variant, NULL);
+   FREE(job);
+}
+
+
+/**
+ * Whether the background job of a fallback variant has finished, either
+ * with the optimized variant or with a failure to build it.  A cache-only
+ * job which missed the disk cache goes back to waiting for the fallback to
+ * become hot.
+ */
+static bool
+fs_variant_job_done(struct lp_fs_variant_job *job)
+{
+   if (!job->queued || !util_queue_fence_is_signalled(&job->fence))
+      return false;
+
+   if (job->cache_only && !job->compiled) {
+      job->cache_only = false;
+      job->queued = false;
+      return false;
+   }
+
+   return true;
+}
+
+
+static void
+fs_variant_job_queue(struct llvmpipe_context *lp,
+                     struct lp_fragment_shader_variant *fallback);
+
+
+/**
+ * Generate an unoptimized variant to draw with right away, along with the
+ * job which compiles the optimized variant for the same key once it is
+ * used often enough.  Returns NULL if the caller should just compile the
+ * optimized variant synchronously.
+ */
+static struct lp_fragment_shader_variant *
+generate_fallback_variant(struct llvmpipe_context *lp,
+                          struct lp_fragment_shader *shader,
+                          const struct lp_fragment_shader_variant_key *key)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fs_variant_job *job = CALLOC_STRUCT(lp_fs_variant_job);
+   if (!job)
+      return NULL;
+
+   job->screen = screen;
+   job->stats = lp->stats;
+   util_queue_fence_init(&job->fence);
+
+   struct lp_fragment_shader_variant *variant =
+      generate_variant(lp, shader, key, false);
+
+   if (!variant) {
+      fs_variant_job_destroy(lp, job);
+      return NULL;
+   }
+
+   variant->job = job;
+
+   /* Loading optimized code from the disk cache is cheaper still. */
+   if (screen->disk_shader_cache) {
+      job->cache_only = true;
+      fs_variant_job_queue(lp, variant);
+   }
+
+   return variant;
+}
+
+
+/**
+ * Queue the compilation of the optimized variant replacing a fallback
+ * variant.  Drops the job if that is not possible, leaving the fallback
+ * in place for good.
+ */
+static void
+fs_variant_job_queue(struct llvmpipe_context *lp,
+                     struct lp_fragment_shader_variant *fallback)
+{
+   struct lp_fs_variant_job *job = fallback->job;
+
+   /* A cache-only job which missed leaves both for the compile. */
+   if (!job->variant)
+      job->variant = create_variant(lp, fallback->shader, &fallback->key);
+   if (!job->nir)
+      job->nir = nir_shader_clone(NULL, fallback->shader->base.ir.nir);
+
+   if (!job->variant || !job->nir) {
+      fallback->job = NULL;
+      fs_variant_job_destroy(lp, job);
+      return;
+   }
+
+   job->queued = true;
+   util_queue_add_job(&lp->compile_queue, job, &job->fence,
+                      fs_variant_job_execute, NULL, 0);
+}
+
+
+/**
+ * Put a new variant at the head of the shader's and the context's
+ * variant lists.
+ */
+static void
+llvmpipe_add_shader_variant(struct llvmpipe_context *lp,
+                            struct lp_fragment_shader_variant *variant)
+{
+   list_add(&variant->list_item_local.list,
+            &variant->shader->variants.list);
+   list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
+   lp->nr_fs_variants++;
+   lp->nr_fs_instrs += variant->nr_instrs;
+   variant->shader->variants_cached++;
+}
+
+
+static void
+llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
+                               struct lp_fragment_shader_variant *variant);
+
+
+/**
+ * Replace a fallback variant whose background job has finished with the
+ * optimized variant.  Scenes still referencing the fallback keep it alive
+ * until they are done with it.
+ */
+static struct lp_fragment_shader_variant *
+replace_fallback_variant(struct llvmpipe_context *lp,
+                         struct lp_fragment_shader_variant *fallback)
+{
+   struct lp_fs_variant_job *job = fallback->job;
+   struct lp_fragment_shader_variant *variant = NULL;
+
+   fallback->job = NULL;
+   if (job->compiled)
+      lp_fs_variant_reference(lp, &variant, job->variant);
+   fs_variant_job_destroy(lp, job);
+
+   /* Keep using the fallback if the optimized variant failed to build. */
+   if (!variant)
+      return fallback;
+
+   llvmpipe_remove_shader_variant(lp, fallback);
+   lp_fs_variant_reference(lp, &fallback, NULL);
+   llvmpipe_add_shader_variant(lp, variant);
+
    return variant;
 }
 
@@ -4239,7 +4525,11 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
-   gallivm_destroy(variant->gallivm);
+   if (variant->job)
+      fs_variant_job_destroy(lp, variant->job);
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   lp_context_destroy(&variant->context);
    lp_fs_reference(lp, &variant->shader, NULL);
    FREE(variant->function_name[RAST_EDGE_TEST]);
    FREE(variant->function_name[RAST_WHOLE]);
@@ -4718,16 +5008,16 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if (BITSET_TEST(nir->info.textures_used, i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                  lp->sampler_views[MESA_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[MESA_SHADER_FRAGMENT][i]);
          }
       }
    } else {
       key->nr_sampler_views = key->nr_samplers;
       for (unsigned i = 0; i < key->nr_sampler_views; ++i) {
          if (BITSET_TEST(nir->info.samplers_used, i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                 lp->sampler_views[MESA_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[MESA_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -4780,6 +5070,12 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    if (variant) {
+      /* Swap in the optimized variant once it has been compiled in the
+       * background.
+       */
+      if (variant->job && fs_variant_job_done(variant->job))
+         variant = replace_fallback_variant(lp, variant);
+
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
        */
@@ -4839,27 +5135,50 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
        * Generate the new variant.
        */
       int64_t t0 = os_time_get();
-      variant = generate_variant(lp, shader, key);
+      if (util_queue_is_initialized(&lp->compile_queue))
+         variant = generate_fallback_variant(lp, shader, key);
+      if (!variant)
+         variant = generate_variant(lp, shader, key, true);
       int64_t t1 = os_time_get();
       int64_t dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+      lp_stats_count_compile(lp->stats, dt);
 
       /* Put the new variant into the list */
-      if (variant) {
-         list_add(&variant->list_item_local.list, &shader->variants.list);
-         list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
-         lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
-         shader->variants_cached++;
-      }
+      if (variant)
+         llvmpipe_add_shader_variant(lp, variant);
    }
 
+   lp_fs_variant_reference(lp, &lp->fs_fallback,
+                           variant && variant->job ? variant : NULL);
+
    /* Bind this variant */
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
 
+/**
+ * Called before each draw while a fallback fragment shader variant is
+ * bound: queue the optimized variant once the fallback is hot, and
+ * revalidate the fragment shader once it has been compiled.
+ */
+void
+llvmpipe_check_fs_fallback(struct llvmpipe_context *lp)
+{
+   struct lp_fragment_shader_variant *fallback = lp->fs_fallback;
+   struct lp_fs_variant_job *job = fallback->job;
+
+   if (!job || fs_variant_job_done(job)) {
+      lp->dirty |= LP_NEW_FS;
+      return;
+   }
+
+   if (!job->queued && ++job->invocations >= lp->tier_up_threshold)
+      fs_variant_job_queue(lp, fallback);
+}
+
+
 void
 llvmpipe_init_fs_funcs(struct llvmpipe_context *llvmpipe)
 {
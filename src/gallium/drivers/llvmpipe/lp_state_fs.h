@@ -41,6 +41,7 @@
 #include "lp_jit.h"
 
 struct lp_fragment_shader;
+struct lp_fs_variant_job;
 
 
 /** Indexes into jit_function[] array */
@@ -154,6 +155,11 @@ struct lp_fragment_shader_variant
    unsigned opaque:1;
    unsigned blit:1;
    unsigned linear_input_mask:16;
+
+   /* Primitives may be skipped in tiles where they fail the depth test. */
+   unsigned hiz_cull:1;
+   /* Depth is written by the shader instead of interpolated. */
+   unsigned shader_z:1;
    struct pipe_reference reference;
 
    struct gallivm_state *gallivm;
@@ -193,6 +199,14 @@ struct lp_fragment_shader_variant
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
+   /* Set on unoptimized fallback variants while the optimized variant is
+    * compiled in the background.
+    */
+   struct lp_fs_variant_job *job;
+
+   /* LLVM context owned by variants compiled off the context's thread */
+   lp_context_ref context;
+
    /* For debugging/profiling purposes */
    unsigned no;
 
@@ -237,7 +251,7 @@ void
 llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant);
 
 void
-llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
+llvmpipe_fs_variant_linear_llvm(struct nir_shader *nir,
                                 struct lp_fragment_shader *shader,
                                 struct lp_fragment_shader_variant *variant);
 
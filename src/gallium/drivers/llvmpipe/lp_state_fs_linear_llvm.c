@@ -30,6 +30,7 @@
 #include "pipe/p_defines.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_pointer.h"
 #include "util/format/u_format.h"
 #include "util/u_dump.h"
@@ -101,10 +102,15 @@ emit_fetch_texel_linear(const struct lp_build_sampler_aos *base,
 
    /* Pointer to a row of texels */
    LLVMValueRef texels_ptr = sampler->texels_ptrs[sampler->instance];
+   texels_ptr = LLVMBuildBitCast(bld->gallivm->builder, texels_ptr,
+                                 LLVMPointerType(bld->vec_type, 0), "");
 
-   LLVMValueRef texel = lp_build_pointer_get2(bld->gallivm->builder,
-                                              bld->vec_type,
-                                              texels_ptr, sampler->counter);
+   /* Rows are only guaranteed to be 16-byte aligned, which is less than
+    * the natural alignment of the wider vector types.
+    */
+   LLVMValueRef texel =
+      lp_build_pointer_get_unaligned2(bld->gallivm->builder, bld->vec_type,
+                                      texels_ptr, sampler->counter, 16);
    assert(LLVMTypeOf(texel) == bld->vec_type);
 
    /*
@@ -125,7 +131,7 @@ emit_fetch_texel_linear(const struct lp_build_sampler_aos *base,
  */
 static LLVMValueRef
 llvm_fragment_body(struct lp_build_context *bld,
-                   struct lp_fragment_shader *shader,
+                   struct nir_shader *nir,
                    struct lp_fragment_shader_variant *variant,
                    struct linear_sampler* sampler,
                    LLVMValueRef *inputs_ptrs,
@@ -144,7 +150,6 @@ llvm_fragment_body(struct lp_build_context *bld,
    LLVMValueRef result = NULL;
    bool rgba_order = (variant->key.cbuf_format[0] == PIPE_FORMAT_R8G8B8A8_UNORM ||
                       variant->key.cbuf_format[0] == PIPE_FORMAT_R8G8B8X8_UNORM);
-   struct nir_shader *nir = shader->base.ir.nir;
    sampler->instance = 0;
 
    /*
@@ -152,8 +157,12 @@ llvm_fragment_body(struct lp_build_context *bld,
     */
    unsigned i;
    for (i = 0; i < util_bitcount64(nir->info.inputs_read); ++i) {
+      LLVMValueRef input_ptr =
+         LLVMBuildBitCast(builder, inputs_ptrs[i],
+                          LLVMPointerType(bld->vec_type, 0), "");
       inputs[i] =
-         lp_build_pointer_get2(builder, bld->vec_type, inputs_ptrs[i], sampler->counter);
+         lp_build_pointer_get_unaligned2(builder, bld->vec_type,
+                                         input_ptr, sampler->counter, 16);
       assert(LLVMTypeOf(inputs[i]) == bld->vec_type);
    }
    for ( ; i < PIPE_MAX_SHADER_INPUTS; ++i) {
@@ -230,13 +239,105 @@ llvm_fragment_body(struct lp_build_context *bld,
 }
 
 
+/**
+ * Number of pixels the main loop of the linear shader processes at once.
+ *
+ * The shader always works on whole unorm8x16 vectors (4 pixels) for the
+ * row tail; with AVX2 and AVX-512BW the bulk of the row is done with 256
+ * and 512-bit vectors instead.
+ */
+static unsigned
+linear_block_pixels(void)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   /* Honour LP_NATIVE_VECTOR_WIDTH=128. */
+   if (lp_native_vector_width < 256)
+      return 4;
+
+   if (caps->has_avx512bw && caps->max_vector_bits >= 512)
+      return 16;
+
+   if (caps->has_avx2)
+      return 8;
+
+   return 4;
+}
+
+
+/**
+ * Run the fragment shader on the pixels [start, end) of the row, in blocks
+ * of fs_type.length / 4 pixels.  start and end must be multiples of the
+ * block size.
+ */
+static void
+llvm_fragment_blocks(struct gallivm_state *gallivm,
+                     struct nir_shader *nir,
+                     struct lp_fragment_shader_variant *variant,
+                     struct linear_sampler *sampler,
+                     LLVMValueRef *inputs_ptrs,
+                     LLVMValueRef consts_ptr,
+                     LLVMValueRef blend_color,
+                     LLVMValueRef alpha_ref,
+                     struct lp_type fs_type,
+                     LLVMValueRef color0_ptr,
+                     LLVMValueRef start,
+                     LLVMValueRef end)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMValueRef shift =
+      LLVMConstInt(int32t, util_logbase2(fs_type.length / 4), 0);
+   struct lp_build_context bld;
+
+   lp_build_context_init(&bld, gallivm, fs_type);
+
+   blend_color = lp_build_broadcast(gallivm,
+                                    LLVMVectorType(int32t, fs_type.length / 4),
+                                    blend_color);
+   blend_color = LLVMBuildBitCast(builder, blend_color, bld.vec_type, "");
+
+   color0_ptr = LLVMBuildBitCast(builder, color0_ptr,
+                                 LLVMPointerType(bld.vec_type, 0), "");
+
+   start = LLVMBuildLShr(builder, start, shift, "");
+   end = LLVMBuildLShr(builder, end, shift, "");
+
+   /* for (loop.counter = start; loop.counter < end; loop.counter++) { */
+   struct lp_build_for_loop_state loop;
+   lp_build_for_loop_begin(&loop, gallivm, start,
+                           LLVMIntULT, end, LLVMConstInt(int32t, 1, 0));
+   {
+      LLVMValueRef value;
+      sampler->counter = loop.counter;
+
+      /* Read a block of pixels */
+      value = lp_build_pointer_get_unaligned2(builder,
+                                              bld.vec_type,
+                                              color0_ptr,
+                                              loop.counter, 4);
+
+      /* Perform fragment shader body */
+      value = llvm_fragment_body(&bld, nir, variant, sampler, inputs_ptrs,
+                                 consts_ptr, blend_color, alpha_ref, fs_type,
+                                 value);
+
+      /* Write a block of pixels */
+      lp_build_pointer_set_unaligned(builder, color0_ptr, loop.counter,
+                                     value, 4);
+   }
+   lp_build_for_loop_end(&loop);
+}
+
+
 /**
  * Generate a function that executes the fragment shader in a linear fashion.
- * The shader operates on unorm8[16] vectors.
+ * The shader operates on unorm8[16] vectors, or wider ones where the CPU
+ * has them.
  * See lp_state_fs_analysis for the "linear" conditions.
  */
 void
-llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
+llvmpipe_fs_variant_linear_llvm(struct nir_shader *nir,
                                 struct lp_fragment_shader *shader,
                                 struct lp_fragment_shader_variant *variant)
 {
@@ -244,7 +345,6 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
           shader->kind == LP_FS_KIND_BLIT_RGB1 ||
           shader->kind == LP_FS_KIND_LLVM_LINEAR);
 
-   struct nir_shader *nir = shader->base.ir.nir;
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMTypeRef int8t = LLVMInt8TypeInContext(gallivm->context);
    LLVMTypeRef int32t = LLVMInt32TypeInContext(gallivm->context);
@@ -261,9 +361,7 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
    fs_type.length = 16;
 
    if (LP_DEBUG & DEBUG_TGSI) {
-      if (shader->base.ir.nir) {
-         nir_print_shader(shader->base.ir.nir, stderr);
-      }
+      nir_print_shader(nir, stderr);
    }
 
    /*
@@ -303,7 +401,7 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
       }
    }
 
-   if (variant->gallivm->cache->data_size) {
+   if (variant->gallivm->cache && variant->gallivm->cache->data_size) {
       gallivm_stub_func(gallivm, function);
       return;
    }
@@ -358,8 +456,6 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
                                    context_ptr);
    color0_ptr = LLVMBuildLoad2(builder, LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0),
                                color0_ptr, "");
-   color0_ptr = LLVMBuildBitCast(builder, color0_ptr,
-                                 LLVMPointerType(bld.vec_type, 0), "");
 
    LLVMValueRef blend_color =
       lp_jit_linear_context_blend_color(gallivm,
@@ -367,10 +463,6 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
                                         context_ptr);
    blend_color = LLVMBuildLoad2(builder, LLVMInt32TypeInContext(gallivm->context),
                                 blend_color, "");
-   blend_color = lp_build_broadcast(gallivm, LLVMVectorType(int32t, 4),
-                                    blend_color);
-   blend_color = LLVMBuildBitCast(builder, blend_color,
-                                  LLVMVectorType(int8t, 16), "");
 
    LLVMValueRef alpha_ref =
       lp_jit_linear_context_alpha_ref(gallivm,
@@ -461,34 +553,37 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
    /* excess = width & 0x3 */
    LLVMValueRef excess =
       LLVMBuildAnd(builder, width, LLVMConstInt(int32t, 3, 0), "");
-   /* width *= 4 */
-   width = LLVMBuildLShr(builder, width, LLVMConstInt(int32t, 2, 0), "");
 
-   /* Loop over blocks of 4 pixels */
-   /* for loop.counter = 0; loop.counter < width; loop.counter++) { */
-   struct lp_build_for_loop_state loop;
-   lp_build_for_loop_begin(&loop, gallivm, LLVMConstInt(int32t, 0, 0),
-                           LLVMIntULT, width, LLVMConstInt(int32t, 1, 0));
-   {
-      LLVMValueRef value;
-      sampler.counter = loop.counter;
+   /* Loop over wide blocks of pixels, then over blocks of 4 pixels */
+   const unsigned block_pixels = linear_block_pixels();
+   LLVMValueRef start = LLVMConstInt(int32t, 0, 0);
+   LLVMValueRef end =
+      LLVMBuildAnd(builder, width, LLVMConstInt(int32t, ~3u, 0), "");
 
-      /* Read 4 pixels */
-      value = lp_build_pointer_get_unaligned2(builder,
-                                              bld.vec_type,
-                                              color0_ptr,
-                                              loop.counter, 4);
+   if (block_pixels > 4) {
+      struct lp_type wide_type = fs_type;
+      wide_type.length = block_pixels * 4;
 
-      /* Perform fragment shader body */
-      value = llvm_fragment_body(&bld, shader, variant, &sampler, inputs_ptrs,
-                                 consts_ptr, blend_color, alpha_ref, fs_type,
-                                 value);
+      LLVMValueRef wide_end =
+         LLVMBuildAnd(builder, width,
+                      LLVMConstInt(int32t, ~(block_pixels - 1), 0), "");
 
-      /* Write 4 pixels */
-      lp_build_pointer_set_unaligned(builder, color0_ptr, loop.counter,
-                                     value, 4);
+      llvm_fragment_blocks(gallivm, nir, variant, &sampler, inputs_ptrs,
+                           consts_ptr, blend_color, alpha_ref, wide_type,
+                           color0_ptr, start, wide_end);
+      start = wide_end;
    }
-   lp_build_for_loop_end(&loop);
+
+   llvm_fragment_blocks(gallivm, nir, variant, &sampler, inputs_ptrs,
+                        consts_ptr, blend_color, alpha_ref, fs_type,
+                        color0_ptr, start, end);
+
+   /* width /= 4 */
+   width = LLVMBuildLShr(builder, width, LLVMConstInt(int32t, 2, 0), "");
+
+   blend_color = lp_build_broadcast(gallivm, LLVMVectorType(int32t, 4),
+                                    blend_color);
+   blend_color = LLVMBuildBitCast(builder, blend_color, bld.vec_type, "");
 
    /* Compute the edge pixels (width % 4) */
    struct lp_build_if_state ifstate;
@@ -502,8 +597,10 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
       sampler.counter = width;
 
       /* Get the i32* pixel pointer from the <i16x8>* element pointer */
+      pixel_ptr = LLVMBuildBitCast(gallivm->builder, color0_ptr,
+                                   LLVMPointerType(bld.vec_type, 0), "");
       pixel_ptr = LLVMBuildGEP2(gallivm->builder, bld.vec_type,
-                                color0_ptr, &width, 1, "");
+                                pixel_ptr, &width, 1, "");
       pixel_ptr = LLVMBuildBitCast(gallivm->builder, pixel_ptr,
                                    LLVMPointerType(int32t, 0), "");
 
@@ -526,7 +623,7 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
       buf = LLVMBuildLoad2(gallivm->builder, pixelt, buf_ptr, "");
       buf = LLVMBuildBitCast(builder, buf, bld.vec_type, "");
 
-      result = llvm_fragment_body(&bld, shader, variant, &sampler,
+      result = llvm_fragment_body(&bld, nir, variant, &sampler,
                                   inputs_ptrs, consts_ptr, blend_color,
                                   alpha_ref, fs_type, buf);
       result = LLVMBuildBitCast(builder, result, pixelt, "");
@@ -545,8 +642,6 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
    }
    lp_build_endif(&ifstate);
 
-   color0_ptr = LLVMBuildBitCast(builder, color0_ptr, pint8t, "");
-
    LLVMBuildRet(builder, color0_ptr);
 
    gallivm_verify_function(gallivm, function);
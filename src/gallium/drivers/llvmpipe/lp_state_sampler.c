@@ -376,7 +376,8 @@ prepare_shader_sampling(struct llvmpipe_context *lp,
                                  first_level, last_level,
                                  num_samples, sample_stride,
                                  addr,
-                                 row_stride, img_stride, mip_offsets);
+                                 row_stride, img_stride, mip_offsets,
+                                 llvmpipe_resource_is_tiled(tex));
       }
    }
 }
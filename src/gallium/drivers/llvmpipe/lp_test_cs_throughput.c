@@ -0,0 +1,263 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Compute shader throughput at the native vector width.
+ *
+ * A compute shader doing a chain of integer and float ALU work, a subgroup
+ * shuffle and a divergent branch per step is dispatched over a buffer.
+ * The result must match the CPU's.  The time per invocation is reported
+ * as TSV along with the vector width, so running this with
+ * LP_NATIVE_VECTOR_WIDTH=256 and 512 compares 8 and 16-wide code.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "gallivm/lp_bld_type.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "util/os_time.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "frontend/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define NUM_INVOCATIONS (64 * 1024)
+#define WORKGROUP_SIZE 64
+#define NUM_STEPS 64
+#define NUM_RUNS 4
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "ns_per_invocation\t"
+           "vector_width\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, bool success, double ns, unsigned width)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.2f\t", ns);
+   fprintf(fp, "%u\n", width);
+   fflush(fp);
+}
+
+
+/**
+ * One step of the shader, given the value of the neighbouring invocation
+ * (subgroup invocation ^ 1).
+ */
+static uint32_t
+cs_step(uint32_t y, uint32_t neighbour)
+{
+   y = y * 1664525u + 1013904223u + neighbour;
+
+   float f = (float)(y >> 8) * (1.0f / 65536.0f);
+   f = fminf(fmaxf(f, 16.0f), 200.0f);
+   y ^= (uint32_t)(int32_t)rintf(f);
+
+   if (y & 1)
+      y ^= 0x5bd1e995;
+
+   return y;
+}
+
+
+static void *
+create_cs(struct pipe_context *pipe)
+{
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_COMPUTE,
+                                     pipe->screen->nir_options[MESA_SHADER_COMPUTE],
+                                     "cs_throughput");
+   b.shader->info.workgroup_size[0] = WORKGROUP_SIZE;
+   b.shader->info.workgroup_size[1] = 1;
+   b.shader->info.workgroup_size[2] = 1;
+   b.shader->info.num_ssbos = 1;
+
+   nir_def *zero = nir_imm_int(&b, 0);
+   nir_def *id =
+      nir_iadd(&b, nir_imul_imm(&b, nir_channel(&b, nir_load_workgroup_id(&b), 0),
+                                WORKGROUP_SIZE),
+               nir_channel(&b, nir_load_local_invocation_id(&b), 0));
+   nir_def *offset = nir_imul_imm(&b, id, 4);
+   nir_def *neighbour =
+      nir_ixor(&b, nir_load_subgroup_invocation(&b), nir_imm_int(&b, 1));
+   nir_def *y = nir_load_ssbo(&b, 1, 32, zero, offset, .align_mul = 4);
+
+   for (unsigned i = 0; i < NUM_STEPS; i++) {
+      y = nir_iadd(&b, nir_iadd_imm(&b, nir_imul_imm(&b, y, 1664525u), 1013904223u),
+                   nir_shuffle(&b, y, neighbour));
+
+      nir_def *f = nir_fmul_imm(&b, nir_u2f32(&b, nir_ushr_imm(&b, y, 8)),
+                                1.0 / 65536.0);
+      f = nir_fmin(&b, nir_fmax(&b, f, nir_imm_float(&b, 16.0f)),
+                   nir_imm_float(&b, 200.0f));
+      y = nir_ixor(&b, y, nir_f2i32(&b, nir_fround_even(&b, f)));
+
+      nir_push_if(&b, nir_i2b(&b, nir_iand_imm(&b, y, 1)));
+      nir_def *odd = nir_ixor(&b, y, nir_imm_int(&b, 0x5bd1e995));
+      nir_pop_if(&b, NULL);
+      y = nir_if_phi(&b, odd, y);
+   }
+
+   nir_store_ssbo(&b, y, zero, offset, .align_mul = 4);
+
+   nir_validate_shader(b.shader, "lp_test_cs_throughput");
+   if (pipe->screen->finalize_nir)
+      pipe->screen->finalize_nir(pipe->screen, b.shader, true);
+
+   struct pipe_compute_state state = {
+      .ir_type = PIPE_SHADER_IR_NIR,
+      .prog = b.shader,
+   };
+   return pipe->create_compute_state(pipe, &state);
+}
+
+
+static bool
+test_grid(unsigned verbose, FILE *fp, unsigned num_invocations,
+          unsigned num_runs)
+{
+   struct sw_winsys *winsys = null_sw_create();
+   struct pipe_screen *screen = llvmpipe_create_screen(winsys);
+   const unsigned size = num_invocations * sizeof(uint32_t);
+   bool success = true;
+
+   if (!screen) {
+      winsys->destroy(winsys);
+      return false;
+   }
+
+   struct pipe_context *pipe = screen->context_create(screen, NULL, 0);
+   void *cs = pipe ? create_cs(pipe) : NULL;
+   struct pipe_resource *buf =
+      pipe_buffer_create(screen, PIPE_BIND_SHADER_BUFFER, PIPE_USAGE_DEFAULT,
+                         size);
+   uint32_t *input = MALLOC(size);
+   uint32_t *reference = MALLOC(size);
+   uint32_t *out = MALLOC(size);
+
+   if (!cs || !buf) {
+      success = false;
+      goto out;
+   }
+
+   for (unsigned i = 0; i < num_invocations; i++)
+      input[i] = reference[i] = i * 2654435761u;
+
+   for (unsigned step = 0; step < NUM_STEPS; step++) {
+      for (unsigned i = 0; i < num_invocations; i += 2) {
+         uint32_t y0 = reference[i], y1 = reference[i + 1];
+         reference[i] = cs_step(y0, y1);
+         reference[i + 1] = cs_step(y1, y0);
+      }
+   }
+
+   pipe->bind_compute_state(pipe, cs);
+
+   struct pipe_shader_buffer sb = {
+      .buffer = buf,
+      .buffer_size = size,
+   };
+   pipe->set_shader_buffers(pipe, MESA_SHADER_COMPUTE, 0, 1, &sb, 0x1);
+
+   struct pipe_grid_info info = {
+      .work_dim = 1,
+      .block = { WORKGROUP_SIZE, 1, 1 },
+      .grid = { num_invocations / WORKGROUP_SIZE, 1, 1 },
+   };
+   int64_t best = INT64_MAX;
+
+   for (unsigned run = 0; run < num_runs; run++) {
+      struct pipe_fence_handle *fence = NULL;
+
+      pipe_buffer_write(pipe, buf, 0, size, input);
+
+      int64_t start = os_time_get_nano();
+      pipe->launch_grid(pipe, &info);
+      pipe->flush(pipe, &fence, 0);
+      screen->fence_finish(screen, NULL, fence, OS_TIMEOUT_INFINITE);
+      best = MIN2(best, os_time_get_nano() - start);
+      screen->fence_reference(screen, &fence, NULL);
+
+      pipe_buffer_read(pipe, buf, 0, size, out);
+      if (memcmp(out, reference, size)) {
+         for (unsigned i = 0; i < num_invocations; i++) {
+            if (out[i] != reference[i]) {
+               printf("invocation %u: got 0x%08x, expected 0x%08x\n",
+                      i, out[i], reference[i]);
+               break;
+            }
+         }
+         success = false;
+      }
+   }
+
+   double ns = (double)best / num_invocations;
+   if (!success || verbose >= 1) {
+      printf("%u bit vectors: %s, %.2f ns/invocation\n",
+             lp_native_vector_width, success ? "pass" : "FAIL", ns);
+   }
+
+   if (fp)
+      write_tsv_row(fp, success, ns, lp_native_vector_width);
+
+   pipe->set_shader_buffers(pipe, MESA_SHADER_COMPUTE, 0, 1, NULL, 0);
+   pipe->bind_compute_state(pipe, NULL);
+
+out:
+   pipe_resource_reference(&buf, NULL);
+   if (cs)
+      pipe->delete_compute_state(pipe, cs);
+   if (pipe)
+      pipe->destroy(pipe);
+   screen->destroy(screen);
+   FREE(input);
+   FREE(reference);
+   FREE(out);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_grid(verbose, fp, NUM_INVOCATIONS, NUM_RUNS);
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   /* Only check the results, on a few workgroups */
+   return test_grid(verbose, fp, 16 * WORKGROUP_SIZE, 1);
+}
@@ -0,0 +1,201 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Dispatch overhead of the compute shader thread pool.
+ *
+ * Tasks of varying iteration counts and per-iteration cost are run
+ * through a pool, from grids of many empty workgroups, where the time is
+ * all scheduling, to a few expensive ones, where it's all load balancing.
+ * Every iteration must run exactly once.  The time per dispatch and the
+ * iterations per second are reported as TSV.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_memory.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_test.h"
+
+
+#define NUM_THREADS 4
+
+
+struct tpool_test_case {
+   unsigned num_iters;
+   unsigned work;        /* loop iterations per task iteration */
+   unsigned num_dispatches;
+};
+
+static const struct tpool_test_case test_cases[] = {
+   { 1, 0, 4096 },
+   { 64, 0, 4096 },
+   { 4096, 0, 256 },
+   { 1 << 20, 0, 4 },
+   { 3, 1 << 20, 4 },
+   { 2 * NUM_THREADS + 1, 1 << 18, 4 },
+};
+
+/* Few dispatches and little work, only checking that every iteration runs */
+static const struct tpool_test_case single_test_cases[] = {
+   { 1, 0, 16 },
+   { 64, 0, 16 },
+   { 4096, 0, 4 },
+   { 2 * NUM_THREADS + 1, 1024, 4 },
+};
+
+
+struct tpool_test_data {
+   uint8_t *counts;
+   unsigned work;
+   unsigned sink;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "us_per_dispatch\t"
+           "iters_per_sec\t"
+           "num_iters\t"
+           "work\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, const struct tpool_test_case *test, bool success,
+              double us_per_dispatch, double iters_per_sec)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.2f\t", us_per_dispatch);
+   fprintf(fp, "%.0f\t", iters_per_sec);
+   fprintf(fp, "%u\t", test->num_iters);
+   fprintf(fp, "%u\n", test->work);
+   fflush(fp);
+}
+
+
+static void
+tpool_test_task(void *data, int iter_start, int iter_count,
+                struct lp_cs_local_mem *lmem)
+{
+   struct tpool_test_data *td = data;
+   unsigned sink = 0;
+
+   for (int i = iter_start; i < iter_start + iter_count; i++) {
+      p_atomic_inc(&td->counts[i]);
+
+      /* Something the compiler can't drop, standing in for a workgroup. */
+      for (unsigned j = 0; j < td->work; j++)
+         sink = sink * 1664525 + 1013904223;
+   }
+
+   p_atomic_add(&td->sink, sink);
+}
+
+
+static bool
+test_one(unsigned verbose, FILE *fp, struct lp_cs_tpool *pool,
+         const struct tpool_test_case *test)
+{
+   struct tpool_test_data td;
+   bool success = true;
+   int64_t time = 0;
+
+   memset(&td, 0, sizeof(td));
+   td.counts = CALLOC(test->num_iters, sizeof(*td.counts));
+   td.work = test->work;
+   if (!td.counts)
+      return false;
+
+   for (unsigned d = 0; d < test->num_dispatches; d++) {
+      struct lp_cs_tpool_task *task;
+
+      memset(td.counts, 0, test->num_iters * sizeof(*td.counts));
+
+      int64_t start = os_time_get_nano();
+      task = lp_cs_tpool_queue_task(pool, tpool_test_task, &td,
+                                    test->num_iters);
+      lp_cs_tpool_wait_for_task(pool, &task);
+      time += os_time_get_nano() - start;
+
+      for (unsigned i = 0; i < test->num_iters; i++) {
+         if (td.counts[i] != 1) {
+            if (verbose >= 1 || success)
+               printf("iteration %u of %u ran %u times\n", i,
+                      test->num_iters, td.counts[i]);
+            success = false;
+         }
+      }
+   }
+
+   FREE(td.counts);
+
+   const double us_per_dispatch = (double)time / 1000.0 / test->num_dispatches;
+   const double iters_per_sec = (double)test->num_iters * test->num_dispatches /
+                                ((double)MAX2(time, 1) / 1e9);
+
+   if (!success || verbose >= 1) {
+      printf("%u iterations, work %u: %s, %.2f us/dispatch, %.0f iterations/s\n",
+             test->num_iters, test->work, success ? "pass" : "FAIL",
+             us_per_dispatch, iters_per_sec);
+   }
+
+   if (fp)
+      write_tsv_row(fp, test, success, us_per_dispatch, iters_per_sec);
+
+   return success;
+}
+
+
+static bool
+test_cases_run(unsigned verbose, FILE *fp,
+               const struct tpool_test_case *cases, unsigned num_cases)
+{
+   struct lp_cs_tpool *pool = lp_cs_tpool_create(NUM_THREADS, NULL);
+   bool success = true;
+
+   if (!pool)
+      return false;
+
+   for (unsigned i = 0; i < num_cases; i++)
+      success &= test_one(verbose, fp, pool, &cases[i]);
+
+   lp_cs_tpool_destroy(pool);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_cases_run(verbose, fp, test_cases, ARRAY_SIZE(test_cases));
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_cases_run(verbose, fp, single_test_cases,
+                         ARRAY_SIZE(single_test_cases));
+}
@@ -0,0 +1,673 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Vertex shading of large draws split across the draw module's shade
+ * threads (draw_pt_shade_threads()).
+ *
+ * Linear and indexed point draws are run through a vertex shader which
+ * depends on both the fetched attribute and the vertex ID, and the results
+ * are captured with stream output.  Every thread count must capture the
+ * same vertices, in submission order, as the serial path and as computed
+ * on the CPU.
+ *
+ * A patch draw with fractional spacing and different tess factors for
+ * every patch does the same for the TES, whose patches are split across
+ * the threads as well.  It has more distinct tessellations than the draw
+ * module caches.  The time per vertex or per domain point is reported as
+ * TSV.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "tgsi/tgsi_text.h"
+#include "util/os_time.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "frontend/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define NUM_VERTICES (64 * 1024)
+#define NUM_RUNS 4
+#define SO_STRIDE 8   /* dwords, OUT[1] and OUT[2] */
+#define NUM_PATCHES 1024
+#define TESS_SO_STRIDE 4
+#define TESS_SO_SIZE (16 * 1024 * 1024)
+
+
+/*
+ * OUT[1] = IN[0] + VERTEXID, which is exact in floats for the values used
+ * here.  OUT[2] is a 64 step dependent MAD chain to give the shader some
+ * weight, only compared against the serial path.
+ */
+static const char vs_text[] =
+   "VERT\n"
+   "DCL IN[0]\n"
+   "DCL SV[0], VERTEXID\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "DCL OUT[2], GENERIC[1]\n"
+   "DCL TEMP[0..2]\n"
+   "IMM[0] FLT32 { 0.999, 0.001, 0.015625, 1.0 }\n"
+   "IMM[1] FLT32 { 0.0, 0.0, 0.0, 0.0 }\n"
+   "  0: MOV OUT[0], IN[0]\n"
+   "  1: U2F TEMP[0], SV[0].xxxx\n"
+   "  2: ADD OUT[1], IN[0], TEMP[0]\n"
+   "  3: MOV TEMP[1], IN[0]\n"
+   "  4: MOV TEMP[2].x, IMM[1].xxxx\n"
+   "  5: BGNLOOP\n"
+   "  6:   MAD TEMP[1], TEMP[1], IMM[0].xxxx, IMM[0].yyyy\n"
+   "  7:   ADD TEMP[2].x, TEMP[2].xxxx, IMM[0].zzzz\n"
+   "  8:   SGE TEMP[2].y, TEMP[2].xxxx, IMM[0].wwww\n"
+   "  9:   IF TEMP[2].yyyy\n"
+   " 10:     BRK\n"
+   " 11:   ENDIF\n"
+   " 12: ENDLOOP\n"
+   " 13: MOV OUT[2], TEMP[1]\n"
+   " 14: END\n";
+
+
+struct draw_shade_test {
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct pipe_resource *so_buf;
+   struct pipe_stream_output_target *so_target;
+   void *vs, *fs, *velems, *rs, *dsa, *blend;
+   void *tcs, *tes;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "ns_per_vertex\t"
+           "threads\t"
+           "draw\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, bool success, double ns, unsigned threads,
+              const char *draw)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.2f\t", ns);
+   fprintf(fp, "%u\t", threads);
+   fprintf(fp, "%s\n", draw);
+   fflush(fp);
+}
+
+
+static void *
+create_vs(struct pipe_context *pipe)
+{
+   struct tgsi_token tokens[256];
+   struct pipe_shader_state state = {0};
+
+   if (!tgsi_text_translate(vs_text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   pipe_shader_state_from_tgsi(&state, tokens);
+   state.stream_output.num_outputs = 2;
+   state.stream_output.stride[0] = SO_STRIDE;
+   for (unsigned i = 0; i < 2; i++) {
+      state.stream_output.output[i].register_index = 1 + i;
+      state.stream_output.output[i].num_components = 4;
+      state.stream_output.output[i].dst_offset = 4 * i;
+   }
+
+   return pipe->create_vs_state(pipe, &state);
+}
+
+
+static nir_variable *
+create_var(nir_shader *nir, nir_variable_mode mode, gl_varying_slot slot,
+           bool per_vertex)
+{
+   const struct glsl_type *type = glsl_vec4_type();
+
+   if (per_vertex)
+      type = glsl_array_type(type, 0, 0);
+
+   return nir_create_variable_with_location(nir, mode, slot, type);
+}
+
+
+static void *
+create_shader_from_nir(struct pipe_context *pipe, nir_shader *nir)
+{
+   struct pipe_shader_state state = {
+      .type = PIPE_SHADER_IR_NIR,
+      .ir.nir = nir,
+   };
+
+   nir_validate_shader(nir, "lp_test_draw_shade");
+   if (pipe->screen->finalize_nir)
+      pipe->screen->finalize_nir(pipe->screen, nir, true);
+
+   if (nir->info.stage == MESA_SHADER_TESS_CTRL)
+      return pipe->create_tcs_state(pipe, &state);
+
+   state.stream_output.num_outputs = 1;
+   state.stream_output.stride[0] = TESS_SO_STRIDE;
+   state.stream_output.output[0].register_index = 1;
+   state.stream_output.output[0].num_components = 4;
+   return pipe->create_tes_state(pipe, &state);
+}
+
+
+/**
+ * Pass the single vertex of each patch through, with tess factors of
+ * 1 + fract(0.37 * x) * 7, x being the VS's OUT[1].x.
+ */
+static void *
+create_tcs(struct pipe_context *pipe)
+{
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_TESS_CTRL,
+                                     pipe->screen->nir_options[MESA_SHADER_TESS_CTRL],
+                                     "tcs");
+   nir_variable *in_pos = create_var(b.shader, nir_var_shader_in, VARYING_SLOT_POS, true);
+   nir_variable *in_var = create_var(b.shader, nir_var_shader_in, VARYING_SLOT_VAR0, true);
+   nir_variable *out_pos = create_var(b.shader, nir_var_shader_out, VARYING_SLOT_POS, true);
+   nir_variable *out_var = create_var(b.shader, nir_var_shader_out, VARYING_SLOT_VAR0, true);
+   nir_variable *outer =
+      nir_create_variable_with_location(b.shader, nir_var_shader_out,
+                                        VARYING_SLOT_TESS_LEVEL_OUTER, glsl_vec4_type());
+   nir_variable *inner =
+      nir_create_variable_with_location(b.shader, nir_var_shader_out,
+                                        VARYING_SLOT_TESS_LEVEL_INNER, glsl_vec_type(2));
+   outer->data.patch = true;
+   inner->data.patch = true;
+
+   nir_def *id = nir_load_invocation_id(&b);
+   nir_def *var = nir_load_array_var(&b, in_var, id);
+   nir_store_array_var(&b, out_pos, id, nir_load_array_var(&b, in_pos, id), 0xf);
+   nir_store_array_var(&b, out_var, id, var, 0xf);
+
+   nir_def *factor = nir_fmul_imm(&b, nir_channel(&b, var, 0), 0.37);
+   factor = nir_fadd_imm(&b, nir_fmul_imm(&b, nir_ffract(&b, factor), 7.0), 1.0);
+   nir_store_var(&b, outer, nir_replicate(&b, factor, 4), 0xf);
+   nir_store_var(&b, inner, nir_replicate(&b, factor, 2), 0x3);
+
+   b.shader->info.tess.tcs_vertices_out = 1;
+
+   return create_shader_from_nir(pipe, b.shader);
+}
+
+
+/**
+ * Output the domain point, the patch's primitive ID and its OUT[1].x.
+ */
+static void *
+create_tes(struct pipe_context *pipe)
+{
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_TESS_EVAL,
+                                     pipe->screen->nir_options[MESA_SHADER_TESS_EVAL],
+                                     "tes");
+   nir_variable *in_pos = create_var(b.shader, nir_var_shader_in, VARYING_SLOT_POS, true);
+   nir_variable *in_var = create_var(b.shader, nir_var_shader_in, VARYING_SLOT_VAR0, true);
+   nir_variable *out_pos = create_var(b.shader, nir_var_shader_out, VARYING_SLOT_POS, false);
+   nir_variable *out_var = create_var(b.shader, nir_var_shader_out, VARYING_SLOT_VAR0, false);
+
+   nir_def *zero = nir_imm_int(&b, 0);
+   nir_def *coord = nir_load_tess_coord(&b);
+   nir_def *var = nir_load_array_var(&b, in_var, zero);
+   nir_store_var(&b, out_pos, nir_load_array_var(&b, in_pos, zero), 0xf);
+   nir_store_var(&b, out_var,
+                 nir_vec4(&b, nir_channel(&b, coord, 0), nir_channel(&b, coord, 1),
+                          nir_u2f32(&b, nir_load_primitive_id(&b)),
+                          nir_channel(&b, var, 0)),
+                 0xf);
+
+   b.shader->info.tess._primitive_mode = TESS_PRIMITIVE_TRIANGLES;
+   b.shader->info.tess.spacing = TESS_SPACING_FRACTIONAL_ODD;
+   b.shader->info.tess.ccw = true;
+
+   return create_shader_from_nir(pipe, b.shader);
+}
+
+
+/**
+ * Create a context shading with \p threads threads, drawing nothing but
+ * the stream output.
+ */
+static bool
+draw_shade_test_init(struct draw_shade_test *t, struct pipe_screen *screen,
+                     unsigned threads, bool tess)
+{
+   char value[16];
+
+   /* Read by the draw module on the first large draw of the context */
+   snprintf(value, sizeof(value), "%u", threads);
+   setenv("DRAW_SHADE_THREADS", value, 1);
+
+   memset(t, 0, sizeof(*t));
+   t->screen = screen;
+   t->pipe = screen->context_create(screen, NULL, 0);
+   if (!t->pipe)
+      return false;
+
+   struct pipe_context *pipe = t->pipe;
+
+   struct pipe_rasterizer_state rs = {0};
+   rs.rasterizer_discard = 1;
+   rs.point_size = 1.0f;
+   rs.depth_clip_near = 1;
+   rs.depth_clip_far = 1;
+   t->rs = pipe->create_rasterizer_state(pipe, &rs);
+   pipe->bind_rasterizer_state(pipe, t->rs);
+
+   struct pipe_depth_stencil_alpha_state dsa = {0};
+   t->dsa = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+   pipe->bind_depth_stencil_alpha_state(pipe, t->dsa);
+
+   struct pipe_blend_state blend = {0};
+   t->blend = pipe->create_blend_state(pipe, &blend);
+   pipe->bind_blend_state(pipe, t->blend);
+
+   /* The draw module's viewport transform reads this even when discarding */
+   struct pipe_viewport_state vp = {
+      .scale = { 1.0f, 1.0f, 1.0f },
+      .swizzle_x = PIPE_VIEWPORT_SWIZZLE_POSITIVE_X,
+      .swizzle_y = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Y,
+      .swizzle_z = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Z,
+      .swizzle_w = PIPE_VIEWPORT_SWIZZLE_POSITIVE_W,
+   };
+   pipe->set_viewport_states(pipe, 0, 1, &vp);
+
+   struct pipe_vertex_element ve = {0};
+   ve.src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   ve.src_stride = 4 * sizeof(float);
+   t->velems = pipe->create_vertex_elements_state(pipe, 1, &ve);
+   pipe->bind_vertex_elements_state(pipe, t->velems);
+
+   t->vs = create_vs(pipe);
+   t->fs = util_make_empty_fragment_shader(pipe);
+   if (!t->vs || !t->fs)
+      return false;
+   pipe->bind_vs_state(pipe, t->vs);
+   pipe->bind_fs_state(pipe, t->fs);
+
+   if (tess) {
+      t->tcs = create_tcs(pipe);
+      t->tes = create_tes(pipe);
+      if (!t->tcs || !t->tes)
+         return false;
+      pipe->bind_tcs_state(pipe, t->tcs);
+      pipe->bind_tes_state(pipe, t->tes);
+      pipe->set_patch_vertices(pipe, 1);
+   }
+
+   const unsigned size = tess ? TESS_SO_SIZE :
+                                NUM_VERTICES * SO_STRIDE * sizeof(uint32_t);
+   t->so_buf = pipe_buffer_create(screen, PIPE_BIND_STREAM_OUTPUT,
+                                  PIPE_USAGE_STAGING, size);
+   if (!t->so_buf)
+      return false;
+   t->so_target = pipe->create_stream_output_target(pipe, t->so_buf, 0, size);
+
+   return t->so_target != NULL;
+}
+
+
+static void
+draw_shade_test_fini(struct draw_shade_test *t)
+{
+   struct pipe_context *pipe = t->pipe;
+
+   if (!pipe)
+      return;
+
+   pipe->set_stream_output_targets(pipe, 0, NULL, NULL, 0);
+   if (t->so_target)
+      pipe->stream_output_target_destroy(pipe, t->so_target);
+   pipe_resource_reference(&t->so_buf, NULL);
+   if (t->tcs) {
+      pipe->bind_tcs_state(pipe, NULL);
+      pipe->delete_tcs_state(pipe, t->tcs);
+   }
+   if (t->tes) {
+      pipe->bind_tes_state(pipe, NULL);
+      pipe->delete_tes_state(pipe, t->tes);
+   }
+   if (t->vs)
+      pipe->delete_vs_state(pipe, t->vs);
+   if (t->fs)
+      pipe->delete_fs_state(pipe, t->fs);
+   if (t->velems)
+      pipe->delete_vertex_elements_state(pipe, t->velems);
+   if (t->rs)
+      pipe->delete_rasterizer_state(pipe, t->rs);
+   if (t->dsa)
+      pipe->delete_depth_stencil_alpha_state(pipe, t->dsa);
+   if (t->blend)
+      pipe->delete_blend_state(pipe, t->blend);
+   pipe->destroy(pipe);
+}
+
+
+/**
+ * Draw all vertices once, returning the time taken.
+ */
+static int64_t
+draw_points(struct draw_shade_test *t, const float *verts,
+            const uint32_t *indices)
+{
+   struct pipe_context *pipe = t->pipe;
+   const unsigned offset = 0;
+
+   struct pipe_vertex_buffer vb = {0};
+   vb.is_user_buffer = true;
+   vb.buffer.user = verts;
+   pipe->set_vertex_buffers(pipe, 1, &vb);
+
+   pipe->set_stream_output_targets(pipe, 1, &t->so_target, &offset,
+                                   MESA_PRIM_POINTS);
+
+   struct pipe_draw_info info = {0};
+   info.mode = MESA_PRIM_POINTS;
+   info.instance_count = 1;
+   info.max_index = ~0u;
+   if (indices) {
+      info.index_size = 4;
+      info.has_user_indices = true;
+      info.index.user = indices;
+   }
+
+   struct pipe_draw_start_count_bias draw = { 0, NUM_VERTICES, 0 };
+
+   int64_t start = os_time_get_nano();
+   pipe->draw_vbo(pipe, &info, 0, NULL, &draw, 1);
+   pipe->flush(pipe, NULL, 0);
+   return os_time_get_nano() - start;
+}
+
+
+static bool
+test_draw_shade(unsigned verbose, FILE *fp, struct pipe_screen *screen,
+                const float *verts, const uint32_t *indices)
+{
+   static const unsigned thread_counts[] = { 1, 2, 4, 16 };
+   const unsigned size = NUM_VERTICES * SO_STRIDE * sizeof(uint32_t);
+   float *reference = MALLOC(size);
+   bool success = true;
+
+   for (unsigned c = 0; c < ARRAY_SIZE(thread_counts); c++) {
+      const unsigned threads = thread_counts[c];
+      struct draw_shade_test t;
+      int64_t best = INT64_MAX;
+      bool match = true;
+
+      if (!draw_shade_test_init(&t, screen, threads, false)) {
+         draw_shade_test_fini(&t);
+         FREE(reference);
+         return false;
+      }
+
+      for (unsigned run = 0; run < NUM_RUNS; run++)
+         best = MIN2(best, draw_points(&t, verts, indices));
+
+      float *out = MALLOC(size);
+      pipe_buffer_read(t.pipe, t.so_buf, 0, size, out);
+
+      for (unsigned i = 0; i < NUM_VERTICES && match; i++) {
+         const unsigned index = indices ? indices[i] : i;
+         const float *v = &out[i * SO_STRIDE];
+
+         for (unsigned j = 0; j < 4; j++) {
+            if (v[j] != verts[index * 4 + j] + (float)index) {
+               if (verbose >= 1)
+                  printf("vertex %u component %u: got %f, expected %f\n",
+                         i, j, v[j], verts[index * 4 + j] + (float)index);
+               match = false;
+            }
+         }
+      }
+
+      /* The serial path is the reference for the rest of the output */
+      if (c == 0)
+         memcpy(reference, out, size);
+      else if (memcmp(reference, out, size))
+         match = false;
+
+      FREE(out);
+      draw_shade_test_fini(&t);
+
+      double ns = (double)best / NUM_VERTICES;
+      if (!match || verbose >= 1) {
+         printf("%s, %u threads: %s, %.2f ns/vertex\n",
+                indices ? "indexed" : "linear", threads,
+                match ? "pass" : "FAIL", ns);
+      }
+
+      if (fp)
+         write_tsv_row(fp, match, ns, threads, indices ? "indexed" : "linear");
+
+      success = success && match;
+   }
+
+   unsetenv("DRAW_SHADE_THREADS");
+   FREE(reference);
+
+   return success;
+}
+
+
+/**
+ * Draw NUM_PATCHES single vertex patches once, returning the time taken
+ * and the number of triangles captured.
+ */
+static int64_t
+draw_patches(struct draw_shade_test *t, const float *verts,
+             uint64_t *num_prims)
+{
+   struct pipe_context *pipe = t->pipe;
+   const unsigned offset = 0;
+
+   struct pipe_vertex_buffer vb = {0};
+   vb.is_user_buffer = true;
+   vb.buffer.user = verts;
+   pipe->set_vertex_buffers(pipe, 1, &vb);
+
+   pipe->set_stream_output_targets(pipe, 1, &t->so_target, &offset,
+                                   MESA_PRIM_TRIANGLES);
+
+   struct pipe_draw_info info = {0};
+   info.mode = MESA_PRIM_PATCHES;
+   info.instance_count = 1;
+   info.max_index = ~0u;
+
+   struct pipe_draw_start_count_bias draw = { 0, NUM_PATCHES, 0 };
+   struct pipe_query *query =
+      pipe->create_query(pipe, PIPE_QUERY_SO_STATISTICS, 0);
+   union pipe_query_result result;
+
+   int64_t start = os_time_get_nano();
+   pipe->begin_query(pipe, query);
+   pipe->draw_vbo(pipe, &info, 0, NULL, &draw, 1);
+   pipe->end_query(pipe, query);
+   pipe->flush(pipe, NULL, 0);
+   int64_t time = os_time_get_nano() - start;
+
+   pipe->get_query_result(pipe, query, true, &result);
+   pipe->destroy_query(pipe, query);
+
+   /* Everything must fit, or the comparisons below mean nothing */
+   *num_prims = result.so_statistics.num_primitives_written;
+   if (result.so_statistics.primitives_storage_needed != *num_prims)
+      *num_prims = 0;
+
+   return time;
+}
+
+
+/**
+ * Check the TES outputs captured: patches in order, each with its own
+ * primitive ID and input, and domain points in [0, 1].
+ */
+static bool
+check_tess_output(unsigned verbose, const float *out, unsigned num_verts,
+                  const float *verts)
+{
+   unsigned patch = 0;
+
+   for (unsigned i = 0; i < num_verts; i++) {
+      const float *v = &out[i * TESS_SO_STRIDE];
+      unsigned prim_id = (unsigned)v[2];
+
+      if (prim_id != patch && prim_id != patch + 1)
+         goto fail;
+      patch = prim_id;
+
+      if (patch >= NUM_PATCHES ||
+          v[3] != verts[patch * 4] + (float)patch ||
+          !(v[0] >= 0.0f && v[0] <= 1.0f) ||
+          !(v[1] >= 0.0f && v[1] <= 1.0f))
+         goto fail;
+      continue;
+
+fail:
+      if (verbose >= 1)
+         printf("tess vertex %u: got %f %f %f %f after patch %u\n",
+                i, v[0], v[1], v[2], v[3], patch);
+      return false;
+   }
+
+   return num_verts && patch == NUM_PATCHES - 1;
+}
+
+
+static bool
+test_tess_shade(unsigned verbose, FILE *fp, struct pipe_screen *screen,
+                const float *verts)
+{
+   static const unsigned thread_counts[] = { 1, 2, 4, 16 };
+   float *reference = MALLOC(TESS_SO_SIZE);
+   float *out = MALLOC(TESS_SO_SIZE);
+   uint64_t reference_prims = 0;
+   bool success = true;
+
+   for (unsigned c = 0; c < ARRAY_SIZE(thread_counts); c++) {
+      const unsigned threads = thread_counts[c];
+      struct draw_shade_test t;
+      int64_t best = INT64_MAX;
+      uint64_t num_prims = 0;
+
+      if (!draw_shade_test_init(&t, screen, threads, true)) {
+         draw_shade_test_fini(&t);
+         success = false;
+         break;
+      }
+
+      for (unsigned run = 0; run < NUM_RUNS; run++)
+         best = MIN2(best, draw_patches(&t, verts, &num_prims));
+
+      const unsigned size = num_prims * 3 * TESS_SO_STRIDE * sizeof(float);
+      pipe_buffer_read(t.pipe, t.so_buf, 0, size, out);
+      draw_shade_test_fini(&t);
+
+      bool match = check_tess_output(verbose, out, num_prims * 3, verts);
+
+      if (c == 0) {
+         memcpy(reference, out, size);
+         reference_prims = num_prims;
+      } else if (num_prims != reference_prims || memcmp(reference, out, size)) {
+         match = false;
+      }
+
+      double ns = num_prims ? (double)best / (num_prims * 3) : 0.0;
+      if (!match || verbose >= 1) {
+         printf("tess, %u threads: %s, %" PRIu64 " triangles, %.2f ns/vertex\n",
+                threads, match ? "pass" : "FAIL", num_prims, ns);
+      }
+
+      if (fp)
+         write_tsv_row(fp, match, ns, threads, "tess");
+
+      success = success && match;
+   }
+
+   unsetenv("DRAW_SHADE_THREADS");
+   FREE(reference);
+   FREE(out);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   struct sw_winsys *winsys = null_sw_create();
+   struct pipe_screen *screen = llvmpipe_create_screen(winsys);
+   bool success = true;
+
+   if (!screen) {
+      winsys->destroy(winsys);
+      return false;
+   }
+
+   float *verts = MALLOC(NUM_VERTICES * 4 * sizeof(float));
+   uint32_t *indices = MALLOC(NUM_VERTICES * sizeof(uint32_t));
+
+   for (unsigned i = 0; i < NUM_VERTICES; i++) {
+      verts[i * 4 + 0] = (float)(i % 251) / 256.0f;
+      verts[i * 4 + 1] = (float)(i % 241) / 256.0f;
+      verts[i * 4 + 2] = (float)(i % 239) / 256.0f;
+      verts[i * 4 + 3] = 1.0f;
+      indices[i] = i;
+   }
+
+   /* A fixed shuffle, so each chunk fetches from all over the buffer */
+   srand(0x5eed);
+   for (unsigned i = NUM_VERTICES - 1; i > 0; i--) {
+      unsigned j = rand() % (i + 1);
+      uint32_t tmp = indices[i];
+      indices[i] = indices[j];
+      indices[j] = tmp;
+   }
+
+   success = test_draw_shade(verbose, fp, screen, verts, NULL) && success;
+   success = test_draw_shade(verbose, fp, screen, verts, indices) && success;
+   success = test_tess_shade(verbose, fp, screen, verts) && success;
+
+   FREE(verts);
+   FREE(indices);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_all(verbose, fp);
+}
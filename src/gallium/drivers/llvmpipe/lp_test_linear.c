@@ -0,0 +1,309 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Throughput of the kernels behind the linear rasterization path.
+ *
+ * Premultiplied-alpha blending of a tile, as done by the linear shaders, is
+ * run with 4, 8 and 16 pixels per iteration (the widths the CPU supports,
+ * see linear_block_pixels() in lp_state_fs_linear_llvm.c), and with the
+ * SSE2 fastpath kernel.  The shaders must match the 4-pixel shader
+ * exactly, the SSE2 kernel to within its documented error.  Megapixels per second for each kernel are reported as TSV.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+#include "util/u_sse.h"
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_bld_blend.h"
+#include "lp_limits.h"
+#include "lp_test.h"
+
+
+#define NUM_PIXELS (TILE_SIZE * TILE_SIZE)
+#define NUM_RUNS 64
+
+
+typedef void (*blend_row_func_t)(uint32_t *dst, const uint32_t *src,
+                                 int32_t num_blocks);
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "mpix_per_sec\t"
+           "kernel\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, bool success, double mpix, const char *kernel)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.1f\t", mpix);
+   fprintf(fp, "%s\n", kernel);
+   fflush(fp);
+}
+
+
+/**
+ * Build a function which blends num_blocks blocks of src onto dst with
+ * ONE/INV_SRC_ALPHA, pixels_per_block pixels at a time.
+ */
+static LLVMValueRef
+build_blend_func(struct gallivm_state *gallivm, unsigned pixels_per_block,
+                 const char *name)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   const unsigned char swizzle[4] = { 2, 1, 0, 3 };
+   struct pipe_blend_state blend;
+   struct lp_type type;
+
+   memset(&type, 0, sizeof type);
+   type.norm = true;
+   type.width = 8;
+   type.length = pixels_per_block * 4;
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].blend_enable = 1;
+   blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+   blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+   blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(context);
+   LLVMTypeRef args[] = {
+      LLVMPointerType(vec_type, 0),
+      LLVMPointerType(vec_type, 0),
+      i32t,
+   };
+   LLVMValueRef func = LLVMAddFunction(gallivm->module, name,
+      LLVMFunctionType(LLVMVoidTypeInContext(context),
+                       args, ARRAY_SIZE(args), 0));
+   LLVMValueRef dst_arg = LLVMGetParam(func, 0);
+   LLVMValueRef src_arg = LLVMGetParam(func, 1);
+   LLVMValueRef num_arg = LLVMGetParam(func, 2);
+
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   struct lp_build_for_loop_state loop;
+   lp_build_for_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0),
+                           LLVMIntULT, num_arg,
+                           lp_build_const_int32(gallivm, 1));
+   {
+      LLVMValueRef dst_ptr =
+         LLVMBuildGEP2(builder, vec_type, dst_arg, &loop.counter, 1, "");
+      LLVMValueRef src_ptr =
+         LLVMBuildGEP2(builder, vec_type, src_arg, &loop.counter, 1, "");
+      LLVMValueRef dst = LLVMBuildLoad2(builder, vec_type, dst_ptr, "dst");
+      LLVMValueRef src = LLVMBuildLoad2(builder, vec_type, src_ptr, "src");
+
+      LLVMSetAlignment(dst, 4);
+      LLVMSetAlignment(src, 16);
+
+      LLVMValueRef res =
+         lp_build_blend_aos(gallivm, &blend, PIPE_FORMAT_B8G8R8A8_UNORM,
+                            type, 0, src, NULL, LLVMGetUndef(vec_type), NULL,
+                            dst, NULL, LLVMGetUndef(vec_type), NULL,
+                            swizzle, 4);
+
+      LLVMSetAlignment(LLVMBuildStore(builder, res, dst_ptr), 4);
+   }
+   lp_build_for_loop_end(&loop);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+#if DETECT_ARCH_SSE
+static void
+blend_premul_sse2(uint32_t *dst, const uint32_t *src, int32_t num_blocks)
+{
+   for (int32_t i = 0; i < num_blocks * 4; i += 4) {
+      __m128i d = _mm_loadu_si128((const __m128i *)&dst[i]);
+      d = util_sse2_blend_premul_4(*(const __m128i *)&src[i], d);
+      _mm_storeu_si128((__m128i *)&dst[i], d);
+   }
+}
+#endif
+
+
+static bool
+compare_pixels(const uint32_t *res, const uint32_t *ref, unsigned n,
+               unsigned tolerance)
+{
+   for (unsigned i = 0; i < n; i++) {
+      for (unsigned c = 0; c < 4; c++) {
+         int a = (res[i] >> (c * 8)) & 0xff;
+         int b = (ref[i] >> (c * 8)) & 0xff;
+         if (abs(a - b) > tolerance)
+            return false;
+      }
+   }
+   return true;
+}
+
+
+/**
+ * Time one kernel over the tile and check it against ref, if there is one.
+ */
+static bool
+test_kernel(unsigned verbose, FILE *fp, const char *name,
+            blend_row_func_t func, unsigned pixels_per_block,
+            const uint32_t *src, const uint32_t *dst0, uint32_t *dst,
+            const uint32_t *ref, unsigned tolerance)
+{
+   int64_t best = INT64_MAX;
+
+   for (unsigned run = 0; run < NUM_RUNS; run++) {
+      memcpy(dst, dst0, NUM_PIXELS * 4);
+
+      int64_t start = os_time_get_nano();
+      func(dst, src, NUM_PIXELS / pixels_per_block);
+      best = MIN2(best, os_time_get_nano() - start);
+   }
+
+   bool success = !ref || compare_pixels(dst, ref, NUM_PIXELS, tolerance);
+   const double mpix = NUM_PIXELS * 1e3 / MAX2(best, 1);
+
+   if (!success || verbose >= 1) {
+      printf("%s: %s, %.1f Mpix/s\n", name, success ? "pass" : "FAIL", mpix);
+   }
+
+   if (fp)
+      write_tsv_row(fp, success, mpix, name);
+
+   return success;
+}
+
+
+static bool
+test_linear(unsigned verbose, FILE *fp)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+   const unsigned widths[] = { 4, 8, 16 };
+   const bool supported[] = {
+      true,
+      caps->has_avx2,
+      caps->has_avx512bw,
+   };
+   const char *names[] = {
+      "jit_premul_4",
+      "jit_premul_8",
+      "jit_premul_16",
+   };
+   bool success = true;
+
+   uint32_t *src = align_malloc(NUM_PIXELS * 4, 64);
+   uint32_t *dst0 = align_malloc(NUM_PIXELS * 4, 64);
+   uint32_t *dst = align_malloc(NUM_PIXELS * 4, 64);
+   uint32_t *ref = align_malloc(NUM_PIXELS * 4, 64);
+
+   /* Premultiplied source: no channel exceeds alpha. */
+   for (unsigned i = 0; i < NUM_PIXELS; i++) {
+      unsigned a = rand() & 0xff;
+      unsigned r = a ? rand() % (a + 1) : 0;
+      unsigned g = a ? rand() % (a + 1) : 0;
+      unsigned b = a ? rand() % (a + 1) : 0;
+      src[i] = (a << 24) | (r << 16) | (g << 8) | b;
+      dst0[i] = ((uint32_t)rand() << 16) ^ rand();
+   }
+
+   lp_context_ref context;
+   lp_context_create(&context);
+   struct gallivm_state *gallivm = gallivm_create("test_module", &context, NULL);
+
+   LLVMValueRef funcs[ARRAY_SIZE(widths)];
+   for (unsigned i = 0; i < ARRAY_SIZE(widths); i++) {
+      funcs[i] = supported[i] ?
+         build_blend_func(gallivm, widths[i], names[i]) : NULL;
+   }
+
+   gallivm_compile_module(gallivm);
+
+   blend_row_func_t blend[ARRAY_SIZE(widths)];
+   for (unsigned i = 0; i < ARRAY_SIZE(widths); i++) {
+      blend[i] = funcs[i] ?
+         (blend_row_func_t)gallivm_jit_function(gallivm, funcs[i], names[i]) :
+         NULL;
+   }
+
+   gallivm_free_ir(gallivm);
+
+   /* The 4-pixel shader is the reference for the others. */
+   for (unsigned i = 0; i < ARRAY_SIZE(widths); i++) {
+      if (!blend[i])
+         continue;
+
+      success &= test_kernel(verbose, fp, names[i], blend[i], widths[i],
+                             src, dst0, dst, i ? ref : NULL, 0);
+      if (i == 0)
+         memcpy(ref, dst, NUM_PIXELS * 4);
+   }
+
+#if DETECT_ARCH_SSE
+   /* The SSE2 kernel approximates the division by 255 differently. */
+   success &= test_kernel(verbose, fp, "sse2_premul_4", blend_premul_sse2, 4,
+                          src, dst0, dst, ref, UTIL_SSE2_BLEND_PREMUL_ERROR);
+#endif
+
+   gallivm_destroy(gallivm);
+   lp_context_destroy(&context);
+
+   align_free(src);
+   align_free(dst0);
+   align_free(dst);
+   align_free(ref);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_linear(verbose, fp);
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_all(verbose, fp);
+}
@@ -34,6 +34,7 @@
  */
 
 
+#include "util/u_cpu_detect.h"
 #include "util/u_math.h"
 
 #include "gallivm/lp_bld_const.h"
@@ -380,6 +381,14 @@ main(int argc, char **argv)
    if (!lp_build_init())
       return 1;
 
+   /* LP_NATIVE_VECTOR_WIDTH may ask for vectors the CPU doesn't have */
+   if (lp_native_vector_width > util_get_cpu_caps()->max_vector_bits) {
+      printf("skipped: %u bit vectors not supported by the CPU\n",
+             lp_native_vector_width);
+      LLVMShutdown();
+      return 77;
+   }
+
    for (i = 1; i < argc; ++i) {
       if (strcmp(argv[i], "-v") == 0)
          ++verbose;
@@ -0,0 +1,183 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Allocations done by the binner for scene data blocks, with and without
+ * the per-setup block pool (struct lp_scene_block_pool).
+ *
+ * Frames of varying size are binned with lp_scene_alloc() into a ring of
+ * scenes, as lp_setup_get_empty_scene() does with several scenes in
+ * flight, and lp_scene_end_rasterization() releases each scene's blocks
+ * when it is reused.  Without the pool, the released blocks are freed.
+ * Once warmed up with the largest frames, the pooled binner must not
+ * malloc at all.  The mallocs and the time per frame are reported as TSV.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_memory.h"
+
+#include "lp_scene.h"
+#include "lp_setup_context.h"
+#include "lp_test.h"
+
+
+#define NUM_FRAMES 256
+#define SCENES_IN_FLIGHT 3
+#define WARMUP_FRAMES SCENES_IN_FLIGHT
+#define MAX_BLOCKS_PER_FRAME 64
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "mallocs_per_frame\t"
+           "ns_per_frame\t"
+           "allocator\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, bool success, double mallocs, double ns,
+              const char *allocator)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.2f\t", mallocs);
+   fprintf(fp, "%.0f\t", ns);
+   fprintf(fp, "%s\n", allocator);
+   fflush(fp);
+}
+
+
+/**
+ * Free the blocks held by the pool, as if there was no pool.
+ */
+static void
+drain_pool(struct lp_scene_block_pool *pool)
+{
+   lp_scene_block_pool_fini(pool);
+   lp_scene_block_pool_init(pool);
+}
+
+
+static bool
+test_pool(unsigned verbose, FILE *fp, bool pooled)
+{
+   const char *name = pooled ? "pool" : "malloc";
+   struct lp_setup_context setup;
+   struct pipe_framebuffer_state fb;
+   struct lp_scene *scenes[SCENES_IN_FLIGHT];
+   uint64_t mallocs = 0;
+   int64_t time = 0;
+   bool binned = true;
+
+   memset(&setup, 0, sizeof setup);
+   slab_create(&setup.scene_slab, sizeof(struct lp_scene), SCENES_IN_FLIGHT);
+   lp_scene_block_pool_init(&setup.block_pool);
+
+   for (unsigned i = 0; i < SCENES_IN_FLIGHT; i++)
+      scenes[i] = lp_scene_create(&setup);
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = TILE_SIZE;
+   fb.height = TILE_SIZE;
+
+   srand(0);
+
+   for (unsigned frame = 0; frame < NUM_FRAMES; frame++) {
+      struct lp_scene *scene = scenes[frame % SCENES_IN_FLIGHT];
+
+      /* Warm up with frames as large as any later one, so that the pool
+       * ends up holding enough blocks for all the scenes in flight.
+       */
+      const unsigned num_blocks = frame < WARMUP_FRAMES ?
+         MAX_BLOCKS_PER_FRAME : 1 + rand() % MAX_BLOCKS_PER_FRAME;
+
+      int64_t start = os_time_get_nano();
+
+      if (frame >= SCENES_IN_FLIGHT)
+         lp_scene_end_rasterization(scene);
+      if (!pooled)
+         drain_pool(&setup.block_pool);
+
+      if (!lp_scene_begin_binning(scene, &fb)) {
+         binned = false;
+         break;
+      }
+      for (unsigned i = 0; i < num_blocks; i++) {
+         /* Touch the block like the binner would. */
+         uint8_t *data = lp_scene_alloc(scene, DATA_BLOCK_SIZE);
+         if (!data)
+            break;
+         memset(data, 0, 256);
+      }
+      lp_scene_end_binning(scene);
+
+      time += os_time_get_nano() - start;
+
+      assert(setup.block_pool.num_blocks <= LP_SCENE_POOL_MAX_BLOCKS);
+
+      if (frame >= WARMUP_FRAMES)
+         mallocs += scene->stats[LP_STAT_SCENE_BLOCK_MALLOCS];
+      else
+         time = 0;
+      memset(scene->stats, 0, sizeof scene->stats);
+   }
+
+   for (unsigned i = 0; i < SCENES_IN_FLIGHT; i++)
+      lp_scene_destroy(scenes[i]);
+
+   lp_scene_block_pool_fini(&setup.block_pool);
+   slab_destroy(&setup.scene_slab);
+
+   const unsigned num_frames = NUM_FRAMES - WARMUP_FRAMES;
+   const double mallocs_per_frame = (double)mallocs / num_frames;
+   const double ns_per_frame = (double)time / num_frames;
+   bool success = binned && (!pooled || mallocs == 0);
+
+   if (!success || verbose >= 1) {
+      printf("%s: %s, %.2f mallocs/frame, %.0f ns/frame\n", name,
+             success ? "pass" : "FAIL", mallocs_per_frame, ns_per_frame);
+   }
+
+   if (fp)
+      write_tsv_row(fp, success, mallocs_per_frame, ns_per_frame, name);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   bool success = true;
+
+   success &= test_pool(verbose, fp, false);
+   success &= test_pool(verbose, fp, true);
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_all(verbose, fp);
+}
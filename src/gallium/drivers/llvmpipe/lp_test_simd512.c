@@ -0,0 +1,505 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Compare the 512-bit (16 x 32-bit) code paths of gallivm with the 256-bit
+ * ones.
+ *
+ * Each operation with an AVX-512 specific path (min/max, iround, fast
+ * rsqrt, select on a non-sext mask and the native pack/unpack behind the
+ * unorm8 mul and lerp) is run over the same inputs at both widths.  Both
+ * must match the C reference, where there is one, and each other, except
+ * for the precision of the rsqrt estimate.  The cycles per element of each
+ * width are reported as TSV.
+ *
+ * The 16-wide functions are built regardless of LP_NATIVE_VECTOR_WIDTH, so
+ * this covers the AVX-512 paths whenever the CPU has them, and the generic
+ * split ones otherwise.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_arit.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_test.h"
+
+
+#define NUM_BYTES (256 * 1024)
+#define NUM_RUNS 8
+
+
+enum simd_input {
+   INPUT_FLOAT,
+   INPUT_FLOAT_NAN,       /* with NaNs in either operand */
+   INPUT_FLOAT_POSITIVE,
+   INPUT_UNORM8,
+};
+
+
+typedef void (*simd_func_t)(void *out, const void *a, const void *b,
+                            const void *c, int32_t num_vecs);
+
+
+/**
+ * Describe an operation with an AVX-512 path.
+ */
+struct simd_test {
+   const char *name;
+   enum simd_input input;
+
+   LLVMValueRef
+   (*build)(struct lp_build_context *bld,
+            LLVMValueRef a, LLVMValueRef b, LLVMValueRef c);
+
+   /*
+    * Reference on the element bits, NULL if the result is only compared
+    * with the 256-bit one.
+    */
+   uint32_t
+   (*ref)(uint32_t a, uint32_t b, uint32_t c);
+
+   /* Max relative error against the reference, 0 for exact results */
+   double eps;
+};
+
+
+static inline float
+bits_to_float(uint32_t x)
+{
+   return uif(x);
+}
+
+
+static inline uint32_t
+float_to_bits(float x)
+{
+   return fui(x);
+}
+
+
+static LLVMValueRef
+build_min(struct lp_build_context *bld,
+          LLVMValueRef a, LLVMValueRef b, LLVMValueRef c)
+{
+   return lp_build_min_ext(bld, a, b, GALLIVM_NAN_RETURN_OTHER);
+}
+
+
+static uint32_t
+ref_min(uint32_t a, uint32_t b, uint32_t c)
+{
+   return float_to_bits(fminf(bits_to_float(a), bits_to_float(b)));
+}
+
+
+static LLVMValueRef
+build_max(struct lp_build_context *bld,
+          LLVMValueRef a, LLVMValueRef b, LLVMValueRef c)
+{
+   return lp_build_max_ext(bld, a, b, GALLIVM_NAN_RETURN_OTHER);
+}
+
+
+static uint32_t
+ref_max(uint32_t a, uint32_t b, uint32_t c)
+{
+   return float_to_bits(fmaxf(bits_to_float(a), bits_to_float(b)));
+}
+
+
+static LLVMValueRef
+build_iround(struct lp_build_context *bld,
+             LLVMValueRef a, LLVMValueRef b, LLVMValueRef c)
+{
+   return lp_build_iround(bld, a);
+}
+
+
+static uint32_t
+ref_iround(uint32_t a, uint32_t b, uint32_t c)
+{
+   return (uint32_t)(int32_t)lrintf(bits_to_float(a));
+}
+
+
+static LLVMValueRef
+build_fast_rsqrt(struct lp_build_context *bld,
+                 LLVMValueRef a, LLVMValueRef b, LLVMValueRef c)
+{
+   return lp_build_fast_rsqrt(bld, a);
+}
+
+
+static uint32_t
+ref_rsqrt(uint32_t a, uint32_t b, uint32_t c)
+{
+   return float_to_bits(1.0 / sqrt(bits_to_float(a)));
+}
+
+
+/**
+ * Select on a mask loaded from memory, which lp_build_select can't tell
+ * is all ones or zeros per element.
+ */
+static LLVMValueRef
+build_select(struct lp_build_context *bld,
+             LLVMValueRef a, LLVMValueRef b, LLVMValueRef c)
+{
+   LLVMValueRef mask =
+      LLVMBuildBitCast(bld->gallivm->builder, c, bld->int_vec_type, "");
+   return lp_build_select(bld, mask, a, b);
+}
+
+
+static uint32_t
+ref_select(uint32_t a, uint32_t b, uint32_t c)
+{
+   return c ? a : b;
+}
+
+
+static LLVMValueRef
+build_mul_unorm8(struct lp_build_context *bld,
+                 LLVMValueRef a, LLVMValueRef b, LLVMValueRef c)
+{
+   return lp_build_mul(bld, a, b);
+}
+
+
+static uint32_t
+ref_mul_unorm8(uint32_t a, uint32_t b, uint32_t c)
+{
+   /* round(a * b / 255), there are no ties */
+   return (2 * a * b + 255) / 510;
+}
+
+
+static LLVMValueRef
+build_lerp_unorm8(struct lp_build_context *bld,
+                  LLVMValueRef a, LLVMValueRef b, LLVMValueRef c)
+{
+   return lp_build_lerp(bld, a, b, c, 0);
+}
+
+
+static const struct simd_test simd_tests[] = {
+   { "min", INPUT_FLOAT_NAN, build_min, ref_min, 0.0 },
+   { "max", INPUT_FLOAT_NAN, build_max, ref_max, 0.0 },
+   { "iround", INPUT_FLOAT, build_iround, ref_iround, 0.0 },
+   /* RSQRTPS guarantees 1.5 * 2^-12, RSQRT14PS 2^-14 */
+   { "fast_rsqrt", INPUT_FLOAT_POSITIVE, build_fast_rsqrt, ref_rsqrt, 1.0 / 2048 },
+   { "select", INPUT_FLOAT, build_select, ref_select, 0.0 },
+   { "mul_unorm8", INPUT_UNORM8, build_mul_unorm8, ref_mul_unorm8, 0.0 },
+   { "lerp_unorm8", INPUT_UNORM8, build_lerp_unorm8, NULL, 0.0 },
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_elem\t"
+           "op\t"
+           "width\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, bool success, double cycles, const char *op,
+              unsigned width)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.3f\t", cycles);
+   fprintf(fp, "%s\t", op);
+   fprintf(fp, "%u\n", width);
+   fflush(fp);
+}
+
+
+static struct lp_type
+test_type(const struct simd_test *test, unsigned width)
+{
+   if (test->input == INPUT_UNORM8)
+      return lp_type_unorm(8, width);
+   return lp_type_float_vec(32, width);
+}
+
+
+/**
+ * Build a function which applies the operation to num_vecs vectors.
+ */
+static LLVMValueRef
+build_simd_func(struct gallivm_state *gallivm, const struct simd_test *test,
+                unsigned width, const char *name)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type type = test_type(test, width);
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef ptr_type = LLVMPointerType(vec_type, 0);
+   LLVMTypeRef args[] = {
+      ptr_type, ptr_type, ptr_type, ptr_type,
+      LLVMInt32TypeInContext(context),
+   };
+   LLVMValueRef func = LLVMAddFunction(gallivm->module, name,
+      LLVMFunctionType(LLVMVoidTypeInContext(context),
+                       args, ARRAY_SIZE(args), 0));
+   LLVMValueRef ptrs[4];
+
+   for (unsigned i = 0; i < 4; i++)
+      ptrs[i] = LLVMGetParam(func, i);
+
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   struct lp_build_context bld;
+   lp_build_context_init(&bld, gallivm, type);
+
+   struct lp_build_loop_state loop;
+   lp_build_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0));
+   {
+      LLVMValueRef src[3], res;
+
+      for (unsigned i = 0; i < 3; i++) {
+         LLVMValueRef ptr = LLVMBuildGEP2(builder, vec_type, ptrs[i + 1],
+                                          &loop.counter, 1, "");
+         src[i] = LLVMBuildLoad2(builder, vec_type, ptr, "");
+      }
+
+      res = test->build(&bld, src[0], src[1], src[2]);
+      res = LLVMBuildBitCast(builder, res, vec_type, "");
+      LLVMBuildStore(builder, res,
+                     LLVMBuildGEP2(builder, vec_type, ptrs[0],
+                                   &loop.counter, 1, ""));
+   }
+   lp_build_loop_end_cond(&loop, LLVMGetParam(func, 4), NULL, LLVMIntUGE);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+static float
+random_range(float min, float max)
+{
+   return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+
+static unsigned
+init_inputs(enum simd_input input, uint32_t *a, uint32_t *b, uint32_t *c)
+{
+   if (input == INPUT_UNORM8) {
+      uint8_t *a8 = (uint8_t *)a, *b8 = (uint8_t *)b, *c8 = (uint8_t *)c;
+
+      for (unsigned i = 0; i < NUM_BYTES; i++) {
+         a8[i] = rand();
+         b8[i] = rand();
+         c8[i] = rand();
+      }
+      /* The extremes */
+      a8[0] = b8[0] = 0;
+      a8[1] = b8[1] = 255;
+      a8[2] = 255;
+      b8[2] = 0;
+
+      return NUM_BYTES;
+   }
+
+   const unsigned n = NUM_BYTES / 4;
+
+   for (unsigned i = 0; i < n; i++) {
+      float x;
+
+      if (input == INPUT_FLOAT_POSITIVE)
+         x = exp2f(random_range(-20.0f, 20.0f));
+      else if (i % 8 == 7)
+         x = (float)(int)(i % 64) - 31.5f;   /* round half to even */
+      else
+         x = random_range(-1000.0f, 1000.0f);
+
+      a[i] = float_to_bits(x);
+      b[i] = float_to_bits(random_range(-1000.0f, 1000.0f));
+      c[i] = rand() & 1 ? ~0u : 0;
+
+      if (input == INPUT_FLOAT_NAN) {
+         if (i % 13 == 0)
+            a[i] = float_to_bits(NAN);
+         if (i % 17 == 0)
+            b[i] = float_to_bits(NAN);
+      }
+   }
+
+   return n;
+}
+
+
+static uint32_t
+get_elem(const void *p, bool unorm8, unsigned i)
+{
+   return unorm8 ? ((const uint8_t *)p)[i] : ((const uint32_t *)p)[i];
+}
+
+
+static bool
+compare_elem(const struct simd_test *test, uint32_t res, uint32_t ref)
+{
+   if (test->eps == 0.0) {
+      if (test->input == INPUT_FLOAT_NAN &&
+          isnan(bits_to_float(res)) && isnan(bits_to_float(ref)))
+         return true;
+      return res == ref;
+   }
+
+   double x = bits_to_float(res), y = bits_to_float(ref);
+   return fabs(x - y) <= test->eps * fabs(y);
+}
+
+
+static bool
+test_simd(unsigned verbose, FILE *fp, const struct simd_test *test,
+          uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *out[2])
+{
+   const unsigned widths[2] = { 256, 512 };
+   const bool unorm8 = test->input == INPUT_UNORM8;
+   const unsigned n = init_inputs(test->input, a, b, c);
+   simd_func_t funcs[2];
+   uint64_t cycles[2];
+   bool success = true;
+
+   lp_context_ref context;
+   lp_context_create(&context);
+   struct gallivm_state *gallivm = gallivm_create("test_module", &context, NULL);
+
+   LLVMValueRef llvm_funcs[2];
+   char names[2][64];
+   for (unsigned w = 0; w < 2; w++) {
+      snprintf(names[w], sizeof names[w], "%s_%u", test->name, widths[w]);
+      llvm_funcs[w] = build_simd_func(gallivm, test, widths[w], names[w]);
+   }
+
+   gallivm_compile_module(gallivm);
+
+   for (unsigned w = 0; w < 2; w++)
+      funcs[w] = (simd_func_t)gallivm_jit_function(gallivm, llvm_funcs[w],
+                                                    names[w]);
+
+   gallivm_free_ir(gallivm);
+
+   for (unsigned w = 0; w < 2; w++) {
+      const unsigned num_vecs = NUM_BYTES / (widths[w] / 8);
+
+      cycles[w] = UINT64_MAX;
+      for (unsigned run = 0; run < NUM_RUNS; run++) {
+         uint64_t start = rdtsc();
+         funcs[w](out[w], a, b, c, num_vecs);
+         cycles[w] = MIN2(cycles[w], rdtsc() - start);
+      }
+   }
+
+   gallivm_destroy(gallivm);
+   lp_context_destroy(&context);
+
+   for (unsigned w = 0; w < 2; w++) {
+      unsigned num_errors = 0;
+
+      for (unsigned i = 0; i < n; i++) {
+         uint32_t res = get_elem(out[w], unorm8, i);
+         uint32_t ref;
+         bool match;
+
+         if (test->ref) {
+            ref = test->ref(get_elem(a, unorm8, i), get_elem(b, unorm8, i),
+                            get_elem(c, unorm8, i));
+            match = compare_elem(test, res, ref);
+         } else {
+            /* Only the 256-bit result to compare with */
+            ref = get_elem(out[0], unorm8, i);
+            match = res == ref;
+         }
+
+         if (!match && num_errors++ < 4) {
+            printf("%s %u: element %u: got 0x%08x, expected 0x%08x\n",
+                   test->name, widths[w], i, res, ref);
+         }
+      }
+
+      if (num_errors || verbose >= 1) {
+         printf("%s %u: %s, %.3f cycles/elem\n", test->name, widths[w],
+                num_errors ? "FAIL" : "pass", (double)cycles[w] / n);
+      }
+
+      if (fp)
+         write_tsv_row(fp, !num_errors, (double)cycles[w] / n, test->name,
+                       widths[w]);
+
+      success = success && !num_errors;
+   }
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   uint32_t *a = align_malloc(NUM_BYTES, 64);
+   uint32_t *b = align_malloc(NUM_BYTES, 64);
+   uint32_t *c = align_malloc(NUM_BYTES, 64);
+   uint32_t *out[2] = {
+      align_malloc(NUM_BYTES, 64),
+      align_malloc(NUM_BYTES, 64),
+   };
+   bool success = true;
+
+   if (verbose >= 1 && !util_get_cpu_caps()->has_avx512f)
+      printf("no AVX-512, testing the generic 16-wide paths\n");
+
+   for (unsigned i = 0; i < ARRAY_SIZE(simd_tests); i++)
+      success &= test_simd(verbose, fp, &simd_tests[i], a, b, c, out);
+
+   align_free(a);
+   align_free(b);
+   align_free(c);
+   align_free(out[0]);
+   align_free(out[1]);
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_all(verbose, fp);
+}
@@ -0,0 +1,279 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Compare texel fetches from linear and 4x4 block-tiled
+ * (LP_RESOURCE_FLAG_TILED_4X4) textures.
+ *
+ * The texture is read in the order the rasterizer shades pixels, i.e. 4x4
+ * blocks in row-major order, at minification factors of 1 to 8.  Both
+ * layouts must return the same texels; the cycles per texel are reported
+ * as TSV.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_memory.h"
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_gather.h"
+#include "gallivm/lp_bld_sample.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_texture.h"
+#include "lp_test.h"
+
+
+#define TEX_SIZE 1024
+#define TEX_BPP 4
+#define NUM_RUNS 8
+
+
+typedef void (*fetch_func_t)(uint32_t *out, const uint8_t *base,
+                             const int32_t *x, const int32_t *y,
+                             int32_t num_vecs, int32_t stride);
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_texel\t"
+           "layout\t"
+           "footprint\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, bool success, double cycles, bool tiled,
+              unsigned footprint)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.2f\t", cycles);
+   fprintf(fp, "%s\t", tiled ? "tiled_4x4" : "linear");
+   fprintf(fp, "%u\n", footprint);
+   fflush(fp);
+}
+
+
+/**
+ * Build a function which fetches the texels at (x[i], y[i]) and xors
+ * them together lane-wise.
+ */
+static LLVMValueRef
+build_fetch_func(struct gallivm_state *gallivm, struct lp_type type,
+                 bool tiled, const char *name)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(context);
+   LLVMTypeRef args[] = {
+      LLVMPointerType(vec_type, 0),
+      LLVMPointerType(LLVMInt8TypeInContext(context), 0),
+      LLVMPointerType(vec_type, 0),
+      LLVMPointerType(vec_type, 0),
+      i32t,
+      i32t,
+   };
+   LLVMValueRef func = LLVMAddFunction(gallivm->module, name,
+      LLVMFunctionType(LLVMVoidTypeInContext(context),
+                       args, ARRAY_SIZE(args), 0));
+   LLVMValueRef out_arg = LLVMGetParam(func, 0);
+   LLVMValueRef base_arg = LLVMGetParam(func, 1);
+   LLVMValueRef x_arg = LLVMGetParam(func, 2);
+   LLVMValueRef y_arg = LLVMGetParam(func, 3);
+   LLVMValueRef num_arg = LLVMGetParam(func, 4);
+   LLVMValueRef stride_arg = LLVMGetParam(func, 5);
+
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   struct lp_build_context bld;
+   lp_build_context_init(&bld, gallivm, type);
+
+   const struct util_format_description *desc =
+      util_format_description(PIPE_FORMAT_R8G8B8A8_UNORM);
+   LLVMValueRef stride = lp_build_broadcast_scalar(&bld, stride_arg);
+   LLVMValueRef acc = lp_build_alloca(gallivm, vec_type, "acc");
+
+   struct lp_build_loop_state loop;
+   lp_build_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0));
+   {
+      LLVMValueRef x = LLVMBuildLoad2(builder, vec_type,
+         LLVMBuildGEP2(builder, vec_type, x_arg, &loop.counter, 1, ""), "x");
+      LLVMValueRef y = LLVMBuildLoad2(builder, vec_type,
+         LLVMBuildGEP2(builder, vec_type, y_arg, &loop.counter, 1, ""), "y");
+      LLVMValueRef offset, i, j;
+
+      if (tiled) {
+         lp_build_tiled_4x4_sample_offset(&bld, desc, x, y, NULL, stride,
+                                          NULL, &offset, &i, &j);
+      } else {
+         lp_build_sample_offset(&bld, desc, x, y, NULL, stride,
+                                NULL, &offset, &i, &j);
+      }
+
+      LLVMValueRef texel = lp_build_gather(gallivm, type.length, 32,
+                                           lp_type_int(32), true, base_arg,
+                                           offset, false);
+      LLVMValueRef sum = LLVMBuildLoad2(builder, vec_type, acc, "");
+      LLVMBuildStore(builder, LLVMBuildXor(builder, sum, texel, ""), acc);
+   }
+   lp_build_loop_end_cond(&loop, num_arg, NULL, LLVMIntUGE);
+
+   LLVMBuildStore(builder, LLVMBuildLoad2(builder, vec_type, acc, ""),
+                  out_arg);
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+/**
+ * Fill x/y with the texels read when drawing a TEX_SIZE / footprint
+ * square in 4x4 blocks, one texel per pixel.
+ */
+static unsigned
+init_coords(int32_t *x, int32_t *y, unsigned footprint)
+{
+   const unsigned size = TEX_SIZE / footprint;
+   unsigned n = 0;
+
+   for (unsigned by = 0; by < size; by += 4) {
+      for (unsigned bx = 0; bx < size; bx += 4) {
+         for (unsigned py = 0; py < 4; py++) {
+            for (unsigned px = 0; px < 4; px++) {
+               x[n] = (bx + px) * footprint;
+               y[n] = (by + py) * footprint;
+               n++;
+            }
+         }
+      }
+   }
+
+   return n;
+}
+
+
+static bool
+test_texlayout(unsigned verbose, FILE *fp)
+{
+   const unsigned stride = TEX_SIZE * TEX_BPP;
+   const unsigned num_texels = TEX_SIZE * TEX_SIZE;
+   struct lp_type type = lp_type_int_vec(32, lp_native_vector_width);
+   bool success = true;
+
+   uint32_t *linear = align_malloc(num_texels * TEX_BPP, 64);
+   uint8_t *tiled = align_malloc(num_texels * TEX_BPP, 64);
+   int32_t *x = align_malloc(num_texels * sizeof(int32_t), 64);
+   int32_t *y = align_malloc(num_texels * sizeof(int32_t), 64);
+   uint32_t *out = align_malloc(type.length * sizeof(uint32_t), 64);
+   uint32_t *expected = MALLOC(type.length * sizeof(uint32_t));
+
+   for (unsigned j = 0; j < TEX_SIZE; j++) {
+      for (unsigned i = 0; i < TEX_SIZE; i++) {
+         uint32_t texel = (j << 16) | i;
+         linear[j * TEX_SIZE + i] = texel;
+         memcpy(tiled + llvmpipe_tiled_offset(i, j, stride, TEX_BPP),
+                &texel, TEX_BPP);
+      }
+   }
+
+   lp_context_ref context;
+   lp_context_create(&context);
+   struct gallivm_state *gallivm = gallivm_create("test_module", &context, NULL);
+
+   LLVMValueRef funcs[2] = {
+      build_fetch_func(gallivm, type, false, "fetch_linear"),
+      build_fetch_func(gallivm, type, true, "fetch_tiled"),
+   };
+
+   gallivm_compile_module(gallivm);
+
+   fetch_func_t fetch[2] = {
+      (fetch_func_t)gallivm_jit_function(gallivm, funcs[0], "fetch_linear"),
+      (fetch_func_t)gallivm_jit_function(gallivm, funcs[1], "fetch_tiled"),
+   };
+
+   gallivm_free_ir(gallivm);
+
+   for (unsigned footprint = 1; footprint <= 8; footprint *= 2) {
+      unsigned n = init_coords(x, y, footprint);
+      assert(n % type.length == 0);
+
+      memset(expected, 0, type.length * sizeof(uint32_t));
+      for (unsigned i = 0; i < n; i++)
+         expected[i % type.length] ^= linear[y[i] * TEX_SIZE + x[i]];
+
+      for (unsigned t = 0; t < 2; t++) {
+         const void *base = t ? (const void *)tiled : (const void *)linear;
+         uint64_t best = UINT64_MAX;
+
+         for (unsigned run = 0; run < NUM_RUNS; run++) {
+            uint64_t start = rdtsc();
+            fetch[t](out, base, x, y, n / type.length, stride);
+            best = MIN2(best, rdtsc() - start);
+         }
+
+         bool match = !memcmp(out, expected, type.length * sizeof(uint32_t));
+         if (!match || verbose >= 1) {
+            printf("%s footprint %u: %s, %.2f cycles/texel\n",
+                   t ? "tiled_4x4" : "linear", footprint,
+                   match ? "pass" : "FAIL", (double)best / n);
+         }
+
+         if (fp)
+            write_tsv_row(fp, match, (double)best / n, t, footprint);
+
+         success = success && match;
+      }
+   }
+
+   gallivm_destroy(gallivm);
+   lp_context_destroy(&context);
+
+   align_free(linear);
+   align_free(tiled);
+   align_free(x);
+   align_free(y);
+   align_free(out);
+   FREE(expected);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_texlayout(verbose, fp);
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_all(verbose, fp);
+}
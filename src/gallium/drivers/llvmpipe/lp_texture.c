@@ -296,6 +296,57 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
 }
 
 
+/**
+ * Can the texture be stored in 4x4 blocks (LP_RESOURCE_FLAG_TILED_4X4)?
+ * Only private color textures which are never accessed directly by the
+ * CPU or through images qualify.
+ */
+static bool
+llvmpipe_can_tile_texture(const struct llvmpipe_screen *screen,
+                          const struct pipe_resource *templat,
+                          bool alloc_backing)
+{
+   if (!screen->tiled_textures || !alloc_backing)
+      return false;
+
+   if (templat->flags & (PIPE_RESOURCE_FLAG_SPARSE |
+                         PIPE_RESOURCE_FLAG_MAP_PERSISTENT |
+                         PIPE_RESOURCE_FLAG_MAP_COHERENT))
+      return false;
+
+   if (templat->bind & (PIPE_BIND_DISPLAY_TARGET |
+                        PIPE_BIND_SCANOUT |
+                        PIPE_BIND_SHARED |
+                        PIPE_BIND_LINEAR |
+                        PIPE_BIND_SHADER_IMAGE |
+                        PIPE_BIND_DEPTH_STENCIL))
+      return false;
+
+   if (templat->nr_samples > 1)
+      return false;
+
+   switch (templat->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+   case PIPE_TEXTURE_3D:
+      break;
+   default:
+      return false;
+   }
+
+   const struct util_format_description *desc =
+      util_format_description(templat->format);
+   if (!desc || desc->block.width != 1 || desc->block.height != 1 ||
+       util_format_is_depth_or_stencil(templat->format))
+      return false;
+
+   return desc->block.bits >= 8 && util_is_power_of_two_nonzero(desc->block.bits);
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_create_all(struct pipe_screen *_screen,
                              const struct pipe_resource *templat,
@@ -329,6 +380,9 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
             goto fail;
       } else {
          /* texture map */
+         if (llvmpipe_can_tile_texture(screen, templat, alloc_backing))
+            lpr->base.flags |= LP_RESOURCE_FLAG_TILED_4X4;
+
          if (!llvmpipe_texture_layout(screen, lpr, alloc_backing))
             goto fail;
 
@@ -922,6 +976,20 @@ fail:
 }
 
 
+/**
+ * Number of texels starting at x, at most \p width, which are contiguous
+ * in memory for the staging copies below.
+ */
+static unsigned
+llvmpipe_texel_run(const struct pipe_resource *resource,
+                   unsigned x, unsigned width)
+{
+   if (llvmpipe_resource_is_tiled(resource))
+      return MIN2(4 - (x & 3), width);
+   return 1;
+}
+
+
 void *
 llvmpipe_transfer_map_ms(struct pipe_context *pipe,
                          struct pipe_resource *resource,
@@ -1014,11 +1082,24 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
 
    format = lpr->base.format;
 
-   if (llvmpipe_resource_is_texture(resource) && (resource->flags & PIPE_RESOURCE_FLAG_SPARSE)) {
+   /* Sparse and tiled textures are mapped through a linear staging copy. */
+   if (llvmpipe_resource_is_texture(resource) &&
+       (resource->flags & (PIPE_RESOURCE_FLAG_SPARSE |
+                           LP_RESOURCE_FLAG_TILED_4X4))) {
+      if ((usage & PIPE_MAP_DIRECTLY) && llvmpipe_resource_is_tiled(resource)) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
       map = llvmpipe_resource_map(resource, 0, 0, tex_usage);
       if (!map)
          return NULL;
 
+      if (usage & PIPE_MAP_WRITE)
+         screen->timestamp++;
+
       lpt->block_box = (struct pipe_box) {
          .x = box->x / util_format_get_blockwidth(format),
          .width = DIV_ROUND_UP(box->x + box->width, util_format_get_blockwidth(format)),
@@ -1042,14 +1123,18 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       if (usage & PIPE_MAP_READ) {
          for (uint32_t z = 0; z < lpt->block_box.depth; z++) {
             for (uint32_t y = 0; y < lpt->block_box.height; y++) {
-               for (uint32_t x = 0; x < lpt->block_box.width; x++) {
+               for (uint32_t x = 0; x < lpt->block_box.width;) {
+                  unsigned count = llvmpipe_texel_run(resource,
+                                                      lpt->block_box.x + x,
+                                                      lpt->block_box.width - x);
                   memcpy(staging_map,
                          map + llvmpipe_get_texel_offset(resource, level,
                                                          lpt->block_box.x + x,
                                                          lpt->block_box.y + y,
                                                          lpt->block_box.z + z),
-                         block_stride);
-                  staging_map += block_stride;
+                         block_stride * count);
+                  staging_map += block_stride * count;
+                  x += count;
                }
             }
          }
@@ -1092,6 +1177,12 @@ llvmpipe_get_texel_offset(struct pipe_resource *resource,
       z = 0;
    }
 
+   if (llvmpipe_resource_is_tiled(resource)) {
+      return lpr->mip_offsets[level] + lpr->img_stride[level] * (layer + z) +
+             llvmpipe_tiled_offset(x, y, lpr->row_stride[level],
+                                   util_format_get_blocksize(resource->format));
+   }
+
    uint32_t dimensions = 1;
    switch (resource->target) {
    case PIPE_TEXTURE_2D:
@@ -1157,7 +1248,9 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 
    assert(resource);
 
-   if (llvmpipe_resource_is_texture(resource) && (resource->flags & PIPE_RESOURCE_FLAG_SPARSE) &&
+   if (llvmpipe_resource_is_texture(resource) &&
+       (resource->flags & (PIPE_RESOURCE_FLAG_SPARSE |
+                           LP_RESOURCE_FLAG_TILED_4X4)) &&
        (transfer->usage & PIPE_MAP_WRITE)) {
       uint32_t block_stride = util_format_get_blocksize(resource->format);
 
@@ -1166,13 +1259,17 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 
       for (uint32_t z = 0; z < lpt->block_box.depth; z++) {
          for (uint32_t y = 0; y < lpt->block_box.height; y++) {
-            for (uint32_t x = 0; x < lpt->block_box.width; x++) {
+            for (uint32_t x = 0; x < lpt->block_box.width;) {
+               unsigned count = llvmpipe_texel_run(resource,
+                                                   lpt->block_box.x + x,
+                                                   lpt->block_box.width - x);
                memcpy(dst + llvmpipe_get_texel_offset(resource, transfer->level,
                                                       lpt->block_box.x + x,
                                                       lpt->block_box.y + y,
                                                       lpt->block_box.z + z),
-                      src, block_stride);
-               src += block_stride;
+                      src, block_stride * count);
+               src += block_stride * count;
+               x += count;
             }
          }
       }
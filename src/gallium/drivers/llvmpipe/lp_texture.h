@@ -32,12 +32,21 @@
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
 #include "lp_limits.h"
+#include "gallivm/lp_bld_sample.h"
 #include "util/bitset.h"
 #if MESA_DEBUG
 #include "util/list.h"
 #endif
 
 
+/**
+ * Resource flag marking textures stored in 4x4 pixel blocks instead of
+ * rows.  Blocks are laid out row-major, so the block containing (x, y)
+ * starts at (y & ~3) * row_stride + (x & ~3) * 4 * bpp.
+ */
+#define LP_RESOURCE_FLAG_TILED_4X4 PIPE_RESOURCE_FLAG_DRV_PRIV
+
+
 enum lp_texture_usage
 {
    LP_TEX_USAGE_READ = 100,
@@ -227,6 +236,41 @@ llvmpipe_resource_is_1d(const struct pipe_resource *resource)
 }
 
 
+/**
+ * Is the texture stored in 4x4 pixel blocks (LP_RESOURCE_FLAG_TILED_4X4)?
+ */
+static inline bool
+llvmpipe_resource_is_tiled(const struct pipe_resource *resource)
+{
+   return !!(resource->flags & LP_RESOURCE_FLAG_TILED_4X4);
+}
+
+
+/**
+ * lp_sampler_static_texture_state() plus the llvmpipe texture layout.
+ */
+static inline void
+llvmpipe_sampler_static_texture_state(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+   if (view && view->texture)
+      state->tiled_4x4 = llvmpipe_resource_is_tiled(view->texture);
+}
+
+
+/**
+ * Byte offset of pixel (x, y) within one image of a tiled texture.
+ */
+static inline unsigned
+llvmpipe_tiled_offset(unsigned x, unsigned y, unsigned row_stride,
+                      unsigned bpp)
+{
+   return (y & ~3u) * row_stride +
+          ((x & ~3u) * 4 + (y & 3u) * 4 + (x & 3u)) * bpp;
+}
+
+
 static inline unsigned
 llvmpipe_layer_stride(struct pipe_resource *resource,
                       unsigned level)
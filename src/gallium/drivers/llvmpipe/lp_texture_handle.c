@@ -60,7 +60,7 @@ llvmpipe_create_texture_handle(struct pipe_context *pctx, struct pipe_sampler_vi
    if (view) {
       struct lp_texture_handle_state state;
       memset(&state, 0, sizeof(state));
-      lp_sampler_static_texture_state(&state.static_state, view);
+      llvmpipe_sampler_static_texture_state(&state.static_state, view);
       if (view->texture)
          lp_jit_texture_from_pipe(&state.dynamic_state, view);
       else
@@ -219,6 +219,41 @@ lp_function_cache_init(struct lp_function_cache *cache, struct hash_table *initi
 {
    p_atomic_set(&cache->latest_cache.value, (uint64_t)(uintptr_t)initial_cache);
    cache->trash_caches = UTIL_DYNARRAY_INIT;
+   cache->trash_keys = UTIL_DYNARRAY_INIT;
+}
+
+/**
+ * Replace the latest cache by an empty one, and return the old one.  Its
+ * keys become trash along with it.
+ */
+static struct hash_table *
+retire_function_cache_locked(struct lp_function_cache *cache)
+{
+   struct hash_table *old_cache = acquire_latest_function_cache(cache);
+
+   if (!_mesa_hash_table_num_entries(old_cache))
+      return old_cache;
+
+   replace_function_cache_locked(cache,
+      _mesa_hash_table_create(NULL, old_cache->key_hash_function,
+                              old_cache->key_equals_function));
+
+   hash_table_foreach(old_cache, entry)
+      util_dynarray_append(&cache->trash_keys, (void *)entry->key);
+
+   return old_cache;
+}
+
+static void
+free_function_cache_trash(struct lp_function_cache *cache)
+{
+   util_dynarray_foreach (&cache->trash_caches, struct hash_table *, trash)
+      _mesa_hash_table_destroy(*trash, NULL);
+   util_dynarray_clear(&cache->trash_caches);
+
+   util_dynarray_foreach (&cache->trash_keys, void *, key)
+      free(*key);
+   util_dynarray_clear(&cache->trash_keys);
 }
 
 void
@@ -258,9 +293,9 @@ llvmpipe_sampler_matrix_destroy(struct llvmpipe_context *ctx)
 
    for (uint32_t i = 0; i < ARRAY_SIZE(matrix->caches); i++) {
       _mesa_hash_table_destroy(acquire_latest_function_cache(&matrix->caches[i]), NULL);
-      util_dynarray_foreach (&matrix->caches[i].trash_caches, struct hash_table *, trash)
-         _mesa_hash_table_destroy(*trash, NULL);
+      free_function_cache_trash(&matrix->caches[i]);
       util_dynarray_fini(&matrix->caches[i].trash_caches);
+      util_dynarray_fini(&matrix->caches[i].trash_keys);
    }
 
    free(matrix->samplers);
@@ -1467,6 +1502,27 @@ llvmpipe_register_shader(struct pipe_context *ctx, const struct pipe_shader_stat
       nir_shader_instructions_pass(shader->ir.nir, register_instr, nir_metadata_all, ctx);
 }
 
+/**
+ * Whether shaders launched by contexts other than \p ctx may be running.
+ * Those can use texture handles created by \p ctx, and thus search its
+ * function caches.
+ */
+static bool
+other_contexts_busy(struct llvmpipe_context *ctx)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(ctx->pipe.screen);
+   bool busy = false;
+
+   mtx_lock(&screen->ctx_mutex);
+   list_for_each_entry(struct llvmpipe_context, other, &screen->ctx_list, list) {
+      if (other != ctx && p_atomic_read(&other->shaders_busy))
+         busy = true;
+   }
+   mtx_unlock(&screen->ctx_mutex);
+
+   return busy;
+}
+
 void
 llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_fence_handle **fence)
 {
@@ -1475,57 +1531,70 @@ llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_
 
    struct lp_sampler_matrix *matrix = &ctx->sampler_matrix;
 
-   /* If the cache is empty, there is nothing to do. */
    bool has_cache_entry = false;
+   bool has_trash = false;
    for (uint32_t i = 0; i < ARRAY_SIZE(matrix->caches); i++) {
-      if (_mesa_hash_table_num_entries(acquire_latest_function_cache(&matrix->caches[i]))) {
-         has_cache_entry = true;
-         break;
-      }
+      has_cache_entry |= _mesa_hash_table_num_entries(acquire_latest_function_cache(&matrix->caches[i])) > 0;
+      has_trash |= util_dynarray_num_elements(&matrix->caches[i].trash_caches, struct hash_table *) > 0;
    }
-   if (!has_cache_entry)
+
+   /* If the cache is empty, there is nothing to do, except for freeing
+    * trash left behind while other contexts were busy.  Don't wait for
+    * that.
+    */
+   if (has_cache_entry) {
+      ctx->pipe.screen->fence_finish(ctx->pipe.screen, NULL, *fence, OS_TIMEOUT_INFINITE);
+   } else if (!has_trash ||
+              !ctx->pipe.screen->fence_finish(ctx->pipe.screen, NULL, *fence, 0)) {
       return;
+   }
 
-   ctx->pipe.screen->fence_finish(ctx->pipe.screen, NULL, *fence, OS_TIMEOUT_INFINITE);
+   p_atomic_set(&ctx->shaders_busy, 0);
+
+   /* Shaders of this context are finished, but those of other contexts may
+    * still be calling the compile functions, which insert into the caches
+    * under the lock and search them without it.  Move the cache entries
+    * into the tables and start with empty caches, but keep the old ones
+    * around until no other context is busy.
+    */
+   simple_mtx_lock(&matrix->lock);
 
-   /* All work is finished, it's safe to move cache entries into the table. */
-   hash_table_foreach_remove(acquire_latest_function_cache(&matrix->caches[LP_FUNCTION_CACHE_SAMPLE]), entry) {
+   hash_table_foreach(retire_function_cache_locked(&matrix->caches[LP_FUNCTION_CACHE_SAMPLE]), entry) {
       struct sample_function_cache_key *key = (void *)entry->key;
 
       if (key->texture_functions->sample_functions[key->sampler_index] == matrix->jit_sample_functions) {
-         key->texture_functions->sample_functions[key->sampler_index] = malloc(LP_SAMPLE_KEY_COUNT * sizeof(void *));
-         memcpy(key->texture_functions->sample_functions[key->sampler_index], matrix->jit_sample_functions,
-                LP_SAMPLE_KEY_COUNT * sizeof(void *));
+         void **functions = malloc(LP_SAMPLE_KEY_COUNT * sizeof(void *));
+         memcpy(functions, matrix->jit_sample_functions, LP_SAMPLE_KEY_COUNT * sizeof(void *));
+         key->texture_functions->sample_functions[key->sampler_index] = functions;
       }
 
       key->texture_functions->sample_functions[key->sampler_index][key->sample_key] = entry->data;
-      free(key);
    }
 
-   hash_table_foreach_remove(acquire_latest_function_cache(&matrix->caches[LP_FUNCTION_CACHE_FETCH]), entry) {
+   hash_table_foreach(retire_function_cache_locked(&matrix->caches[LP_FUNCTION_CACHE_FETCH]), entry) {
       struct sample_function_cache_key *key = (void *)entry->key;
 
       if (key->texture_functions->fetch_functions == matrix->jit_fetch_functions) {
-         key->texture_functions->fetch_functions = malloc(LP_SAMPLE_KEY_COUNT * sizeof(void *));
-         memcpy(key->texture_functions->fetch_functions, matrix->jit_fetch_functions, LP_SAMPLE_KEY_COUNT * sizeof(void *));
+         void **functions = malloc(LP_SAMPLE_KEY_COUNT * sizeof(void *));
+         memcpy(functions, matrix->jit_fetch_functions, LP_SAMPLE_KEY_COUNT * sizeof(void *));
+         key->texture_functions->fetch_functions = functions;
       }
 
       key->texture_functions->fetch_functions[key->sample_key] = entry->data;
-      free(key);
    }
 
-   hash_table_foreach_remove(acquire_latest_function_cache(&matrix->caches[LP_FUNCTION_CACHE_SIZE]), entry) {
+   hash_table_foreach(retire_function_cache_locked(&matrix->caches[LP_FUNCTION_CACHE_SIZE]), entry) {
       struct size_function_cache_key *key = (void *)entry->key;
       if (key->samples)
          key->texture_functions->samples_function = entry->data;
       else
          key->texture_functions->size_function = entry->data;
-      free(key);
    }
 
-   for (uint32_t i = 0; i < ARRAY_SIZE(matrix->caches); i++) {
-      util_dynarray_foreach (&matrix->caches[i].trash_caches, struct hash_table *, trash)
-         _mesa_hash_table_destroy(*trash, NULL);
-      util_dynarray_clear(&matrix->caches[i].trash_caches);
+   if (!other_contexts_busy(ctx)) {
+      for (uint32_t i = 0; i < ARRAY_SIZE(matrix->caches); i++)
+         free_function_cache_trash(&matrix->caches[i]);
    }
+
+   simple_mtx_unlock(&matrix->lock);
 }
@@ -35,6 +35,8 @@
 struct lp_function_cache {
    p_atomic_uint64_t latest_cache;
    struct util_dynarray trash_caches;
+   /* Keys of the trash caches, which share them with each other */
+   struct util_dynarray trash_keys;
 };
 
 enum lp_function_cache_type {
@@ -271,7 +271,8 @@ prepare_shader_sampling(
                                  width0, tex->height0, num_layers,
                                  first_level, last_level, 0, 0,
                                  addr,
-                                 row_stride, img_stride, mip_offsets);
+                                 row_stride, img_stride, mip_offsets,
+                                 false);
       }
    }
 }
@@ -5,9 +5,12 @@
 
 #include "lvp_acceleration_structure.h"
 #include "lvp_entrypoints.h"
+#include "vk_cmd_enqueue_entrypoints.h"
 
 #include "radix_sort/radix_sort_u64.h"
 #include "bvh/vk_bvh.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 
 struct radix_sort_vk_target_config lvp_radix_sort_config = {
    .keyval_dwords = 2,
@@ -54,7 +57,7 @@ lvp_init_radix_sort(struct lvp_device *device)
    simple_mtx_unlock(&device->radix_sort_lock);
 }
 
-static void
+void
 lvp_get_leaf_node_size(VkGeometryTypeKHR geometry_type, uint32_t *ir_leaf_node_size,
                        uint32_t *output_leaf_node_size)
 {
@@ -76,7 +79,7 @@ lvp_get_leaf_node_size(VkGeometryTypeKHR geometry_type, uint32_t *ir_leaf_node_s
    }
 }
 
-static VkDeviceSize
+VkDeviceSize
 lvp_get_as_size_internal(VkGeometryTypeKHR geometry_type, uint32_t leaf_node_count)
 {
    uint32_t internal_node_count = MAX2(leaf_node_count, 2) - 1;
@@ -195,7 +198,7 @@ ir_id_to_offset(uint32_t id)
    return id & (~3u);
 }
 
-static uint32_t
+uint32_t
 lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR flags)
 {
    uint32_t ret = sbt_offset;
@@ -569,8 +572,30 @@ lvp_WriteAccelerationStructuresPropertiesKHR(
    const VkAccelerationStructureKHR *pAccelerationStructures, VkQueryType queryType,
    size_t dataSize, void *pData, size_t stride)
 {
-   UNREACHABLE("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   for (uint32_t i = 0; i < accelerationStructureCount; i++) {
+      VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, pAccelerationStructures[i]);
+
+      const struct lvp_bvh_header *header =
+         (const void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+      uint64_t *dst = (void *)((uint8_t *)pData + i * stride);
+
+      switch (queryType) {
+      case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR:
+      case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SIZE_KHR:
+         *dst = header->compacted_size;
+         break;
+      case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR:
+         *dst = header->serialization_size;
+         break;
+      case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_BOTTOM_LEVEL_POINTERS_KHR:
+         *dst = header->instance_count;
+         break;
+      default:
+         UNREACHABLE("Unsupported query type");
+      }
+   }
+
+   return VK_SUCCESS;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL
@@ -579,8 +604,12 @@ lvp_BuildAccelerationStructuresKHR(
    const VkAccelerationStructureBuildGeometryInfoKHR *pInfos,
    const VkAccelerationStructureBuildRangeInfoKHR *const *ppBuildRangeInfos)
 {
-   UNREACHABLE("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   VK_FROM_HANDLE(lvp_device, device, _device);
+
+   for (uint32_t i = 0; i < infoCount; i++)
+      lvp_build_as_cpu(device, &pInfos[i], ppBuildRangeInfos[i]);
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
 }
 
 VKAPI_ATTR void VKAPI_CALL
@@ -595,28 +624,85 @@ lvp_GetDeviceAccelerationStructureCompatibilityKHR(
                             : VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
 }
 
+void
+lvp_copy_as(struct vk_acceleration_structure *dst_accel_struct,
+            const struct vk_acceleration_structure *src_accel_struct)
+{
+   struct lvp_bvh_header *src = (void *)(uintptr_t)vk_acceleration_structure_get_va(src_accel_struct);
+   struct lvp_bvh_header *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(dst_accel_struct);
+   memcpy(dst, src, src->compacted_size);
+}
+
+void
+lvp_copy_memory_to_as(struct vk_acceleration_structure *accel_struct, const void *data)
+{
+   struct lvp_bvh_header *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+   const struct lvp_accel_struct_serialization_header *src = data;
+
+   memcpy(dst, &src->instances[src->instance_count], src->compacted_size);
+
+   for (uint32_t i = 0; i < src->instance_count; i++) {
+      uint8_t *leaf_nodes = (uint8_t *)dst;
+      leaf_nodes += dst->leaf_nodes_offset;
+      struct lvp_bvh_instance_node *node = (struct lvp_bvh_instance_node *)leaf_nodes;
+      node[i].bvh_ptr = src->instances[i];
+   }
+}
+
+void
+lvp_copy_as_to_memory(void *data, const struct vk_acceleration_structure *accel_struct)
+{
+   struct lvp_bvh_header *src = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+   struct lvp_accel_struct_serialization_header *dst = data;
+
+   lvp_device_get_cache_uuid(dst->driver_uuid);
+   lvp_device_get_cache_uuid(dst->accel_struct_compat);
+   dst->serialization_size = src->serialization_size;
+   dst->compacted_size = src->compacted_size;
+   dst->instance_count = src->instance_count;
+
+   for (uint32_t i = 0; i < src->instance_count; i++) {
+      uint8_t *leaf_nodes = (uint8_t *)src;
+      leaf_nodes += src->leaf_nodes_offset;
+      struct lvp_bvh_instance_node *node = (struct lvp_bvh_instance_node *)leaf_nodes;
+      dst->instances[i] = node[i].bvh_ptr;
+   }
+
+   memcpy(&dst->instances[dst->instance_count], src, src->compacted_size);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL
 lvp_CopyAccelerationStructureKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
                                  const VkCopyAccelerationStructureInfoKHR *pInfo)
 {
-   UNREACHABLE("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   VK_FROM_HANDLE(vk_acceleration_structure, src, pInfo->src);
+   VK_FROM_HANDLE(vk_acceleration_structure, dst, pInfo->dst);
+
+   lvp_copy_as(dst, src);
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL
 lvp_CopyMemoryToAccelerationStructureKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
                                          const VkCopyMemoryToAccelerationStructureInfoKHR *pInfo)
 {
-   UNREACHABLE("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   VK_FROM_HANDLE(vk_acceleration_structure, dst, pInfo->dst);
+
+   lvp_copy_memory_to_as(dst, pInfo->src.hostAddress);
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL
 lvp_CopyAccelerationStructureToMemoryKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
                                          const VkCopyAccelerationStructureToMemoryInfoKHR *pInfo)
 {
-   UNREACHABLE("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   VK_FROM_HANDLE(vk_acceleration_structure, src, pInfo->src);
+
+   lvp_copy_as_to_memory(pInfo->dst.hostAddress, src);
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
 }
 
 static VkResult
@@ -644,6 +730,17 @@ lvp_device_init_accel_struct_state(struct lvp_device *device)
 
    simple_mtx_init(&device->radix_sort_lock, mtx_plain);
 
+   /* LVP_BVH_BUILD_GPU selects the generic compute shader builder, e.g. to
+    * compare build times.  Threads are only started once used.
+    */
+   device->gpu_bvh_build = debug_get_bool_option("LVP_BVH_BUILD_GPU", false);
+   if (!device->gpu_bvh_build) {
+      unsigned num_threads = MIN2(util_get_cpu_caps()->nr_cpus, LVP_BVH_MAX_THREADS);
+      if (num_threads > 1)
+         util_queue_init(&device->bvh_queue, "lvp_bvh", 2 * num_threads, num_threads,
+                         UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+   }
+
    return VK_SUCCESS;
 }
 
@@ -652,6 +749,9 @@ lvp_device_finish_accel_struct_state(struct lvp_device *device)
 {
    simple_mtx_destroy(&device->radix_sort_lock);
 
+   if (util_queue_is_initialized(&device->bvh_queue))
+      util_queue_destroy(&device->bvh_queue);
+
    if (device->radix_sort)
       radix_sort_vk_destroy(device->radix_sort, lvp_device_to_handle(device), &device->vk.alloc);
 }
@@ -693,6 +793,14 @@ lvp_CmdBuildAccelerationStructuresKHR(VkCommandBuffer commandBuffer, uint32_t in
 {
    VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
    struct lvp_device *device = lvp_cmd_buffer_device(cmd_buffer);
+
+   /* Replayed by lvp_build_as_cpu() */
+   if (!device->gpu_bvh_build) {
+      vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(commandBuffer, infoCount, pInfos,
+                                                       ppBuildRangeInfos);
+      return;
+   }
+
    lvp_init_radix_sort(device);
 
    lvp_enqueue_save_state(commandBuffer);
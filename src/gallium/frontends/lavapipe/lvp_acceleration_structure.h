@@ -98,4 +98,29 @@ lvp_device_init_accel_struct_state(struct lvp_device *device);
 void
 lvp_device_finish_accel_struct_state(struct lvp_device *device);
 
+void
+lvp_get_leaf_node_size(VkGeometryTypeKHR geometry_type, uint32_t *ir_leaf_node_size,
+                       uint32_t *output_leaf_node_size);
+
+VkDeviceSize
+lvp_get_as_size_internal(VkGeometryTypeKHR geometry_type, uint32_t leaf_node_count);
+
+uint32_t
+lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR flags);
+
+void
+lvp_build_as_cpu(struct lvp_device *device,
+                 const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                 const VkAccelerationStructureBuildRangeInfoKHR *ranges);
+
+void
+lvp_copy_as(struct vk_acceleration_structure *dst_accel_struct,
+            const struct vk_acceleration_structure *src_accel_struct);
+
+void
+lvp_copy_memory_to_as(struct vk_acceleration_structure *accel_struct, const void *data);
+
+void
+lvp_copy_as_to_memory(void *data, const struct vk_acceleration_structure *accel_struct);
+
 #endif
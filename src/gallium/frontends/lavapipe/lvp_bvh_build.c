@@ -0,0 +1,770 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Acceleration structure builder running directly on the CPU.
+ *
+ * The generic builder in vulkan/runtime/bvh runs as compute shaders, which
+ * lavapipe emulates with llvmpipe.  This one builds the same lvp_bvh_*
+ * layout from C, for host builds and for vkCmdBuildAccelerationStructuresKHR
+ * replay alike:
+ *
+ *  1. The leaf nodes are written straight into the acceleration structure,
+ *     one slot per primitive, by the worker threads.
+ *  2. The top of the tree is built by the calling thread with a binned SAH,
+ *     until the remaining subtrees are small enough to be distributed.
+ *  3. The subtrees are built in parallel the same way.
+ *
+ * A node covering n leaves always owns the n - 1 box nodes following it,
+ * so threads never need to synchronize to allocate nodes.  Splits which
+ * would exceed LVP_MAX_BLAS_DEPTH / LVP_MAX_TLAS_DEPTH fall back to the
+ * object median, which keeps the tree within the traversal stack without
+ * the flattening pass the IR encoder needs.
+ */
+
+#include "lvp_acceleration_structure.h"
+
+#include "util/format/u_format.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "util/perf/cpu_trace.h"
+#include "vk_format.h"
+
+#define LVP_BVH_SAH_BINS 16
+
+/* Primitives per leaf job */
+#define LVP_BVH_LEAF_CHUNK 16384
+
+/* Subtrees smaller than this are never split across threads */
+#define LVP_BVH_MIN_TASK_LEAVES 1024
+
+struct lvp_bvh_ref {
+   vk_aabb bounds;
+   uint32_t node;  /**< id of the leaf node */
+};
+
+struct lvp_bvh_task {
+   uint32_t begin, end;
+   uint32_t node_index;
+   uint32_t depth;
+};
+
+struct lvp_bvh_leaf_chunk {
+   struct vk_bvh_geometry_data geom;
+   uint32_t first, count;
+};
+
+struct lvp_bvh_builder {
+   struct lvp_device *device;
+   VkAccelerationStructureTypeKHR type;
+   VkGeometryTypeKHR geometry_type;
+
+   uint8_t *output;
+   uint32_t leaf_nodes_offset;
+   uint32_t leaf_node_size;
+   uint32_t max_depth;
+
+   /* One per primitive, compacted to the active ones before building */
+   struct lvp_bvh_ref *refs;
+   uint32_t num_refs;
+
+   struct util_dynarray leaf_chunks;
+   struct util_dynarray tasks;
+   uint32_t max_task_leaves;
+};
+
+typedef void (*lvp_bvh_work_func)(struct lvp_bvh_builder *b, uint32_t index);
+
+struct lvp_bvh_work {
+   struct lvp_bvh_builder *builder;
+   lvp_bvh_work_func func;
+   uint32_t count;
+   uint32_t next;
+};
+
+struct lvp_bvh_job {
+   struct lvp_bvh_work *work;
+   struct util_queue_fence fence;
+};
+
+
+static void
+lvp_bvh_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lvp_bvh_job *job = data;
+   struct lvp_bvh_work *work = job->work;
+   uint32_t i;
+
+   while ((i = p_atomic_inc_return(&work->next) - 1) < work->count)
+      work->func(work->builder, i);
+}
+
+/**
+ * Run func(b, 0..count-1) on the device's BVH worker threads and the
+ * calling thread.
+ */
+static void
+lvp_bvh_parallel_for(struct lvp_bvh_builder *b, uint32_t count,
+                     lvp_bvh_work_func func)
+{
+   struct util_queue *queue = &b->device->bvh_queue;
+   struct lvp_bvh_work work = {
+      .builder = b,
+      .func = func,
+      .count = count,
+   };
+   struct lvp_bvh_job jobs[LVP_BVH_MAX_THREADS];
+   uint32_t num_jobs = 0;
+
+   if (count > 1 && util_queue_is_initialized(queue))
+      num_jobs = MIN3(count, queue->max_threads, ARRAY_SIZE(jobs)) - 1;
+
+   for (uint32_t i = 0; i < num_jobs; i++) {
+      jobs[i].work = &work;
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(queue, &jobs[i], &jobs[i].fence,
+                         lvp_bvh_job_execute, NULL, 0);
+   }
+
+   struct lvp_bvh_job self = { .work = &work };
+   lvp_bvh_job_execute(&self, NULL, 0);
+
+   for (uint32_t i = 0; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
+
+static inline void
+lvp_bvh_aabb_init(vk_aabb *aabb)
+{
+   aabb->min.x = aabb->min.y = aabb->min.z = INFINITY;
+   aabb->max.x = aabb->max.y = aabb->max.z = -INFINITY;
+}
+
+static inline void
+lvp_bvh_aabb_merge(vk_aabb *dst, const vk_aabb *src)
+{
+   dst->min.x = MIN2(dst->min.x, src->min.x);
+   dst->min.y = MIN2(dst->min.y, src->min.y);
+   dst->min.z = MIN2(dst->min.z, src->min.z);
+   dst->max.x = MAX2(dst->max.x, src->max.x);
+   dst->max.y = MAX2(dst->max.y, src->max.y);
+   dst->max.z = MAX2(dst->max.z, src->max.z);
+}
+
+static inline void
+lvp_bvh_aabb_add_point(vk_aabb *dst, const float p[3])
+{
+   dst->min.x = MIN2(dst->min.x, p[0]);
+   dst->min.y = MIN2(dst->min.y, p[1]);
+   dst->min.z = MIN2(dst->min.z, p[2]);
+   dst->max.x = MAX2(dst->max.x, p[0]);
+   dst->max.y = MAX2(dst->max.y, p[1]);
+   dst->max.z = MAX2(dst->max.z, p[2]);
+}
+
+static inline float
+lvp_bvh_aabb_half_area(const vk_aabb *aabb)
+{
+   float x = aabb->max.x - aabb->min.x;
+   float y = aabb->max.y - aabb->min.y;
+   float z = aabb->max.z - aabb->min.z;
+   return x * y + y * z + z * x;
+}
+
+static inline bool
+lvp_bvh_aabb_is_nan(const vk_aabb *aabb)
+{
+   return isnan(aabb->min.x) || isnan(aabb->min.y) || isnan(aabb->min.z) ||
+          isnan(aabb->max.x) || isnan(aabb->max.y) || isnan(aabb->max.z);
+}
+
+/* Twice the centroid, which orders the same and saves a multiply. */
+static inline float
+lvp_bvh_centroid(const struct lvp_bvh_ref *ref, unsigned axis)
+{
+   const float *min = &ref->bounds.min.x;
+   const float *max = &ref->bounds.max.x;
+   return min[axis] + max[axis];
+}
+
+static inline struct lvp_bvh_box_node *
+lvp_bvh_box_node(struct lvp_bvh_builder *b, uint32_t index)
+{
+   return (void *)(b->output + LVP_BVH_ROOT_NODE_OFFSET +
+                   index * sizeof(struct lvp_bvh_box_node));
+}
+
+static inline uint32_t
+lvp_bvh_box_node_id(uint32_t index)
+{
+   return (LVP_BVH_ROOT_NODE_OFFSET + index * sizeof(struct lvp_bvh_box_node)) |
+          lvp_bvh_node_internal;
+}
+
+static void
+lvp_bvh_set_child(struct lvp_bvh_box_node *node, unsigned i, uint32_t child,
+                  const vk_aabb *bounds)
+{
+   node->children[i] = child;
+
+   if (child == LVP_BVH_INVALID_NODE) {
+      node->bounds[i] = (vk_aabb){
+         .min = { NAN, NAN, NAN },
+         .max = { NAN, NAN, NAN },
+      };
+      return;
+   }
+
+   /* Increase the bounding box size a bit for watertightness, like
+    * lvp_encode_as() does.
+    */
+   vk_aabb b = *bounds;
+   b.min.x -= MAX2(fabsf(b.min.x), 1.0) * FLT_EPSILON;
+   b.min.y -= MAX2(fabsf(b.min.y), 1.0) * FLT_EPSILON;
+   b.min.z -= MAX2(fabsf(b.min.z), 1.0) * FLT_EPSILON;
+   b.max.x += MAX2(fabsf(b.max.x), 1.0) * FLT_EPSILON;
+   b.max.y += MAX2(fabsf(b.max.y), 1.0) * FLT_EPSILON;
+   b.max.z += MAX2(fabsf(b.max.z), 1.0) * FLT_EPSILON;
+   node->bounds[i] = b;
+}
+
+
+/*
+ * Leaves
+ */
+
+static uint32_t
+lvp_bvh_load_index(const struct vk_bvh_geometry_data *geom, uint32_t i)
+{
+   const void *indices = (const void *)(uintptr_t)geom->indices;
+
+   switch (geom->index_format) {
+   case VK_INDEX_TYPE_UINT16:
+      return ((const uint16_t *)indices)[i];
+   case VK_INDEX_TYPE_UINT32:
+      return ((const uint32_t *)indices)[i];
+   case VK_INDEX_TYPE_UINT8_KHR:
+      return ((const uint8_t *)indices)[i];
+   default:
+      return i;
+   }
+}
+
+static void
+lvp_bvh_load_vertex(const struct vk_bvh_geometry_data *geom,
+                    enum pipe_format format, uint32_t index, float v[3])
+{
+   const uint8_t *src =
+      (const uint8_t *)(uintptr_t)geom->data + (uint64_t)index * geom->stride;
+
+   if (geom->vertex_format == VK_FORMAT_R32G32B32_SFLOAT ||
+       geom->vertex_format == VK_FORMAT_R32G32B32A32_SFLOAT) {
+      memcpy(v, src, 3 * sizeof(float));
+   } else {
+      float rgba[4];
+      util_format_unpack_rgba(format, rgba, src, 1);
+      v[0] = rgba[0];
+      v[1] = rgba[1];
+      v[2] = rgba[2];
+   }
+}
+
+static bool
+lvp_bvh_build_triangle(const struct vk_bvh_geometry_data *geom,
+                       enum pipe_format format, uint32_t id,
+                       struct lvp_bvh_triangle_node *node, vk_aabb *bounds)
+{
+   const float *transform = (const float *)(uintptr_t)geom->transform;
+   float v[3][3];
+
+   for (unsigned i = 0; i < 3; i++) {
+      lvp_bvh_load_vertex(geom, format, lvp_bvh_load_index(geom, id * 3 + i), v[i]);
+
+      if (transform) {
+         float p[3];
+         for (unsigned row = 0; row < 3; row++) {
+            p[row] = transform[row * 4 + 0] * v[i][0] +
+                     transform[row * 4 + 1] * v[i][1] +
+                     transform[row * 4 + 2] * v[i][2] +
+                     transform[row * 4 + 3];
+         }
+         memcpy(v[i], p, sizeof(p));
+      }
+   }
+
+   lvp_bvh_aabb_init(bounds);
+   for (unsigned i = 0; i < 3; i++) {
+      /* A triangle with any NaN coordinate is inactive. */
+      if (isnan(v[i][0]) || isnan(v[i][1]) || isnan(v[i][2]))
+         return false;
+      lvp_bvh_aabb_add_point(bounds, v[i]);
+   }
+
+   memcpy(node->coords, v, sizeof(node->coords));
+   node->primitive_id = id;
+   node->geometry_id_and_flags = geom->geometry_id;
+   return true;
+}
+
+static bool
+lvp_bvh_build_aabb(const struct vk_bvh_geometry_data *geom, uint32_t id,
+                   struct lvp_bvh_aabb_node *node, vk_aabb *bounds)
+{
+   const float *src =
+      (const float *)((const uint8_t *)(uintptr_t)geom->data + (uint64_t)id * geom->stride);
+
+   memcpy(bounds, src, sizeof(*bounds));
+   if (lvp_bvh_aabb_is_nan(bounds))
+      return false;
+
+   node->bounds = *bounds;
+   node->primitive_id = id;
+   node->geometry_id_and_flags = geom->geometry_id;
+   return true;
+}
+
+static bool
+lvp_bvh_build_instance(const struct vk_bvh_geometry_data *geom, uint32_t id,
+                       struct lvp_bvh_instance_node *node, vk_aabb *bounds)
+{
+   const uint8_t *src = (const uint8_t *)(uintptr_t)geom->data + (uint64_t)id * geom->stride;
+
+   /* arrayOfPointers */
+   if (geom->stride == 8)
+      src = (const uint8_t *)(uintptr_t)*(const uint64_t *)src;
+
+   const VkAccelerationStructureInstanceKHR *instance = (const void *)src;
+
+   /* Instances without a BLAS are inactive, and those with an empty mask
+    * can never be hit.  Serialization reads bvh_ptr from every slot.
+    */
+   memset(node, 0, sizeof(*node));
+   if (!instance->accelerationStructureReference || !instance->mask)
+      return false;
+
+   const struct lvp_bvh_header *blas =
+      (const void *)(uintptr_t)instance->accelerationStructureReference;
+   const float *blas_min = &blas->bounds.min.x;
+   const float *blas_max = &blas->bounds.max.x;
+   const float (*m)[4] = instance->transform.matrix;
+   float *min = &bounds->min.x;
+   float *max = &bounds->max.x;
+
+   for (unsigned row = 0; row < 3; row++) {
+      min[row] = max[row] = m[row][3];
+      for (unsigned col = 0; col < 3; col++) {
+         float a = m[row][col] * blas_min[col];
+         float b = m[row][col] * blas_max[col];
+         min[row] += MIN2(a, b);
+         max[row] += MAX2(a, b);
+      }
+   }
+
+   if (lvp_bvh_aabb_is_nan(bounds))
+      return false;
+
+   node->bvh_ptr = instance->accelerationStructureReference;
+   node->custom_instance_and_mask =
+      instance->instanceCustomIndex | (instance->mask << 24);
+   node->sbt_offset_and_flags =
+      lvp_pack_sbt_offset_and_flags(instance->instanceShaderBindingTableRecordOffset,
+                                    instance->flags);
+   node->instance_id = id;
+   memcpy(node->otw_matrix.values, m, sizeof(node->otw_matrix.values));
+
+   float transform[16], inv_transform[16];
+   memcpy(transform, m, sizeof(node->otw_matrix.values));
+   transform[12] = transform[13] = transform[14] = 0.0f;
+   transform[15] = 1.0f;
+
+   util_invert_mat4x4(inv_transform, transform);
+   memcpy(node->wto_matrix.values, inv_transform, sizeof(node->wto_matrix.values));
+
+   return true;
+}
+
+static void
+lvp_bvh_build_leaves(struct lvp_bvh_builder *b, uint32_t index)
+{
+   const struct lvp_bvh_leaf_chunk *chunk =
+      util_dynarray_element(&b->leaf_chunks, struct lvp_bvh_leaf_chunk, index);
+   const struct vk_bvh_geometry_data *geom = &chunk->geom;
+   const enum pipe_format format = b->geometry_type == VK_GEOMETRY_TYPE_TRIANGLES_KHR ?
+      vk_format_to_pipe_format(geom->vertex_format) : PIPE_FORMAT_NONE;
+
+   for (uint32_t id = chunk->first; id < chunk->first + chunk->count; id++) {
+      const uint32_t slot = geom->first_id + id;
+      const uint32_t offset = b->leaf_nodes_offset + slot * b->leaf_node_size;
+      struct lvp_bvh_ref *ref = &b->refs[slot];
+      void *leaf = b->output + offset;
+      bool active;
+
+      switch (b->geometry_type) {
+      case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+         active = lvp_bvh_build_triangle(geom, format, id, leaf, &ref->bounds);
+         ref->node = offset | lvp_bvh_node_triangle;
+         break;
+      case VK_GEOMETRY_TYPE_AABBS_KHR:
+         active = lvp_bvh_build_aabb(geom, id, leaf, &ref->bounds);
+         ref->node = offset | lvp_bvh_node_aabb;
+         break;
+      default:
+         active = lvp_bvh_build_instance(geom, id, leaf, &ref->bounds);
+         ref->node = offset | lvp_bvh_node_instance;
+         break;
+      }
+
+      if (!active)
+         ref->node = LVP_BVH_INVALID_NODE;
+   }
+}
+
+
+/*
+ * Box nodes
+ */
+
+static inline unsigned
+lvp_bvh_depth_for(uint32_t num_leaves)
+{
+   return util_logbase2_ceil(num_leaves);
+}
+
+/**
+ * Partition refs[begin..end) around the median centroid on \p axis.
+ */
+static uint32_t
+lvp_bvh_median_split(struct lvp_bvh_builder *b, uint32_t begin, uint32_t end,
+                     unsigned axis)
+{
+   struct lvp_bvh_ref *refs = b->refs;
+   const int32_t mid = begin + (end - begin) / 2;
+   int32_t lo = begin, hi = end - 1;
+
+   /* Quickselect */
+   while (lo < hi) {
+      const float pivot = lvp_bvh_centroid(&refs[lo + (hi - lo) / 2], axis);
+      int32_t i = lo, j = hi;
+
+      while (i <= j) {
+         while (lvp_bvh_centroid(&refs[i], axis) < pivot)
+            i++;
+         while (lvp_bvh_centroid(&refs[j], axis) > pivot)
+            j--;
+         if (i <= j) {
+            struct lvp_bvh_ref tmp = refs[i];
+            refs[i++] = refs[j];
+            refs[j--] = tmp;
+         }
+      }
+
+      if (mid <= j)
+         hi = j;
+      else if (mid >= i)
+         lo = i;
+      else
+         break;
+   }
+
+   return mid;
+}
+
+/**
+ * Split refs[begin..end) in two non-empty halves, using the binned SAH
+ * unless that would make the tree too deep.
+ *
+ * \return the first ref of the second half
+ */
+static uint32_t
+lvp_bvh_split(struct lvp_bvh_builder *b, uint32_t begin, uint32_t end,
+              uint32_t depth, vk_aabb child_bounds[2])
+{
+   struct lvp_bvh_ref *refs = b->refs;
+   const uint32_t n = end - begin;
+
+   vk_aabb centroids;
+   lvp_bvh_aabb_init(&centroids);
+   for (uint32_t i = begin; i < end; i++) {
+      const float c[3] = {
+         lvp_bvh_centroid(&refs[i], 0),
+         lvp_bvh_centroid(&refs[i], 1),
+         lvp_bvh_centroid(&refs[i], 2),
+      };
+      lvp_bvh_aabb_add_point(&centroids, c);
+   }
+
+   const float *cmin = &centroids.min.x;
+   const float *cmax = &centroids.max.x;
+   float extent[3];
+   unsigned largest_axis = 0;
+   for (unsigned axis = 0; axis < 3; axis++) {
+      extent[axis] = cmax[axis] - cmin[axis];
+      if (extent[axis] > extent[largest_axis])
+         largest_axis = axis;
+   }
+
+   struct {
+      vk_aabb bounds;
+      uint32_t count;
+   } bins[3][LVP_BVH_SAH_BINS];
+   float scale[3];
+
+   for (unsigned axis = 0; axis < 3; axis++) {
+      scale[axis] = extent[axis] > 0.0f ?
+         LVP_BVH_SAH_BINS * (1.0f - 1e-6f) / extent[axis] : 0.0f;
+      for (unsigned i = 0; i < LVP_BVH_SAH_BINS; i++) {
+         lvp_bvh_aabb_init(&bins[axis][i].bounds);
+         bins[axis][i].count = 0;
+      }
+   }
+
+   for (uint32_t i = begin; i < end; i++) {
+      for (unsigned axis = 0; axis < 3; axis++) {
+         unsigned bin = (lvp_bvh_centroid(&refs[i], axis) - cmin[axis]) * scale[axis];
+         bin = MIN2(bin, LVP_BVH_SAH_BINS - 1);
+         lvp_bvh_aabb_merge(&bins[axis][bin].bounds, &refs[i].bounds);
+         bins[axis][bin].count++;
+      }
+   }
+
+   float best_cost = INFINITY;
+   unsigned best_axis = 0, best_bin = 0;
+   uint32_t best_left = 0;
+   vk_aabb best_bounds[2];
+
+   for (unsigned axis = 0; axis < 3; axis++) {
+      if (!scale[axis])
+         continue;
+
+      /* Sweep from the right, then evaluate the splits from the left. */
+      vk_aabb right_bounds[LVP_BVH_SAH_BINS];
+      uint32_t right_count[LVP_BVH_SAH_BINS];
+      vk_aabb acc;
+      uint32_t count = 0;
+
+      lvp_bvh_aabb_init(&acc);
+      for (unsigned i = LVP_BVH_SAH_BINS - 1; i > 0; i--) {
+         lvp_bvh_aabb_merge(&acc, &bins[axis][i].bounds);
+         count += bins[axis][i].count;
+         right_bounds[i] = acc;
+         right_count[i] = count;
+      }
+
+      lvp_bvh_aabb_init(&acc);
+      count = 0;
+      for (unsigned i = 1; i < LVP_BVH_SAH_BINS; i++) {
+         lvp_bvh_aabb_merge(&acc, &bins[axis][i - 1].bounds);
+         count += bins[axis][i - 1].count;
+
+         if (!count || !right_count[i])
+            continue;
+
+         float cost = lvp_bvh_aabb_half_area(&acc) * count +
+                      lvp_bvh_aabb_half_area(&right_bounds[i]) * right_count[i];
+         if (cost < best_cost) {
+            best_cost = cost;
+            best_axis = axis;
+            best_bin = i;
+            best_left = count;
+            best_bounds[0] = acc;
+            best_bounds[1] = right_bounds[i];
+         }
+      }
+   }
+
+   /* Children at depth + 1 must still fit their subtrees, see
+    * lvp_bvh_build_node().
+    */
+   const bool sah = best_cost < INFINITY &&
+      depth + lvp_bvh_depth_for(MAX2(best_left, n - best_left)) < b->max_depth;
+
+   uint32_t mid;
+   if (sah) {
+      uint32_t i = begin, j = end;
+      while (i < j) {
+         unsigned bin = (lvp_bvh_centroid(&refs[i], best_axis) - cmin[best_axis]) *
+                        scale[best_axis];
+         if (MIN2(bin, LVP_BVH_SAH_BINS - 1) < best_bin) {
+            i++;
+         } else {
+            struct lvp_bvh_ref tmp = refs[i];
+            refs[i] = refs[--j];
+            refs[j] = tmp;
+         }
+      }
+      mid = i;
+      assert(mid - begin == best_left);
+      child_bounds[0] = best_bounds[0];
+      child_bounds[1] = best_bounds[1];
+   } else {
+      mid = lvp_bvh_median_split(b, begin, end, largest_axis);
+
+      lvp_bvh_aabb_init(&child_bounds[0]);
+      lvp_bvh_aabb_init(&child_bounds[1]);
+      for (uint32_t i = begin; i < end; i++)
+         lvp_bvh_aabb_merge(&child_bounds[i >= mid], &refs[i].bounds);
+   }
+
+   return mid;
+}
+
+/**
+ * Build the subtree of box node \p node_index over refs[begin..end), which
+ * holds at least two refs.  Subtrees of up to max_task_leaves are queued
+ * as tasks if \p defer is set.
+ */
+static void
+lvp_bvh_build_node(struct lvp_bvh_builder *b, uint32_t begin, uint32_t end,
+                   uint32_t node_index, uint32_t depth, bool defer)
+{
+   struct lvp_bvh_box_node *node = lvp_bvh_box_node(b, node_index);
+   vk_aabb child_bounds[2];
+
+   const uint32_t mid = lvp_bvh_split(b, begin, end, depth, child_bounds);
+   const uint32_t child_begin[2] = { begin, mid };
+   const uint32_t child_end[2] = { mid, end };
+   const uint32_t child_index[2] = { node_index + 1, node_index + (mid - begin) };
+
+   for (unsigned i = 0; i < 2; i++) {
+      const uint32_t n = child_end[i] - child_begin[i];
+
+      if (n == 1) {
+         lvp_bvh_set_child(node, i, b->refs[child_begin[i]].node, &child_bounds[i]);
+         continue;
+      }
+
+      lvp_bvh_set_child(node, i, lvp_bvh_box_node_id(child_index[i]), &child_bounds[i]);
+
+      if (defer && n <= b->max_task_leaves) {
+         struct lvp_bvh_task task = {
+            .begin = child_begin[i],
+            .end = child_end[i],
+            .node_index = child_index[i],
+            .depth = depth + 1,
+         };
+         util_dynarray_append(&b->tasks, task);
+      } else {
+         lvp_bvh_build_node(b, child_begin[i], child_end[i], child_index[i],
+                            depth + 1, defer);
+      }
+   }
+}
+
+static void
+lvp_bvh_build_task(struct lvp_bvh_builder *b, uint32_t index)
+{
+   const struct lvp_bvh_task *task =
+      util_dynarray_element(&b->tasks, struct lvp_bvh_task, index);
+
+   lvp_bvh_build_node(b, task->begin, task->end, task->node_index, task->depth, false);
+}
+
+
+/**
+ * Build the acceleration structure described by \p info on the CPU.
+ */
+void
+lvp_build_as_cpu(struct lvp_device *device,
+                 const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                 const VkAccelerationStructureBuildRangeInfoKHR *ranges)
+{
+   VK_FROM_HANDLE(vk_acceleration_structure, dst, info->dstAccelerationStructure);
+
+   MESA_TRACE_FUNC();
+
+   struct lvp_bvh_builder b = {
+      .device = device,
+      .type = info->type,
+      .geometry_type = vk_get_as_geometry_type(info),
+      .output = (void *)(uintptr_t)vk_acceleration_structure_get_va(dst),
+      .max_depth = info->type == VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR ?
+                   LVP_MAX_TLAS_DEPTH : LVP_MAX_BLAS_DEPTH,
+   };
+   util_dynarray_init(&b.leaf_chunks, NULL);
+   util_dynarray_init(&b.tasks, NULL);
+
+   uint32_t num_leaves = 0;
+   for (uint32_t i = 0; i < info->geometryCount; i++) {
+      const VkAccelerationStructureGeometryKHR *geom =
+         info->pGeometries ? &info->pGeometries[i] : info->ppGeometries[i];
+      struct vk_bvh_geometry_data data =
+         vk_fill_geometry_data(info->type, num_leaves, i, geom, &ranges[i]);
+
+      for (uint32_t first = 0; first < ranges[i].primitiveCount;
+           first += LVP_BVH_LEAF_CHUNK) {
+         struct lvp_bvh_leaf_chunk chunk = {
+            .geom = data,
+            .first = first,
+            .count = MIN2(ranges[i].primitiveCount - first, LVP_BVH_LEAF_CHUNK),
+         };
+         util_dynarray_append(&b.leaf_chunks, chunk);
+      }
+
+      num_leaves += ranges[i].primitiveCount;
+   }
+
+   uint32_t ir_leaf_node_size;
+   lvp_get_leaf_node_size(b.geometry_type, &ir_leaf_node_size, &b.leaf_node_size);
+
+   /* Same layout as lvp_encode_as(), sized by lvp_get_as_size(). */
+   const uint32_t max_box_nodes = MAX2(num_leaves, 2) - 1;
+   b.leaf_nodes_offset = LVP_BVH_ROOT_NODE_OFFSET +
+                         max_box_nodes * sizeof(struct lvp_bvh_box_node);
+
+   struct lvp_bvh_header *header = (void *)b.output;
+   const uint32_t bvh_size = lvp_get_as_size_internal(b.geometry_type, num_leaves);
+   header->instance_count =
+      b.geometry_type == VK_GEOMETRY_TYPE_INSTANCES_KHR ? num_leaves : 0;
+   header->leaf_nodes_offset = b.leaf_nodes_offset;
+   header->compacted_size = bvh_size;
+   header->serialization_size = sizeof(struct lvp_accel_struct_serialization_header) +
+                                sizeof(uint64_t) * header->instance_count + bvh_size;
+
+   b.refs = malloc(MAX2(num_leaves, 1) * sizeof(*b.refs));
+   if (!b.refs) {
+      /* Leave an empty, but valid, acceleration structure. */
+      num_leaves = 0;
+      util_dynarray_clear(&b.leaf_chunks);
+   }
+
+   lvp_bvh_parallel_for(&b, util_dynarray_num_elements(&b.leaf_chunks,
+                                                       struct lvp_bvh_leaf_chunk),
+                        lvp_bvh_build_leaves);
+
+   lvp_bvh_aabb_init(&header->bounds);
+   for (uint32_t i = 0; i < num_leaves; i++) {
+      if (b.refs[i].node == LVP_BVH_INVALID_NODE)
+         continue;
+      lvp_bvh_aabb_merge(&header->bounds, &b.refs[i].bounds);
+      b.refs[b.num_refs++] = b.refs[i];
+   }
+
+   struct lvp_bvh_box_node *root = lvp_bvh_box_node(&b, 0);
+   if (b.num_refs < 2) {
+      if (b.num_refs)
+         lvp_bvh_set_child(root, 0, b.refs[0].node, &b.refs[0].bounds);
+      else
+         lvp_bvh_set_child(root, 0, LVP_BVH_INVALID_NODE, NULL);
+      lvp_bvh_set_child(root, 1, LVP_BVH_INVALID_NODE, NULL);
+   } else {
+      const unsigned num_threads = util_queue_is_initialized(&device->bvh_queue) ?
+                                   device->bvh_queue.max_threads : 1;
+
+      /* A few tasks per thread, for load balancing. */
+      b.max_task_leaves = num_threads > 1 ?
+         MAX2(b.num_refs / (num_threads * 4), LVP_BVH_MIN_TASK_LEAVES) : 0;
+
+      lvp_bvh_build_node(&b, 0, b.num_refs, 0, 0, b.max_task_leaves > 0);
+
+      lvp_bvh_parallel_for(&b, util_dynarray_num_elements(&b.tasks, struct lvp_bvh_task),
+                           lvp_bvh_build_task);
+   }
+
+   free(b.refs);
+   util_dynarray_fini(&b.leaf_chunks);
+   util_dynarray_fini(&b.tasks);
+}
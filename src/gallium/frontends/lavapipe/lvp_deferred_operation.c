@@ -0,0 +1,248 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Jobs shared between the device's compile threads, the creating thread and
+ * the threads joining a VkDeferredOperationKHR.
+ *
+ * A job set is a fixed number of independent jobs.  Any thread may claim
+ * the next job, so the thread waiting for a set never depends on a worker
+ * thread actually getting scheduled: it runs whatever is left itself and
+ * only waits for jobs which are already running elsewhere.  This keeps
+ * nested sets (pipelines -> stages) free of deadlocks.
+ */
+
+#include "lvp_private.h"
+
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+
+struct lvp_job_set {
+   lvp_job_func func;
+   lvp_job_finish_func finish;
+   void *data;
+
+   uint32_t count;
+   uint32_t next;
+   uint32_t done;
+   uint32_t refcount;
+
+   /* Signalled once all jobs and finish have run */
+   struct util_queue_fence fence;
+   VkResult result;
+};
+
+static struct lvp_job_set *
+lvp_job_set_create(uint32_t count, lvp_job_func func,
+                   lvp_job_finish_func finish, void *data)
+{
+   struct lvp_job_set *set = calloc(1, sizeof(*set));
+   if (!set)
+      return NULL;
+
+   set->func = func;
+   set->finish = finish;
+   set->data = data;
+   set->count = count;
+   set->refcount = 1;
+   set->result = VK_SUCCESS;
+   util_queue_fence_init(&set->fence);
+   util_queue_fence_reset(&set->fence);
+
+   return set;
+}
+
+static void
+lvp_job_set_unref(struct lvp_job_set *set)
+{
+   if (p_atomic_dec_zero(&set->refcount)) {
+      util_queue_fence_destroy(&set->fence);
+      free(set);
+   }
+}
+
+/* Run jobs until none are left to claim, returns true once the set completed. */
+static bool
+lvp_job_set_join(struct lvp_job_set *set)
+{
+   uint32_t i;
+
+   while ((i = p_atomic_inc_return(&set->next) - 1) < set->count) {
+      set->func(set->data, i);
+
+      if (p_atomic_inc_return(&set->done) == set->count) {
+         if (set->finish)
+            set->result = set->finish(set->data);
+         util_queue_fence_signal(&set->fence);
+         return true;
+      }
+   }
+
+   return util_queue_fence_is_signalled(&set->fence);
+}
+
+static void
+lvp_job_set_execute(void *data, void *gdata, int thread_index)
+{
+   struct lvp_job_set *set = data;
+
+   lvp_job_set_join(set);
+   lvp_job_set_unref(set);
+}
+
+void
+lvp_device_init_compile_queue(struct lvp_device *device)
+{
+   /* LVP_COMPILE_THREADS=1 compiles everything on the creating thread */
+   unsigned num_threads = debug_get_num_option("LVP_COMPILE_THREADS",
+                                               util_get_cpu_caps()->nr_cpus);
+   num_threads = MIN2(num_threads, LVP_COMPILE_MAX_THREADS);
+
+   if (num_threads > 1)
+      util_queue_init(&device->compile_queue, "lvp_compile", 4 * num_threads,
+                      num_threads, UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+}
+
+void
+lvp_device_finish_compile_queue(struct lvp_device *device)
+{
+   if (util_queue_is_initialized(&device->compile_queue))
+      util_queue_destroy(&device->compile_queue);
+}
+
+/**
+ * Run func(data, 0..count-1) on the compile threads and the calling thread,
+ * returning once all of them finished.  May be called from a job itself.
+ */
+void
+lvp_parallel_for(struct lvp_device *device, uint32_t count,
+                 lvp_job_func func, void *data)
+{
+   struct util_queue *queue = &device->compile_queue;
+   struct lvp_job_set *set = NULL;
+
+   if (count > 1 && util_queue_is_initialized(queue))
+      set = lvp_job_set_create(count, func, NULL, data);
+
+   if (!set) {
+      for (uint32_t i = 0; i < count; i++)
+         func(data, i);
+      return;
+   }
+
+   uint32_t num_helpers = MIN2(count, queue->max_threads) - 1;
+   p_atomic_add(&set->refcount, num_helpers);
+   for (uint32_t i = 0; i < num_helpers; i++)
+      util_queue_add_job(queue, set, NULL, lvp_job_set_execute, NULL, 0);
+
+   if (!lvp_job_set_join(set))
+      util_queue_fence_wait(&set->fence);
+
+   lvp_job_set_unref(set);
+}
+
+/**
+ * Make func(data, 0..count-1) the work of a deferred operation.  The jobs
+ * only run in vkDeferredOperationJoinKHR, finish runs on the thread which
+ * completes the last one and provides the result of the operation.
+ */
+VkResult
+lvp_deferred_operation_defer(struct lvp_deferred_operation *op, uint32_t count,
+                             lvp_job_func func, lvp_job_finish_func finish,
+                             void *data)
+{
+   struct lvp_job_set *set = lvp_job_set_create(count, func, finish, data);
+   if (!set)
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+   if (op->jobs)
+      lvp_job_set_unref(op->jobs);
+   op->jobs = set;
+
+   /* Nothing to join for */
+   if (!count) {
+      set->result = finish(data);
+      util_queue_fence_signal(&set->fence);
+   }
+
+   return VK_OPERATION_DEFERRED_KHR;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+lvp_CreateDeferredOperationKHR(VkDevice _device,
+                               const VkAllocationCallbacks *pAllocator,
+                               VkDeferredOperationKHR *pDeferredOperation)
+{
+   VK_FROM_HANDLE(lvp_device, device, _device);
+
+   struct lvp_deferred_operation *op =
+      vk_zalloc2(&device->vk.alloc, pAllocator, sizeof(*op), 8,
+                 VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   if (op == NULL)
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+   vk_object_base_init(&device->vk, &op->vk.base,
+                       VK_OBJECT_TYPE_DEFERRED_OPERATION_KHR);
+
+   *pDeferredOperation = lvp_deferred_operation_to_handle(op);
+
+   return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL
+lvp_DestroyDeferredOperationKHR(VkDevice _device,
+                                VkDeferredOperationKHR operation,
+                                const VkAllocationCallbacks *pAllocator)
+{
+   VK_FROM_HANDLE(lvp_device, device, _device);
+   VK_FROM_HANDLE(lvp_deferred_operation, op, operation);
+
+   if (op == NULL)
+      return;
+
+   if (op->jobs)
+      lvp_job_set_unref(op->jobs);
+
+   vk_object_base_finish(&op->vk.base);
+   vk_free2(&device->vk.alloc, pAllocator, op);
+}
+
+VKAPI_ATTR uint32_t VKAPI_CALL
+lvp_GetDeferredOperationMaxConcurrencyKHR(VkDevice _device,
+                                          VkDeferredOperationKHR operation)
+{
+   VK_FROM_HANDLE(lvp_deferred_operation, op, operation);
+   struct lvp_job_set *set = op->jobs;
+
+   if (!set || util_queue_fence_is_signalled(&set->fence))
+      return 0;
+
+   uint32_t claimed = MIN2(p_atomic_read(&set->next), set->count);
+   return MAX2(set->count - claimed, 1);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+lvp_GetDeferredOperationResultKHR(VkDevice _device,
+                                  VkDeferredOperationKHR operation)
+{
+   VK_FROM_HANDLE(lvp_deferred_operation, op, operation);
+   struct lvp_job_set *set = op->jobs;
+
+   if (!set)
+      return VK_SUCCESS;
+
+   return util_queue_fence_is_signalled(&set->fence) ? set->result : VK_NOT_READY;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+lvp_DeferredOperationJoinKHR(VkDevice _device,
+                             VkDeferredOperationKHR operation)
+{
+   VK_FROM_HANDLE(lvp_deferred_operation, op, operation);
+
+   if (!op->jobs)
+      return VK_SUCCESS;
+
+   return lvp_job_set_join(op->jobs) ? VK_SUCCESS : VK_THREAD_DONE_KHR;
+}
@@ -575,7 +575,7 @@ lvp_get_features(const struct lvp_physical_device *pdevice,
       .accelerationStructure = true,
       .accelerationStructureCaptureReplay = false,
       .accelerationStructureIndirectBuild = false,
-      .accelerationStructureHostCommands = false,
+      .accelerationStructureHostCommands = true,
       .descriptorBindingAccelerationStructureUpdateAfterBind = true,
 
       /* VK_EXT_descriptor_buffer */
@@ -1693,28 +1693,36 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
 {
    VK_OUTARRAY_MAKE_TYPED(VkQueueFamilyProperties2, out, pQueueFamilyProperties, pCount);
 
-   VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(pQueueFamilyProperties, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
-   if (prio) {
-      prio->priorityCount = 4;
-      prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
-      prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
-      prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
-      prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
-   }
-   VkQueueFamilyOwnershipTransferPropertiesKHR *prop = vk_find_struct(pQueueFamilyProperties, QUEUE_FAMILY_OWNERSHIP_TRANSFER_PROPERTIES_KHR);
-   if (prop)
-      prop->optimalImageTransferToQueueFamilies = ~0;
-
-   vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
-      p->queueFamilyProperties = (VkQueueFamilyProperties) {
-         .queueFlags = VK_QUEUE_GRAPHICS_BIT |
-         VK_QUEUE_COMPUTE_BIT |
-         VK_QUEUE_TRANSFER_BIT |
-         (DETECT_OS_LINUX ? VK_QUEUE_SPARSE_BINDING_BIT : 0),
-         .queueCount = 1,
-         .timestampValidBits = 64,
-         .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
-      };
+   static const VkQueueFlags queue_flags[LVP_QUEUE_FAMILY_COUNT] = {
+      [LVP_QUEUE_FAMILY_GRAPHICS] = VK_QUEUE_GRAPHICS_BIT |
+                                    VK_QUEUE_COMPUTE_BIT |
+                                    VK_QUEUE_TRANSFER_BIT |
+                                    (DETECT_OS_LINUX ? VK_QUEUE_SPARSE_BINDING_BIT : 0),
+      [LVP_QUEUE_FAMILY_COMPUTE] = VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT,
+      [LVP_QUEUE_FAMILY_TRANSFER] = VK_QUEUE_TRANSFER_BIT,
+   };
+
+   for (unsigned i = 0; i < LVP_QUEUE_FAMILY_COUNT; i++) {
+      vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
+         p->queueFamilyProperties = (VkQueueFamilyProperties) {
+            .queueFlags = queue_flags[i],
+            .queueCount = LVP_MAX_QUEUES_PER_FAMILY,
+            .timestampValidBits = 64,
+            .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
+         };
+
+         VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(p, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
+         if (prio) {
+            prio->priorityCount = 4;
+            prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
+            prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
+            prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
+            prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
+         }
+         VkQueueFamilyOwnershipTransferPropertiesKHR *prop = vk_find_struct(p, QUEUE_FAMILY_OWNERSHIP_TRANSFER_PROPERTIES_KHR);
+         if (prop)
+            prop->optimalImageTransferToQueueFamilies = ~0;
+      }
    }
 }
 
@@ -1800,15 +1808,24 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vk_icdGetInstanceProcAddr(
    return lvp_GetInstanceProcAddr(instance, pName);
 }
 
+/* Pipelines destroyed while possibly still bound are queued on
+ * device->queue and destroyed after the next submission on any queue.
+ * They are destroyed without the lock held, since destroying the CSOs of
+ * other queues takes their locks.
+ */
 static void
-destroy_pipelines(struct lvp_queue *queue)
+destroy_pipelines(struct lvp_device *device)
 {
-   struct lvp_device *device = lvp_queue_device(queue);
-   simple_mtx_lock(&queue->lock);
-   while (util_dynarray_contains(&queue->pipeline_destroys, struct lvp_pipeline*)) {
-      lvp_pipeline_destroy(device, util_dynarray_pop(&queue->pipeline_destroys, struct lvp_pipeline*), true);
+   simple_mtx_lock(&device->queue.lock);
+   while (util_dynarray_contains(&device->queue.pipeline_destroys, struct lvp_pipeline*)) {
+      struct lvp_pipeline *pipeline =
+         util_dynarray_pop(&device->queue.pipeline_destroys, struct lvp_pipeline*);
+
+      simple_mtx_unlock(&device->queue.lock);
+      lvp_pipeline_destroy(device, pipeline, false);
+      simple_mtx_lock(&device->queue.lock);
    }
-   simple_mtx_unlock(&queue->lock);
+   simple_mtx_unlock(&device->queue.lock);
 }
 
 static VkResult
@@ -1861,7 +1878,7 @@ lvp_queue_submit(struct vk_queue *vk_queue,
          vk_sync_as_lvp_pipe_sync(submit->signals[i].sync);
       lvp_pipe_sync_signal_with_fence(device, sync, queue->last_fence);
    }
-   destroy_pipelines(queue);
+   destroy_pipelines(device);
 
    return VK_SUCCESS;
 }
@@ -1871,6 +1888,8 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
                const VkDeviceQueueCreateInfo *create_info,
                uint32_t index_in_family)
 {
+   const struct lvp_physical_device *pdev = lvp_device_physical(device);
+
    VkResult result = vk_queue_init(&queue->vk, &device->vk, create_info,
                                    index_in_family);
    if (result != VK_SUCCESS)
@@ -1888,28 +1907,86 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
    queue->cso = cso_create_context(queue->ctx, CSO_NO_VBUF);
    queue->uploader = u_upload_create(queue->ctx, 1024 * 1024, PIPE_BIND_CONSTANT_BUFFER, PIPE_USAGE_STREAM, 0);
 
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, pdev->drv_options[MESA_SHADER_FRAGMENT], "dummy_frag");
+   struct pipe_shader_state shstate = {0};
+   shstate.type = PIPE_SHADER_IR_NIR;
+   shstate.ir.nir = b.shader;
+   queue->noop_fs = queue->ctx->create_fs_state(queue->ctx, &shstate);
+
    queue->vk.driver_submit = lvp_queue_submit;
 
    simple_mtx_init(&queue->lock, mtx_plain);
    queue->pipeline_destroys = UTIL_DYNARRAY_INIT;
 
+   queue->index = device->queue_count++;
+   device->queues[queue->index] = queue;
+
    return VK_SUCCESS;
 }
 
 static void
 lvp_queue_finish(struct lvp_queue *queue)
 {
+   struct lvp_device *device = lvp_queue_device(queue);
+
    vk_queue_finish(&queue->vk);
 
-   destroy_pipelines(queue);
+   destroy_pipelines(device);
    simple_mtx_destroy(&queue->lock);
    util_dynarray_fini(&queue->pipeline_destroys);
 
+   if (queue->last_fence)
+      device->pscreen->fence_reference(device->pscreen, &queue->last_fence, NULL);
+
+   queue->ctx->delete_fs_state(queue->ctx, queue->noop_fs);
    u_upload_destroy(queue->uploader);
    cso_destroy_context(queue->cso);
    queue->ctx->destroy(queue->ctx);
 }
 
+/* Create the queues after the first one, which is lvp_device::queue. */
+static VkResult
+lvp_create_queues(struct lvp_device *device, const VkDeviceCreateInfo *pCreateInfo)
+{
+   size_t state_size = lvp_get_rendering_state_size();
+
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *create_info = &pCreateInfo->pQueueCreateInfos[i];
+
+      assert(create_info->queueFamilyIndex < LVP_QUEUE_FAMILY_COUNT);
+      assert(create_info->queueCount <= LVP_MAX_QUEUES_PER_FAMILY);
+
+      for (uint32_t j = i ? 0 : 1; j < create_info->queueCount; j++) {
+         struct lvp_queue *queue =
+            vk_zalloc(&device->vk.alloc, sizeof(*queue) + state_size, 8,
+                      VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+         if (!queue)
+            return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+         queue->state = queue + 1;
+
+         VkResult result = lvp_queue_init(device, queue, create_info, j);
+         if (result != VK_SUCCESS) {
+            vk_free(&device->vk.alloc, queue);
+            return result;
+         }
+      }
+   }
+
+   return VK_SUCCESS;
+}
+
+static void
+lvp_destroy_queues(struct lvp_device *device)
+{
+   while (device->queue_count > 1) {
+      struct lvp_queue *queue = device->queues[--device->queue_count];
+
+      lvp_queue_finish(queue);
+      vk_free(&device->vk.alloc, queue);
+   }
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
    VkPhysicalDevice                            physicalDevice,
    const VkDeviceCreateInfo*                   pCreateInfo,
@@ -1967,15 +2044,13 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount <= LVP_NUM_QUEUES);
+   assert(pCreateInfo->queueCreateInfoCount <= LVP_QUEUE_FAMILY_COUNT);
    if (pCreateInfo->queueCreateInfoCount) {
-      assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-      assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
       result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
    } else {
       /* VK_KHR_maintenance9 allows zero queues devices used to compile shaders only.
-      *  Since we only ever create a single queue, and it has no hardward backing it,
-      *  we can just create a dummy queue on the behalf of the user.
+      *  Queues have no hardware backing them, so we can just create a dummy
+      *  queue on the behalf of the user.
       */
       const float fake_priority = 1.0f;
       const VkDeviceQueueCreateInfo dummy_create_info = {
@@ -1994,11 +2069,14 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
       return result;
    }
 
-   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, physical_device->drv_options[MESA_SHADER_FRAGMENT], "dummy_frag");
-   struct pipe_shader_state shstate = {0};
-   shstate.type = PIPE_SHADER_IR_NIR;
-   shstate.ir.nir = b.shader;
-   device->noop_fs = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+   result = lvp_create_queues(device, pCreateInfo);
+   if (result != VK_SUCCESS) {
+      lvp_destroy_queues(device);
+      lvp_queue_finish(&device->queue);
+      vk_free(&device->vk.alloc, device);
+      return result;
+   }
+
    _mesa_hash_table_init(&device->bda, NULL, _mesa_hash_pointer, _mesa_key_pointer_equal);
    simple_mtx_init(&device->bda_lock, mtx_plain);
 
@@ -2022,6 +2100,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
    }
 
    lvp_device_init_accel_struct_state(device);
+   lvp_device_init_compile_queue(device);
 
    *pDevice = lvp_device_to_handle(device);
 
@@ -2036,6 +2115,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
    VK_FROM_HANDLE(lvp_device, device, _device);
 
    lvp_device_finish_accel_struct_state(device);
+   lvp_device_finish_compile_queue(device);
 
    vk_meta_device_finish(&device->vk, &device->meta);
 
@@ -2052,14 +2132,13 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
    device->queue.ctx->delete_texture_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_texture_handle);
    device->queue.ctx->delete_image_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_image_handle);
 
-   device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
-
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
    _mesa_hash_table_fini(&device->bda, NULL);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
 
+   /* Pipelines still queued for destruction may have CSOs on any queue. */
+   destroy_pipelines(device);
+   lvp_destroy_queues(device);
    lvp_queue_finish(&device->queue);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
@@ -91,6 +91,7 @@ struct lvp_conditional_rendering_state {
 struct rendering_state {
    struct pipe_context *pctx;
    struct lvp_device *device;
+   struct lvp_queue *queue;
    struct u_upload_mgr *uploader;
    struct cso_context *cso;
 
@@ -343,7 +344,7 @@ static void emit_compute_state(struct rendering_state *state)
    }
 
    if (state->compute_shader_dirty)
-      state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_COMPUTE]->shader_cso);
+      state->pctx->bind_compute_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_COMPUTE], false));
 
    state->compute_shader_dirty = false;
 
@@ -416,7 +417,7 @@ emit_advanced_blend_fs(struct rendering_state *state)
          state->pctx->delete_fs_state(state->pctx, state->advanced_blend_fs_variant);
          state->advanced_blend_fs_variant = NULL;
          state->advanced_blend_fs_shader = NULL;
-         state->pctx->bind_fs_state(state->pctx, shader->shader_cso);
+         state->pctx->bind_fs_state(state->pctx, lvp_shader_queue_cso(state->queue, shader, false));
       }
       return;
    }
@@ -475,7 +476,7 @@ static void emit_state(struct rendering_state *state)
    emit_advanced_blend_fs(state);
 
    if (!state->shaders[MESA_SHADER_FRAGMENT] && !state->noop_fs_bound) {
-      state->pctx->bind_fs_state(state->pctx, state->device->noop_fs);
+      state->pctx->bind_fs_state(state->pctx, state->queue->noop_fs);
       state->noop_fs_bound = true;
    }
    if (state->blend_dirty) {
@@ -738,37 +739,37 @@ handle_graphics_stages(struct rendering_state *state, VkShaderStageFlagBits shad
 
       switch (vk_stage) {
       case VK_SHADER_STAGE_FRAGMENT_BIT:
-         state->pctx->bind_fs_state(state->pctx, state->shaders[MESA_SHADER_FRAGMENT]->shader_cso);
+         state->pctx->bind_fs_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_FRAGMENT], false));
          state->noop_fs_bound = false;
          break;
       case VK_SHADER_STAGE_VERTEX_BIT:
-         state->pctx->bind_vs_state(state->pctx, state->shaders[MESA_SHADER_VERTEX]->shader_cso);
+         state->pctx->bind_vs_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_VERTEX], false));
          break;
       case VK_SHADER_STAGE_GEOMETRY_BIT:
-         state->pctx->bind_gs_state(state->pctx, state->shaders[MESA_SHADER_GEOMETRY]->shader_cso);
+         state->pctx->bind_gs_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_GEOMETRY], false));
          state->gs_output_lines = state->shaders[MESA_SHADER_GEOMETRY]->pipeline_nir->nir->info.gs.output_primitive == MESA_PRIM_LINES ? GS_OUTPUT_LINES : GS_OUTPUT_NOT_LINES;
          break;
       case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
-         state->pctx->bind_tcs_state(state->pctx, state->shaders[MESA_SHADER_TESS_CTRL]->shader_cso);
+         state->pctx->bind_tcs_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_TESS_CTRL], false));
          break;
       case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
          state->tess_states[0] = NULL;
          state->tess_states[1] = NULL;
          if (dynamic_tess_origin) {
-            state->tess_states[0] = state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso;
-            state->tess_states[1] = state->shaders[MESA_SHADER_TESS_EVAL]->tess_ccw_cso;
+            state->tess_states[0] = lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_TESS_EVAL], false);
+            state->tess_states[1] = lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_TESS_EVAL], true);
             state->pctx->bind_tes_state(state->pctx, state->tess_states[state->tess_ccw]);
          } else {
-            state->pctx->bind_tes_state(state->pctx, state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso);
+            state->pctx->bind_tes_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_TESS_EVAL], false));
          }
          if (!dynamic_tess_origin)
             state->tess_ccw = false;
          break;
       case VK_SHADER_STAGE_TASK_BIT_EXT:
-         state->pctx->bind_ts_state(state->pctx, state->shaders[MESA_SHADER_TASK]->shader_cso);
+         state->pctx->bind_ts_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_TASK], false));
          break;
       case VK_SHADER_STAGE_MESH_BIT_EXT:
-         state->pctx->bind_ms_state(state->pctx, state->shaders[MESA_SHADER_MESH]->shader_cso);
+         state->pctx->bind_ms_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_MESH], false));
          break;
       default:
          assert(0);
@@ -832,7 +833,9 @@ static void handle_graphics_pipeline(struct lvp_pipeline *pipeline,
                                      struct rendering_state *state)
 {
    const struct vk_graphics_pipeline_state *ps = &pipeline->graphics_state;
-   lvp_pipeline_shaders_compile(pipeline, true);
+   /* Other queues create their own CSOs, see lvp_shader_queue_cso() */
+   if (state->queue == &state->device->queue)
+      lvp_pipeline_shaders_compile(pipeline, true);
    bool dynamic_tess_origin = BITSET_TEST(ps->dynamic, MESA_VK_DYNAMIC_TS_DOMAIN_ORIGIN);
    unbind_graphics_stages(state,
                           (~pipeline->graphics_state.shader_stages) &
@@ -4620,9 +4623,7 @@ handle_copy_acceleration_structure(struct vk_cmd_queue_entry *cmd, struct render
    VK_FROM_HANDLE(vk_acceleration_structure, src_accel_struct, copy->info->src);
    VK_FROM_HANDLE(vk_acceleration_structure, dst_accel_struct, copy->info->dst);
 
-   struct lvp_bvh_header *src = (void *)(uintptr_t)vk_acceleration_structure_get_va(src_accel_struct);
-   struct lvp_bvh_header *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(dst_accel_struct);
-   memcpy(dst, src, src->compacted_size);
+   lvp_copy_as(dst_accel_struct, src_accel_struct);
 }
 
 static void
@@ -4632,17 +4633,7 @@ handle_copy_memory_to_acceleration_structure(struct vk_cmd_queue_entry *cmd, str
 
    VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, copy->info->dst);
 
-   struct lvp_bvh_header *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
-   const struct lvp_accel_struct_serialization_header *src = copy->info->src.hostAddress;
-
-   memcpy(dst, &src->instances[src->instance_count], src->compacted_size);
-
-   for (uint32_t i = 0; i < src->instance_count; i++) {
-      uint8_t *leaf_nodes = (uint8_t *)dst;
-      leaf_nodes += dst->leaf_nodes_offset;
-      struct lvp_bvh_instance_node *node = (struct lvp_bvh_instance_node *)leaf_nodes;
-      node[i].bvh_ptr = src->instances[i];
-   }
+   lvp_copy_memory_to_as(accel_struct, copy->info->src.hostAddress);
 }
 
 static void
@@ -4652,23 +4643,18 @@ handle_copy_acceleration_structure_to_memory(struct vk_cmd_queue_entry *cmd, str
 
    VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, copy->info->src);
 
-   struct lvp_bvh_header *src = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
-   struct lvp_accel_struct_serialization_header *dst = copy->info->dst.hostAddress;
+   lvp_copy_as_to_memory(copy->info->dst.hostAddress, accel_struct);
+}
 
-   lvp_device_get_cache_uuid(dst->driver_uuid);
-   lvp_device_get_cache_uuid(dst->accel_struct_compat);
-   dst->serialization_size = src->serialization_size;
-   dst->compacted_size = src->compacted_size;
-   dst->instance_count = src->instance_count;
+static void
+handle_build_acceleration_structures(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   struct vk_cmd_build_acceleration_structures_khr *build = &cmd->u.build_acceleration_structures_khr;
 
-   for (uint32_t i = 0; i < src->instance_count; i++) {
-      uint8_t *leaf_nodes = (uint8_t *)src;
-      leaf_nodes += src->leaf_nodes_offset;
-      struct lvp_bvh_instance_node *node = (struct lvp_bvh_instance_node *)leaf_nodes;
-      dst->instances[i] = node[i].bvh_ptr;
-   }
+   finish_fence(state);
 
-   memcpy(&dst->instances[dst->instance_count], src, src->compacted_size);
+   for (uint32_t i = 0; i < build->info_count; i++)
+      lvp_build_as_cpu(state->device, &build->infos[i], build->pp_build_range_infos[i]);
 }
 
 static void
@@ -4722,7 +4708,7 @@ lvp_trace_rays(struct rendering_state *state, VkTraceRaysIndirectCommand2KHR *co
       state->constbuf_dirty[MESA_SHADER_RAYGEN] = false;
    }
 
-   state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_RAYGEN]->shader_cso);
+   state->pctx->bind_compute_state(state->pctx, lvp_shader_queue_cso(state->queue, state->shaders[MESA_SHADER_RAYGEN], false));
 
    state->pcbuf_dirty[MESA_SHADER_COMPUTE] = true;
    state->constbuf_dirty[MESA_SHADER_COMPUTE] = true;
@@ -5478,6 +5464,9 @@ static void lvp_execute_cmd_buffer(struct list_head *cmds,
       case VK_CMD_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_KHR:
          handle_copy_acceleration_structure_to_memory(cmd, state);
          break;
+      case VK_CMD_BUILD_ACCELERATION_STRUCTURES_KHR:
+         handle_build_acceleration_structures(cmd, state);
+         break;
       case VK_CMD_BUILD_ACCELERATION_STRUCTURES_INDIRECT_KHR:
          break;
       case VK_CMD_WRITE_ACCELERATION_STRUCTURES_PROPERTIES_KHR:
@@ -5525,6 +5514,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    memset(state, 0, sizeof(*state));
    state->pctx = queue->ctx;
    state->device = device;
+   state->queue = queue;
    state->uploader = queue->uploader;
    state->cso = queue->cso;
    state->blend_dirty = true;
@@ -29,6 +29,7 @@
 #include "vk_util.h"
 #include "glsl_types.h"
 #include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
 #include "spirv/nir_spirv.h"
 #include "nir/nir_builder.h"
 #include "nir/nir_serialize.h"
@@ -41,30 +42,53 @@
 
 typedef void (*cso_destroy_func)(struct pipe_context*, void*);
 
+static void
+shader_cso_destroy(struct pipe_context *ctx, mesa_shader_stage stage, void *cso)
+{
+   cso_destroy_func destroy[] = {
+      ctx->delete_vs_state,
+      ctx->delete_tcs_state,
+      ctx->delete_tes_state,
+      ctx->delete_gs_state,
+      ctx->delete_fs_state,
+      ctx->delete_compute_state,
+      ctx->delete_ts_state,
+      ctx->delete_ms_state,
+   };
+
+   if (cso)
+      destroy[stage](ctx, cso);
+}
+
 static void
 shader_destroy(struct lvp_device *device, struct lvp_shader *shader, bool locked)
 {
    if (!shader->pipeline_nir)
       return;
    mesa_shader_stage stage = shader->pipeline_nir->nir->info.stage;
-   cso_destroy_func destroy[] = {
-      device->queue.ctx->delete_vs_state,
-      device->queue.ctx->delete_tcs_state,
-      device->queue.ctx->delete_tes_state,
-      device->queue.ctx->delete_gs_state,
-      device->queue.ctx->delete_fs_state,
-      device->queue.ctx->delete_compute_state,
-      device->queue.ctx->delete_ts_state,
-      device->queue.ctx->delete_ms_state,
-   };
+
+   /* The other queues only ever take device->queue.lock while holding their
+    * own, so theirs must not be taken while holding it.
+    */
+   for (uint32_t i = 1; i < device->queue_count; i++) {
+      struct lvp_queue *queue = device->queues[i];
+      void **csos = shader->queue_csos[i - 1];
+
+      if (!csos[0] && !csos[1])
+         continue;
+
+      assert(!locked);
+      simple_mtx_lock(&queue->lock);
+      shader_cso_destroy(queue->ctx, stage, csos[0]);
+      shader_cso_destroy(queue->ctx, stage, csos[1]);
+      simple_mtx_unlock(&queue->lock);
+   }
 
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
-   if (shader->shader_cso)
-      destroy[stage](device->queue.ctx, shader->shader_cso);
-   if (shader->tess_ccw_cso)
-      destroy[stage](device->queue.ctx, shader->tess_ccw_cso);
+   shader_cso_destroy(device->queue.ctx, stage, shader->shader_cso);
+   shader_cso_destroy(device->queue.ctx, stage, shader->tess_ccw_cso);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
@@ -120,6 +144,127 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
    }
 }
 
+struct lvp_create_pipelines_jobs {
+   VkDevice device;
+   VkPipelineCache cache;
+   const uint8_t *create_infos;
+   size_t create_info_size;
+   const VkAllocationCallbacks *alloc;
+   lvp_pipeline_create_func create;
+   VkPipeline *pipelines;
+   uint32_t count;
+   VkPipelineCreateFlagBits2KHR *flags;
+   VkResult *results;
+};
+
+static void
+lvp_create_pipeline_job(void *data, uint32_t index)
+{
+   struct lvp_create_pipelines_jobs *jobs = data;
+
+   MESA_TRACE_FUNC();
+   jobs->results[index] = jobs->create(jobs->device, jobs->cache,
+                                       jobs->create_infos + index * jobs->create_info_size,
+                                       jobs->alloc, &jobs->flags[index],
+                                       &jobs->pipelines[index]);
+}
+
+static VkResult
+lvp_create_pipelines_finish(struct lvp_create_pipelines_jobs *jobs)
+{
+   VK_FROM_HANDLE(lvp_device, device, jobs->device);
+   VkResult result = VK_SUCCESS;
+   bool early_return = false;
+
+   /* All pipelines were created, drop the ones after the first failure
+    * asking for an early return as if we had stopped there.
+    */
+   for (uint32_t i = 0; i < jobs->count; i++) {
+      if (early_return) {
+         if (jobs->pipelines[i])
+            lvp_pipeline_destroy(device, lvp_pipeline_from_handle(jobs->pipelines[i]), false);
+         jobs->pipelines[i] = VK_NULL_HANDLE;
+      } else if (jobs->results[i] != VK_SUCCESS) {
+         result = jobs->results[i];
+         jobs->pipelines[i] = VK_NULL_HANDLE;
+         early_return = jobs->flags[i] & VK_PIPELINE_CREATE_2_EARLY_RETURN_ON_FAILURE_BIT_KHR;
+      }
+   }
+
+   return result;
+}
+
+static VkResult
+lvp_create_pipelines_deferred_finish(void *data)
+{
+   struct lvp_create_pipelines_jobs *jobs = data;
+   VK_FROM_HANDLE(lvp_device, device, jobs->device);
+
+   VkResult result = lvp_create_pipelines_finish(jobs);
+   vk_free(&device->vk.alloc, jobs);
+
+   return result;
+}
+
+/**
+ * Create \p count pipelines with \p create, spread across the compile
+ * threads or, with a deferred operation, the threads joining it.
+ */
+VkResult
+lvp_create_pipelines(VkDevice _device, VkDeferredOperationKHR deferred_operation,
+                     VkPipelineCache cache, uint32_t count,
+                     const void *create_infos, size_t create_info_size,
+                     const VkAllocationCallbacks *alloc,
+                     lvp_pipeline_create_func create, VkPipeline *pipelines)
+{
+   VK_FROM_HANDLE(lvp_device, device, _device);
+   VK_FROM_HANDLE(lvp_deferred_operation, op, deferred_operation);
+   struct lvp_create_pipelines_jobs *jobs;
+
+   MESA_TRACE_FUNC();
+
+   VK_MULTIALLOC(ma);
+   vk_multialloc_add(&ma, &jobs, struct lvp_create_pipelines_jobs, 1);
+   VK_MULTIALLOC_DECL(&ma, VkPipelineCreateFlagBits2KHR, flags, count);
+   VK_MULTIALLOC_DECL(&ma, VkResult, results, count);
+   if (!vk_multialloc_zalloc(&ma, &device->vk.alloc, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)) {
+      for (uint32_t i = 0; i < count; i++)
+         pipelines[i] = VK_NULL_HANDLE;
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
+   *jobs = (struct lvp_create_pipelines_jobs) {
+      .device = _device,
+      .cache = cache,
+      .create_infos = create_infos,
+      .create_info_size = create_info_size,
+      .alloc = alloc,
+      .create = create,
+      .pipelines = pipelines,
+      .count = count,
+      .flags = flags,
+      .results = results,
+   };
+
+   if (op) {
+      VkResult result = lvp_deferred_operation_defer(op, count, lvp_create_pipeline_job,
+                                                     lvp_create_pipelines_deferred_finish, jobs);
+      if (result != VK_OPERATION_DEFERRED_KHR) {
+         vk_free(&device->vk.alloc, jobs);
+         for (uint32_t i = 0; i < count; i++)
+            pipelines[i] = VK_NULL_HANDLE;
+      }
+      return result;
+   }
+
+   lvp_parallel_for(device, count, lvp_create_pipeline_job, jobs);
+
+   VkResult result = lvp_create_pipelines_finish(jobs);
+   vk_free(&device->vk.alloc, jobs);
+
+   return result;
+}
+
 static void
 shared_var_info(const struct glsl_type *type, unsigned *size, unsigned *align)
 {
@@ -667,14 +812,14 @@ lvp_pipeline_xfb_init(struct lvp_pipeline *pipeline)
 }
 
 static void *
-lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir)
+lvp_shader_compile_stage(struct pipe_context *ctx, struct lvp_shader *shader, nir_shader *nir)
 {
    if (nir->info.stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {0};
       shstate.prog = nir;
       shstate.ir_type = PIPE_SHADER_IR_NIR;
       shstate.static_shared_mem = nir->info.shared_size;
-      return device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {0};
       shstate.type = PIPE_SHADER_IR_NIR;
@@ -683,19 +828,19 @@ lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, n
 
       switch (nir->info.stage) {
       case MESA_SHADER_FRAGMENT:
-         return device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         return device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         return device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         return device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         return device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
+         return ctx->create_tes_state(ctx, &shstate);
       case MESA_SHADER_TASK:
-         return device->queue.ctx->create_ts_state(device->queue.ctx, &shstate);
+         return ctx->create_ts_state(ctx, &shstate);
       case MESA_SHADER_MESH:
-         return device->queue.ctx->create_ms_state(device->queue.ctx, &shstate);
+         return ctx->create_ms_state(ctx, &shstate);
       default:
          UNREACHABLE("illegal shader");
          break;
@@ -713,7 +858,7 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
-   void *state = lvp_shader_compile_stage(device, shader, nir);
+   void *state = lvp_shader_compile_stage(device->queue.ctx, shader, nir);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
@@ -721,6 +866,34 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    return state;
 }
 
+/**
+ * Return the CSO to bind \p shader with on \p queue.
+ *
+ * CSOs belong to the context they were created with, since llvmpipe keeps
+ * the shader variants of each context apart.  Queues other than
+ * device->queue create their own from the shader's NIR the first time they
+ * bind it, which is called with queue->lock held.
+ */
+void *
+lvp_shader_queue_cso(struct lvp_queue *queue, struct lvp_shader *shader, bool tess_ccw)
+{
+   if (!queue->index)
+      return tess_ccw ? shader->tess_ccw_cso : shader->shader_cso;
+
+   void **cso = &shader->queue_csos[queue->index - 1][tess_ccw];
+   struct lvp_pipeline_nir *pipeline_nir = tess_ccw ? shader->tess_ccw : shader->pipeline_nir;
+
+   if (!*cso && pipeline_nir) {
+      struct lvp_device *device = lvp_queue_device(queue);
+      nir_shader *nir = nir_shader_clone(NULL, pipeline_nir->nir);
+
+      device->pscreen->finalize_nir(device->pscreen, nir, true);
+      *cso = lvp_shader_compile_stage(queue->ctx, shader, nir);
+   }
+
+   return *cso;
+}
+
 #ifndef NDEBUG
 static bool
 layouts_equal(const struct lvp_descriptor_set_layout *a, const struct lvp_descriptor_set_layout *b)
@@ -835,6 +1008,23 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
    assert(!dst->tess_ccw_cso);
 }
 
+struct lvp_stage_to_ir_jobs {
+   struct lvp_pipeline *pipeline;
+   const void *pipeline_pNext;
+   uint32_t count;
+   const VkPipelineShaderStageCreateInfo *stages[LVP_SHADER_STAGES];
+   VkResult results[LVP_SHADER_STAGES];
+};
+
+static void
+lvp_stage_to_ir_job(void *data, uint32_t index)
+{
+   struct lvp_stage_to_ir_jobs *jobs = data;
+
+   jobs->results[index] = lvp_shader_compile_to_ir(jobs->pipeline, jobs->pipeline_pNext,
+                                                   jobs->stages[index]);
+}
+
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
@@ -924,6 +1114,10 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                                                    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT |
                                                    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT));
 
+   struct lvp_stage_to_ir_jobs jobs = {
+      .pipeline = pipeline,
+      .pipeline_pNext = pCreateInfo->pNext,
+   };
    for (uint32_t i = 0; i < pCreateInfo->stageCount; i++) {
       const VkPipelineShaderStageCreateInfo *sinfo = &pCreateInfo->pStages[i];
       mesa_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
@@ -934,11 +1128,18 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, pCreateInfo->pNext, sinfo);
+      jobs.stages[jobs.count++] = sinfo;
+   }
+
+   /* The stages are independent until linking */
+   lvp_parallel_for(device, jobs.count, lvp_stage_to_ir_job, &jobs);
+
+   for (uint32_t i = 0; i < jobs.count; i++) {
+      result = jobs.results[i];
       if (result != VK_SUCCESS)
          goto fail;
 
-      switch (stage) {
+      switch (vk_to_mesa_shader_stage(jobs.stages[i]->stage)) {
       case MESA_SHADER_FRAGMENT:
          if (pipeline->shaders[MESA_SHADER_FRAGMENT].pipeline_nir->nir->info.fs.uses_sample_shading)
             pipeline->force_min_sample = true;
@@ -1013,25 +1214,65 @@ fail:
    return result;
 }
 
+struct lvp_finalize_jobs {
+   struct lvp_device *device;
+   uint32_t count;
+   const nir_shader *src[LVP_SHADER_STAGES + 1];
+   nir_shader *nir[LVP_SHADER_STAGES + 1];
+};
+
+static void
+lvp_finalize_job(void *data, uint32_t index)
+{
+   struct lvp_finalize_jobs *jobs = data;
+   struct pipe_screen *pscreen = lvp_device_physical(jobs->device)->pscreen;
+
+   jobs->nir[index] = nir_shader_clone(NULL, jobs->src[index]);
+   pscreen->finalize_nir(pscreen, jobs->nir[index], true);
+}
+
 void
 lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline, bool locked)
 {
    struct lvp_device *device = lvp_pipeline_device(pipeline);
    if (pipeline->compiled)
       return;
+
+   struct lvp_finalize_jobs jobs = { .device = device };
+   struct lvp_shader *shaders[ARRAY_SIZE(jobs.src)];
+   void **csos[ARRAY_SIZE(jobs.src)];
+
    for (uint32_t i = 0; i < ARRAY_SIZE(pipeline->shaders); i++) {
-      if (!pipeline->shaders[i].pipeline_nir)
+      struct lvp_shader *shader = &pipeline->shaders[i];
+      if (!shader->pipeline_nir)
          continue;
 
-      mesa_shader_stage stage = i;
-      assert(stage == pipeline->shaders[i].pipeline_nir->nir->info.stage);
+      assert(i == shader->pipeline_nir->nir->info.stage);
 
-      pipeline->shaders[stage].shader_cso = lvp_shader_compile(device, &pipeline->shaders[stage],
-         nir_shader_clone(NULL, pipeline->shaders[stage].pipeline_nir->nir), locked);
-      if (pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw)
-         pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw_cso = lvp_shader_compile(device, &pipeline->shaders[stage],
-            nir_shader_clone(NULL, pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw->nir), locked);
+      shaders[jobs.count] = shader;
+      csos[jobs.count] = &shader->shader_cso;
+      jobs.src[jobs.count++] = shader->pipeline_nir->nir;
+      if (i == MESA_SHADER_TESS_EVAL && shader->tess_ccw) {
+         shaders[jobs.count] = shader;
+         csos[jobs.count] = &shader->tess_ccw_cso;
+         jobs.src[jobs.count++] = shader->tess_ccw->nir;
+      }
    }
+
+   /* Only NIR finalization runs in parallel, the CSOs are created on the
+    * queue's context which needs the lock.
+    */
+   lvp_parallel_for(device, jobs.count, lvp_finalize_job, &jobs);
+
+   if (!locked)
+      simple_mtx_lock(&device->queue.lock);
+
+   for (uint32_t i = 0; i < jobs.count; i++)
+      *csos[i] = lvp_shader_compile_stage(device->queue.ctx, shaders[i], jobs.nir[i]);
+
+   if (!locked)
+      simple_mtx_unlock(&device->queue.lock);
+
    pipeline->compiled = true;
 }
 
@@ -1077,6 +1318,20 @@ lvp_graphics_pipeline_create(
    return VK_SUCCESS;
 }
 
+static VkResult
+create_graphics_pipeline(VkDevice device, VkPipelineCache cache, const void *create_info,
+                         const VkAllocationCallbacks *alloc,
+                         VkPipelineCreateFlagBits2KHR *flags, VkPipeline *pipeline)
+{
+   const VkGraphicsPipelineCreateInfo *info = create_info;
+
+   *flags = vk_graphics_pipeline_create_flags(info);
+   if (*flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR)
+      return VK_PIPELINE_COMPILE_REQUIRED;
+
+   return lvp_graphics_pipeline_create(device, cache, info, *flags, pipeline, false);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
    VkDevice                                    _device,
    VkPipelineCache                             pipelineCache,
@@ -1085,33 +1340,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
-   VkResult result = VK_SUCCESS;
-   unsigned i = 0;
-
-   for (; i < count; i++) {
-      VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
-      VkPipelineCreateFlagBits2KHR flags = vk_graphics_pipeline_create_flags(&pCreateInfos[i]);
-
-      if (!(flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR))
-         r = lvp_graphics_pipeline_create(_device,
-                                          pipelineCache,
-                                          &pCreateInfos[i],
-                                          flags,
-                                          &pPipelines[i],
-                                          false);
-      if (r != VK_SUCCESS) {
-         result = r;
-         pPipelines[i] = VK_NULL_HANDLE;
-         if (flags & VK_PIPELINE_CREATE_2_EARLY_RETURN_ON_FAILURE_BIT_KHR)
-            break;
-      }
-   }
-   if (result != VK_SUCCESS) {
-      for (; i < count; i++)
-         pPipelines[i] = VK_NULL_HANDLE;
-   }
-
-   return result;
+   return lvp_create_pipelines(_device, VK_NULL_HANDLE, pipelineCache, count,
+                               pCreateInfos, sizeof(*pCreateInfos), pAllocator,
+                               create_graphics_pipeline, pPipelines);
 }
 
 static VkResult
@@ -1181,6 +1412,20 @@ lvp_compute_pipeline_create(
    return VK_SUCCESS;
 }
 
+static VkResult
+create_compute_pipeline(VkDevice device, VkPipelineCache cache, const void *create_info,
+                        const VkAllocationCallbacks *alloc,
+                        VkPipelineCreateFlagBits2KHR *flags, VkPipeline *pipeline)
+{
+   const VkComputePipelineCreateInfo *info = create_info;
+
+   *flags = vk_compute_pipeline_create_flags(info);
+   if (*flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR)
+      return VK_PIPELINE_COMPILE_REQUIRED;
+
+   return lvp_compute_pipeline_create(device, cache, info, *flags, pipeline);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
    VkDevice                                    _device,
    VkPipelineCache                             pipelineCache,
@@ -1189,33 +1434,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
-   VkResult result = VK_SUCCESS;
-   unsigned i = 0;
-
-   for (; i < count; i++) {
-      VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
-      VkPipelineCreateFlagBits2KHR flags = vk_compute_pipeline_create_flags(&pCreateInfos[i]);
-
-      if (!(flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR))
-         r = lvp_compute_pipeline_create(_device,
-                                         pipelineCache,
-                                         &pCreateInfos[i],
-                                         flags,
-                                         &pPipelines[i]);
-      if (r != VK_SUCCESS) {
-         result = r;
-         pPipelines[i] = VK_NULL_HANDLE;
-         if (flags & VK_PIPELINE_CREATE_2_EARLY_RETURN_ON_FAILURE_BIT_KHR)
-            break;
-      }
-   }
-   if (result != VK_SUCCESS) {
-      for (; i < count; i++)
-         pPipelines[i] = VK_NULL_HANDLE;
-   }
-
-
-   return result;
+   return lvp_create_pipelines(_device, VK_NULL_HANDLE, pipelineCache, count,
+                               pCreateInfos, sizeof(*pCreateInfos), pAllocator,
+                               create_compute_pipeline, pPipelines);
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_DestroyShaderEXT(
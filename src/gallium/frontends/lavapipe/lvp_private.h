@@ -78,6 +78,7 @@ typedef uint32_t xcb_window_t;
 #include "vk_cmd_queue.h"
 #include "vk_command_buffer.h"
 #include "vk_command_pool.h"
+#include "vk_deferred_operation.h"
 #include "vk_descriptor_set_layout.h"
 #include "vk_graphics_state.h"
 #include "vk_pipeline_layout.h"
@@ -97,7 +98,8 @@ typedef uint32_t xcb_window_t;
 extern "C" {
 #endif
 
-#define LVP_NUM_QUEUES 1
+#define LVP_MAX_QUEUES_PER_FAMILY 4
+#define LVP_NUM_QUEUES (LVP_QUEUE_FAMILY_COUNT * LVP_MAX_QUEUES_PER_FAMILY)
 #define MAX_SETS 8
 #define MAX_DESCRIPTORS 1000000 /* Required by vkd3d-proton */
 #define MAX_PUSH_CONSTANTS_SIZE 256
@@ -111,6 +113,8 @@ extern "C" {
 
 #define LVP_MAX_TLAS_DEPTH 24
 #define LVP_MAX_BLAS_DEPTH 29
+#define LVP_BVH_MAX_THREADS 32
+#define LVP_COMPILE_MAX_THREADS 32
 
 #ifdef _WIN32
 #define lvp_printflike(a, b)
@@ -181,12 +185,26 @@ void lvp_finish_wsi(struct lvp_physical_device *physical_device);
 bool lvp_physical_device_extension_supported(struct lvp_physical_device *dev,
                                               const char *name);
 
+enum lvp_queue_family {
+   LVP_QUEUE_FAMILY_GRAPHICS,
+   LVP_QUEUE_FAMILY_COMPUTE,
+   LVP_QUEUE_FAMILY_TRANSFER,
+   LVP_QUEUE_FAMILY_COUNT,
+};
+
+/* Every queue executes on its own pipe_context and submit thread.
+ * lvp_device::queue is the first one created, and its context is also
+ * used for the objects created outside of command execution (shader CSOs,
+ * texture handles, host copies).
+ */
 struct lvp_queue {
    struct vk_queue vk;
+   uint32_t index; /**< in lvp_device::queues, 0 for lvp_device::queue */
    struct pipe_context *ctx;
    struct cso_context *cso;
    struct u_upload_mgr *uploader;
    struct pipe_fence_handle *last_fence;
+   void *noop_fs;
    void *state;
    struct util_dynarray pipeline_destroys;
    simple_mtx_t lock;
@@ -207,8 +225,9 @@ struct lvp_device {
    struct vk_device vk;
 
    struct lvp_queue queue;
+   struct lvp_queue *queues[LVP_NUM_QUEUES];
+   uint32_t queue_count;
    struct pipe_screen *pscreen;
-   void *noop_fs;
    simple_mtx_t bda_lock;
    struct hash_table bda;
    struct pipe_resource *zero_buffer; /* for zeroed bda */
@@ -226,6 +245,13 @@ struct lvp_device {
    radix_sort_vk_t *radix_sort;
    simple_mtx_t radix_sort_lock;
    struct vk_acceleration_structure_build_args accel_struct_args;
+
+   /* Worker threads of lvp_build_as_cpu() */
+   struct util_queue bvh_queue;
+   bool gpu_bvh_build;
+
+   /* Worker threads of lvp_parallel_for() */
+   struct util_queue compile_queue;
 };
 
 static inline const struct lvp_physical_device *
@@ -444,6 +470,8 @@ struct lvp_shader {
    struct lvp_pipeline_nir *tess_ccw;
    void *shader_cso;
    void *tess_ccw_cso;
+   /* shader_cso and tess_ccw_cso of the other queues, see lvp_shader_queue_cso() */
+   void *queue_csos[LVP_NUM_QUEUES - 1][2];
    struct pipe_stream_output_info stream_output;
    struct blob blob; //preserved for GetShaderBinaryDataEXT
    uint32_t push_constant_size;
@@ -572,6 +600,40 @@ struct lvp_exec_graph_internal_data {
 void
 lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline, bool locked);
 
+typedef VkResult (*lvp_pipeline_create_func)(VkDevice device, VkPipelineCache cache,
+                                             const void *create_info,
+                                             const VkAllocationCallbacks *alloc,
+                                             VkPipelineCreateFlagBits2KHR *flags,
+                                             VkPipeline *pipeline);
+
+VkResult
+lvp_create_pipelines(VkDevice device, VkDeferredOperationKHR deferred_operation,
+                     VkPipelineCache cache, uint32_t count,
+                     const void *create_infos, size_t create_info_size,
+                     const VkAllocationCallbacks *alloc,
+                     lvp_pipeline_create_func create, VkPipeline *pipelines);
+
+typedef void (*lvp_job_func)(void *data, uint32_t index);
+typedef VkResult (*lvp_job_finish_func)(void *data);
+
+struct lvp_deferred_operation {
+   struct vk_deferred_operation vk;
+   /* work of the last operation deferred to this object */
+   struct lvp_job_set *jobs;
+};
+
+void
+lvp_device_init_compile_queue(struct lvp_device *device);
+void
+lvp_device_finish_compile_queue(struct lvp_device *device);
+void
+lvp_parallel_for(struct lvp_device *device, uint32_t count,
+                 lvp_job_func func, void *data);
+VkResult
+lvp_deferred_operation_defer(struct lvp_deferred_operation *op, uint32_t count,
+                             lvp_job_func func, lvp_job_finish_func finish,
+                             void *data);
+
 struct lvp_event {
    struct vk_object_base base;
    volatile uint64_t event_storage;
@@ -685,6 +747,8 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_descriptor_set, base, VkDescriptorSet,
                                VK_OBJECT_TYPE_DESCRIPTOR_SET)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_descriptor_set_layout, vk.base, VkDescriptorSetLayout,
                                VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT)
+VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_deferred_operation, vk.base, VkDeferredOperationKHR,
+                               VK_OBJECT_TYPE_DEFERRED_OPERATION_KHR)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_device_memory, vk.base, VkDeviceMemory,
                                VK_OBJECT_TYPE_DEVICE_MEMORY)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
@@ -802,6 +866,9 @@ lvp_shader_optimize(nir_shader *nir);
 void *
 lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir, bool locked);
 
+void *
+lvp_shader_queue_cso(struct lvp_queue *queue, struct lvp_shader *shader, bool tess_ccw);
+
 enum vk_cmd_type
 lvp_nv_dgc_token_to_cmd_type(const VkIndirectCommandsLayoutTokenNV *token);
 
@@ -1179,6 +1179,16 @@ fail:
    return result;
 }
 
+static VkResult
+create_ray_tracing_pipeline(VkDevice device, VkPipelineCache cache, const void *create_info,
+                            const VkAllocationCallbacks *alloc,
+                            VkPipelineCreateFlagBits2KHR *flags, VkPipeline *pipeline)
+{
+   *flags = vk_rt_pipeline_create_flags(create_info);
+
+   return lvp_create_ray_tracing_pipeline(device, alloc, create_info, pipeline);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL
 lvp_CreateRayTracingPipelinesKHR(
    VkDevice device,
@@ -1189,27 +1199,9 @@ lvp_CreateRayTracingPipelinesKHR(
    const VkAllocationCallbacks *pAllocator,
    VkPipeline *pPipelines)
 {
-   VkResult result = VK_SUCCESS;
-
-   uint32_t i = 0;
-   for (; i < createInfoCount; i++) {
-      VkResult tmp_result = lvp_create_ray_tracing_pipeline(
-         device, pAllocator, pCreateInfos + i, pPipelines + i);
-
-      if (tmp_result != VK_SUCCESS) {
-         result = tmp_result;
-         pPipelines[i] = VK_NULL_HANDLE;
-
-         if (vk_rt_pipeline_create_flags(&pCreateInfos[i]) &
-             VK_PIPELINE_CREATE_2_EARLY_RETURN_ON_FAILURE_BIT_KHR)
-            break;
-      }
-   }
-
-   for (; i < createInfoCount; i++)
-      pPipelines[i] = VK_NULL_HANDLE;
-
-   return result;
+   return lvp_create_pipelines(device, deferredOperation, pipelineCache, createInfoCount,
+                               pCreateInfos, sizeof(*pCreateInfos), pAllocator,
+                               create_ray_tracing_pipeline, pPipelines);
 }
 
 
@@ -0,0 +1,327 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Time vkCmdBuildAccelerationStructuresKHR on a triangle BLAS through the
+ * lavapipe entrypoints.
+ *
+ * Usage: lvp_bvh_build_bench [number of triangles] [runs]
+ *
+ * This measures whichever builder the device uses: lvp_build_as_cpu() by
+ * default, or the vulkan/runtime/bvh compute shaders with
+ * LVP_BVH_BUILD_GPU=1.  Run it both ways to compare them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan_core.h>
+
+#include "pipe/p_screen.h"
+#include "util/macros.h"
+#include "util/os_time.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+
+/* lavapipe's entrypoints pull in its pipe loader, which calls the screen
+ * creation every gallium target defines.
+ */
+#include "target-helpers/sw_helper.h"
+
+PUBLIC VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+vk_icdGetInstanceProcAddr(VkInstance instance, const char *pName);
+
+#define CHECK(expr)                                                     \
+   do {                                                                 \
+      VkResult _result = (expr);                                        \
+      if (_result != VK_SUCCESS) {                                      \
+         fprintf(stderr, "%s failed: %d\n", #expr, _result);            \
+         exit(1);                                                       \
+      }                                                                 \
+   } while (0)
+
+#define INSTANCE_PROC(name) \
+   PFN_##name name = (PFN_##name)vk_icdGetInstanceProcAddr(instance, #name)
+#define DEVICE_PROC(name) \
+   PFN_##name name = (PFN_##name)vkGetDeviceProcAddr(device, #name)
+
+struct bench_buffer {
+   VkBuffer buffer;
+   VkDeviceMemory memory;
+   VkDeviceAddress address;
+   void *map;
+};
+
+struct bench_context {
+   VkDevice device;
+   VkPhysicalDevice physical_device;
+   PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr;
+   PFN_vkGetPhysicalDeviceMemoryProperties vkGetPhysicalDeviceMemoryProperties;
+};
+
+static void
+buffer_create(const struct bench_context *ctx, struct bench_buffer *buf,
+              VkDeviceSize size, VkBufferUsageFlags usage)
+{
+   VkDevice device = ctx->device;
+   PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr = ctx->vkGetDeviceProcAddr;
+   DEVICE_PROC(vkCreateBuffer);
+   DEVICE_PROC(vkGetBufferMemoryRequirements);
+   DEVICE_PROC(vkAllocateMemory);
+   DEVICE_PROC(vkBindBufferMemory);
+   DEVICE_PROC(vkMapMemory);
+   DEVICE_PROC(vkGetBufferDeviceAddress);
+
+   const VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = size,
+      .usage = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+   };
+   CHECK(vkCreateBuffer(device, &buffer_info, NULL, &buf->buffer));
+
+   VkMemoryRequirements reqs;
+   vkGetBufferMemoryRequirements(device, buf->buffer, &reqs);
+
+   VkPhysicalDeviceMemoryProperties props;
+   ctx->vkGetPhysicalDeviceMemoryProperties(ctx->physical_device, &props);
+
+   const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+   uint32_t type = 0;
+   while ((props.memoryTypes[type].propertyFlags & flags) != flags ||
+          !(reqs.memoryTypeBits & BITFIELD_BIT(type)))
+      type++;
+
+   const VkMemoryAllocateFlagsInfo flags_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+      .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+   };
+   const VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .pNext = &flags_info,
+      .allocationSize = reqs.size,
+      .memoryTypeIndex = type,
+   };
+   CHECK(vkAllocateMemory(device, &alloc_info, NULL, &buf->memory));
+   CHECK(vkBindBufferMemory(device, buf->buffer, buf->memory, 0));
+   CHECK(vkMapMemory(device, buf->memory, 0, VK_WHOLE_SIZE, 0, &buf->map));
+
+   const VkBufferDeviceAddressInfo address_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+      .buffer = buf->buffer,
+   };
+   buf->address = vkGetBufferDeviceAddress(device, &address_info);
+}
+
+static void
+buffer_destroy(const struct bench_context *ctx, struct bench_buffer *buf)
+{
+   VkDevice device = ctx->device;
+   PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr = ctx->vkGetDeviceProcAddr;
+   DEVICE_PROC(vkDestroyBuffer);
+   DEVICE_PROC(vkFreeMemory);
+
+   vkDestroyBuffer(device, buf->buffer, NULL);
+   vkFreeMemory(device, buf->memory, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   const uint32_t num_triangles = argc > 1 ? atoi(argv[1]) : 1000000;
+   const unsigned num_runs = argc > 2 ? atoi(argv[2]) : 3;
+   VkInstance instance = VK_NULL_HANDLE;
+
+   INSTANCE_PROC(vkCreateInstance);
+
+   const VkApplicationInfo app_info = {
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .apiVersion = VK_API_VERSION_1_3,
+   };
+   const VkInstanceCreateInfo instance_info = {
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &app_info,
+   };
+   CHECK(vkCreateInstance(&instance_info, NULL, &instance));
+
+   INSTANCE_PROC(vkDestroyInstance);
+   INSTANCE_PROC(vkEnumeratePhysicalDevices);
+   INSTANCE_PROC(vkCreateDevice);
+   INSTANCE_PROC(vkGetDeviceProcAddr);
+   INSTANCE_PROC(vkGetPhysicalDeviceMemoryProperties);
+
+   uint32_t count = 1;
+   VkPhysicalDevice physical_device;
+   CHECK(vkEnumeratePhysicalDevices(instance, &count, &physical_device));
+
+   VkPhysicalDeviceAccelerationStructureFeaturesKHR as_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
+      .accelerationStructure = true,
+   };
+   VkPhysicalDeviceVulkan12Features features12 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .pNext = &as_features,
+      .bufferDeviceAddress = true,
+   };
+   static const char *extensions[] = {
+      VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+      VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+   };
+   const float priority = 1.0f;
+   const VkDeviceQueueCreateInfo queue_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueCount = 1,
+      .pQueuePriorities = &priority,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &features12,
+      .queueCreateInfoCount = 1,
+      .pQueueCreateInfos = &queue_info,
+      .enabledExtensionCount = ARRAY_SIZE(extensions),
+      .ppEnabledExtensionNames = extensions,
+   };
+   VkDevice device;
+   CHECK(vkCreateDevice(physical_device, &device_info, NULL, &device));
+
+   const struct bench_context ctx = {
+      .device = device,
+      .physical_device = physical_device,
+      .vkGetDeviceProcAddr = vkGetDeviceProcAddr,
+      .vkGetPhysicalDeviceMemoryProperties = vkGetPhysicalDeviceMemoryProperties,
+   };
+
+   DEVICE_PROC(vkDestroyDevice);
+   DEVICE_PROC(vkGetDeviceQueue);
+   DEVICE_PROC(vkCreateCommandPool);
+   DEVICE_PROC(vkDestroyCommandPool);
+   DEVICE_PROC(vkAllocateCommandBuffers);
+   DEVICE_PROC(vkBeginCommandBuffer);
+   DEVICE_PROC(vkEndCommandBuffer);
+   DEVICE_PROC(vkResetCommandBuffer);
+   DEVICE_PROC(vkQueueSubmit);
+   DEVICE_PROC(vkQueueWaitIdle);
+   DEVICE_PROC(vkGetAccelerationStructureBuildSizesKHR);
+   DEVICE_PROC(vkCreateAccelerationStructureKHR);
+   DEVICE_PROC(vkDestroyAccelerationStructureKHR);
+   DEVICE_PROC(vkCmdBuildAccelerationStructuresKHR);
+
+   /* Small random triangles spread over a cube, like a tessellated scene */
+   struct bench_buffer vertices;
+   buffer_create(&ctx, &vertices, (VkDeviceSize)num_triangles * 9 * sizeof(float),
+                 VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+   float *v = vertices.map;
+   srand(0xb7b);
+   for (uint32_t i = 0; i < num_triangles; i++) {
+      float center[3];
+      for (unsigned c = 0; c < 3; c++)
+         center[c] = (float)rand() / RAND_MAX * 100.0f;
+      for (unsigned j = 0; j < 9; j++)
+         *v++ = center[j % 3] + (float)rand() / RAND_MAX;
+   }
+
+   const VkAccelerationStructureGeometryKHR geometry = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+      .geometry.triangles = {
+         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+         .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+         .vertexData.deviceAddress = vertices.address,
+         .vertexStride = 3 * sizeof(float),
+         .maxVertex = num_triangles * 3 - 1,
+         .indexType = VK_INDEX_TYPE_NONE_KHR,
+      },
+      .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+   };
+   VkAccelerationStructureBuildGeometryInfoKHR build_info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+      .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+      .flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
+      .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+      .geometryCount = 1,
+      .pGeometries = &geometry,
+   };
+   VkAccelerationStructureBuildSizesInfoKHR sizes = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+   };
+   vkGetAccelerationStructureBuildSizesKHR(device,
+                                           VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                                           &build_info, &num_triangles, &sizes);
+
+   struct bench_buffer as_buffer, scratch;
+   buffer_create(&ctx, &as_buffer, sizes.accelerationStructureSize,
+                 VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
+   buffer_create(&ctx, &scratch, MAX2(sizes.buildScratchSize, 1),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+   const VkAccelerationStructureCreateInfoKHR as_info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+      .buffer = as_buffer.buffer,
+      .size = sizes.accelerationStructureSize,
+      .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+   };
+   VkAccelerationStructureKHR as;
+   CHECK(vkCreateAccelerationStructureKHR(device, &as_info, NULL, &as));
+   build_info.dstAccelerationStructure = as;
+   build_info.scratchData.deviceAddress = scratch.address;
+
+   VkQueue queue;
+   vkGetDeviceQueue(device, 0, 0, &queue);
+
+   const VkCommandPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+   };
+   VkCommandPool pool;
+   CHECK(vkCreateCommandPool(device, &pool_info, NULL, &pool));
+
+   const VkCommandBufferAllocateInfo cmd_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+   };
+   VkCommandBuffer cmd;
+   CHECK(vkAllocateCommandBuffers(device, &cmd_info, &cmd));
+
+   const VkAccelerationStructureBuildRangeInfoKHR range = {
+      .primitiveCount = num_triangles,
+   };
+   const VkAccelerationStructureBuildRangeInfoKHR *ranges = &range;
+   const VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+   };
+   const VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &cmd,
+   };
+   int64_t best = INT64_MAX;
+
+   for (unsigned run = 0; run < num_runs; run++) {
+      CHECK(vkResetCommandBuffer(cmd, 0));
+      CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+      vkCmdBuildAccelerationStructuresKHR(cmd, 1, &build_info, &ranges);
+      CHECK(vkEndCommandBuffer(cmd));
+
+      int64_t start = os_time_get_nano();
+      CHECK(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE));
+      CHECK(vkQueueWaitIdle(queue));
+      best = MIN2(best, os_time_get_nano() - start);
+   }
+
+   printf("%s builder, %u triangles: %.1f ms\n",
+          debug_get_bool_option("LVP_BVH_BUILD_GPU", false) ? "compute shader" : "CPU",
+          num_triangles, best / 1000000.0);
+
+   vkDestroyCommandPool(device, pool, NULL);
+   vkDestroyAccelerationStructureKHR(device, as, NULL);
+   buffer_destroy(&ctx, &scratch);
+   buffer_destroy(&ctx, &as_buffer);
+   buffer_destroy(&ctx, &vertices);
+   vkDestroyDevice(device, NULL);
+   vkDestroyInstance(instance, NULL);
+
+   return 0;
+}
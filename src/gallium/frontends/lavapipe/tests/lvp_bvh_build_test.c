@@ -0,0 +1,467 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Build acceleration structures with lvp_build_as_cpu() and traverse them.
+ *
+ * Every tree is walked to check that each box contains its children, that
+ * each active primitive is reachable exactly once and that the depth stays
+ * within LVP_MAX_BLAS_DEPTH.  Triangle BLASes are then traced with random
+ * rays, and the closest hit is compared against a brute force search of the
+ * input triangles.
+ */
+
+#include <stdio.h>
+
+#include "lvp_acceleration_structure.h"
+
+#include "util/u_math.h"
+#include "util/u_queue.h"
+
+/* lavapipe's entrypoints pull in its pipe loader, which calls the screen
+ * creation every gallium target defines.
+ */
+#include "target-helpers/sw_helper.h"
+
+#define NUM_RAYS 1024
+
+struct bvh_buffer {
+   struct vk_buffer buffer;
+   struct vk_acceleration_structure accel_struct;
+   uint8_t *data;
+};
+
+struct walk_state {
+   const uint8_t *data;
+   const struct lvp_bvh_header *header;
+   uint32_t leaf_nodes_offset;
+   uint32_t num_leaves;
+   uint8_t *reached;
+   bool success;
+};
+
+static bool failed;
+
+#define CHECK(cond)                                                  \
+   do {                                                              \
+      if (!(cond)) {                                                 \
+         fprintf(stderr, "%s:%d: check `%s' failed\n",               \
+                 __FILE__, __LINE__, #cond);                         \
+         failed = true;                                              \
+         return;                                                     \
+      }                                                              \
+   } while (0)
+
+static uint32_t rand_state = 1;
+
+static float
+rand_float(void)
+{
+   rand_state = rand_state * 1103515245 + 12345;
+   return (float)(rand_state >> 8) / (float)(1 << 24);
+}
+
+static void
+bvh_buffer_init(struct bvh_buffer *buf, VkGeometryTypeKHR geometry_type,
+                uint32_t num_leaves)
+{
+   const VkDeviceSize size = lvp_get_as_size_internal(geometry_type, num_leaves);
+
+   buf->data = calloc(1, size);
+   buf->buffer = (struct vk_buffer) {
+      .device_address = (uintptr_t)buf->data,
+      .size = size,
+   };
+   buf->accel_struct = (struct vk_acceleration_structure) {
+      .base.type = VK_OBJECT_TYPE_ACCELERATION_STRUCTURE_KHR,
+      .buffer = &buf->buffer,
+      .size = size,
+   };
+}
+
+static void
+bvh_build(struct lvp_device *device, struct bvh_buffer *buf,
+          const VkAccelerationStructureGeometryKHR *geom, uint32_t num_leaves)
+{
+   bvh_buffer_init(buf, geom->geometryType, num_leaves);
+
+   const VkAccelerationStructureBuildGeometryInfoKHR info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+      .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+      .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+      .dstAccelerationStructure = vk_acceleration_structure_to_handle(&buf->accel_struct),
+      .geometryCount = 1,
+      .pGeometries = geom,
+   };
+   const VkAccelerationStructureBuildRangeInfoKHR range = {
+      .primitiveCount = num_leaves,
+   };
+
+   lvp_build_as_cpu(device, &info, &range);
+}
+
+static bool
+aabb_contains(const vk_aabb *outer, const vk_aabb *inner)
+{
+   return outer->min.x <= inner->min.x && outer->max.x >= inner->max.x &&
+          outer->min.y <= inner->min.y && outer->max.y >= inner->max.y &&
+          outer->min.z <= inner->min.z && outer->max.z >= inner->max.z;
+}
+
+static void
+leaf_bounds(const uint8_t *data, uint32_t node, vk_aabb *bounds)
+{
+   const void *leaf = data + (node & ~7u);
+
+   if ((node & 7) == lvp_bvh_node_aabb) {
+      *bounds = ((const struct lvp_bvh_aabb_node *)leaf)->bounds;
+      return;
+   }
+
+   const struct lvp_bvh_triangle_node *tri = leaf;
+   bounds->min = bounds->max = (vec3){
+      tri->coords[0][0], tri->coords[0][1], tri->coords[0][2],
+   };
+   for (unsigned i = 1; i < 3; i++) {
+      bounds->min.x = MIN2(bounds->min.x, tri->coords[i][0]);
+      bounds->min.y = MIN2(bounds->min.y, tri->coords[i][1]);
+      bounds->min.z = MIN2(bounds->min.z, tri->coords[i][2]);
+      bounds->max.x = MAX2(bounds->max.x, tri->coords[i][0]);
+      bounds->max.y = MAX2(bounds->max.y, tri->coords[i][1]);
+      bounds->max.z = MAX2(bounds->max.z, tri->coords[i][2]);
+   }
+}
+
+static void
+walk(struct walk_state *s, uint32_t node, const vk_aabb *bounds, uint32_t depth)
+{
+   if (!s->success || node == LVP_BVH_INVALID_NODE)
+      return;
+
+   const uint32_t offset = node & ~7u;
+
+   if ((node & 7) != lvp_bvh_node_internal) {
+      const uint32_t slot = (offset - s->leaf_nodes_offset) /
+         ((node & 7) == lvp_bvh_node_aabb ? sizeof(struct lvp_bvh_aabb_node) :
+                                            sizeof(struct lvp_bvh_triangle_node));
+      vk_aabb b;
+
+      leaf_bounds(s->data, node, &b);
+      s->success = offset >= s->leaf_nodes_offset && slot < s->num_leaves &&
+                   !s->reached[slot]++ && aabb_contains(bounds, &b) &&
+                   aabb_contains(&s->header->bounds, &b);
+      return;
+   }
+
+   const struct lvp_bvh_box_node *box = (const void *)(s->data + offset);
+
+   if (offset < LVP_BVH_ROOT_NODE_OFFSET || offset >= s->leaf_nodes_offset ||
+       depth > LVP_MAX_BLAS_DEPTH) {
+      s->success = false;
+      return;
+   }
+
+   for (unsigned i = 0; i < 2; i++) {
+      if (box->children[i] != LVP_BVH_INVALID_NODE &&
+          !aabb_contains(bounds, &box->bounds[i])) {
+         s->success = false;
+         return;
+      }
+      walk(s, box->children[i], &box->bounds[i], depth + 1);
+   }
+}
+
+/**
+ * Walk the whole tree, and check that exactly the primitives which aren't
+ * set in \p inactive are reached.
+ */
+static void
+check_tree(const struct bvh_buffer *buf, VkGeometryTypeKHR geometry_type,
+           uint32_t num_leaves, const bool *inactive)
+{
+   const struct lvp_bvh_header *header = (const void *)buf->data;
+   const vk_aabb everything = {
+      .min = { -INFINITY, -INFINITY, -INFINITY },
+      .max = { INFINITY, INFINITY, INFINITY },
+   };
+   struct walk_state s = {
+      .data = buf->data,
+      .header = header,
+      .leaf_nodes_offset = header->leaf_nodes_offset,
+      .num_leaves = num_leaves,
+      .reached = calloc(MAX2(num_leaves, 1), 1),
+      .success = true,
+   };
+
+   walk(&s, LVP_BVH_ROOT_NODE, &everything, 0);
+
+   for (uint32_t i = 0; i < num_leaves && s.success; i++)
+      s.success = s.reached[i] == (inactive && inactive[i] ? 0 : 1);
+
+   free(s.reached);
+
+   CHECK(s.success);
+   CHECK(header->leaf_nodes_offset ==
+         LVP_BVH_ROOT_NODE_OFFSET +
+         (MAX2(num_leaves, 2) - 1) * sizeof(struct lvp_bvh_box_node));
+   CHECK(header->compacted_size ==
+         lvp_get_as_size_internal(geometry_type, num_leaves));
+}
+
+
+/*
+ * Ray tracing
+ */
+
+struct ray {
+   float origin[3];
+   float dir[3];
+   float inv_dir[3];
+};
+
+static bool
+ray_box(const struct ray *ray, const vk_aabb *box, float t_max)
+{
+   const float *min = &box->min.x;
+   const float *max = &box->max.x;
+   float t0 = 0.0f, t1 = t_max;
+
+   for (unsigned i = 0; i < 3; i++) {
+      float near = (min[i] - ray->origin[i]) * ray->inv_dir[i];
+      float far = (max[i] - ray->origin[i]) * ray->inv_dir[i];
+      t0 = MAX2(t0, MIN2(near, far));
+      t1 = MIN2(t1, MAX2(near, far));
+   }
+
+   return t0 <= t1;
+}
+
+/** Möller–Trumbore; returns INFINITY on a miss. */
+static float
+ray_triangle(const struct ray *ray, const float coords[3][3])
+{
+   const float *v0 = coords[0];
+   float e1[3], e2[3], p[3], s[3], q[3];
+
+   for (unsigned i = 0; i < 3; i++) {
+      e1[i] = coords[1][i] - v0[i];
+      e2[i] = coords[2][i] - v0[i];
+      s[i] = ray->origin[i] - v0[i];
+   }
+
+   p[0] = ray->dir[1] * e2[2] - ray->dir[2] * e2[1];
+   p[1] = ray->dir[2] * e2[0] - ray->dir[0] * e2[2];
+   p[2] = ray->dir[0] * e2[1] - ray->dir[1] * e2[0];
+
+   const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+   if (fabsf(det) < 1e-12f)
+      return INFINITY;
+
+   const float inv_det = 1.0f / det;
+   const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+   if (u < 0.0f || u > 1.0f)
+      return INFINITY;
+
+   q[0] = s[1] * e1[2] - s[2] * e1[1];
+   q[1] = s[2] * e1[0] - s[0] * e1[2];
+   q[2] = s[0] * e1[1] - s[1] * e1[0];
+
+   const float v = (ray->dir[0] * q[0] + ray->dir[1] * q[1] + ray->dir[2] * q[2]) * inv_det;
+   if (v < 0.0f || u + v > 1.0f)
+      return INFINITY;
+
+   const float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+   return t >= 0.0f ? t : INFINITY;
+}
+
+static float
+trace_bvh(const uint8_t *data, const struct ray *ray)
+{
+   uint32_t stack[LVP_MAX_BLAS_DEPTH + 1];
+   unsigned top = 0;
+   float t_hit = INFINITY;
+
+   stack[top++] = LVP_BVH_ROOT_NODE;
+
+   while (top) {
+      const uint32_t node = stack[--top];
+      const void *ptr = data + (node & ~7u);
+
+      if ((node & 7) == lvp_bvh_node_triangle) {
+         const struct lvp_bvh_triangle_node *tri = ptr;
+         t_hit = MIN2(t_hit, ray_triangle(ray, tri->coords));
+         continue;
+      }
+
+      const struct lvp_bvh_box_node *box = ptr;
+      for (unsigned i = 0; i < 2; i++) {
+         if (box->children[i] != LVP_BVH_INVALID_NODE &&
+             ray_box(ray, &box->bounds[i], t_hit)) {
+            assert(top < ARRAY_SIZE(stack));
+            stack[top++] = box->children[i];
+         }
+      }
+   }
+
+   return t_hit;
+}
+
+static float
+trace_brute_force(const float (*vertices)[3][3], const bool *inactive,
+                  uint32_t num_leaves, const struct ray *ray)
+{
+   float t_hit = INFINITY;
+
+   for (uint32_t i = 0; i < num_leaves; i++) {
+      if (!inactive[i])
+         t_hit = MIN2(t_hit, ray_triangle(ray, vertices[i]));
+   }
+
+   return t_hit;
+}
+
+static void
+check_rays(const struct bvh_buffer *buf, const float (*vertices)[3][3],
+           const bool *inactive, uint32_t num_leaves)
+{
+   unsigned hits = 0;
+
+   for (unsigned r = 0; r < NUM_RAYS; r++) {
+      struct ray ray;
+      float len = 0.0f;
+
+      for (unsigned i = 0; i < 3; i++) {
+         ray.origin[i] = rand_float() * 1.2f - 0.1f;
+         ray.dir[i] = rand_float() * 2.0f - 1.0f;
+         len += ray.dir[i] * ray.dir[i];
+      }
+      for (unsigned i = 0; i < 3; i++) {
+         ray.dir[i] /= sqrtf(len);
+         ray.inv_dir[i] = 1.0f / ray.dir[i];
+      }
+
+      const float expected = trace_brute_force(vertices, inactive, num_leaves, &ray);
+      const float t = trace_bvh(buf->data, &ray);
+
+      CHECK(t == expected);
+      hits += expected != INFINITY;
+   }
+
+   /* Make sure the rays actually exercise the traversal. */
+   CHECK(num_leaves < 1000 || hits > NUM_RAYS / 4);
+}
+
+
+/*
+ * Tests
+ */
+
+static void
+test_triangles(struct lvp_device *device, uint32_t num_leaves)
+{
+   float (*vertices)[3][3] = malloc(MAX2(num_leaves, 1) * sizeof(*vertices));
+   bool *inactive = calloc(MAX2(num_leaves, 1), sizeof(bool));
+   const float size = 4.0f / sqrtf(MAX2(num_leaves, 1));
+
+   for (uint32_t i = 0; i < num_leaves; i++) {
+      const float center[3] = { rand_float(), rand_float(), rand_float() };
+
+      for (unsigned v = 0; v < 3; v++) {
+         for (unsigned c = 0; c < 3; c++)
+            vertices[i][v][c] = center[c] + (rand_float() - 0.5f) * size;
+      }
+
+      /* A few inactive triangles. */
+      if (i % 97 == 13) {
+         vertices[i][i % 3][i % 2] = NAN;
+         inactive[i] = true;
+      }
+   }
+
+   const VkAccelerationStructureGeometryKHR geom = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+      .geometry.triangles = {
+         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+         .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+         .vertexData.deviceAddress = (uintptr_t)vertices,
+         .vertexStride = 3 * sizeof(float),
+         .maxVertex = MAX2(num_leaves * 3, 1) - 1,
+         .indexType = VK_INDEX_TYPE_NONE_KHR,
+      },
+   };
+   struct bvh_buffer buf;
+
+   bvh_build(device, &buf, &geom, num_leaves);
+   check_tree(&buf, VK_GEOMETRY_TYPE_TRIANGLES_KHR, num_leaves, inactive);
+   check_rays(&buf, (const float (*)[3][3])vertices, inactive, num_leaves);
+
+   free(buf.data);
+   free(inactive);
+   free(vertices);
+}
+
+static void
+test_aabbs(struct lvp_device *device, uint32_t num_leaves)
+{
+   VkAabbPositionsKHR *aabbs = malloc(MAX2(num_leaves, 1) * sizeof(*aabbs));
+
+   for (uint32_t i = 0; i < num_leaves; i++) {
+      const float x = rand_float(), y = rand_float(), z = rand_float();
+      const float size = rand_float() * 0.01f;
+
+      aabbs[i] = (VkAabbPositionsKHR) {
+         x, y, z, x + size, y + size, z + size,
+      };
+   }
+
+   const VkAccelerationStructureGeometryKHR geom = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType = VK_GEOMETRY_TYPE_AABBS_KHR,
+      .geometry.aabbs = {
+         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR,
+         .data.deviceAddress = (uintptr_t)aabbs,
+         .stride = sizeof(*aabbs),
+      },
+   };
+   struct bvh_buffer buf;
+
+   bvh_build(device, &buf, &geom, num_leaves);
+   check_tree(&buf, VK_GEOMETRY_TYPE_AABBS_KHR, num_leaves, NULL);
+
+   free(buf.data);
+   free(aabbs);
+}
+
+static void
+test_all(struct lvp_device *device)
+{
+   static const uint32_t counts[] = { 0, 1, 2, 3, 17, 1000, 50000 };
+
+   for (unsigned i = 0; i < ARRAY_SIZE(counts); i++) {
+      test_triangles(device, counts[i]);
+      test_aabbs(device, counts[i]);
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   struct lvp_device *device = calloc(1, sizeof(*device));
+
+   /* Single threaded, then with worker threads. */
+   test_all(device);
+
+   if (!util_queue_init(&device->bvh_queue, "lvp_bvh", 16, 4,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL))
+      return 1;
+
+   test_all(device);
+
+   util_queue_destroy(&device->bvh_queue);
+   free(device);
+
+   printf("%s\n", failed ? "FAIL" : "PASS");
+   return failed ? 1 : 0;
+}
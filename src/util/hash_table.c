@@ -33,7 +33,8 @@
  */
 
 /**
- * Implements an open-addressing, linear-reprobing hash table.
+ * Implements an open-addressing hash table, probed a group of entries at a
+ * time through an array of control bytes, see hash_table_ctrl.h.
  *
  * For more information, see:
  *
@@ -45,10 +46,11 @@
 #include <assert.h>
 
 #include "hash_table.h"
+#include "hash_table_ctrl.h"
 #include "ralloc.h"
 #include "macros.h"
 #include "u_memory.h"
-#include "fast_urem_by_const.h"
+#include "util/bitscan.h"
 #include "util/u_memory.h"
 
 #define XXH_INLINE_ALL
@@ -75,67 +77,6 @@ uint_key(unsigned id)
 
 static const uint32_t deleted_key_value;
 
-/**
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
- */
-static const struct {
-   uint32_t max_entries, size, rehash;
-   uint64_t size_magic, rehash_magic;
-} hash_sizes[] = {
-#define ENTRY(max_entries, size, rehash) \
-   { max_entries, size, rehash, \
-      REMAINDER_MAGIC(size), REMAINDER_MAGIC(rehash) }
-
-   /* Starting with only 2 entries at initialization causes a lot of table
-    * reallocations and rehashing while growing the table.
-    *
-    * Below are results from counting reallocations when compiling
-    * my GLSL shader-db on radeonsi+ACO.
-    *
-    * 2 entries is the baseline.
-    * Starting with  4 entries reduces reallocations to 70%.
-    * Starting with  8 entries reduces reallocations to 48%.
-    * Starting with 16 entries reduces reallocations to 33%.
-    * Starting with 32 entries reduces reallocations to 21%.
-    * Starting with 64 entries reduces reallocations to 13%.
-    */
-#if 0 /* Start with 16 entries. */
-   ENTRY(2,            5,            3            ),
-   ENTRY(4,            7,            5            ),
-   ENTRY(8,            13,           11           ),
-#endif
-   ENTRY(16,           19,           17           ),
-   ENTRY(32,           43,           41           ),
-   ENTRY(64,           73,           71           ),
-   ENTRY(128,          151,          149          ),
-   ENTRY(256,          283,          281          ),
-   ENTRY(512,          571,          569          ),
-   ENTRY(1024,         1153,         1151         ),
-   ENTRY(2048,         2269,         2267         ),
-   ENTRY(4096,         4519,         4517         ),
-   ENTRY(8192,         9013,         9011         ),
-   ENTRY(16384,        18043,        18041        ),
-   ENTRY(32768,        36109,        36107        ),
-   ENTRY(65536,        72091,        72089        ),
-   ENTRY(131072,       144409,       144407       ),
-   ENTRY(262144,       288361,       288359       ),
-   ENTRY(524288,       576883,       576881       ),
-   ENTRY(1048576,      1153459,      1153457      ),
-   ENTRY(2097152,      2307163,      2307161      ),
-   ENTRY(4194304,      4613893,      4613891      ),
-   ENTRY(8388608,      9227641,      9227639      ),
-   ENTRY(16777216,     18455029,     18455027     ),
-   ENTRY(33554432,     36911011,     36911009     ),
-   ENTRY(67108864,     73819861,     73819859     ),
-   ENTRY(134217728,    147639589,    147639587    ),
-   ENTRY(268435456,    295279081,    295279079    ),
-   ENTRY(536870912,    590559793,    590559791    ),
-   ENTRY(1073741824,   1181116273,   1181116271   ),
-   ENTRY(2147483648ul, 2362232233ul, 2362232231ul )
-};
-
 ASSERTED static inline bool
 key_pointer_is_reserved(const struct hash_table *ht, const void *key)
 {
@@ -143,21 +84,30 @@ key_pointer_is_reserved(const struct hash_table *ht, const void *key)
 }
 
 static int
-entry_is_free(const struct hash_entry *entry)
+entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
+{
+   return entry->key != NULL && entry->key != ht->deleted_key;
+}
+
+static inline uint8_t *
+hash_table_ctrl(const struct hash_table *ht)
 {
-   return entry->key == NULL;
+   return (uint8_t *)(ht->table + ht->size);
 }
 
-static int
-entry_is_deleted(const struct hash_table *ht, struct hash_entry *entry)
+/* The entries followed by their control bytes */
+static inline size_t
+hash_table_storage_size(uint32_t size)
 {
-   return entry->key == ht->deleted_key;
+   return (size_t)size * (sizeof(struct hash_entry) + 1);
 }
 
-static int
-entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
+static void
+hash_table_set_size(struct hash_table *ht, unsigned size_index)
 {
-   return entry->key != NULL && entry->key != ht->deleted_key;
+   ht->size_index = size_index;
+   ht->size = ht_size(size_index);
+   ht->max_entries = ht_max_entries(size_index);
 }
 
 void
@@ -167,18 +117,18 @@ _mesa_hash_table_init(struct hash_table *ht,
                       bool (*key_equals_function)(const void *a,
                                                   const void *b))
 {
+   STATIC_ASSERT(offsetof(struct hash_table, _initial_ctrl) ==
+                 offsetof(struct hash_table, _initial_storage) +
+                 sizeof(ht->_initial_storage));
+
    ht->mem_ctx = mem_ctx;
-   ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   hash_table_set_size(ht, 0);
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
    assert(ht->size == ARRAY_SIZE(ht->_initial_storage));
    ht->table = ht->_initial_storage;
    memset(ht->table, 0, sizeof(ht->_initial_storage));
+   memset(ht->_initial_ctrl, HT_CTRL_EMPTY, sizeof(ht->_initial_ctrl));
    ht->entries = 0;
    ht->deleted_entries = 0;
    ht->deleted_key = &deleted_key_value;
@@ -241,14 +191,15 @@ _mesa_hash_table_copy(struct hash_table *dst, struct hash_table *src,
    dst->mem_ctx = dst_mem_ctx;
 
    if (src->table != src->_initial_storage) {
-      dst->table = ralloc_array(dst_mem_ctx, struct hash_entry, dst->size);
+      dst->table = ralloc_size(dst_mem_ctx, hash_table_storage_size(dst->size));
       if (dst->table == NULL)
          return false;
 
-      memcpy(dst->table, src->table, dst->size * sizeof(struct hash_entry));
+      memcpy(dst->table, src->table, hash_table_storage_size(dst->size));
    } else {
       dst->table = dst->_initial_storage;
-      memcpy(dst->table, src->_initial_storage, sizeof(src->_initial_storage));
+      memcpy(dst->table, src->_initial_storage,
+             sizeof(src->_initial_storage) + sizeof(src->_initial_ctrl));
    }
 
    return true;
@@ -314,7 +265,8 @@ _mesa_hash_table_destroy(struct hash_table *ht,
 static void
 hash_table_clear_fast(struct hash_table *ht)
 {
-   memset(ht->table, 0, sizeof(struct hash_entry) * hash_sizes[ht->size_index].size);
+   memset(ht->table, 0, sizeof(struct hash_entry) * ht->size);
+   memset(hash_table_ctrl(ht), HT_CTRL_EMPTY, ht->size);
    ht->entries = ht->deleted_entries = 0;
 }
 
@@ -331,19 +283,12 @@ _mesa_hash_table_clear(struct hash_table *ht,
    if (!ht)
       return;
 
-   struct hash_entry *entry;
-
    if (delete_function) {
-      for (entry = ht->table; entry != ht->table + ht->size; entry++) {
-         if (entry_is_present(ht, entry))
-            delete_function(entry);
+      hash_table_foreach(ht, entry)
+         delete_function(entry);
+   }
 
-         entry->key = NULL;
-      }
-      ht->entries = 0;
-      ht->deleted_entries = 0;
-   } else
-      hash_table_clear_fast(ht);
+   hash_table_clear_fast(ht);
 }
 
 /** Sets the value of the key pointer used for deleted entries in the table.
@@ -367,27 +312,23 @@ hash_table_search(const struct hash_table *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(ht, key));
 
-   uint32_t size = ht->size;
-   uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
-                                               ht->rehash_magic);
-   uint32_t hash_address = start_hash_address;
+   const uint32_t mixed = ht_mix(hash);
+   const uint8_t *ctrl = hash_table_ctrl(ht);
+   struct ht_probe probe = ht_probe_start(mixed, ht->size);
 
    do {
-      struct hash_entry *entry = ht->table + hash_address;
+      const uint8_t *group = ctrl + probe.offset;
 
-      if (entry_is_free(entry)) {
-         return NULL;
-      } else if (entry_is_present(ht, entry) && entry->hash == hash) {
-         if (ht->key_equals_function(key, entry->key)) {
+      u_foreach_bit(i, ht_group_match(group, ht_ctrl_for_hash(mixed))) {
+         struct hash_entry *entry = ht->table + probe.offset + i;
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
             return entry;
-         }
       }
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_hash_address);
+      if (ht_group_match_empty(group))
+         return NULL;
+   } while (ht_probe_next(&probe));
 
    return NULL;
 }
@@ -417,29 +358,35 @@ static struct hash_entry *
 hash_table_insert(struct hash_table *ht, uint32_t hash,
                   const void *key, void *data);
 
-static void
-hash_table_insert_rehash(struct hash_table *ht, uint32_t hash,
-                         const void *key, void *data)
-{
-   uint32_t size = ht->size;
-   uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
-                                               ht->rehash_magic);
-   uint32_t hash_address = start_hash_address;
+/* Takes the first empty or deleted entry of the probe sequence of the hash,
+ * which must not be in the table, and returns it with only the hash set.
+ */
+static struct hash_entry *
+hash_table_add_entry(struct hash_table *ht, uint32_t hash)
+{
+   const uint32_t mixed = ht_mix(hash);
+   uint8_t *ctrl = hash_table_ctrl(ht);
+   struct ht_probe probe = ht_probe_start(mixed, ht->size);
+
    do {
-      struct hash_entry *entry = ht->table + hash_address;
+      const uint32_t available = ht_group_match_available(ctrl + probe.offset);
 
-      if (likely(entry->key == NULL)) {
-         entry->hash = hash;
-         entry->key = key;
-         entry->data = data;
-         return;
+      if (likely(available)) {
+         const uint32_t i = probe.offset + ffs(available) - 1;
+
+         if (ctrl[i] == HT_CTRL_DELETED)
+            ht->deleted_entries--;
+         ctrl[i] = ht_ctrl_for_hash(mixed);
+         ht->table[i].hash = hash;
+         ht->entries++;
+         return ht->table + i;
       }
+   } while (ht_probe_next(&probe));
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (true);
+   /* We could hit here if a required resize failed. An unchecked-malloc
+    * application could ignore this result.
+    */
+   return NULL;
 }
 
 static void
@@ -454,11 +401,12 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
       return;
    }
 
-   if (new_size_index >= ARRAY_SIZE(hash_sizes))
+   if (new_size_index > HT_MAX_SIZE_INDEX ||
+       ht_size(new_size_index) > SIZE_MAX / (sizeof(struct hash_entry) + 1))
       return;
 
-   table = rzalloc_array(ht->mem_ctx, struct hash_entry,
-                         hash_sizes[new_size_index].size);
+   table = rzalloc_size(ht->mem_ctx,
+                        hash_table_storage_size(ht_size(new_size_index)));
    if (table == NULL)
       return;
 
@@ -472,20 +420,19 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
    }
 
    ht->table = table;
-   ht->size_index = new_size_index;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   hash_table_set_size(ht, new_size_index);
+   memset(hash_table_ctrl(ht), HT_CTRL_EMPTY, ht->size);
    ht->entries = 0;
    ht->deleted_entries = 0;
 
    hash_table_foreach(&old_ht, entry) {
-      hash_table_insert_rehash(ht, entry->hash, entry->key, entry->data);
+      struct hash_entry *new_entry = hash_table_add_entry(ht, entry->hash);
+
+      new_entry->key = entry->key;
+      new_entry->data = entry->data;
    }
 
-   ht->entries = old_ht.entries;
+   assert(ht->entries == old_ht.entries);
 
    if (old_ht.table != old_ht._initial_storage)
       ralloc_free(old_ht.table);
@@ -494,8 +441,6 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
 static struct hash_entry *
 hash_table_get_entry(struct hash_table *ht, uint32_t hash, const void *key)
 {
-   struct hash_entry *available_entry = NULL;
-
    assert(!key_pointer_is_reserved(ht, key));
 
    if (ht->entries >= ht->max_entries) {
@@ -504,55 +449,48 @@ hash_table_get_entry(struct hash_table *ht, uint32_t hash, const void *key)
       _mesa_hash_table_rehash(ht, ht->size_index);
    }
 
-   uint32_t size = ht->size;
-   uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
-                                               ht->rehash_magic);
-   uint32_t hash_address = start_hash_address;
+   /* Implement replacement when another insert happens
+    * with a matching key.  This is a relatively common
+    * feature of hash tables, with the alternative
+    * generally being "insert the new value as well, and
+    * return it first when the key is searched for".
+    *
+    * Note that the hash table doesn't have a delete
+    * callback.  If freeing of old data pointers is
+    * required to avoid memory leaks, perform a search
+    * before inserting.
+    */
+   const uint32_t mixed = ht_mix(hash);
+   uint8_t *ctrl = hash_table_ctrl(ht);
+   struct ht_probe probe = ht_probe_start(mixed, ht->size);
+
    do {
-      struct hash_entry *entry = ht->table + hash_address;
+      const uint8_t *group = ctrl + probe.offset;
 
-      if (!entry_is_present(ht, entry)) {
-         /* Stash the first available entry we find */
-         if (available_entry == NULL)
-            available_entry = entry;
-         if (entry_is_free(entry))
-            break;
+      u_foreach_bit(i, ht_group_match(group, ht_ctrl_for_hash(mixed))) {
+         struct hash_entry *entry = ht->table + probe.offset + i;
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
+            return entry;
       }
 
-      /* Implement replacement when another insert happens
-       * with a matching key.  This is a relatively common
-       * feature of hash tables, with the alternative
-       * generally being "insert the new value as well, and
-       * return it first when the key is searched for".
-       *
-       * Note that the hash table doesn't have a delete
-       * callback.  If freeing of old data pointers is
-       * required to avoid memory leaks, perform a search
-       * before inserting.
-       */
-      if (!entry_is_deleted(ht, entry) &&
-          entry->hash == hash &&
-          ht->key_equals_function(key, entry->key))
-         return entry;
+      const uint32_t empty = ht_group_match_empty(group);
+      if (empty) {
+         /* Without deleted entries, the groups probed before this one are
+          * full, so its first empty entry is the first available one.
+          */
+         if (ht->deleted_entries)
+            break;
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_hash_address);
-
-   if (available_entry) {
-      if (entry_is_deleted(ht, available_entry))
-         ht->deleted_entries--;
-      available_entry->hash = hash;
-      ht->entries++;
-      return available_entry;
-   }
+         const uint32_t i = probe.offset + ffs(empty) - 1;
+         ctrl[i] = ht_ctrl_for_hash(mixed);
+         ht->table[i].hash = hash;
+         ht->entries++;
+         return ht->table + i;
+      }
+   } while (ht_probe_next(&probe));
 
-   /* We could hit here if a required resize failed. An unchecked-malloc
-    * application could ignore this result.
-    */
-   return NULL;
+   return hash_table_add_entry(ht, hash);
 }
 
 static struct hash_entry *
@@ -603,9 +541,21 @@ _mesa_hash_table_remove(struct hash_table *ht,
    if (!entry)
       return;
 
-   entry->key = ht->deleted_key;
+   uint8_t *ctrl = hash_table_ctrl(ht);
+   const uint32_t i = entry - ht->table;
+
+   /* No probe ever went past a group which still has an empty entry, so
+    * the entry can be made empty again instead of leaving a tombstone.
+    */
+   if (ht_group_match_empty(ctrl + (i & ~(HT_GROUP_SIZE - 1)))) {
+      ctrl[i] = HT_CTRL_EMPTY;
+      entry->key = NULL;
+   } else {
+      ctrl[i] = HT_CTRL_DELETED;
+      entry->key = ht->deleted_key;
+      ht->deleted_entries++;
+   }
    ht->entries--;
-   ht->deleted_entries++;
 }
 
 /**
@@ -617,6 +567,23 @@ void _mesa_hash_table_remove_key(struct hash_table *ht,
    _mesa_hash_table_remove(ht, _mesa_hash_table_search(ht, key));
 }
 
+/* Returns the first present entry at index start or after it. */
+static struct hash_entry *
+hash_table_next_present(const struct hash_table *ht, uint32_t start)
+{
+   const uint8_t *ctrl = hash_table_ctrl(ht);
+
+   /* Looking at one control byte at a time is cheaper than matching whole
+    * groups here, as each step only depends on the previous one through i.
+    */
+   for (uint32_t i = start; i < ht->size; i++) {
+      if (ctrl[i] < HT_CTRL_EMPTY)
+         return ht->table + i;
+   }
+
+   return NULL;
+}
+
 /**
  * This function is an iterator over the hash_table when no deleted entries are present.
  *
@@ -628,38 +595,22 @@ _mesa_hash_table_next_entry_unsafe(const struct hash_table *ht, struct hash_entr
    assert(!ht->deleted_entries);
    if (!ht->entries)
       return NULL;
-   if (entry == NULL)
-      entry = ht->table;
-   else
-      entry = entry + 1;
-   if (entry != ht->table + ht->size)
-      return entry->key ? entry : _mesa_hash_table_next_entry_unsafe(ht, entry);
 
-   return NULL;
+   return hash_table_next_present(ht, entry ? entry - ht->table + 1 : 0);
 }
 
 /**
  * This function is an iterator over the hash table.
  *
  * Pass in NULL for the first entry, as in the start of a for loop.  Note that
- * an iteration over the table is O(table_size) not O(entries).
+ * an iteration over the table is O(table_size) not O(entries), but it only
+ * looks at the control bytes of empty entries.
  */
 struct hash_entry *
 _mesa_hash_table_next_entry(struct hash_table *ht,
                             struct hash_entry *entry)
 {
-   if (entry == NULL)
-      entry = ht->table;
-   else
-      entry = entry + 1;
-
-   for (; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(ht, entry)) {
-         return entry;
-      }
-   }
-
-   return NULL;
+   return hash_table_next_present(ht, entry ? entry - ht->table + 1 : 0);
 }
 
 /**
@@ -680,24 +631,22 @@ _mesa_hash_table_random_entry(struct hash_table *ht,
    if (ht->entries == 0)
       return NULL;
 
-   for (entry = ht->table + i; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(ht, entry) &&
-          (!predicate || predicate(entry))) {
+   for (entry = hash_table_next_present(ht, i); entry;
+        entry = hash_table_next_present(ht, entry - ht->table + 1)) {
+      if (!predicate || predicate(entry))
          return entry;
-      }
    }
 
-   for (entry = ht->table; entry != ht->table + i; entry++) {
-      if (entry_is_present(ht, entry) &&
-          (!predicate || predicate(entry))) {
+   for (entry = hash_table_next_present(ht, 0);
+        entry && entry < ht->table + i;
+        entry = hash_table_next_present(ht, entry - ht->table + 1)) {
+      if (!predicate || predicate(entry))
          return entry;
-      }
    }
 
    return NULL;
 }
 
-
 uint32_t
 _mesa_hash_data(const void *data, size_t size)
 {
@@ -840,8 +789,8 @@ _mesa_hash_table_reserve(struct hash_table *ht, unsigned size)
 {
    if (size < ht->max_entries)
       return true;
-   for (unsigned i = ht->size_index + 1; i < ARRAY_SIZE(hash_sizes); i++) {
-      if (hash_sizes[i].max_entries >= size) {
+   for (unsigned i = ht->size_index + 1; i <= HT_MAX_SIZE_INDEX; i++) {
+      if (ht_max_entries(i) >= size) {
          _mesa_hash_table_rehash(ht, i);
          break;
       }
@@ -33,6 +33,8 @@
 #include <stdbool.h>
 #include "macros.h"
 
+#include "hash_table_ctrl.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -50,9 +52,6 @@ struct hash_table {
    bool (*key_equals_function)(const void *a, const void *b);
    const void *deleted_key;
    uint32_t size;
-   uint32_t rehash;
-   uint64_t size_magic;
-   uint64_t rehash_magic;
    uint32_t max_entries;
    uint32_t size_index;
    uint32_t entries;
@@ -61,11 +60,13 @@ struct hash_table {
    /* "table" points to here at first. A bigger storage is allocated separately
     * when a bigger size is needed.
     */
-   struct hash_entry _initial_storage[19]; /* hash_sizes[0].size */
+   struct hash_entry _initial_storage[HT_GROUP_SIZE];
 
-   /* Don't insert any new fields here. All other fields must be before
+   /* The control bytes of _initial_storage, which always follow the entries.
+    * Don't insert any new fields here. All other fields must be before
     * _initial_storage.
     */
+   uint8_t _initial_ctrl[HT_GROUP_SIZE];
 };
 
 struct hash_table *
@@ -172,6 +173,20 @@ _mesa_hash_table_reserve(struct hash_table *ht, unsigned size);
    for (struct hash_entry *entry = _mesa_hash_table_next_entry(ht, NULL);  \
         entry != NULL;                                                     \
         entry = _mesa_hash_table_next_entry(ht, entry))
+
+/* Empties an entry of hash_table_foreach_remove.  The control byte, which
+ * follows the entries, is what marks the entry as empty.
+ */
+static inline void
+_mesa_hash_table_clear_entry(struct hash_table *ht, struct hash_entry *entry)
+{
+   ((uint8_t *)(ht->table + ht->size))[entry - ht->table] = HT_CTRL_EMPTY;
+   entry->hash = 0;
+   entry->key = NULL;
+   entry->data = NULL;
+   ht->entries--;
+}
+
 /**
  * This foreach function destroys the table as it iterates.
  * It is not safe to use when inserting or removing entries.
@@ -179,8 +194,8 @@ _mesa_hash_table_reserve(struct hash_table *ht, unsigned size);
 #define hash_table_foreach_remove(ht, entry)                                      \
    for (struct hash_entry *entry = _mesa_hash_table_next_entry_unsafe(ht, NULL);  \
         (ht)->entries;                                                     \
-        entry->hash = 0, entry->key = (void*)NULL, entry->data = NULL,      \
-        (ht)->entries--, entry = _mesa_hash_table_next_entry_unsafe(ht, entry))
+        _mesa_hash_table_clear_entry(ht, entry),                           \
+        entry = _mesa_hash_table_next_entry_unsafe(ht, entry))
 
 static inline void
 hash_table_call_foreach(struct hash_table *ht,
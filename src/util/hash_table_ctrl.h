@@ -0,0 +1,182 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Control bytes of the open addressing tables of hash_table.c and set.c.
+ *
+ * Next to its array of entries, a table has one control byte per entry,
+ * which is HT_CTRL_EMPTY, HT_CTRL_DELETED or, for a present entry, 7 bits of
+ * its hash.  The entries are split in groups of HT_GROUP_SIZE, and lookups
+ * compare a whole group of control bytes at once, with SSE2 or NEON where
+ * available, so they only ever look at the entries whose 7 bits match.
+ * Groups are probed quadratically starting from the other bits of the hash,
+ * and a probe stops at the first group with an empty entry.
+ *
+ * The control bytes directly follow the entries in memory, both in the
+ * initial storage embedded in the table and in later allocations.
+ * hash_table.h and set.h include this header for that layout and for the
+ * clearing done by their foreach_remove macros.
+ */
+
+#ifndef HASH_TABLE_CTRL_H
+#define HASH_TABLE_CTRL_H
+
+#include <stdint.h>
+
+#include "detect_arch.h"
+#include "detect_cc.h"
+#include "macros.h"
+
+#if DETECT_ARCH_SSE
+#include <emmintrin.h>
+#elif DETECT_ARCH_AARCH64 && DETECT_CC_GCC
+#include <arm_neon.h>
+#endif
+
+#define HT_GROUP_SIZE 16
+
+#define HT_CTRL_EMPTY   0x80
+#define HT_CTRL_DELETED 0xfe
+
+/* The tables are never smaller than a group and grow by powers of two. */
+#define HT_MIN_SIZE_LOG2 4
+#define HT_MAX_SIZE_INDEX (31 - HT_MIN_SIZE_LOG2)
+
+static inline uint32_t
+ht_size(unsigned size_index)
+{
+   return 1u << (HT_MIN_SIZE_LOG2 + size_index);
+}
+
+/* Entries are at most 7/8 present or deleted before a rehash. */
+static inline uint32_t
+ht_max_entries(unsigned size_index)
+{
+   return ht_size(size_index) - ht_size(size_index) / 8;
+}
+
+/**
+ * The hashes given by users are often weak in their high or low bits, so
+ * they are mixed before being split into the group index and the control
+ * byte.  This is the finalizer of MurmurHash3.
+ */
+static inline uint32_t
+ht_mix(uint32_t hash)
+{
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6b;
+   hash ^= hash >> 13;
+   hash *= 0xc2b2ae35;
+   hash ^= hash >> 16;
+   return hash;
+}
+
+static inline uint8_t
+ht_ctrl_for_hash(uint32_t mixed)
+{
+   return mixed & 0x7f;
+}
+
+struct ht_probe {
+   uint32_t group_mask;
+   uint32_t offset;  /* index of the first entry of the current group */
+   uint32_t index;   /* number of groups probed before the current one */
+};
+
+static inline struct ht_probe
+ht_probe_start(uint32_t mixed, uint32_t size)
+{
+   struct ht_probe probe;
+
+   /* No compound literal, this header is included by C++ too. */
+   probe.group_mask = size / HT_GROUP_SIZE - 1;
+   probe.offset = ((mixed >> 7) & probe.group_mask) * HT_GROUP_SIZE;
+   probe.index = 0;
+   return probe;
+}
+
+/* Moves to the next group.  Returns false once all groups were probed. */
+static inline bool
+ht_probe_next(struct ht_probe *probe)
+{
+   /* Triangular numbers visit every group once for power of two counts. */
+   probe->index++;
+   probe->offset = (probe->offset / HT_GROUP_SIZE + probe->index) &
+                   probe->group_mask;
+   probe->offset *= HT_GROUP_SIZE;
+
+   return probe->index <= probe->group_mask;
+}
+
+#if DETECT_ARCH_SSE
+
+static inline uint32_t
+ht_group_match(const uint8_t *ctrl, uint8_t value)
+{
+   __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+}
+
+/* Entries which are empty or deleted */
+static inline uint32_t
+ht_group_match_available(const uint8_t *ctrl)
+{
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+
+#elif DETECT_ARCH_AARCH64 && DETECT_CC_GCC
+
+static inline uint32_t
+ht_neon_movemask(uint8x16_t mask)
+{
+   static const uint8_t bits[16] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+   };
+   uint8x16_t weighted = vandq_u8(mask, vld1q_u8(bits));
+
+   return vaddv_u8(vget_low_u8(weighted)) |
+          (vaddv_u8(vget_high_u8(weighted)) << 8);
+}
+
+static inline uint32_t
+ht_group_match(const uint8_t *ctrl, uint8_t value)
+{
+   return ht_neon_movemask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(value)));
+}
+
+static inline uint32_t
+ht_group_match_available(const uint8_t *ctrl)
+{
+   return ht_neon_movemask(vcltzq_s8(vld1q_s8((const int8_t *)ctrl)));
+}
+
+#else
+
+static inline uint32_t
+ht_group_match(const uint8_t *ctrl, uint8_t value)
+{
+   uint32_t mask = 0;
+   for (unsigned i = 0; i < HT_GROUP_SIZE; i++)
+      mask |= (uint32_t)(ctrl[i] == value) << i;
+   return mask;
+}
+
+static inline uint32_t
+ht_group_match_available(const uint8_t *ctrl)
+{
+   uint32_t mask = 0;
+   for (unsigned i = 0; i < HT_GROUP_SIZE; i++)
+      mask |= (uint32_t)(ctrl[i] >> 7) << i;
+   return mask;
+}
+
+#endif
+
+static inline uint32_t
+ht_group_match_empty(const uint8_t *ctrl)
+{
+   return ht_group_match(ctrl, HT_CTRL_EMPTY);
+}
+
+#endif /* HASH_TABLE_CTRL_H */
@@ -76,6 +76,7 @@
 #include "blob.h"
 #include "ralloc.h"
 #include "util/bitset.h"
+#include "util/sparse_bitset.h"
 #include "u_math.h"
 #include "register_allocate.h"
 #include "register_allocate_internal.h"
@@ -501,6 +502,32 @@ ra_set_deserialize(void *mem_ctx, struct blob_reader *blob)
    return regs;
 }
 
+/* Up to this many nodes, the graph tracks which nodes interfere with a
+ * triangular bit matrix, which takes n * (n - 1) / 2 bits.  Bigger graphs
+ * only have the adjacency lists of the nodes, see ra_test_adjacency().
+ */
+#define RA_MAX_ADJACENCY_BITS_NODES 8192
+
+/* In graphs without the bit matrix, nodes with more neighbours than this
+ * also keep them in a sparse bitset, so finding duplicates doesn't scan
+ * their list.  Neighbours tend to have close indices, so the bitset only
+ * has a few blocks.
+ */
+#define RA_MIN_ADJACENCY_SET_SIZE 32
+
+static void
+ra_node_init_adjacency_set(struct ra_graph *g, unsigned n)
+{
+   struct ra_list *adj = &g->nodes[n].adjacency;
+   struct u_sparse_bitset *set = ralloc(g, struct u_sparse_bitset);
+
+   u_sparse_bitset_init(set, 0, set);
+   for (unsigned i = 0; i < adj->size; i++)
+      u_sparse_bitset_set(set, adj->elems[i]);
+
+   g->nodes_extra[n].adjacency_set = set;
+}
+
 static uint64_t
 ra_get_num_adjacency_bits(uint64_t n)
 {
@@ -517,23 +544,54 @@ ra_get_adjacency_bit_index(unsigned n1, unsigned n2)
 }
 
 static bool
-ra_test_adjacency_bit(struct ra_graph *g, unsigned n1, unsigned n2)
+ra_test_adjacency(struct ra_graph *g, unsigned n1, unsigned n2)
 {
-   uint64_t index = ra_get_adjacency_bit_index(n1, n2);
-   return BITSET_TEST(g->adjacency, index);
+   if (g->adjacency) {
+      uint64_t index = ra_get_adjacency_bit_index(n1, n2);
+      return BITSET_TEST(g->adjacency, index);
+   }
+
+   /* Without the bit matrix, look for n1 in the adjacency list of n2 or the
+    * other way around, whichever is shorter.  Most nodes only interfere
+    * with a few others, even in very large graphs.  Lists longer than
+    * RA_MIN_ADJACENCY_SET_SIZE have a set to search instead.
+    */
+   struct ra_list *adj1 = &g->nodes[n1].adjacency;
+   struct ra_list *adj2 = &g->nodes[n2].adjacency;
+   if (adj1->size > adj2->size) {
+      SWAP(adj1, adj2);
+      SWAP(n1, n2);
+   }
+
+   struct u_sparse_bitset *set = g->nodes_extra[n1].adjacency_set;
+   if (set)
+      return u_sparse_bitset_test(set, n2);
+
+   for (unsigned i = 0; i < adj1->size; i++) {
+      if (adj1->elems[i] == n2)
+         return true;
+   }
+
+   return false;
 }
 
 static void
 ra_set_adjacency_bit(struct ra_graph *g, unsigned n1, unsigned n2)
 {
-   unsigned index = ra_get_adjacency_bit_index(n1, n2);
+   if (!g->adjacency)
+      return;
+
+   uint64_t index = ra_get_adjacency_bit_index(n1, n2);
    BITSET_SET(g->adjacency, index);
 }
 
 static void
 ra_clear_adjacency_bit(struct ra_graph *g, unsigned n1, unsigned n2)
 {
-   unsigned index = ra_get_adjacency_bit_index(n1, n2);
+   if (!g->adjacency)
+      return;
+
+   uint64_t index = ra_get_adjacency_bit_index(n1, n2);
    BITSET_CLEAR(g->adjacency, index);
 }
 
@@ -552,6 +610,15 @@ ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
       adj->elems = reralloc(g, adj->elems, unsigned int, adj->cap);
    }
    adj->elems[adj->size++] = n2;
+
+   if (g->adjacency)
+      return;
+
+   struct u_sparse_bitset *set = g->nodes_extra[n1].adjacency_set;
+   if (set)
+      u_sparse_bitset_set(set, n2);
+   else if (adj->size > RA_MIN_ADJACENCY_SET_SIZE)
+      ra_node_init_adjacency_set(g, n1);
 }
 
 static void
@@ -572,6 +639,10 @@ ra_node_remove_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
          break;
       }
    }
+
+   struct u_sparse_bitset *set = g->nodes_extra[n1].adjacency_set;
+   if (set)
+      u_sparse_bitset_clear(set, n2);
 }
 
 static void
@@ -587,9 +658,23 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
    alloc = align(alloc, BITSET_WORDBITS);
    g->nodes = rerzalloc(g, g->nodes, struct ra_node, g->alloc, alloc);
    g->nodes_extra = rerzalloc(g, g->nodes_extra, struct ra_node_extra, g->alloc, alloc);
-   g->adjacency = rerzalloc(g, g->adjacency, BITSET_WORD,
-                            BITSET_WORDS(ra_get_num_adjacency_bits(g->alloc)),
-                            BITSET_WORDS(ra_get_num_adjacency_bits(alloc)));
+
+   /* The adjacency lists hold all the interferences, so the bit matrix can
+    * be dropped once the graph gets too big for it.
+    */
+   if (alloc <= RA_MAX_ADJACENCY_BITS_NODES) {
+      g->adjacency = rerzalloc(g, g->adjacency, BITSET_WORD,
+                               BITSET_WORDS(ra_get_num_adjacency_bits(g->alloc)),
+                               BITSET_WORDS(ra_get_num_adjacency_bits(alloc)));
+   } else if (g->adjacency) {
+      ralloc_free(g->adjacency);
+      g->adjacency = NULL;
+
+      for (unsigned i = 0; i < g->count; i++) {
+         if (g->nodes[i].adjacency.size > RA_MIN_ADJACENCY_SET_SIZE)
+            ra_node_init_adjacency_set(g, i);
+      }
+   }
 
    /* Initialize new nodes. */
    for (unsigned i = g->alloc; i < alloc; i++) {
@@ -676,7 +761,7 @@ ra_add_node_interference(struct ra_graph *g,
                          unsigned int n1, unsigned int n2)
 {
    assert(n1 < g->count && n2 < g->count);
-   if (n1 != n2 && !ra_test_adjacency_bit(g, n1, n2)) {
+   if (n1 != n2 && !ra_test_adjacency(g, n1, n2)) {
       ra_set_adjacency_bit(g, n1, n2);
       ra_add_node_adjacency(g, n1, n2);
       ra_add_node_adjacency(g, n2, n1);
@@ -692,6 +777,12 @@ ra_reset_node_interference(struct ra_graph *g, unsigned int n)
       ra_node_remove_adjacency(g, adj->elems[i], n);
 
    adj->size = 0;
+
+   struct u_sparse_bitset *set = g->nodes_extra[n].adjacency_set;
+   if (set) {
+      u_sparse_bitset_free(set);
+      u_sparse_bitset_init(set, 0, set);
+   }
 }
 
 static void
@@ -133,6 +133,11 @@ struct ra_node_extra {
     * capacity as the nodes array.
     */
    unsigned int forced_reg;
+
+   /* The nodes of the adjacency list as a sparse bitset, for nodes with
+    * many neighbours in graphs without the bit matrix.  NULL otherwise.
+    */
+   struct u_sparse_bitset *adjacency_set;
 };
 
 struct ra_graph {
@@ -145,6 +150,9 @@ struct ra_graph {
    /* Less used per-node data.  Keep it out of the tight loops. */
    struct ra_node_extra *nodes_extra;
 
+   /* Triangular bit matrix of interferences, or NULL if the graph is too big
+    * for it.
+    */
    BITSET_WORD *adjacency;
    unsigned int count; /**< count of nodes. */
 
@@ -40,95 +40,37 @@
 #include "macros.h"
 #include "ralloc.h"
 #include "set.h"
-#include "fast_urem_by_const.h"
-
-/*
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
- */
+#include "hash_table_ctrl.h"
+#include "util/bitscan.h"
 
 static const uint32_t deleted_key_value;
 static const void *deleted_key = &deleted_key_value;
 
-static const struct {
-   uint32_t max_entries, size, rehash;
-   uint64_t size_magic, rehash_magic;
-} hash_sizes[] = {
-#define ENTRY(max_entries, size, rehash) \
-   { max_entries, size, rehash, \
-      REMAINDER_MAGIC(size), REMAINDER_MAGIC(rehash) }
-
-   /* Starting with only 2 entries at initialization causes a lot of set
-    * reallocations and rehashing while growing the set.
-    *
-    * Below are results from counting reallocations when compiling
-    * my GLSL shader-db on radeonsi+ACO.
-    *
-    * 2 entries is the baseline.
-    * Starting with  4 entries reduces reallocations to 55%.
-    * Starting with  8 entries reduces reallocations to 37%.
-    * Starting with 16 entries reduces reallocations to 28%.
-    * Starting with 32 entries reduces reallocations to 23%.
-    * Starting with 64 entries reduces reallocations to 21%.
-    */
-#if 0 /* Start with 16 entries. */
-   ENTRY(2,            5,            3            ),
-   ENTRY(4,            7,            5            ),
-   ENTRY(8,            13,           11           ),
-#endif
-   ENTRY(16,           19,           17           ),
-   ENTRY(32,           43,           41           ),
-   ENTRY(64,           73,           71           ),
-   ENTRY(128,          151,          149          ),
-   ENTRY(256,          283,          281          ),
-   ENTRY(512,          571,          569          ),
-   ENTRY(1024,         1153,         1151         ),
-   ENTRY(2048,         2269,         2267         ),
-   ENTRY(4096,         4519,         4517         ),
-   ENTRY(8192,         9013,         9011         ),
-   ENTRY(16384,        18043,        18041        ),
-   ENTRY(32768,        36109,        36107        ),
-   ENTRY(65536,        72091,        72089        ),
-   ENTRY(131072,       144409,       144407       ),
-   ENTRY(262144,       288361,       288359       ),
-   ENTRY(524288,       576883,       576881       ),
-   ENTRY(1048576,      1153459,      1153457      ),
-   ENTRY(2097152,      2307163,      2307161      ),
-   ENTRY(4194304,      4613893,      4613891      ),
-   ENTRY(8388608,      9227641,      9227639      ),
-   ENTRY(16777216,     18455029,     18455027     ),
-   ENTRY(33554432,     36911011,     36911009     ),
-   ENTRY(67108864,     73819861,     73819859     ),
-   ENTRY(134217728,    147639589,    147639587    ),
-   ENTRY(268435456,    295279081,    295279079    ),
-   ENTRY(536870912,    590559793,    590559791    ),
-   ENTRY(1073741824,   1181116273,   1181116271   ),
-   ENTRY(2147483648ul, 2362232233ul, 2362232231ul )
-};
-
 ASSERTED static inline bool
 key_pointer_is_reserved(const void *key)
 {
    return key == NULL || key == deleted_key;
 }
 
-static int
-entry_is_free(struct set_entry *entry)
+static inline uint8_t *
+set_ctrl(const struct set *ht)
 {
-   return entry->key == NULL;
+   return (uint8_t *)(ht->table + ht->size);
 }
 
-static int
-entry_is_deleted(struct set_entry *entry)
+/* The entries followed by their control bytes */
+static inline size_t
+set_storage_size(uint32_t size)
 {
-   return entry->key == deleted_key;
+   return (size_t)size * (sizeof(struct set_entry) + 1);
 }
 
-static int
-entry_is_present(struct set_entry *entry)
+static void
+set_set_size(struct set *ht, unsigned size_index)
 {
-   return entry->key != NULL && entry->key != deleted_key;
+   ht->size_index = size_index;
+   ht->size = ht_size(size_index);
+   ht->max_entries = ht_max_entries(size_index);
 }
 
 void
@@ -137,18 +79,18 @@ _mesa_set_init(struct set *ht, void *mem_ctx,
                  bool (*key_equals_function)(const void *a,
                                              const void *b))
 {
+   STATIC_ASSERT(offsetof(struct set, _initial_ctrl) ==
+                 offsetof(struct set, _initial_storage) +
+                 sizeof(ht->_initial_storage));
+
    ht->mem_ctx = mem_ctx;
-   ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   set_set_size(ht, 0);
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
    assert(ht->size == ARRAY_SIZE(ht->_initial_storage));
    ht->table = ht->_initial_storage;
    memset(ht->table, 0, sizeof(ht->_initial_storage));
+   memset(ht->_initial_ctrl, HT_CTRL_EMPTY, sizeof(ht->_initial_ctrl));
    ht->entries = 0;
    ht->deleted_entries = 0;
 }
@@ -212,14 +154,15 @@ _mesa_set_copy(struct set *dst, struct set *src, void *dst_mem_ctx)
    dst->mem_ctx = dst_mem_ctx;
 
    if (src->table != src->_initial_storage) {
-      dst->table = ralloc_array(dst_mem_ctx, struct set_entry, dst->size);
+      dst->table = ralloc_size(dst_mem_ctx, set_storage_size(dst->size));
       if (dst->table == NULL)
          return false;
 
-      memcpy(dst->table, src->table, dst->size * sizeof(struct set_entry));
+      memcpy(dst->table, src->table, set_storage_size(dst->size));
    } else {
       dst->table = dst->_initial_storage;
-      memcpy(dst->table, src->_initial_storage, sizeof(src->_initial_storage));
+      memcpy(dst->table, src->_initial_storage,
+             sizeof(src->_initial_storage) + sizeof(src->_initial_ctrl));
    }
 
    return true;
@@ -284,7 +227,8 @@ _mesa_set_destroy(struct set *ht, void (*delete_function)(struct set_entry *entr
 static void
 set_clear_fast(struct set *ht)
 {
-   memset(ht->table, 0, sizeof(struct set_entry) * hash_sizes[ht->size_index].size);
+   memset(ht->table, 0, sizeof(struct set_entry) * ht->size);
+   memset(set_ctrl(ht), HT_CTRL_EMPTY, ht->size);
    ht->entries = ht->deleted_entries = 0;
 }
 
@@ -300,19 +244,12 @@ _mesa_set_clear(struct set *set, void (*delete_function)(struct set_entry *entry
    if (!set)
       return;
 
-   struct set_entry *entry;
-
    if (delete_function) {
-      for (entry = set->table; entry != set->table + set->size; entry++) {
-         if (entry_is_present(entry))
-            delete_function(entry);
+      set_foreach(set, entry)
+         delete_function(entry);
+   }
 
-         entry->key = NULL;
-      }
-      set->entries = 0;
-      set->deleted_entries = 0;
-   } else
-      set_clear_fast(set);
+   set_clear_fast(set);
 }
 
 /**
@@ -325,26 +262,23 @@ set_search(const struct set *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(key));
 
-   uint32_t size = ht->size;
-   uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
-                                           ht->rehash_magic) + 1;
-   uint32_t hash_address = start_address;
+   const uint32_t mixed = ht_mix(hash);
+   const uint8_t *ctrl = set_ctrl(ht);
+   struct ht_probe probe = ht_probe_start(mixed, ht->size);
+
    do {
-      struct set_entry *entry = ht->table + hash_address;
+      const uint8_t *group = ctrl + probe.offset;
 
-      if (entry_is_free(entry)) {
-         return NULL;
-      } else if (entry_is_present(entry) && entry->hash == hash) {
-         if (ht->key_equals_function(key, entry->key)) {
+      u_foreach_bit(i, ht_group_match(group, ht_ctrl_for_hash(mixed))) {
+         struct set_entry *entry = ht->table + probe.offset + i;
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
             return entry;
-         }
       }
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_address);
+      if (ht_group_match_empty(group))
+         return NULL;
+   } while (ht_probe_next(&probe));
 
    return NULL;
 }
@@ -365,26 +299,35 @@ _mesa_set_search_pre_hashed(const struct set *set, uint32_t hash,
    return set_search(set, hash, key);
 }
 
-static void
-set_add_rehash(struct set *ht, uint32_t hash, const void *key)
+/* Takes the first empty or deleted entry of the probe sequence of the hash,
+ * which must not be in the set, and returns it with only the hash set.
+ */
+static struct set_entry *
+set_add_entry(struct set *ht, uint32_t hash)
 {
-   uint32_t size = ht->size;
-   uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
-                                           ht->rehash_magic) + 1;
-   uint32_t hash_address = start_address;
+   const uint32_t mixed = ht_mix(hash);
+   uint8_t *ctrl = set_ctrl(ht);
+   struct ht_probe probe = ht_probe_start(mixed, ht->size);
+
    do {
-      struct set_entry *entry = ht->table + hash_address;
-      if (likely(entry->key == NULL)) {
-         entry->hash = hash;
-         entry->key = key;
-         return;
+      const uint32_t available = ht_group_match_available(ctrl + probe.offset);
+
+      if (likely(available)) {
+         const uint32_t i = probe.offset + ffs(available) - 1;
+
+         if (ctrl[i] == HT_CTRL_DELETED)
+            ht->deleted_entries--;
+         ctrl[i] = ht_ctrl_for_hash(mixed);
+         ht->table[i].hash = hash;
+         ht->entries++;
+         return ht->table + i;
       }
+   } while (ht_probe_next(&probe));
 
-      hash_address = hash_address + double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (true);
+   /* We could hit here if a required resize failed. An unchecked-malloc
+    * application could ignore this result.
+    */
+   return NULL;
 }
 
 static void
@@ -399,11 +342,11 @@ set_rehash(struct set *ht, unsigned new_size_index)
       return;
    }
 
-   if (new_size_index >= ARRAY_SIZE(hash_sizes))
+   if (new_size_index > HT_MAX_SIZE_INDEX ||
+       ht_size(new_size_index) > SIZE_MAX / (sizeof(struct set_entry) + 1))
       return;
 
-   table = rzalloc_array(ht->mem_ctx, struct set_entry,
-                         hash_sizes[new_size_index].size);
+   table = rzalloc_size(ht->mem_ctx, set_storage_size(ht_size(new_size_index)));
    if (table == NULL)
       return;
 
@@ -417,20 +360,16 @@ set_rehash(struct set *ht, unsigned new_size_index)
    }
 
    ht->table = table;
-   ht->size_index = new_size_index;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   set_set_size(ht, new_size_index);
+   memset(set_ctrl(ht), HT_CTRL_EMPTY, ht->size);
    ht->entries = 0;
    ht->deleted_entries = 0;
 
    set_foreach(&old_ht, entry) {
-      set_add_rehash(ht, entry->hash, entry->key);
+      set_add_entry(ht, entry->hash)->key = entry->key;
    }
 
-   ht->entries = old_ht.entries;
+   assert(ht->entries == old_ht.entries);
 
    if (old_ht.table != old_ht._initial_storage)
       ralloc_free(old_ht.table);
@@ -444,7 +383,7 @@ _mesa_set_resize(struct set *set, uint32_t entries)
       entries = set->entries;
 
    unsigned size_index = 0;
-   while (hash_sizes[size_index].max_entries < entries)
+   while (size_index < HT_MAX_SIZE_INDEX && ht_max_entries(size_index) < entries)
       size_index++;
 
    set_rehash(set, size_index);
@@ -460,8 +399,6 @@ _mesa_set_resize(struct set *set, uint32_t entries)
 static struct set_entry *
 set_search_or_add(struct set *ht, uint32_t hash, const void *key, bool *found)
 {
-   struct set_entry *available_entry = NULL;
-
    assert(!key_pointer_is_reserved(key));
 
    if (ht->entries >= ht->max_entries) {
@@ -470,51 +407,49 @@ set_search_or_add(struct set *ht, uint32_t hash, const void *key, bool *found)
       set_rehash(ht, ht->size_index);
    }
 
-   uint32_t size = ht->size;
-   uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
-                                           ht->rehash_magic) + 1;
-   uint32_t hash_address = start_address;
+   const uint32_t mixed = ht_mix(hash);
+   uint8_t *ctrl = set_ctrl(ht);
+   struct ht_probe probe = ht_probe_start(mixed, ht->size);
+   struct set_entry *entry = NULL;
+
+   if (found)
+      *found = false;
+
    do {
-      struct set_entry *entry = ht->table + hash_address;
+      const uint8_t *group = ctrl + probe.offset;
 
-      if (!entry_is_present(entry)) {
-         /* Stash the first available entry we find */
-         if (available_entry == NULL)
-            available_entry = entry;
-         if (entry_is_free(entry))
-            break;
-      }
+      u_foreach_bit(i, ht_group_match(group, ht_ctrl_for_hash(mixed))) {
+         entry = ht->table + probe.offset + i;
 
-      if (!entry_is_deleted(entry) &&
-          entry->hash == hash &&
-          ht->key_equals_function(key, entry->key)) {
-         if (found)
-            *found = true;
-         return entry;
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key)) {
+            if (found)
+               *found = true;
+            return entry;
+         }
       }
 
-      hash_address = hash_address + double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_address);
-
-   if (available_entry) {
-      /* There is no matching entry, create it. */
-      if (entry_is_deleted(available_entry))
-         ht->deleted_entries--;
-      available_entry->hash = hash;
-      available_entry->key = key;
-      ht->entries++;
-      if (found)
-         *found = false;
-      return available_entry;
-   }
+      const uint32_t empty = ht_group_match_empty(group);
+      if (empty) {
+         /* Without deleted entries, the groups probed before this one are
+          * full, so its first empty entry is the first available one.
+          */
+         if (ht->deleted_entries)
+            break;
 
-   /* We could hit here if a required resize failed. An unchecked-malloc
-    * application could ignore this result.
-    */
-   return NULL;
+         const uint32_t i = probe.offset + ffs(empty) - 1;
+         ctrl[i] = ht_ctrl_for_hash(mixed);
+         ht->table[i].hash = hash;
+         ht->table[i].key = key;
+         ht->entries++;
+         return ht->table + i;
+      }
+   } while (ht_probe_next(&probe));
+
+   /* There is no matching entry, create it. */
+   entry = set_add_entry(ht, hash);
+   if (entry)
+      entry->key = key;
+   return entry;
 }
 
 /**
@@ -614,9 +549,21 @@ _mesa_set_remove(struct set *ht, struct set_entry *entry)
    if (!entry)
       return;
 
-   entry->key = deleted_key;
+   uint8_t *ctrl = set_ctrl(ht);
+   const uint32_t i = entry - ht->table;
+
+   /* No probe ever went past a group which still has an empty entry, so
+    * the entry can be made empty again instead of leaving a tombstone.
+    */
+   if (ht_group_match_empty(ctrl + (i & ~(HT_GROUP_SIZE - 1)))) {
+      ctrl[i] = HT_CTRL_EMPTY;
+      entry->key = NULL;
+   } else {
+      ctrl[i] = HT_CTRL_DELETED;
+      entry->key = deleted_key;
+      ht->deleted_entries++;
+   }
    ht->entries--;
-   ht->deleted_entries++;
 }
 
 /**
@@ -628,6 +575,23 @@ _mesa_set_remove_key(struct set *set, const void *key)
    _mesa_set_remove(set, _mesa_set_search(set, key));
 }
 
+/* Returns the first present entry at index start or after it. */
+static struct set_entry *
+set_next_present(const struct set *ht, uint32_t start)
+{
+   const uint8_t *ctrl = set_ctrl(ht);
+
+   /* Looking at one control byte at a time is cheaper than matching whole
+    * groups here, as each step only depends on the previous one through i.
+    */
+   for (uint32_t i = start; i < ht->size; i++) {
+      if (ctrl[i] < HT_CTRL_EMPTY)
+         return ht->table + i;
+   }
+
+   return NULL;
+}
+
 /**
  * This function is an iterator over the set when no deleted entries are present.
  *
@@ -639,37 +603,21 @@ _mesa_set_next_entry_unsafe(const struct set *ht, struct set_entry *entry)
    assert(!ht->deleted_entries);
    if (!ht->entries)
       return NULL;
-   if (entry == NULL)
-      entry = ht->table;
-   else
-      entry = entry + 1;
-   if (entry != ht->table + ht->size)
-      return entry->key ? entry : _mesa_set_next_entry_unsafe(ht, entry);
 
-   return NULL;
+   return set_next_present(ht, entry ? entry - ht->table + 1 : 0);
 }
 
 /**
  * This function is an iterator over the hash table.
  *
  * Pass in NULL for the first entry, as in the start of a for loop.  Note that
- * an iteration over the table is O(table_size) not O(entries).
+ * an iteration over the table is O(table_size) not O(entries), but it only
+ * looks at the control bytes of empty entries.
  */
 struct set_entry *
 _mesa_set_next_entry(const struct set *ht, struct set_entry *entry)
 {
-   if (entry == NULL)
-      entry = ht->table;
-   else
-      entry = entry + 1;
-
-   for (; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(entry)) {
-         return entry;
-      }
-   }
-
-   return NULL;
+   return set_next_present(ht, entry ? entry - ht->table + 1 : 0);
 }
 
 /**
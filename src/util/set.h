@@ -30,6 +30,9 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "hash_table_ctrl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,9 +49,6 @@ struct set {
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    uint32_t size;
-   uint32_t rehash;
-   uint64_t size_magic;
-   uint64_t rehash_magic;
    uint32_t max_entries;
    uint32_t size_index;
    uint32_t entries;
@@ -57,11 +57,13 @@ struct set {
    /* "table" points to here at first. A bigger storage is allocated separately
     * when a bigger size is needed.
     */
-   struct set_entry _initial_storage[19]; /* hash_sizes[0].size */
+   struct set_entry _initial_storage[HT_GROUP_SIZE];
 
-   /* Don't insert any new fields here. All other fields must be before
+   /* The control bytes of _initial_storage, which always follow the entries.
+    * Don't insert any new fields here. All other fields must be before
     * _initial_storage.
     */
+   uint8_t _initial_ctrl[HT_GROUP_SIZE];
 };
 
 void
@@ -152,6 +154,18 @@ _mesa_set_intersects(struct set *a, struct set *b);
         entry != NULL;                                              \
         entry = _mesa_set_next_entry(set, entry))
 
+/* Empties an entry of set_foreach_remove.  The control byte, which follows
+ * the entries, is what marks the entry as empty.
+ */
+static inline void
+_mesa_set_clear_entry(struct set *set, struct set_entry *entry)
+{
+   ((uint8_t *)(set->table + set->size))[entry - set->table] = HT_CTRL_EMPTY;
+   entry->hash = 0;
+   entry->key = NULL;
+   set->entries--;
+}
+
 /**
  * This foreach function destroys the table as it iterates.
  * It is not safe to use when inserting or removing entries.
@@ -159,7 +173,7 @@ _mesa_set_intersects(struct set *a, struct set *b);
 #define set_foreach_remove(set, entry)                              \
    for (struct set_entry *entry = _mesa_set_next_entry_unsafe(set, NULL);  \
         (set)->entries;                                              \
-        entry->hash = 0, entry->key = (void*)NULL, (set)->entries--, entry = _mesa_set_next_entry_unsafe(set, entry))
+        _mesa_set_clear_entry(set, entry), entry = _mesa_set_next_entry_unsafe(set, entry))
 
 #ifdef __cplusplus
 } /* extern C */
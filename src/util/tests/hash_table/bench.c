@@ -0,0 +1,189 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Microbenchmark of the hash table and set with pointer keys.
+ *
+ * Usage: bench [number of keys] [rounds]
+ *
+ * The results are checked as well.  "meson test --benchmark" runs it with
+ * 1000000 keys and 10 rounds.
+ */
+
+#undef NDEBUG
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/set.h"
+
+static unsigned num_keys = 10000;
+static unsigned rounds = 2;
+
+static void
+report(const char *what, int64_t start_ns, unsigned ops)
+{
+   const int64_t ns = os_time_get_nano() - start_ns;
+   printf("%-28s %8.2f ns/op\n", what, (double)ns / ops);
+}
+
+static void
+bench_hash_table(const void **keys, const void **missing)
+{
+   struct hash_table *ht = _mesa_pointer_hash_table_create(NULL);
+   int64_t start;
+   unsigned found = 0;
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      _mesa_hash_table_clear(ht, NULL);
+      for (unsigned i = 0; i < num_keys; i++)
+         _mesa_hash_table_insert(ht, keys[i], (void *)keys[i]);
+   }
+   report("hash_table insert", start, rounds * num_keys);
+   assert(ht->entries == num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      for (unsigned i = 0; i < num_keys; i++)
+         found += _mesa_hash_table_search(ht, keys[i]) != NULL;
+   }
+   report("hash_table search hit", start, rounds * num_keys);
+   assert(found == rounds * num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      for (unsigned i = 0; i < num_keys; i++)
+         found += _mesa_hash_table_search(ht, missing[i]) != NULL;
+   }
+   report("hash_table search miss", start, rounds * num_keys);
+   assert(found == rounds * num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      unsigned count = 0;
+      hash_table_foreach(ht, entry)
+         count += entry->data == entry->key;
+      assert(count == num_keys);
+   }
+   report("hash_table iterate", start, rounds * num_keys);
+
+   /* Remove and add back every other key, as caches and worklists do. */
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      for (unsigned i = 0; i < num_keys; i += 2)
+         _mesa_hash_table_remove_key(ht, keys[i]);
+      for (unsigned i = 0; i < num_keys; i += 2)
+         _mesa_hash_table_insert(ht, keys[i], (void *)keys[i]);
+   }
+   report("hash_table remove+insert", start, rounds * num_keys);
+   assert(ht->entries == num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_keys; i++)
+      _mesa_hash_table_remove_key(ht, keys[i]);
+   report("hash_table remove", start, num_keys);
+   assert(ht->entries == 0);
+
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+static void
+bench_set(const void **keys, const void **missing)
+{
+   struct set *set = _mesa_pointer_set_create(NULL);
+   int64_t start;
+   unsigned found = 0;
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      _mesa_set_clear(set, NULL);
+      for (unsigned i = 0; i < num_keys; i++)
+         _mesa_set_add(set, keys[i]);
+   }
+   report("set add", start, rounds * num_keys);
+   assert(set->entries == num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      for (unsigned i = 0; i < num_keys; i++)
+         found += _mesa_set_search(set, keys[i]) != NULL;
+   }
+   report("set search hit", start, rounds * num_keys);
+   assert(found == rounds * num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      for (unsigned i = 0; i < num_keys; i++)
+         found += _mesa_set_search(set, missing[i]) != NULL;
+   }
+   report("set search miss", start, rounds * num_keys);
+   assert(found == rounds * num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      unsigned count = 0;
+      set_foreach(set, entry)
+         count++;
+      assert(count == num_keys);
+   }
+   report("set iterate", start, rounds * num_keys);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < rounds; r++) {
+      for (unsigned i = 0; i < num_keys; i += 2)
+         _mesa_set_remove_key(set, keys[i]);
+      for (unsigned i = 0; i < num_keys; i += 2)
+         _mesa_set_add(set, keys[i]);
+   }
+   report("set remove+add", start, rounds * num_keys);
+   assert(set->entries == num_keys);
+
+   start = os_time_get_nano();
+   set_foreach_remove(set, entry)
+      assert(entry->key);
+   report("set foreach_remove", start, num_keys);
+   assert(set->entries == 0 && set->deleted_entries == 0);
+
+   _mesa_set_destroy(set, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   if (argc > 1)
+      num_keys = atoi(argv[1]);
+   if (argc > 2)
+      rounds = atoi(argv[2]);
+
+   /* The keys are 16-byte aligned addresses in a buffer, like those of
+    * allocated objects, in a random order.  Half of them are never added
+    * and only used for lookups of missing keys.
+    */
+   char *pool = malloc((size_t)num_keys * 2 * 16);
+   const void **addrs = malloc((size_t)num_keys * 2 * sizeof(*addrs));
+   assert(pool && addrs);
+
+   srand(42);
+   for (unsigned i = 0; i < num_keys * 2; i++)
+      addrs[i] = pool + (size_t)i * 16;
+   for (unsigned i = num_keys * 2 - 1; i > 0; i--) {
+      unsigned j = rand() % (i + 1);
+      const void *tmp = addrs[i];
+      addrs[i] = addrs[j];
+      addrs[j] = tmp;
+   }
+
+   const void **keys = addrs;
+   const void **missing = addrs + num_keys;
+
+   bench_hash_table(keys, missing);
+   bench_set(keys, missing);
+
+   free(addrs);
+   free(pool);
+
+   return 0;
+}
@@ -27,6 +27,7 @@
 #include "register_allocate_internal.h"
 
 #include "util/blob.h"
+#include "util/os_time.h"
 
 class ra_test : public ::testing::Test {
 public:
@@ -279,3 +280,162 @@ TEST_F(ra_test, serialization_roundtrip)
    blob_finish(&blob);
 }
 
+
+/* Makes each node interfere with the next width - 1 nodes, like values with
+ * overlapping live ranges in straight-line code.  Every interference is added
+ * twice, once in each direction.
+ */
+static void
+add_interval_interference(struct ra_graph *g, unsigned start, unsigned end,
+                          unsigned width)
+{
+   for (unsigned i = start; i < end; i++) {
+      for (unsigned j = i + 1; j < MIN2(i + width, end); j++) {
+         ra_add_node_interference(g, i, j);
+         ra_add_node_interference(g, j, i);
+      }
+   }
+}
+
+TEST_F(ra_test, large_graph)
+{
+   const unsigned width = 4, count = 20000;
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, width, true);
+   struct ra_class *c = ra_alloc_reg_class(regs);
+   for (unsigned i = 0; i < width; i++)
+      ra_class_add_reg(c, i);
+   ra_set_finalize(regs, NULL);
+
+   /* Start small and grow past the size where the graph drops the bit
+    * matrix, with interferences added both before and after.
+    */
+   struct ra_graph *g = ra_alloc_interference_graph(regs, 1000);
+   ralloc_steal(mem_ctx, g);
+   for (unsigned i = 0; i < 1000; i++)
+      ra_set_node_class(g, i, c);
+   add_interval_interference(g, 0, 1000, width);
+
+   while (g->count < count)
+      ra_add_node(g, c);
+   ASSERT_EQ(g->adjacency, nullptr);
+   add_interval_interference(g, 0, count, width);
+
+   for (unsigned i = 0; i < count; i++) {
+      unsigned expected = MIN2(i, width - 1) + MIN2(count - 1 - i, width - 1);
+      ASSERT_EQ(g->nodes[i].adjacency.size, expected);
+   }
+
+   ra_reset_node_interference(g, 100);
+   ASSERT_EQ(g->nodes[100].adjacency.size, 0);
+   ASSERT_EQ(g->nodes[101].adjacency.size, 2 * (width - 1) - 1);
+   add_interval_interference(g, 100 - width + 1, 100 + width, width);
+   ASSERT_EQ(g->nodes[100].adjacency.size, 2 * (width - 1));
+
+   ASSERT_TRUE(ra_allocate(g));
+   for (unsigned i = 0; i + 1 < count; i++) {
+      for (unsigned j = i + 1; j < MIN2(i + width, count); j++)
+         ASSERT_NE(ra_get_node_reg(g, i), ra_get_node_reg(g, j));
+   }
+}
+
+/* Run with --gtest_also_run_disabled_tests to print how building and
+ * allocating a graph scales with its number of nodes.
+ */
+TEST_F(ra_test, DISABLED_graph_scaling)
+{
+   const unsigned width = 16;
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, 2 * width, true);
+   struct ra_class *c = ra_alloc_reg_class(regs);
+   for (unsigned i = 0; i < 2 * width; i++)
+      ra_class_add_reg(c, i);
+   ra_set_finalize(regs, NULL);
+
+   for (unsigned count = 1000; count <= 100000; count *= 10) {
+      int64_t start = os_time_get_nano();
+
+      struct ra_graph *g = ra_alloc_interference_graph(regs, count);
+      for (unsigned i = 0; i < count; i++)
+         ra_set_node_class(g, i, c);
+      add_interval_interference(g, 0, count, width);
+      int64_t built = os_time_get_nano();
+
+      ASSERT_TRUE(ra_allocate(g));
+      int64_t allocated = os_time_get_nano();
+
+      printf("%6u nodes: build %8.2f ms, allocate %8.2f ms\n", count,
+             (built - start) / 1000000.0, (allocated - built) / 1000000.0);
+      ralloc_free(g);
+   }
+}
+
+TEST_F(ra_test, large_graph_high_degree)
+{
+   const unsigned width = 64, count = 10000;
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, width, true);
+   struct ra_class *c = ra_alloc_reg_class(regs);
+   for (unsigned i = 0; i < width; i++)
+      ra_class_add_reg(c, i);
+   ra_set_finalize(regs, NULL);
+
+   /* Nodes with many neighbours before and after dropping the bit matrix,
+    * each interference added twice.
+    */
+   struct ra_graph *g = ra_alloc_interference_graph(regs, 1000);
+   ralloc_steal(mem_ctx, g);
+   for (unsigned i = 0; i < 1000; i++)
+      ra_set_node_class(g, i, c);
+   add_interval_interference(g, 0, 1000, width);
+
+   while (g->count < count)
+      ra_add_node(g, c);
+   ASSERT_EQ(g->adjacency, nullptr);
+   add_interval_interference(g, 0, count, width);
+
+   for (unsigned i = 0; i < count; i++) {
+      unsigned expected = MIN2(i, width - 1) + MIN2(count - 1 - i, width - 1);
+      ASSERT_EQ(g->nodes[i].adjacency.size, expected);
+   }
+
+   ra_reset_node_interference(g, 500);
+   ASSERT_EQ(g->nodes[500].adjacency.size, 0);
+   ASSERT_EQ(g->nodes[501].adjacency.size, 2 * (width - 1) - 1);
+   add_interval_interference(g, 500 - width + 1, 500 + width, width);
+   ASSERT_EQ(g->nodes[500].adjacency.size, 2 * (width - 1));
+   ASSERT_EQ(g->nodes[501].adjacency.size, 2 * (width - 1));
+
+   ASSERT_TRUE(ra_allocate(g));
+   for (unsigned i = 0; i + 1 < count; i++) {
+      for (unsigned j = i + 1; j < MIN2(i + width, count); j++)
+         ASSERT_NE(ra_get_node_reg(g, i), ra_get_node_reg(g, j));
+   }
+}
+
+/* Like graph_scaling, for graphs too big for the bit matrix whose nodes
+ * interfere with hundreds of others.
+ */
+TEST_F(ra_test, DISABLED_graph_scaling_high_degree)
+{
+   const unsigned width = 256;
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, 2 * width, true);
+   struct ra_class *c = ra_alloc_reg_class(regs);
+   for (unsigned i = 0; i < 2 * width; i++)
+      ra_class_add_reg(c, i);
+   ra_set_finalize(regs, NULL);
+
+   for (unsigned count = 10000; count <= 40000; count *= 2) {
+      int64_t start = os_time_get_nano();
+
+      struct ra_graph *g = ra_alloc_interference_graph(regs, count);
+      for (unsigned i = 0; i < count; i++)
+         ra_set_node_class(g, i, c);
+      add_interval_interference(g, 0, count, width);
+      int64_t built = os_time_get_nano();
+
+      ASSERT_TRUE(ra_allocate(g));
+      int64_t allocated = os_time_get_nano();
+
+      printf("%6u nodes: build %8.2f ms, allocate %8.2f ms\n", count,
+             (built - start) / 1000000.0, (allocated - built) / 1000000.0);
+      ralloc_free(g);
+   }
+}